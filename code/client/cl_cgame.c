@@ -700,6 +700,60 @@ intptr_t CL_CgameSystemCalls( intptr_t *args ) {
 	return 0;
 }
 
+/*
+====================
+CL_PrefetchMedia
+
+Lets the loader threads start reading the map, the configstring models
+and sounds and the player models while cgame registers everything else.
+Done here from the gamestate rather than by cgame, so any cgame gets it.
+====================
+*/
+static void CL_PrefetchMedia( void ) {
+	const char	*name;
+	char		model[MAX_QPATH], *slash;
+	int			i;
+
+	FS_PrefetchFile( cl.mapname );
+
+	for ( i = 1 ; i < MAX_MODELS ; i++ ) {
+		name = cl.gameState.stringData + cl.gameState.stringOffsets[ CS_MODELS + i ];
+		if ( !name[0] ) {
+			break;
+		}
+		if ( name[0] != '*' ) {
+			FS_PrefetchFile( name );
+		}
+	}
+
+	for ( i = 1 ; i < MAX_SOUNDS ; i++ ) {
+		name = cl.gameState.stringData + cl.gameState.stringOffsets[ CS_SOUNDS + i ];
+		if ( !name[0] ) {
+			break;
+		}
+		if ( name[0] != '*' ) {
+			FS_PrefetchFile( name );
+		}
+	}
+
+	for ( i = 0 ; i < MAX_CLIENTS ; i++ ) {
+		name = cl.gameState.stringData + cl.gameState.stringOffsets[ CS_PLAYERS + i ];
+		if ( !name[0] ) {
+			continue;
+		}
+		Q_strncpyz( model, Info_ValueForKey( name, "model" ), sizeof( model ) );
+		slash = strchr( model, '/' );
+		if ( slash ) {
+			*slash = 0;
+		}
+		if ( !model[0] ) {
+			continue;
+		}
+		FS_PrefetchFile( va( "models/players/%s/lower.md3", model ) );
+		FS_PrefetchFile( va( "models/players/%s/upper.md3", model ) );
+		FS_PrefetchFile( va( "models/players/%s/head.md3", model ) );
+	}
+}
 
 /*
 ====================
@@ -742,8 +796,13 @@ void CL_InitCGame( void ) {
 	// init for this gamestate
 	// use the lastExecutedServerCommand instead of the serverCommandSequence
 	// otherwise server commands sent just before a gamestate are dropped
+	FS_ResetLoadStats();
+	CL_PrefetchMedia();
 	VM_Call( cgvm, CG_INIT, clc.serverMessageSequence, clc.lastExecutedServerCommand, clc.clientNum );
 
+	// anything prefetched that cgame didn't load
+	FS_ClearPrefetch();
+
 	// reset any CVAR_CHEAT cvars registered by cgame
 	if ( !clc.demoplaying && !cl_connectedToCheatServer )
 		Cvar_SetCheatState();
@@ -755,6 +814,9 @@ void CL_InitCGame( void ) {
 	t2 = Sys_Milliseconds();
 
 	Com_Printf( "CL_InitCGame: %5.2f seconds\n", (t2-t1)/1000.0 );
+	if ( com_speeds->integer ) {
+		FS_PrintLoadStats();
+	}
 
 	// have the renderer touch all its images, so they are present
 	// on the card even if the driver does deferred loading
@@ -2820,6 +2820,41 @@ qboolean InFieldOfVision(vec3_t viewangles, float fov, vec3_t angles)
 	return qtrue;
 }
 
+/*
+==================
+BotVisibilityRequest
+
+sets up the trace from the eye to a point of the entity, returns the entity the trace should hit
+==================
+*/
+static int BotVisibilityRequest(traceRequest_t *request, int viewer, vec3_t eye, int ent, vec3_t point, int inwater) {
+	int hitent;
+
+	request->contentmask = CONTENTS_SOLID|CONTENTS_PLAYERCLIP;
+	request->passEntityNum = viewer;
+	hitent = ent;
+	VectorCopy(eye, request->start);
+	VectorCopy(point, request->end);
+	VectorClear(request->mins);
+	VectorClear(request->maxs);
+	request->capsule = qfalse;
+	//if the entity is in water, lava or slime
+	if (trap_AAS_PointContents(point) & (CONTENTS_LAVA|CONTENTS_SLIME|CONTENTS_WATER)) {
+		request->contentmask |= (CONTENTS_LAVA|CONTENTS_SLIME|CONTENTS_WATER);
+	}
+	//if eye is in water, lava or slime
+	if (inwater) {
+		if (!(request->contentmask & (CONTENTS_LAVA|CONTENTS_SLIME|CONTENTS_WATER))) {
+			request->passEntityNum = ent;
+			hitent = viewer;
+			VectorCopy(point, request->start);
+			VectorCopy(eye, request->end);
+		}
+		request->contentmask ^= (CONTENTS_LAVA|CONTENTS_SLIME|CONTENTS_WATER);
+	}
+	return hitent;
+}
+
 /*
 ==================
 BotEntityVisible
@@ -2830,9 +2865,11 @@ returns visibility in the range [0, 1] taking fog and water surfaces into accoun
 float BotEntityVisible(int viewer, vec3_t eye, vec3_t viewangles, float fov, int ent) {
 	int i, contents_mask, passent, hitent, infog, inwater, otherinfog, pc;
 	float squaredfogdist, waterfactor, vis, bestvis;
-	bsp_trace_t trace;
+	bsp_trace_t trace, traces[3];
+	traceRequest_t requests[3];
+	int hitents[3];
 	aas_entityinfo_t entinfo;
-	vec3_t dir, entangles, start, end, middle;
+	vec3_t dir, entangles, start, end, middle, points[3];
 
 	//calculate middle of bounding box
 	BotEntityInfo(ent, &entinfo);
@@ -2848,32 +2885,36 @@ float BotEntityVisible(int viewer, vec3_t eye, vec3_t viewangles, float fov, int
 	infog = (pc & CONTENTS_FOG);
 	inwater = (pc & (CONTENTS_LAVA|CONTENTS_SLIME|CONTENTS_WATER));
 	//
+	//check bottom and top of bounding box as well
+	VectorCopy(middle, points[0]);
+	VectorCopy(points[0], points[1]);
+	points[1][2] += entinfo.mins[2];
+	VectorCopy(points[1], points[2]);
+	points[2][2] += entinfo.maxs[2] - entinfo.mins[2];
+	//
 	bestvis = 0;
 	for (i = 0; i < 3; i++) {
 		//if the point is not in potential visible sight
 		//if (!AAS_inPVS(eye, middle)) continue;
 		//
-		contents_mask = CONTENTS_SOLID|CONTENTS_PLAYERCLIP;
-		passent = viewer;
-		hitent = ent;
-		VectorCopy(eye, start);
-		VectorCopy(middle, end);
-		//if the entity is in water, lava or slime
-		if (trap_AAS_PointContents(middle) & (CONTENTS_LAVA|CONTENTS_SLIME|CONTENTS_WATER)) {
-			contents_mask |= (CONTENTS_LAVA|CONTENTS_SLIME|CONTENTS_WATER);
-		}
-		//if eye is in water, lava or slime
-		if (inwater) {
-			if (!(contents_mask & (CONTENTS_LAVA|CONTENTS_SLIME|CONTENTS_WATER))) {
-				passent = ent;
-				hitent = viewer;
-				VectorCopy(middle, start);
-				VectorCopy(eye, end);
-			}
-			contents_mask ^= (CONTENTS_LAVA|CONTENTS_SLIME|CONTENTS_WATER);
-		}
-		//trace from start to end
-		BotAI_Trace(&trace, start, NULL, NULL, end, passent, contents_mask);
+		//the middle is often all that needs to be checked, the
+		//bottom and top are traced together when it isn't
+		if (i == 0) {
+			hitents[0] = BotVisibilityRequest(&requests[0], viewer, eye, ent, points[0], inwater);
+			BotAI_TraceBatch(&traces[0], &requests[0], 1);
+		}
+		else if (i == 1) {
+			hitents[1] = BotVisibilityRequest(&requests[1], viewer, eye, ent, points[1], inwater);
+			hitents[2] = BotVisibilityRequest(&requests[2], viewer, eye, ent, points[2], inwater);
+			BotAI_TraceBatch(&traces[1], &requests[1], 2);
+		}
+		trace = traces[i];
+		contents_mask = requests[i].contentmask;
+		passent = requests[i].passEntityNum;
+		hitent = hitents[i];
+		VectorCopy(requests[i].start, start);
+		VectorCopy(requests[i].end, end);
+		VectorCopy(points[i], middle);
 		//if water was hit
 		waterfactor = 1.0;
 		//note: trace.contents is always 0, see BotAI_Trace
@@ -2920,9 +2961,6 @@ float BotEntityVisible(int viewer, vec3_t eye, vec3_t viewangles, float fov, int
 			//if pretty much no fog
 			if (bestvis >= 0.95) return bestvis;
 		}
-		//check bottom and top of bounding box as well
-		if (i == 0) middle[2] += entinfo.mins[2];
-		else if (i == 1) middle[2] += entinfo.maxs[2] - entinfo.mins[2];
 	}
 	return bestvis;
 }
@@ -133,30 +133,58 @@ void QDECL BotAI_Print(int type, char *fmt, ...) {
 
 /*
 ==================
-BotAI_Trace
+BotAI_CopyTrace
 ==================
 */
-void BotAI_Trace(bsp_trace_t *bsptrace, vec3_t start, vec3_t mins, vec3_t maxs, vec3_t end, int passent, int contentmask) {
-	trace_t trace;
-
-	trap_Trace(&trace, start, mins, maxs, end, passent, contentmask);
+static void BotAI_CopyTrace(bsp_trace_t *bsptrace, trace_t *trace) {
 	//copy the trace information
-	bsptrace->allsolid = trace.allsolid;
-	bsptrace->startsolid = trace.startsolid;
-	bsptrace->fraction = trace.fraction;
-	VectorCopy(trace.endpos, bsptrace->endpos);
-	bsptrace->plane.dist = trace.plane.dist;
-	VectorCopy(trace.plane.normal, bsptrace->plane.normal);
-	bsptrace->plane.signbits = trace.plane.signbits;
-	bsptrace->plane.type = trace.plane.type;
+	bsptrace->allsolid = trace->allsolid;
+	bsptrace->startsolid = trace->startsolid;
+	bsptrace->fraction = trace->fraction;
+	VectorCopy(trace->endpos, bsptrace->endpos);
+	bsptrace->plane.dist = trace->plane.dist;
+	VectorCopy(trace->plane.normal, bsptrace->plane.normal);
+	bsptrace->plane.signbits = trace->plane.signbits;
+	bsptrace->plane.type = trace->plane.type;
 	bsptrace->surface.value = 0;
-	bsptrace->surface.flags = trace.surfaceFlags;
-	bsptrace->ent = trace.entityNum;
+	bsptrace->surface.flags = trace->surfaceFlags;
+	bsptrace->ent = trace->entityNum;
 	bsptrace->exp_dist = 0;
 	bsptrace->sidenum = 0;
 	bsptrace->contents = 0;
 }
 
+/*
+==================
+BotAI_Trace
+==================
+*/
+void BotAI_Trace(bsp_trace_t *bsptrace, vec3_t start, vec3_t mins, vec3_t maxs, vec3_t end, int passent, int contentmask) {
+	trace_t trace;
+
+	trap_Trace(&trace, start, mins, maxs, end, passent, contentmask);
+	BotAI_CopyTrace(bsptrace, &trace);
+}
+
+/*
+==================
+BotAI_TraceBatch
+==================
+*/
+void BotAI_TraceBatch(bsp_trace_t *bsptraces, const traceRequest_t *requests, int numrequests) {
+	trace_t traces[MAX_BOTAI_TRACES];
+	int i;
+
+	if (numrequests > MAX_BOTAI_TRACES) {
+		BotAI_Print(PRT_FATAL, "BotAI_TraceBatch: %d traces\n", numrequests);
+		return;
+	}
+	trap_TraceBatch(traces, requests, numrequests);
+	for (i = 0; i < numrequests; i++) {
+		BotAI_CopyTrace(&bsptraces[i], &traces[i]);
+	}
+}
+
 /*
 ==================
 BotAI_GetClientState
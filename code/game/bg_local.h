@@ -53,8 +53,8 @@ typedef struct {
 	int			previous_waterlevel;
 } pml_t;
 
-extern	pmove_t		*pm;
-extern	pml_t		pml;
+extern	Q_THREADLOCAL pmove_t	*pm;
+extern	Q_THREADLOCAL pml_t		pml;
 
 // movement parameters
 extern	float	pm_stopspeed;
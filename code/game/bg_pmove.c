@@ -27,8 +27,9 @@ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
 #include "bg_public.h"
 #include "bg_local.h"
 
-pmove_t		*pm;
-pml_t		pml;
+// the game may run several moves at once on engine worker threads
+Q_THREADLOCAL pmove_t	*pm;
+Q_THREADLOCAL pml_t		pml;
 
 // movement parameters
 float	pm_stopspeed = 100.0f;
@@ -731,29 +731,34 @@ void SendPendingPredictableEvents( playerState_t *ps ) {
 	}
 }
 
+// the state a client think carries across its Pmove
+typedef struct {
+	pmove_t		pm;
+	int			oldEventSequence;
+	int			msec;
+
+	// the client as its move left it, for G_RunClients
+	int			pmType;
+	int			spawnCount;
+} clientThink_t;
+
 /*
 ==============
-ClientThink
+ClientThink_setup
 
-This will be called once for each client frame, which will
-usually be a couple times for each server frame on fast clients.
-
-If "g_synchronousClients 1" is set, this will be called exactly
-once for each server frame, which makes for smooth demo recording.
+Everything that happens before the Pmove.
+Returns qfalse if the client doesn't move this time.
 ==============
 */
-void ClientThink_real( gentity_t *ent ) {
+static qboolean ClientThink_setup( gentity_t *ent, clientThink_t *think ) {
 	gclient_t	*client;
-	pmove_t		pm;
-	int			oldEventSequence;
-	int			msec;
 	usercmd_t	*ucmd;
 
 	client = ent->client;
 
 	// don't think if the client is not yet connected (and thus not yet spawned in)
 	if (client->pers.connected != CON_CONNECTED) {
-		return;
+		return qfalse;
 	}
 	// mark the time, so the connection sprite can be removed
 	ucmd = &ent->client->pers.cmd;
@@ -768,14 +773,14 @@ void ClientThink_real( gentity_t *ent ) {
 //		G_Printf("serverTime >>>>>\n" );
 	} 
 
-	msec = ucmd->serverTime - client->ps.commandTime;
+	think->msec = ucmd->serverTime - client->ps.commandTime;
 	// following others may result in bad times, but we still want
 	// to check for follow toggles
-	if ( msec < 1 && client->sess.spectatorState != SPECTATOR_FOLLOW ) {
-		return;
+	if ( think->msec < 1 && client->sess.spectatorState != SPECTATOR_FOLLOW ) {
+		return qfalse;
 	}
-	if ( msec > 200 ) {
-		msec = 200;
+	if ( think->msec > 200 ) {
+		think->msec = 200;
 	}
 
 	if ( pmove_msec.integer < 8 ) {
@@ -796,21 +801,21 @@ void ClientThink_real( gentity_t *ent ) {
 	//
 	if ( level.intermissiontime ) {
 		ClientIntermissionThink( client );
-		return;
+		return qfalse;
 	}
 
 	// spectators don't do much
 	if ( client->sess.sessionTeam == TEAM_SPECTATOR ) {
 		if ( client->sess.spectatorState == SPECTATOR_SCOREBOARD ) {
-			return;
+			return qfalse;
 		}
 		SpectatorThink( ent, ucmd );
-		return;
+		return qfalse;
 	}
 
 	// check for inactivity timer, but never drop the local client of a non-dedicated server
 	if ( !ClientInactivityTimer( client ) ) {
-		return;
+		return qfalse;
 	}
 
 	// clear the rewards if time
@@ -848,15 +853,15 @@ void ClientThink_real( gentity_t *ent ) {
 	}
 
 	// set up for pmove
-	oldEventSequence = client->ps.eventSequence;
+	think->oldEventSequence = client->ps.eventSequence;
 
-	memset (&pm, 0, sizeof(pm));
+	memset (&think->pm, 0, sizeof(think->pm));
 
 	// check for the hit-scan gauntlet, don't let the action
 	// go through as an attack unless it actually hits something
 	if ( client->ps.weapon == WP_GAUNTLET && !( ucmd->buttons & BUTTON_TALK ) &&
 		( ucmd->buttons & BUTTON_ATTACK ) && client->ps.weaponTime <= 0 ) {
-		pm.gauntletHit = CheckGauntletAttack( ent );
+		think->pm.gauntletHit = CheckGauntletAttack( ent );
 	}
 
 	if ( ent->flags & FL_FORCE_GESTURE ) {
@@ -891,47 +896,61 @@ void ClientThink_real( gentity_t *ent ) {
 	}
 #endif
 
-	pm.ps = &client->ps;
-	pm.cmd = *ucmd;
-	if ( pm.ps->pm_type == PM_DEAD ) {
-		pm.tracemask = MASK_PLAYERSOLID & ~CONTENTS_BODY;
+	think->pm.ps = &client->ps;
+	think->pm.cmd = *ucmd;
+	if ( think->pm.ps->pm_type == PM_DEAD ) {
+		think->pm.tracemask = MASK_PLAYERSOLID & ~CONTENTS_BODY;
 	}
 	else if ( ent->r.svFlags & SVF_BOT ) {
-		pm.tracemask = MASK_PLAYERSOLID | CONTENTS_BOTCLIP;
+		think->pm.tracemask = MASK_PLAYERSOLID | CONTENTS_BOTCLIP;
 	}
 	else {
-		pm.tracemask = MASK_PLAYERSOLID;
+		think->pm.tracemask = MASK_PLAYERSOLID;
 	}
-	pm.trace = trap_Trace;
-	pm.pointcontents = trap_PointContents;
-	pm.debugLevel = g_debugMove.integer;
-	pm.noFootsteps = ( g_dmflags.integer & DF_NO_FOOTSTEPS ) > 0;
+	think->pm.trace = trap_Trace;
+	think->pm.pointcontents = trap_PointContents;
+	think->pm.debugLevel = g_debugMove.integer;
+	think->pm.noFootsteps = ( g_dmflags.integer & DF_NO_FOOTSTEPS ) > 0;
 
-	pm.pmove_fixed = pmove_fixed.integer | client->pers.pmoveFixed;
-	pm.pmove_msec = pmove_msec.integer;
+	think->pm.pmove_fixed = pmove_fixed.integer | client->pers.pmoveFixed;
+	think->pm.pmove_msec = pmove_msec.integer;
 
 	VectorCopy( client->ps.origin, client->oldOrigin );
 
 #ifdef MISSIONPACK
-		if (level.intermissionQueued != 0 && g_singlePlayer.integer) {
-			if ( level.time - level.intermissionQueued >= 1000  ) {
-				pm.cmd.buttons = 0;
-				pm.cmd.forwardmove = 0;
-				pm.cmd.rightmove = 0;
-				pm.cmd.upmove = 0;
-				if ( level.time - level.intermissionQueued >= 2000 && level.time - level.intermissionQueued <= 2500 ) {
-					trap_SendConsoleCommand( EXEC_APPEND, "centerview\n");
-				}
-				ent->client->ps.pm_type = PM_SPINTERMISSION;
+	if (level.intermissionQueued != 0 && g_singlePlayer.integer) {
+		if ( level.time - level.intermissionQueued >= 1000  ) {
+			think->pm.cmd.buttons = 0;
+			think->pm.cmd.forwardmove = 0;
+			think->pm.cmd.rightmove = 0;
+			think->pm.cmd.upmove = 0;
+			if ( level.time - level.intermissionQueued >= 2000 && level.time - level.intermissionQueued <= 2500 ) {
+				trap_SendConsoleCommand( EXEC_APPEND, "centerview\n");
 			}
+			ent->client->ps.pm_type = PM_SPINTERMISSION;
 		}
-		Pmove (&pm);
-#else
-		Pmove (&pm);
+	}
 #endif
 
+	return qtrue;
+}
+
+/*
+==============
+ClientThink_finish
+
+Everything that happens after the Pmove
+==============
+*/
+static void ClientThink_finish( gentity_t *ent, clientThink_t *think ) {
+	gclient_t	*client;
+	usercmd_t	*ucmd;
+
+	client = ent->client;
+	ucmd = &client->pers.cmd;
+
 	// save results of pmove
-	if ( ent->client->ps.eventSequence != oldEventSequence ) {
+	if ( ent->client->ps.eventSequence != think->oldEventSequence ) {
 		ent->eventTime = level.time;
 	}
 	if (g_smoothClients.integer) {
@@ -949,14 +968,14 @@ void ClientThink_real( gentity_t *ent ) {
 	// use the snapped origin for linking so it matches client predicted versions
 	VectorCopy( ent->s.pos.trBase, ent->r.currentOrigin );
 
-	VectorCopy (pm.mins, ent->r.mins);
-	VectorCopy (pm.maxs, ent->r.maxs);
+	VectorCopy (think->pm.mins, ent->r.mins);
+	VectorCopy (think->pm.maxs, ent->r.maxs);
 
-	ent->waterlevel = pm.waterlevel;
-	ent->watertype = pm.watertype;
+	ent->waterlevel = think->pm.waterlevel;
+	ent->watertype = think->pm.watertype;
 
 	// execute client events
-	ClientEvents( ent, oldEventSequence );
+	ClientEvents( ent, think->oldEventSequence );
 
 	// link entity now, after any personal teleporters have been used
 	trap_LinkEntity (ent);
@@ -971,10 +990,10 @@ void ClientThink_real( gentity_t *ent ) {
 	BotTestAAS(ent->r.currentOrigin);
 
 	// touch other objects
-	ClientImpacts( ent, &pm );
+	ClientImpacts( ent, &think->pm );
 
 	// save results of triggers and client events
-	if (ent->client->ps.eventSequence != oldEventSequence) {
+	if (ent->client->ps.eventSequence != think->oldEventSequence) {
 		ent->eventTime = level.time;
 	}
 
@@ -1003,7 +1022,28 @@ void ClientThink_real( gentity_t *ent ) {
 	}
 
 	// perform once-a-second actions
-	ClientTimerActions( ent, msec );
+	ClientTimerActions( ent, think->msec );
+}
+
+/*
+==============
+ClientThink_real
+
+This will be called once for each client frame, which will
+usually be a couple times for each server frame on fast clients.
+
+If "g_synchronousClients 1" is set, this will be called exactly
+once for each server frame, which makes for smooth demo recording.
+==============
+*/
+void ClientThink_real( gentity_t *ent ) {
+	clientThink_t	think;
+
+	if ( !ClientThink_setup( ent, &think ) ) {
+		return;
+	}
+	Pmove( &think.pm );
+	ClientThink_finish( ent, &think );
 }
 
 /*
@@ -1038,6 +1078,78 @@ void G_RunClient( gentity_t *ent ) {
 }
 
 
+/*
+==================
+G_ClientPmoveJob
+
+Only traces and writes the playerState and pmove_t of its own client
+==================
+*/
+static void G_ClientPmoveJob( void *data, int index ) {
+	Pmove( ((pmove_t **)data)[index] );
+}
+
+/*
+==================
+G_RunClients
+
+Does what G_RunClient would do for each of the clients, with the moves
+run in parallel when the engine can.  Every move is made against the world
+as it was before any of them, then the results are linked in client order.
+A client that an earlier one killed, respawned or dropped in the meantime
+keeps what that did to it, its move results are stale.
+==================
+*/
+void G_RunClients( gentity_t **ents, int count ) {
+	static clientThink_t	thinks[MAX_CLIENTS];
+	static qboolean	moving[MAX_CLIENTS];
+	pmove_t		*moves[MAX_CLIENTS];
+	gentity_t	*ent;
+	int			i, numMoves;
+
+	numMoves = 0;
+	for ( i = 0 ; i < count ; i++ ) {
+		ent = ents[i];
+		moving[i] = qfalse;
+		if ( !(ent->r.svFlags & SVF_BOT) && !g_synchronousClients.integer ) {
+			continue;
+		}
+		ent->client->pers.cmd.serverTime = level.time;
+		moving[i] = ClientThink_setup( ent, &thinks[i] );
+		if ( moving[i] ) {
+			moves[numMoves++] = &thinks[i].pm;
+		}
+	}
+
+	// debug output from the moves would interleave
+	if ( g_debugMove.integer || !trap_RunParallel( G_ClientPmoveJob, moves, numMoves ) ) {
+		for ( i = 0 ; i < numMoves ; i++ ) {
+			Pmove( moves[i] );
+		}
+	}
+
+	for ( i = 0 ; i < count ; i++ ) {
+		if ( moving[i] ) {
+			thinks[i].pmType = thinks[i].pm.ps->pm_type;
+			thinks[i].spawnCount = thinks[i].pm.ps->persistant[PERS_SPAWN_COUNT];
+		}
+	}
+
+	for ( i = 0 ; i < count ; i++ ) {
+		ent = ents[i];
+		if ( !moving[i] ) {
+			continue;
+		}
+		if ( ent->client->pers.connected != CON_CONNECTED
+			|| ent->client->ps.pm_type != thinks[i].pmType
+			|| ent->client->ps.persistant[PERS_SPAWN_COUNT] != thinks[i].spawnCount ) {
+			continue;
+		}
+		ClientThink_finish( ent, &thinks[i] );
+	}
+}
+
+
 /*
 ==================
 SpectatorClientEndFrame
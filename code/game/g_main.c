@@ -77,6 +77,7 @@ vmCvar_t	g_teamForceBalance;
 vmCvar_t	g_banIPs;
 vmCvar_t	g_filterBan;
 vmCvar_t	g_smoothClients;
+vmCvar_t	g_parallelPmove;
 vmCvar_t	pmove_fixed;
 vmCvar_t	pmove_msec;
 vmCvar_t	g_rankings;
@@ -173,6 +174,7 @@ static cvarTable_t		gameCvarTable[] = {
 	{ &g_proxMineTimeout, "g_proxMineTimeout", "20000", 0, 0, qfalse },
 #endif
 	{ &g_smoothClients, "g_smoothClients", "1", 0, 0, qfalse},
+	{ &g_parallelPmove, "g_parallelPmove", "0", CVAR_ARCHIVE, 0, qfalse},
 	{ &pmove_fixed, "pmove_fixed", "0", CVAR_SYSTEMINFO, 0, qfalse},
 	{ &pmove_msec, "pmove_msec", "8", CVAR_SYSTEMINFO, 0, qfalse},
 
@@ -412,6 +414,10 @@ void G_InitGame( int levelTime, int randomSeed, int restart ) {
 
 	srand( randomSeed );
 
+#ifndef Q3_VM
+	trap_InitFastTraps();
+#endif
+
 	G_RegisterCvars();
 
 	G_ProcessIPBans();
@@ -1757,6 +1763,8 @@ Advances the non-player objects in the world
 void G_RunFrame( int levelTime ) {
 	int			i;
 	gentity_t	*ent;
+	gentity_t	*clients[MAX_CLIENTS];
+	int			numClients;
 
 	// if we are waiting for the level to restart, do nothing
 	if ( level.restarted ) {
@@ -1773,8 +1781,16 @@ void G_RunFrame( int levelTime ) {
 	//
 	// go through all allocated objects
 	//
+	numClients = 0;
 	ent = &g_entities[0];
 	for (i=0 ; i<level.num_entities ; i++, ent++) {
+		// with g_parallelPmove the clients are run together,
+		// still before any of the other entities
+		if ( i == MAX_CLIENTS && numClients ) {
+			G_RunClients( clients, numClients );
+			numClients = 0;
+		}
+
 		if ( !ent->inuse ) {
 			continue;
 		}
@@ -1826,12 +1842,19 @@ void G_RunFrame( int levelTime ) {
 		}
 
 		if ( i < MAX_CLIENTS ) {
-			G_RunClient( ent );
+			if ( g_parallelPmove.integer ) {
+				clients[numClients++] = ent;
+			} else {
+				G_RunClient( ent );
+			}
 			continue;
 		}
 
 		G_RunThink( ent );
 	}
+	if ( numClients ) {
+		G_RunClients( clients, numClients );
+	}
 
 	// perform final fixups on the players
 	ent = &g_entities[0];
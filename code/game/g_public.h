@@ -98,6 +98,32 @@ typedef struct {
 } sharedEntity_t;
 
 
+// one trace of a G_TRACE_BATCH, mins and maxs are relative
+#define	MAX_TRACE_REQUESTS	1024	// per G_TRACE_BATCH call
+
+typedef struct {
+	vec3_t		start, end;
+	vec3_t		mins, maxs;
+	int			passEntityNum;
+	int			contentmask;
+	qboolean	capsule;
+} traceRequest_t;
+
+
+// direct entry points for the hottest traps, handed to a native module
+// by G_FAST_TRAPS so those calls skip the variadic syscall marshalling
+// and the G_* switch
+typedef struct {
+	void		(*trace)( trace_t *results, const vec3_t start, vec3_t mins, vec3_t maxs, const vec3_t end, int passEntityNum, int contentmask, int capsule );
+	int			(*pointContents)( const vec3_t point, int passEntityNum );
+	void		(*linkEntity)( sharedEntity_t *ent );
+	void		(*unlinkEntity)( sharedEntity_t *ent );
+	int			(*entitiesInBox)( const vec3_t mins, const vec3_t maxs, int *list, int maxcount );
+	void		(*getUsercmd)( int clientNum, usercmd_t *cmd );
+	int			(*botGetSnapshotEntity)( int clientNum, int sequence );
+} gameFastTraps_t;
+
+
 
 //===============================================================
 
@@ -230,6 +256,20 @@ typedef enum {
 	// 1.32
 	G_FS_SEEK,
 
+	G_TRACE_BATCH,	// ( trace_t *results, const traceRequest_t *requests, int numRequests );
+	// independent traces in one call, each with the result G_TRACE or
+	// G_TRACECAPSULE would give it
+
+	G_RUN_PARALLEL,	// ( void (*job)( void *data, int index ), void *data, int count );
+	// runs job for every index in [0, count) on the engine worker threads and
+	// returns qtrue, or returns qfalse without running anything when the
+	// module is not a native library.  Jobs may only trace, read entities
+	// and write their own data.
+
+	G_FAST_TRAPS,	// ( int size );
+	// returns a const gameFastTraps_t * when size matches the engine's
+	// table and the module is a native library, otherwise NULL
+
 	BOTLIB_SETUP = 200,				// ( void );
 	BOTLIB_SHUTDOWN,				// ( void );
 	BOTLIB_LIBVAR_SET,
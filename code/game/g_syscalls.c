@@ -31,10 +31,17 @@ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
 static intptr_t (QDECL *syscall)( intptr_t arg, ... ) = (intptr_t (QDECL *)( intptr_t, ...))-1;
 
 
+static const gameFastTraps_t *fastTraps;
+
 Q_EXPORT void dllEntry( intptr_t (QDECL *syscallptr)( intptr_t arg,... ) ) {
 	syscall = syscallptr;
 }
 
+// the hottest traps call straight into the engine once this has found the table
+void trap_InitFastTraps( void ) {
+	fastTraps = (const gameFastTraps_t *)syscall( G_FAST_TRAPS, sizeof( gameFastTraps_t ) );
+}
+
 int PASSFLOAT( float x ) {
 	floatint_t fi;
 	fi.f = x;
@@ -150,14 +157,33 @@ void trap_SetBrushModel( gentity_t *ent, const char *name ) {
 }
 
 void trap_Trace( trace_t *results, const vec3_t start, const vec3_t mins, const vec3_t maxs, const vec3_t end, int passEntityNum, int contentmask ) {
+	if ( fastTraps ) {
+		fastTraps->trace( results, start, (float *)mins, (float *)maxs, end, passEntityNum, contentmask, qfalse );
+		return;
+	}
 	syscall( G_TRACE, results, start, mins, maxs, end, passEntityNum, contentmask );
 }
 
 void trap_TraceCapsule( trace_t *results, const vec3_t start, const vec3_t mins, const vec3_t maxs, const vec3_t end, int passEntityNum, int contentmask ) {
+	if ( fastTraps ) {
+		fastTraps->trace( results, start, (float *)mins, (float *)maxs, end, passEntityNum, contentmask, qtrue );
+		return;
+	}
 	syscall( G_TRACECAPSULE, results, start, mins, maxs, end, passEntityNum, contentmask );
 }
 
+void trap_TraceBatch( trace_t *results, const traceRequest_t *requests, int numRequests ) {
+	syscall( G_TRACE_BATCH, results, requests, numRequests );
+}
+
+qboolean trap_RunParallel( void (*job)( void *data, int index ), void *data, int count ) {
+	return syscall( G_RUN_PARALLEL, job, data, count );
+}
+
 int trap_PointContents( const vec3_t point, int passEntityNum ) {
+	if ( fastTraps ) {
+		return fastTraps->pointContents( point, passEntityNum );
+	}
 	return syscall( G_POINT_CONTENTS, point, passEntityNum );
 }
 
@@ -179,14 +205,25 @@ qboolean trap_AreasConnected( int area1, int area2 ) {
 }
 
 void trap_LinkEntity( gentity_t *ent ) {
+	if ( fastTraps ) {
+		fastTraps->linkEntity( (sharedEntity_t *)ent );
+		return;
+	}
 	syscall( G_LINKENTITY, ent );
 }
 
 void trap_UnlinkEntity( gentity_t *ent ) {
+	if ( fastTraps ) {
+		fastTraps->unlinkEntity( (sharedEntity_t *)ent );
+		return;
+	}
 	syscall( G_UNLINKENTITY, ent );
 }
 
 int trap_EntitiesInBox( const vec3_t mins, const vec3_t maxs, int *list, int maxcount ) {
+	if ( fastTraps ) {
+		return fastTraps->entitiesInBox( mins, maxs, list, maxcount );
+	}
 	return syscall( G_ENTITIES_IN_BOX, mins, maxs, list, maxcount );
 }
 
@@ -207,6 +244,10 @@ void trap_BotFreeClient( int clientNum ) {
 }
 
 void trap_GetUsercmd( int clientNum, usercmd_t *cmd ) {
+	if ( fastTraps ) {
+		fastTraps->getUsercmd( clientNum, cmd );
+		return;
+	}
 	syscall( G_GET_USERCMD, clientNum, cmd );
 }
 
@@ -268,6 +309,9 @@ int trap_BotLibTest(int parm0, char *parm1, vec3_t parm2, vec3_t parm3) {
 }
 
 int trap_BotGetSnapshotEntity( int clientNum, int sequence ) {
+	if ( fastTraps ) {
+		return fastTraps->botGetSnapshotEntity( clientNum, sequence );
+	}
 	return syscall( BOTLIB_GET_SNAPSHOT_ENTITY, clientNum, sequence );
 }
 
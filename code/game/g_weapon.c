@@ -267,7 +267,7 @@ SHOTGUN
 // client predicts same spreads
 #define	DEFAULT_SHOTGUN_DAMAGE	10
 
-qboolean ShotgunPellet( vec3_t start, vec3_t end, gentity_t *ent ) {
+qboolean ShotgunPellet( vec3_t start, vec3_t end, gentity_t *ent, const trace_t *first ) {
 	trace_t		tr;
 	int			damage, i, passent;
 	gentity_t	*traceEnt;
@@ -280,7 +280,11 @@ qboolean ShotgunPellet( vec3_t start, vec3_t end, gentity_t *ent ) {
 	VectorCopy( start, tr_start );
 	VectorCopy( end, tr_end );
 	for (i = 0; i < 10; i++) {
-		trap_Trace (&tr, tr_start, NULL, NULL, tr_end, passent, MASK_SHOT);
+		if ( i == 0 && first ) {
+			tr = *first;
+		} else {
+			trap_Trace (&tr, tr_start, NULL, NULL, tr_end, passent, MASK_SHOT);
+		}
 		traceEnt = &g_entities[ tr.entityNum ];
 
 		// send bullet impact
@@ -327,9 +331,13 @@ qboolean ShotgunPellet( vec3_t start, vec3_t end, gentity_t *ent ) {
 void ShotgunPattern( vec3_t origin, vec3_t origin2, int seed, gentity_t *ent ) {
 	int			i;
 	float		r, u;
-	vec3_t		end;
 	vec3_t		forward, right, up;
 	qboolean	hitClient = qfalse;
+	traceRequest_t	pellets[DEFAULT_SHOTGUN_COUNT];
+	trace_t		traces[DEFAULT_SHOTGUN_COUNT];
+	int			linkcounts[DEFAULT_SHOTGUN_COUNT];
+	gentity_t	*traceEnt;
+	const trace_t	*first;
 
 	// derive the right and up vectors from the forward vector, because
 	// the client won't have any other information
@@ -341,10 +349,34 @@ void ShotgunPattern( vec3_t origin, vec3_t origin2, int seed, gentity_t *ent ) {
 	for ( i = 0 ; i < DEFAULT_SHOTGUN_COUNT ; i++ ) {
 		r = Q_crandom( &seed ) * DEFAULT_SHOTGUN_SPREAD * 16;
 		u = Q_crandom( &seed ) * DEFAULT_SHOTGUN_SPREAD * 16;
-		VectorMA( origin, 8192 * 16, forward, end);
-		VectorMA (end, r, right, end);
-		VectorMA (end, u, up, end);
-		if( ShotgunPellet( origin, end, ent ) && !hitClient ) {
+		VectorMA( origin, 8192 * 16, forward, pellets[i].end);
+		VectorMA (pellets[i].end, r, right, pellets[i].end);
+		VectorMA (pellets[i].end, u, up, pellets[i].end);
+		VectorCopy( origin, pellets[i].start );
+		VectorClear( pellets[i].mins );
+		VectorClear( pellets[i].maxs );
+		pellets[i].passEntityNum = ent->s.number;
+		pellets[i].contentmask = MASK_SHOT;
+		pellets[i].capsule = qfalse;
+	}
+
+	// the first trace of every pellet in one go
+	trap_TraceBatch( traces, pellets, DEFAULT_SHOTGUN_COUNT );
+	for ( i = 0 ; i < DEFAULT_SHOTGUN_COUNT ; i++ ) {
+		linkcounts[i] = g_entities[ traces[i].entityNum ].r.linkcount;
+	}
+
+	for ( i = 0 ; i < DEFAULT_SHOTGUN_COUNT ; i++ ) {
+		// an earlier pellet may have killed or gibbed what this one hit,
+		// and a relinked or unlinked entity needs a fresh trace
+		first = &traces[i];
+		if ( traces[i].entityNum < ENTITYNUM_MAX_NORMAL ) {
+			traceEnt = &g_entities[ traces[i].entityNum ];
+			if ( !traceEnt->r.linked || traceEnt->r.linkcount != linkcounts[i] ) {
+				first = NULL;
+			}
+		}
+		if( ShotgunPellet( origin, pellets[i].end, ent, first ) && !hitClient ) {
 			hitClient = qtrue;
 			ent->client->accuracy_hits++;
 		}
@@ -55,6 +55,10 @@ int		Sys_Milliseconds (void) {
 	return 0;
 }
 
+int64_t	Sys_Microseconds (void) {
+	return 0;
+}
+
 FILE	*Sys_FOpen(const char *ospath, const char *mode) {
 	return fopen( ospath, mode );
 }
@@ -62,6 +66,17 @@ FILE	*Sys_FOpen(const char *ospath, const char *mode) {
 void	Sys_Mkdir (char *path) {
 }
 
+void	*Sys_MapFile (const char *ospath, int *length) {
+	return NULL;
+}
+
+void	Sys_UnmapFile (void *base, int length) {
+}
+
+qboolean	Sys_FileStat (const char *ospath, int64_t *size, int64_t *mtime) {
+	return qfalse;
+}
+
 void	Sys_Init (void) {
 }
 
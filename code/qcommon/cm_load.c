@@ -42,11 +42,13 @@ void SetPlaneSignbits (cplane_t *out) {
 #endif //BSPC
 
 // to allow boxes to be treated as brush models, we allocate
-// some extra indexes along with those needed by the map
-#define	BOX_BRUSHES		1
-#define	BOX_SIDES		6
+// some extra indexes along with those needed by the map, one set
+// for the main thread and each worker that may trace in a job
+#define	BOX_HULLS		( 1 + MAX_WORKERS )
+#define	BOX_BRUSHES		( 1 * BOX_HULLS )
+#define	BOX_SIDES		( 6 * BOX_HULLS )
 #define	BOX_LEAFS		2
-#define	BOX_PLANES		12
+#define	BOX_PLANES		( 12 * BOX_HULLS )
 
 #define	LL(x) x=LittleLong(x)
 
@@ -62,11 +64,32 @@ byte		*cmod_base;
 cvar_t		*cm_noAreas;
 cvar_t		*cm_noCurves;
 cvar_t		*cm_playerCurveClip;
+cvar_t		*cm_clusterLists;
+cvar_t		*cm_patchCache;
 #endif
 
-cmodel_t	box_model;
-cplane_t	*box_planes;
-cbrush_t	*box_brush;
+typedef struct {
+	cmodel_t	model;
+	cplane_t	*planes;
+	cbrush_t	*brush;
+} boxHull_t;
+
+static boxHull_t	box_hulls[BOX_HULLS];
+
+/*
+==================
+CM_ThreadBoxHull
+
+Loader threads all have index -1 and only read files, they must never trace
+==================
+*/
+static boxHull_t *CM_ThreadBoxHull( void ) {
+	int		index;
+
+	index = Com_ThreadIndex();
+	assert( index >= 0 && index < BOX_HULLS );
+	return &box_hulls[index];
+}
 
 
 
@@ -224,6 +247,49 @@ void CM_BoundBrush( cbrush_t *b ) {
 }
 
 
+#ifdef CM_SSE_BRUSHES
+/*
+=================
+CMod_LoadBrushPlanes
+
+Copies the planes of every brush into groups of four, with a four float
+array for each normal component and the distance.  The last group is
+padded with copies of the last plane, which can only repeat its result.
+=================
+*/
+static void CMod_LoadBrushPlanes( void ) {
+	cbrush_t	*b;
+	cplane_t	*plane;
+	float		*out;
+	int			i, j, k, numPlanes, total;
+
+	total = 0;
+	for ( i = 0, b = cm.brushes ; i < cm.numBrushes ; i++, b++ ) {
+		total += ( b->numsides + 3 ) & ~3;
+	}
+
+	out = Hunk_Alloc( total * 4 * sizeof( *out ), h_high );
+
+	for ( i = 0, b = cm.brushes ; i < cm.numBrushes ; i++, b++ ) {
+		if ( !b->numsides ) {
+			continue;
+		}
+		numPlanes = ( b->numsides + 3 ) & ~3;
+
+		b->planes = out;
+		for ( j = 0 ; j < numPlanes ; j++ ) {
+			plane = b->sides[ j < b->numsides ? j : b->numsides - 1 ].plane;
+			k = ( j & ~3 ) * 4 + ( j & 3 );
+			out[k] = plane->normal[0];
+			out[k + 4] = plane->normal[1];
+			out[k + 8] = plane->normal[2];
+			out[k + 12] = plane->dist;
+		}
+		out += numPlanes * 4;
+	}
+}
+#endif
+
 /*
 =================
 CMod_LoadBrushes
@@ -259,6 +325,9 @@ void CMod_LoadBrushes( lump_t *l ) {
 		CM_BoundBrush( out );
 	}
 
+#ifdef CM_SSE_BRUSHES
+	CMod_LoadBrushPlanes();
+#endif
 }
 
 /*
@@ -472,24 +541,106 @@ void CMod_LoadVisibility( lump_t *l ) {
 	Com_Memcpy (cm.visibility, buf + VIS_HEADER, len - VIS_HEADER );
 }
 
+#ifndef BSPC
+/*
+=================
+CMod_ClusterRuns
+
+Writes the runs of visible clusters in one row of the PVS to runs,
+when given, and returns how many there are
+=================
+*/
+static int CMod_ClusterRuns( int row, int *runs ) {
+	const byte	*vis;
+	int			c, first, numRuns;
+
+	vis = cm.visibility + row * cm.clusterBytes;
+	numRuns = 0;
+
+	for ( c = 0 ; c < cm.numClusters ; ) {
+		if ( !vis[c >> 3] ) {
+			c = ( c + 8 ) & ~7;
+			continue;
+		}
+		if ( !( vis[c >> 3] & ( 1 << ( c & 7 ) ) ) ) {
+			c++;
+			continue;
+		}
+
+		first = c;
+		while ( c < cm.numClusters && ( vis[c >> 3] & ( 1 << ( c & 7 ) ) ) ) {
+			c++;
+		}
+
+		if ( runs ) {
+			runs[numRuns * 2] = first;
+			runs[numRuns * 2 + 1] = c - first;
+		}
+		numRuns++;
+	}
+
+	return numRuns;
+}
+
+static void CMod_CountClusterRunsJob( void *data, int row ) {
+	cm.clusterRunOfs[row + 1] = CMod_ClusterRuns( row, NULL );
+}
+
+static void CMod_FillClusterRunsJob( void *data, int row ) {
+	CMod_ClusterRuns( row, cm.clusterRuns + cm.clusterRunOfs[row] * 2 );
+}
+
+/*
+=================
+CMod_BuildClusterLists
+
+Turns every row of the PVS into runs of visible clusters, so callers can
+walk or range check what a cluster sees without scanning the bit vector.
+The rows are independent, so both the counting and the filling are
+spread over the worker threads.
+=================
+*/
+void CMod_BuildClusterLists( void ) {
+	int		i, numRows;
+
+	numRows = cm.vised ? cm.numClusters : 1;
+
+	cm.clusterRunOfs = Hunk_Alloc( ( numRows + 1 ) * sizeof( *cm.clusterRunOfs ), h_high );
+	Com_RunParallel( numRows, CMod_CountClusterRunsJob, NULL );
+	for ( i = 0 ; i < numRows ; i++ ) {
+		cm.clusterRunOfs[i + 1] += cm.clusterRunOfs[i];
+	}
+
+	cm.clusterRuns = Hunk_Alloc( cm.clusterRunOfs[numRows] * 2 * sizeof( *cm.clusterRuns ), h_high );
+	Com_RunParallel( numRows, CMod_FillClusterRunsJob, NULL );
+
+	Com_DPrintf( "%i clusters, %i visible cluster runs\n", cm.numClusters, cm.clusterRunOfs[numRows] );
+}
+#endif
+
 //==================================================================
 
 
 /*
 =================
 CMod_LoadPatches
+
+Generates the collision structure of every patch, on the worker threads
+when there are any, or reads it from the cache written by an earlier
+load when cm_patchCache is set.  cacheName is NULL to skip the cache.
 =================
 */
 #define	MAX_PATCH_VERTS		1024
-void CMod_LoadPatches( lump_t *surfs, lump_t *verts ) {
+void CMod_LoadPatches( lump_t *surfs, lump_t *verts, const char *cacheName, unsigned checksum ) {
 	drawVert_t	*dv, *dv_p;
 	dsurface_t	*in;
 	int			count;
 	int			i, j;
-	int			c;
+	int			c, numPoints;
 	cPatch_t	*patch;
-	vec3_t		points[MAX_PATCH_VERTS];
-	int			width, height;
+	vec3_t		*points, *p;
+	patchSource_t		*sources;
+	struct patchCollide_s	**collides;
 	int			shaderNum;
 
 	in = (void *)(cmod_base + surfs->fileofs);
@@ -502,38 +653,79 @@ void CMod_LoadPatches( lump_t *surfs, lump_t *verts ) {
 	if (verts->filelen % sizeof(*dv))
 		Com_Error (ERR_DROP, "MOD_LoadBmodel: funny lump size");
 
+	if ( !count ) {
+		return;
+	}
+
 	// scan through all the surfaces, but only load patches,
 	// not planar faces
-	for ( i = 0 ; i < count ; i++, in++ ) {
-		if ( LittleLong( in->surfaceType ) != MST_PATCH ) {
+	numPoints = 0;
+	for ( i = 0 ; i < count ; i++ ) {
+		if ( LittleLong( in[i].surfaceType ) != MST_PATCH ) {
 			continue;		// ignore other surfaces
 		}
 		// FIXME: check for non-colliding patches
 
-		cm.surfaces[ i ] = patch = Hunk_Alloc( sizeof( *patch ), h_high );
-
-		// load the full drawverts onto the stack
-		width = LittleLong( in->patchWidth );
-		height = LittleLong( in->patchHeight );
-		c = width * height;
-		if ( c > MAX_PATCH_VERTS ) {
+		c = LittleLong( in[i].patchWidth ) * LittleLong( in[i].patchHeight );
+		if ( c > MAX_PATCH_VERTS || c < 0 ) {
 			Com_Error( ERR_DROP, "ParseMesh: MAX_PATCH_VERTS" );
 		}
+		numPoints += c;
+	}
+
+	sources = Hunk_AllocateTempMemory( count * sizeof( *sources ) );
+	collides = Hunk_AllocateTempMemory( count * sizeof( *collides ) );
+	points = Hunk_AllocateTempMemory( numPoints * sizeof( *points ) + 1 );
+
+	// load the full drawverts of every patch
+	Com_Memset( sources, 0, count * sizeof( *sources ) );
+	p = points;
+	for ( i = 0 ; i < count ; i++ ) {
+		if ( LittleLong( in[i].surfaceType ) != MST_PATCH ) {
+			continue;
+		}
+
+		sources[i].width = LittleLong( in[i].patchWidth );
+		sources[i].height = LittleLong( in[i].patchHeight );
+		sources[i].points = (const vec3_t *)p;
+
+		c = sources[i].width * sources[i].height;
+		dv_p = dv + LittleLong( in[i].firstVert );
+		for ( j = 0 ; j < c ; j++, dv_p++, p++ ) {
+			(*p)[0] = LittleFloat( dv_p->xyz[0] );
+			(*p)[1] = LittleFloat( dv_p->xyz[1] );
+			(*p)[2] = LittleFloat( dv_p->xyz[2] );
+		}
+	}
+
+	// create the internal facet structures
+#ifndef BSPC
+	if ( !cacheName || !CM_LoadPatchCache( cacheName, checksum, count, sources, collides ) ) {
+		CM_GeneratePatchCollides( count, sources, collides );
+		if ( cacheName ) {
+			CM_WritePatchCache( cacheName, checksum, count, collides );
+		}
+	}
+#else
+	CM_GeneratePatchCollides( count, sources, collides );
+#endif
 
-		dv_p = dv + LittleLong( in->firstVert );
-		for ( j = 0 ; j < c ; j++, dv_p++ ) {
-			points[j][0] = LittleFloat( dv_p->xyz[0] );
-			points[j][1] = LittleFloat( dv_p->xyz[1] );
-			points[j][2] = LittleFloat( dv_p->xyz[2] );
+	for ( i = 0 ; i < count ; i++ ) {
+		if ( !collides[i] ) {
+			continue;
 		}
 
-		shaderNum = LittleLong( in->shaderNum );
+		cm.surfaces[ i ] = patch = Hunk_Alloc( sizeof( *patch ), h_high );
+
+		shaderNum = LittleLong( in[i].shaderNum );
 		patch->contents = cm.shaders[shaderNum].contentFlags;
 		patch->surfaceFlags = cm.shaders[shaderNum].surfaceFlags;
-
-		// create the internal facet structure
-		patch->pc = CM_GeneratePatchCollide( width, height, points );
+		patch->pc = collides[i];
 	}
+
+	Hunk_FreeTempMemory( points );
+	Hunk_FreeTempMemory( collides );
+	Hunk_FreeTempMemory( sources );
 }
 
 //==================================================================
@@ -570,11 +762,13 @@ void CM_LoadMap( const char *name, qboolean clientload, int *checksum ) {
 	union {
 		int				*i;
 		void			*v;
+		const void		*cv;
 	} buf;
 	int				i;
 	dheader_t		header;
 	int				length;
 	static unsigned	last_checksum;
+	char			cacheName[MAX_QPATH];
 
 	if ( !name || !name[0] ) {
 		Com_Error( ERR_DROP, "CM_LoadMap: NULL name" );
@@ -584,6 +778,8 @@ void CM_LoadMap( const char *name, qboolean clientload, int *checksum ) {
 	cm_noAreas = Cvar_Get ("cm_noAreas", "0", CVAR_CHEAT);
 	cm_noCurves = Cvar_Get ("cm_noCurves", "0", CVAR_CHEAT);
 	cm_playerCurveClip = Cvar_Get ("cm_playerCurveClip", "1", CVAR_ARCHIVE|CVAR_CHEAT );
+	cm_clusterLists = Cvar_Get ("cm_clusterLists", "0", CVAR_ARCHIVE );
+	cm_patchCache = Cvar_Get ("cm_patchCache", "0", CVAR_ARCHIVE );
 #endif
 	Com_DPrintf( "CM_LoadMap( %s, %i )\n", name, clientload );
 
@@ -609,7 +805,8 @@ void CM_LoadMap( const char *name, qboolean clientload, int *checksum ) {
 	// load the file
 	//
 #ifndef BSPC
-	length = FS_ReadFile( name, &buf.v );
+	// only read, so a stored bsp needn't be copied out of its pak
+	length = FS_ReadFileView( name, &buf.cv );
 #else
 	length = LoadQuakeFile((quakefile_t *) name, &buf.v);
 #endif
@@ -645,7 +842,15 @@ void CM_LoadMap( const char *name, qboolean clientload, int *checksum ) {
 	CMod_LoadNodes (&header.lumps[LUMP_NODES]);
 	CMod_LoadEntityString (&header.lumps[LUMP_ENTITIES]);
 	CMod_LoadVisibility( &header.lumps[LUMP_VISIBILITY] );
-	CMod_LoadPatches( &header.lumps[LUMP_SURFACES], &header.lumps[LUMP_DRAWVERTS] );
+#ifndef BSPC
+	if ( cm_patchCache->integer ) {
+		COM_StripExtension( name, cacheName, sizeof( cacheName ) );
+		Q_strncpyz( cacheName, va( "cache/%s.pcol", cacheName ), sizeof( cacheName ) );
+		CMod_LoadPatches( &header.lumps[LUMP_SURFACES], &header.lumps[LUMP_DRAWVERTS],
+			cacheName, CM_Checksum( &header ) );
+	} else
+#endif
+	CMod_LoadPatches( &header.lumps[LUMP_SURFACES], &header.lumps[LUMP_DRAWVERTS], NULL, 0 );
 
 	// we are NOT freeing the file, because it is cached for the ref
 	FS_FreeFile (buf.v);
@@ -654,6 +859,12 @@ void CM_LoadMap( const char *name, qboolean clientload, int *checksum ) {
 
 	CM_FloodAreaConnections ();
 
+#ifndef BSPC
+	if ( cm_clusterLists->integer ) {
+		CMod_BuildClusterLists();
+	}
+#endif
+
 	// allow this to be cached if it is loaded by the server
 	if ( !clientload ) {
 		Q_strncpyz( cm.name, name, sizeof( cm.name ) );
@@ -683,7 +894,7 @@ cmodel_t	*CM_ClipHandleToModel( clipHandle_t handle ) {
 		return &cm.cmodels[handle];
 	}
 	if ( handle == BOX_MODEL_HANDLE ) {
-		return &box_model;
+		return &CM_ThreadBoxHull()->model;
 	}
 	if ( handle < MAX_SUBMODELS ) {
 		Com_Error( ERR_DROP, "CM_ClipHandleToModel: bad handle %i < %i < %i", 
@@ -742,51 +953,58 @@ CM_InitBoxHull
 
 Set up the planes and nodes so that the six floats of a bounding box
 can just be stored out and get a proper clipping hull structure.
+Every thread gets a hull of its own, so traces against temporary
+boxes can run in parallel jobs.
 ===================
 */
 void CM_InitBoxHull (void)
 {
-	int			i;
+	int			i, h;
 	int			side;
 	cplane_t	*p;
 	cbrushside_t	*s;
+	boxHull_t	*box;
 
-	box_planes = &cm.planes[cm.numPlanes];
-
-	box_brush = &cm.brushes[cm.numBrushes];
-	box_brush->numsides = 6;
-	box_brush->sides = cm.brushsides + cm.numBrushSides;
-	box_brush->contents = CONTENTS_BODY;
-
-	box_model.leaf.numLeafBrushes = 1;
-//	box_model.leaf.firstLeafBrush = cm.numBrushes;
-	box_model.leaf.firstLeafBrush = cm.numLeafBrushes;
-	cm.leafbrushes[cm.numLeafBrushes] = cm.numBrushes;
-
-	for (i=0 ; i<6 ; i++)
+	for (h=0 ; h<BOX_HULLS ; h++)
 	{
-		side = i&1;
+		box = &box_hulls[h];
 
-		// brush sides
-		s = &cm.brushsides[cm.numBrushSides+i];
-		s->plane = 	cm.planes + (cm.numPlanes+i*2+side);
-		s->surfaceFlags = 0;
+		box->planes = &cm.planes[cm.numPlanes + h*12];
 
-		// planes
-		p = &box_planes[i*2];
-		p->type = i>>1;
-		p->signbits = 0;
-		VectorClear (p->normal);
-		p->normal[i>>1] = 1;
+		box->brush = &cm.brushes[cm.numBrushes + h];
+		box->brush->numsides = 6;
+		box->brush->sides = cm.brushsides + cm.numBrushSides + h*6;
+		box->brush->contents = CONTENTS_BODY;
 
-		p = &box_planes[i*2+1];
-		p->type = 3 + (i>>1);
-		p->signbits = 0;
-		VectorClear (p->normal);
-		p->normal[i>>1] = -1;
+		box->model.leaf.numLeafBrushes = 1;
+		box->model.leaf.firstLeafBrush = cm.numLeafBrushes + h;
+		cm.leafbrushes[cm.numLeafBrushes + h] = cm.numBrushes + h;
 
-		SetPlaneSignbits( p );
-	}	
+		for (i=0 ; i<6 ; i++)
+		{
+			side = i&1;
+
+			// brush sides
+			s = &box->brush->sides[i];
+			s->plane = box->planes + (i*2+side);
+			s->surfaceFlags = 0;
+
+			// planes
+			p = &box->planes[i*2];
+			p->type = i>>1;
+			p->signbits = 0;
+			VectorClear (p->normal);
+			p->normal[i>>1] = 1;
+
+			p = &box->planes[i*2+1];
+			p->type = 3 + (i>>1);
+			p->signbits = 0;
+			VectorClear (p->normal);
+			p->normal[i>>1] = -1;
+
+			SetPlaneSignbits( p );
+		}
+	}
 }
 
 /*
@@ -799,29 +1017,32 @@ Capsules are handled differently though.
 ===================
 */
 clipHandle_t CM_TempBoxModel( const vec3_t mins, const vec3_t maxs, int capsule ) {
+	boxHull_t	*box;
+
+	box = CM_ThreadBoxHull();
 
-	VectorCopy( mins, box_model.mins );
-	VectorCopy( maxs, box_model.maxs );
+	VectorCopy( mins, box->model.mins );
+	VectorCopy( maxs, box->model.maxs );
 
 	if ( capsule ) {
 		return CAPSULE_MODEL_HANDLE;
 	}
 
-	box_planes[0].dist = maxs[0];
-	box_planes[1].dist = -maxs[0];
-	box_planes[2].dist = mins[0];
-	box_planes[3].dist = -mins[0];
-	box_planes[4].dist = maxs[1];
-	box_planes[5].dist = -maxs[1];
-	box_planes[6].dist = mins[1];
-	box_planes[7].dist = -mins[1];
-	box_planes[8].dist = maxs[2];
-	box_planes[9].dist = -maxs[2];
-	box_planes[10].dist = mins[2];
-	box_planes[11].dist = -mins[2];
-
-	VectorCopy( mins, box_brush->bounds[0] );
-	VectorCopy( maxs, box_brush->bounds[1] );
+	box->planes[0].dist = maxs[0];
+	box->planes[1].dist = -maxs[0];
+	box->planes[2].dist = mins[0];
+	box->planes[3].dist = -mins[0];
+	box->planes[4].dist = maxs[1];
+	box->planes[5].dist = -maxs[1];
+	box->planes[6].dist = mins[1];
+	box->planes[7].dist = -mins[1];
+	box->planes[8].dist = maxs[2];
+	box->planes[9].dist = -maxs[2];
+	box->planes[10].dist = mins[2];
+	box->planes[11].dist = -mins[2];
+
+	VectorCopy( mins, box->brush->bounds[0] );
+	VectorCopy( maxs, box->brush->bounds[1] );
 
 	return BOX_MODEL_HANDLE;
 }
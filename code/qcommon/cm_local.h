@@ -62,9 +62,16 @@ typedef struct {
 	vec3_t		bounds[2];
 	int			numsides;
 	cbrushside_t	*sides;
+	float		*planes;		// sides in groups of four, NULL = test one at a time
 	int			checkcount;		// to avoid repeated testings
 } cbrush_t;
 
+// brush planes are tested four at a time where SSE can be assumed,
+// with results bit identical to testing them one at a time
+#if idx64
+#define	CM_SSE_BRUSHES
+#endif
+
 
 typedef struct {
 	int			checkcount;				// to avoid repeated testings
@@ -114,6 +121,9 @@ typedef struct {
 	byte		*visibility;
 	qboolean	vised;			// if false, visibility is just a single cluster of ffs
 
+	int			*clusterRunOfs;	// [ numVisRows + 1 ] into clusterRuns, NULL without cm_clusterLists
+	int			*clusterRuns;	// first cluster, count pairs of each row's visible clusters
+
 	int			numEntityChars;
 	char		*entityString;
 
@@ -125,7 +135,7 @@ typedef struct {
 	cPatch_t	**surfaces;			// non-patches will be NULL
 
 	int			floodvalid;
-	int			checkcount;					// incremented on each trace
+	int			checkcount;					// incremented on each trace, atomically
 } clipMap_t;
 
 
@@ -139,6 +149,8 @@ extern	int			c_traces, c_brush_traces, c_patch_traces;
 extern	cvar_t		*cm_noAreas;
 extern	cvar_t		*cm_noCurves;
 extern	cvar_t		*cm_playerCurveClip;
+extern	cvar_t		*cm_clusterLists;
+extern	cvar_t		*cm_patchCache;
 
 // cm_test.c
 
@@ -164,6 +176,7 @@ typedef struct {
 	qboolean	isPoint;	// optimized case
 	trace_t		trace;		// returned from trace call
 	sphere_t	sphere;		// sphere for oriendted capsule collision
+	int			checkcount;	// stamps brushes and patches already tested
 } traceWork_t;
 
 typedef struct leafList_s {
@@ -190,7 +203,17 @@ qboolean CM_BoundsIntersectPoint( const vec3_t mins, const vec3_t maxs, const ve
 
 // cm_patch.c
 
-struct patchCollide_s	*CM_GeneratePatchCollide( int width, int height, vec3_t *points );
+// the control points of one patch surface, points is NULL for other surfaces
+typedef struct {
+	int				width, height;
+	const vec3_t	*points;
+} patchSource_t;
+
+void CM_GeneratePatchCollides( int count, const patchSource_t *sources, struct patchCollide_s **collides );
+qboolean CM_LoadPatchCache( const char *filename, unsigned checksum, int count,
+						   const patchSource_t *sources, struct patchCollide_s **collides );
+void CM_WritePatchCache( const char *filename, unsigned checksum, int count,
+						struct patchCollide_s **collides );
 void CM_TraceThroughPatchCollide( traceWork_t *tw, const struct patchCollide_s *pc );
 qboolean CM_PositionTestInPatchCollide( traceWork_t *tw, const struct patchCollide_s *pc );
 void CM_ClearLevelPatches( void );
@@ -23,12 +23,14 @@ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
 #include "cm_local.h"
 #include "cm_patch.h"
 
+#include <setjmp.h>
+
 /*
 
 This file does not reference any globals, and has these entry points:
 
 void CM_ClearLevelPatches( void );
-struct patchCollide_s	*CM_GeneratePatchCollide( int width, int height, const vec3_t *points );
+void CM_GeneratePatchCollides( int count, const patchSource_t *sources, struct patchCollide_s **collides );
 void CM_TraceThroughPatchCollide( traceWork_t *tw, const struct patchCollide_s *pc );
 qboolean CM_PositionTestInPatchCollide( traceWork_t *tw, const struct patchCollide_s *pc );
 void CM_DrawDebugSurface( void (*drawPoly)(int color, int numPoints, flaot *points) );
@@ -414,11 +416,65 @@ PATCH COLLIDE GENERATION
 ================================================================================
 */
 
-static	int				numPlanes;
-static	patchPlane_t	planes[MAX_PATCH_PLANES];
+// everything a patch is built in, one per thread so the patches of a map
+// can be generated on the worker threads.  Errors and warnings are kept
+// here and reported by the thread that started the generation.
+typedef struct {
+	int				numPlanes;
+	patchPlane_t	planes[MAX_PATCH_PLANES];
+
+	int				numFacets;
+	facet_t			facets[MAX_FACETS];
+
+	cGrid_t			grid;
+	int				gridPlanes[MAX_GRID_SIZE][MAX_GRID_SIZE][2];
+
+	windingPool_t	windings;
+
+	qboolean		debugBlock;					// the first block with mixed border sides
+	vec3_t			debugBlockPoints[4];
+
+	jmp_buf			abort;
+	int				errorCode;
+	char			error[MAX_STRING_CHARS];
+	int				numWarnings;
+	qboolean		developerWarning;
+	char			warning[MAX_STRING_CHARS];	// the first one
+} patchWork_t;
 
-static	int				numFacets;
-static	facet_t			facets[MAX_PATCH_PLANES]; //maybe MAX_FACETS ??
+static	Q_THREADLOCAL patchWork_t	*pwork;
+
+static void QDECL CM_PatchError( int code, const char *fmt, ... ) __attribute__ ((noreturn, format(printf, 2, 3)));
+
+/*
+==================
+CM_PatchError
+
+Abandons the patch being generated
+==================
+*/
+static void QDECL CM_PatchError( int code, const char *fmt, ... ) {
+	va_list		argptr;
+
+	va_start( argptr, fmt );
+	Q_vsnprintf( pwork->error, sizeof( pwork->error ), fmt, argptr );
+	va_end( argptr );
+
+	pwork->errorCode = code;
+	longjmp( pwork->abort, 1 );
+}
+
+/*
+==================
+CM_PatchWarning
+==================
+*/
+static void CM_PatchWarning( qboolean developer, const char *msg ) {
+	if ( !pwork->numWarnings++ ) {
+		pwork->developerWarning = developer;
+		Q_strncpyz( pwork->warning, msg, sizeof( pwork->warning ) );
+	}
+}
 
 #define	NORMAL_EPSILON	0.0001
 #define	DIST_EPSILON	0.02
@@ -491,23 +547,23 @@ int CM_FindPlane2(float plane[4], int *flipped) {
 	int i;
 
 	// see if the points are close enough to an existing plane
-	for ( i = 0 ; i < numPlanes ; i++ ) {
-		if (CM_PlaneEqual(&planes[i], plane, flipped)) return i;
+	for ( i = 0 ; i < pwork->numPlanes ; i++ ) {
+		if (CM_PlaneEqual(&pwork->planes[i], plane, flipped)) return i;
 	}
 
 	// add a new plane
-	if ( numPlanes == MAX_PATCH_PLANES ) {
-		Com_Error( ERR_DROP, "MAX_PATCH_PLANES" );
+	if ( pwork->numPlanes == MAX_PATCH_PLANES ) {
+		CM_PatchError( ERR_DROP, "MAX_PATCH_PLANES" );
 	}
 
-	Vector4Copy( plane, planes[numPlanes].plane );
-	planes[numPlanes].signbits = CM_SignbitsForNormal( plane );
+	Vector4Copy( plane, pwork->planes[pwork->numPlanes].plane );
+	pwork->planes[pwork->numPlanes].signbits = CM_SignbitsForNormal( plane );
 
-	numPlanes++;
+	pwork->numPlanes++;
 
 	*flipped = qfalse;
 
-	return numPlanes-1;
+	return pwork->numPlanes-1;
 }
 
 /*
@@ -525,22 +581,22 @@ static int CM_FindPlane( float *p1, float *p2, float *p3 ) {
 	}
 
 	// see if the points are close enough to an existing plane
-	for ( i = 0 ; i < numPlanes ; i++ ) {
-		if ( DotProduct( plane, planes[i].plane ) < 0 ) {
+	for ( i = 0 ; i < pwork->numPlanes ; i++ ) {
+		if ( DotProduct( plane, pwork->planes[i].plane ) < 0 ) {
 			continue;	// allow backwards planes?
 		}
 
-		d = DotProduct( p1, planes[i].plane ) - planes[i].plane[3];
+		d = DotProduct( p1, pwork->planes[i].plane ) - pwork->planes[i].plane[3];
 		if ( d < -PLANE_TRI_EPSILON || d > PLANE_TRI_EPSILON ) {
 			continue;
 		}
 
-		d = DotProduct( p2, planes[i].plane ) - planes[i].plane[3];
+		d = DotProduct( p2, pwork->planes[i].plane ) - pwork->planes[i].plane[3];
 		if ( d < -PLANE_TRI_EPSILON || d > PLANE_TRI_EPSILON ) {
 			continue;
 		}
 
-		d = DotProduct( p3, planes[i].plane ) - planes[i].plane[3];
+		d = DotProduct( p3, pwork->planes[i].plane ) - pwork->planes[i].plane[3];
 		if ( d < -PLANE_TRI_EPSILON || d > PLANE_TRI_EPSILON ) {
 			continue;
 		}
@@ -550,16 +606,16 @@ static int CM_FindPlane( float *p1, float *p2, float *p3 ) {
 	}
 
 	// add a new plane
-	if ( numPlanes == MAX_PATCH_PLANES ) {
-		Com_Error( ERR_DROP, "MAX_PATCH_PLANES" );
+	if ( pwork->numPlanes == MAX_PATCH_PLANES ) {
+		CM_PatchError( ERR_DROP, "MAX_PATCH_PLANES" );
 	}
 
-	Vector4Copy( plane, planes[numPlanes].plane );
-	planes[numPlanes].signbits = CM_SignbitsForNormal( plane );
+	Vector4Copy( plane, pwork->planes[pwork->numPlanes].plane );
+	pwork->planes[pwork->numPlanes].signbits = CM_SignbitsForNormal( plane );
 
-	numPlanes++;
+	pwork->numPlanes++;
 
-	return numPlanes-1;
+	return pwork->numPlanes-1;
 }
 
 /*
@@ -574,7 +630,7 @@ static int CM_PointOnPlaneSide( float *p, int planeNum ) {
 	if ( planeNum == -1 ) {
 		return SIDE_ON;
 	}
-	plane = planes[ planeNum ].plane;
+	plane = pwork->planes[ planeNum ].plane;
 
 	d = DotProduct( p, plane ) - plane[3];
 
@@ -607,7 +663,7 @@ static int	CM_GridPlane( int gridPlanes[MAX_GRID_SIZE][MAX_GRID_SIZE][2], int i,
 	}
 
 	// should never happen
-	Com_Printf( "WARNING: CM_GridPlane unresolvable\n" );
+	CM_PatchWarning( qfalse, "WARNING: CM_GridPlane unresolvable\n" );
 	return -1;
 }
 
@@ -629,7 +685,7 @@ static int CM_EdgePlaneNum( cGrid_t *grid, int gridPlanes[MAX_GRID_SIZE][MAX_GRI
 		if ( p == -1 ) {
 			return -1;
 		}
-		VectorMA( p1, 4, planes[ p ].plane, up );
+		VectorMA( p1, 4, pwork->planes[ p ].plane, up );
 		return CM_FindPlane( p1, p2, up );
 
 	case 2:	// bottom border
@@ -639,7 +695,7 @@ static int CM_EdgePlaneNum( cGrid_t *grid, int gridPlanes[MAX_GRID_SIZE][MAX_GRI
 		if ( p == -1 ) {
 			return -1;
 		}
-		VectorMA( p1, 4, planes[ p ].plane, up );
+		VectorMA( p1, 4, pwork->planes[ p ].plane, up );
 		return CM_FindPlane( p2, p1, up );
 
 	case 3: // left border
@@ -649,7 +705,7 @@ static int CM_EdgePlaneNum( cGrid_t *grid, int gridPlanes[MAX_GRID_SIZE][MAX_GRI
 		if ( p == -1 ) {
 			return -1;
 		}
-		VectorMA( p1, 4, planes[ p ].plane, up );
+		VectorMA( p1, 4, pwork->planes[ p ].plane, up );
 		return CM_FindPlane( p2, p1, up );
 
 	case 1:	// right border
@@ -659,7 +715,7 @@ static int CM_EdgePlaneNum( cGrid_t *grid, int gridPlanes[MAX_GRID_SIZE][MAX_GRI
 		if ( p == -1 ) {
 			return -1;
 		}
-		VectorMA( p1, 4, planes[ p ].plane, up );
+		VectorMA( p1, 4, pwork->planes[ p ].plane, up );
 		return CM_FindPlane( p1, p2, up );
 
 	case 4:	// diagonal out of triangle 0
@@ -669,7 +725,7 @@ static int CM_EdgePlaneNum( cGrid_t *grid, int gridPlanes[MAX_GRID_SIZE][MAX_GRI
 		if ( p == -1 ) {
 			return -1;
 		}
-		VectorMA( p1, 4, planes[ p ].plane, up );
+		VectorMA( p1, 4, pwork->planes[ p ].plane, up );
 		return CM_FindPlane( p1, p2, up );
 
 	case 5:	// diagonal out of triangle 1
@@ -679,12 +735,12 @@ static int CM_EdgePlaneNum( cGrid_t *grid, int gridPlanes[MAX_GRID_SIZE][MAX_GRI
 		if ( p == -1 ) {
 			return -1;
 		}
-		VectorMA( p1, 4, planes[ p ].plane, up );
+		VectorMA( p1, 4, pwork->planes[ p ].plane, up );
 		return CM_FindPlane( p1, p2, up );
 
 	}
 
-	Com_Error( ERR_DROP, "CM_EdgePlaneNum: bad k" );
+	CM_PatchError( ERR_DROP, "CM_EdgePlaneNum: bad k" );
 	return -1;
 }
 
@@ -720,7 +776,7 @@ static void CM_SetBorderInward( facet_t *facet, cGrid_t *grid, int gridPlanes[MA
 		numPoints = 3;
 		break;
 	default:
-		Com_Error( ERR_FATAL, "CM_SetBorderInward: bad parameter" );
+		CM_PatchError( ERR_FATAL, "CM_SetBorderInward: bad parameter" );
 		numPoints = 0;
 		break;
 	}
@@ -751,14 +807,14 @@ static void CM_SetBorderInward( facet_t *facet, cGrid_t *grid, int gridPlanes[MA
 			facet->borderPlanes[k] = -1;
 		} else {
 			// bisecting side border
-			Com_DPrintf( "WARNING: CM_SetBorderInward: mixed plane sides\n" );
+			CM_PatchWarning( qtrue, "WARNING: CM_SetBorderInward: mixed plane sides\n" );
 			facet->borderInward[k] = qfalse;
-			if ( !debugBlock ) {
-				debugBlock = qtrue;
-				VectorCopy( grid->points[i][j], debugBlockPoints[0] );
-				VectorCopy( grid->points[i+1][j], debugBlockPoints[1] );
-				VectorCopy( grid->points[i+1][j+1], debugBlockPoints[2] );
-				VectorCopy( grid->points[i][j+1], debugBlockPoints[3] );
+			if ( !pwork->debugBlock ) {
+				pwork->debugBlock = qtrue;
+				VectorCopy( grid->points[i][j], pwork->debugBlockPoints[0] );
+				VectorCopy( grid->points[i+1][j], pwork->debugBlockPoints[1] );
+				VectorCopy( grid->points[i+1][j+1], pwork->debugBlockPoints[2] );
+				VectorCopy( grid->points[i][j+1], pwork->debugBlockPoints[3] );
 			}
 		}
 	}
@@ -781,14 +837,14 @@ static qboolean CM_ValidateFacet( facet_t *facet ) {
 		return qfalse;
 	}
 
-	Vector4Copy( planes[ facet->surfacePlane ].plane, plane );
+	Vector4Copy( pwork->planes[ facet->surfacePlane ].plane, plane );
 	w = BaseWindingForPlane( plane,  plane[3] );
 	for ( j = 0 ; j < facet->numBorders && w ; j++ ) {
 		if ( facet->borderPlanes[j] == -1 ) {
 			FreeWinding( w );
 			return qfalse;
 		}
-		Vector4Copy( planes[ facet->borderPlanes[j] ].plane, plane );
+		Vector4Copy( pwork->planes[ facet->borderPlanes[j] ].plane, plane );
 		if ( !facet->borderInward[j] ) {
 			VectorSubtract( vec3_origin, plane, plane );
 			plane[3] = -plane[3];
@@ -831,12 +887,12 @@ void CM_AddFacetBevels( facet_t *facet ) {
 	winding_t *w, *w2;
 	vec3_t mins, maxs, vec, vec2;
 
-	Vector4Copy( planes[ facet->surfacePlane ].plane, plane );
+	Vector4Copy( pwork->planes[ facet->surfacePlane ].plane, plane );
 
 	w = BaseWindingForPlane( plane,  plane[3] );
 	for ( j = 0 ; j < facet->numBorders && w ; j++ ) {
 		if (facet->borderPlanes[j] == facet->surfacePlane) continue;
-		Vector4Copy( planes[ facet->borderPlanes[j] ].plane, plane );
+		Vector4Copy( pwork->planes[ facet->borderPlanes[j] ].plane, plane );
 
 		if ( !facet->borderInward[j] ) {
 			VectorSubtract( vec3_origin, plane, plane );
@@ -866,18 +922,18 @@ void CM_AddFacetBevels( facet_t *facet ) {
 				plane[3] = -mins[axis];
 			}
 			//if it's the surface plane
-			if (CM_PlaneEqual(&planes[facet->surfacePlane], plane, &flipped)) {
+			if (CM_PlaneEqual(&pwork->planes[facet->surfacePlane], plane, &flipped)) {
 				continue;
 			}
 			// see if the plane is allready present
 			for ( i = 0 ; i < facet->numBorders ; i++ ) {
-				if (CM_PlaneEqual(&planes[facet->borderPlanes[i]], plane, &flipped))
+				if (CM_PlaneEqual(&pwork->planes[facet->borderPlanes[i]], plane, &flipped))
 					break;
 			}
 
 			if ( i == facet->numBorders ) {
 				if ( facet->numBorders >= 4 + 6 + 16 ) {
-					Com_Printf( "ERROR: too many bevels\n" );
+					CM_PatchWarning( qfalse, "ERROR: too many bevels\n" );
 					continue;
 				}
 				facet->borderPlanes[facet->numBorders] = CM_FindPlane2(plane, &flipped);
@@ -930,33 +986,33 @@ void CM_AddFacetBevels( facet_t *facet ) {
 					continue;
 
 				//if it's the surface plane
-				if (CM_PlaneEqual(&planes[facet->surfacePlane], plane, &flipped)) {
+				if (CM_PlaneEqual(&pwork->planes[facet->surfacePlane], plane, &flipped)) {
 					continue;
 				}
 				// see if the plane is allready present
 				for ( i = 0 ; i < facet->numBorders ; i++ ) {
-					if (CM_PlaneEqual(&planes[facet->borderPlanes[i]], plane, &flipped)) {
+					if (CM_PlaneEqual(&pwork->planes[facet->borderPlanes[i]], plane, &flipped)) {
 							break;
 					}
 				}
 
 				if ( i == facet->numBorders ) {
 					if ( facet->numBorders >= 4 + 6 + 16 ) {
-						Com_Printf( "ERROR: too many bevels\n" );
+						CM_PatchWarning( qfalse, "ERROR: too many bevels\n" );
 						continue;
 					}
 					facet->borderPlanes[facet->numBorders] = CM_FindPlane2(plane, &flipped);
 
 					for ( k = 0 ; k < facet->numBorders ; k++ ) {
 						if (facet->borderPlanes[facet->numBorders] ==
-							facet->borderPlanes[k]) Com_Printf("WARNING: bevel plane already used\n");
+							facet->borderPlanes[k]) CM_PatchWarning( qfalse, "WARNING: bevel plane already used\n" );
 					}
 
 					facet->borderNoAdjust[facet->numBorders] = 0;
 					facet->borderInward[facet->numBorders] = flipped;
 					//
 					w2 = CopyWinding(w);
-					Vector4Copy(planes[facet->borderPlanes[facet->numBorders]].plane, newplane);
+					Vector4Copy(pwork->planes[facet->borderPlanes[facet->numBorders]].plane, newplane);
 					if (!facet->borderInward[facet->numBorders])
 					{
 						VectorNegate(newplane, newplane);
@@ -964,7 +1020,7 @@ void CM_AddFacetBevels( facet_t *facet ) {
 					} //end if
 					ChopWindingInPlace( &w2, newplane, newplane[3], 0.1f );
 					if (!w2) {
-						Com_DPrintf("WARNING: CM_AddFacetBevels... invalid bevel\n");
+						CM_PatchWarning( qtrue, "WARNING: CM_AddFacetBevels... invalid bevel\n" );
 						continue;
 					}
 					else {
@@ -983,7 +1039,7 @@ void CM_AddFacetBevels( facet_t *facet ) {
 #ifndef BSPC
 	//add opposite plane
 	if ( facet->numBorders >= 4 + 6 + 16 ) {
-		Com_Printf( "ERROR: too many bevels\n" );
+		CM_PatchWarning( qfalse, "ERROR: too many bevels\n" );
 		return;
 	}
 	facet->borderPlanes[facet->numBorders] = facet->surfacePlane;
@@ -1009,13 +1065,13 @@ CM_PatchCollideFromGrid
 static void CM_PatchCollideFromGrid( cGrid_t *grid, patchCollide_t *pf ) {
 	int				i, j;
 	float			*p1, *p2, *p3;
-	int				gridPlanes[MAX_GRID_SIZE][MAX_GRID_SIZE][2];
+	int				(*gridPlanes)[MAX_GRID_SIZE][2] = pwork->gridPlanes;
 	facet_t			*facet;
 	int				borders[4];
 	int				noAdjust[4];
 
-	numPlanes = 0;
-	numFacets = 0;
+	pwork->numPlanes = 0;
+	pwork->numFacets = 0;
 
 	// find the planes for each triangle of the grid
 	for ( i = 0 ; i < grid->width - 1 ; i++ ) {
@@ -1080,10 +1136,10 @@ static void CM_PatchCollideFromGrid( cGrid_t *grid, patchCollide_t *pf ) {
 				borders[EN_RIGHT] = CM_EdgePlaneNum( grid, gridPlanes, i, j, 1 );
 			}
 
-			if ( numFacets == MAX_FACETS ) {
-				Com_Error( ERR_DROP, "MAX_FACETS" );
+			if ( pwork->numFacets == MAX_FACETS ) {
+				CM_PatchError( ERR_DROP, "MAX_FACETS" );
 			}
-			facet = &facets[numFacets];
+			facet = &pwork->facets[pwork->numFacets];
 			Com_Memset( facet, 0, sizeof( *facet ) );
 
 			if ( gridPlanes[i][j][0] == gridPlanes[i][j][1] ) {
@@ -1103,7 +1159,7 @@ static void CM_PatchCollideFromGrid( cGrid_t *grid, patchCollide_t *pf ) {
 				CM_SetBorderInward( facet, grid, gridPlanes, i, j, -1 );
 				if ( CM_ValidateFacet( facet ) ) {
 					CM_AddFacetBevels( facet );
-					numFacets++;
+					pwork->numFacets++;
 				}
 			} else {
 				// two seperate triangles
@@ -1123,13 +1179,13 @@ static void CM_PatchCollideFromGrid( cGrid_t *grid, patchCollide_t *pf ) {
  				CM_SetBorderInward( facet, grid, gridPlanes, i, j, 0 );
 				if ( CM_ValidateFacet( facet ) ) {
 					CM_AddFacetBevels( facet );
-					numFacets++;
+					pwork->numFacets++;
 				}
 
-				if ( numFacets == MAX_FACETS ) {
-					Com_Error( ERR_DROP, "MAX_FACETS" );
+				if ( pwork->numFacets == MAX_FACETS ) {
+					CM_PatchError( ERR_DROP, "MAX_FACETS" );
 				}
-				facet = &facets[numFacets];
+				facet = &pwork->facets[pwork->numFacets];
 				Com_Memset( facet, 0, sizeof( *facet ) );
 
 				facet->surfacePlane = gridPlanes[i][j][1];
@@ -1148,87 +1204,92 @@ static void CM_PatchCollideFromGrid( cGrid_t *grid, patchCollide_t *pf ) {
 				CM_SetBorderInward( facet, grid, gridPlanes, i, j, 1 );
 				if ( CM_ValidateFacet( facet ) ) {
 					CM_AddFacetBevels( facet );
-					numFacets++;
+					pwork->numFacets++;
 				}
 			}
 		}
 	}
 
-	// copy the results out
-	pf->numPlanes = numPlanes;
-	pf->numFacets = numFacets;
-	pf->facets = Hunk_Alloc( numFacets * sizeof( *pf->facets ), h_high );
-	Com_Memcpy( pf->facets, facets, numFacets * sizeof( *pf->facets ) );
-	pf->planes = Hunk_Alloc( numPlanes * sizeof( *pf->planes ), h_high );
-	Com_Memcpy( pf->planes, planes, numPlanes * sizeof( *pf->planes ) );
+	// the results stay in the work until the caller copies them out
+	pf->numPlanes = pwork->numPlanes;
+	pf->planes = pwork->planes;
+	pf->numFacets = pwork->numFacets;
+	pf->facets = pwork->facets;
 }
 
 
 /*
 ===================
-CM_GeneratePatchCollide
+CM_BuildPatchCollide
 
 Creates an internal structure that will be used to perform
-collision detection with a patch mesh.
+collision detection with a patch mesh, in pwork.  The planes and
+facets of pf point into pwork afterwards.
 
 Points is packed as concatenated rows.
 ===================
 */
-struct patchCollide_s	*CM_GeneratePatchCollide( int width, int height, vec3_t *points ) {
-	patchCollide_t	*pf;
-	cGrid_t			grid;
+static qboolean CM_BuildPatchCollide( int width, int height, const vec3_t *points, patchCollide_t *pf, int *blocks ) {
+	cGrid_t			*grid;
 	int				i, j;
 
+	pwork->errorCode = 0;
+	pwork->numWarnings = 0;
+	pwork->debugBlock = qfalse;
+	if ( setjmp( pwork->abort ) ) {
+		return qfalse;
+	}
+
 	if ( width <= 2 || height <= 2 || !points ) {
-		Com_Error( ERR_DROP, "CM_GeneratePatchFacets: bad parameters: (%i, %i, %p)",
+		CM_PatchError( ERR_DROP, "CM_GeneratePatchFacets: bad parameters: (%i, %i, %p)",
 			width, height, (void *)points );
 	}
 
 	if ( !(width & 1) || !(height & 1) ) {
-		Com_Error( ERR_DROP, "CM_GeneratePatchFacets: even sizes are invalid for quadratic meshes" );
+		CM_PatchError( ERR_DROP, "CM_GeneratePatchFacets: even sizes are invalid for quadratic meshes" );
 	}
 
 	if ( width > MAX_GRID_SIZE || height > MAX_GRID_SIZE ) {
-		Com_Error( ERR_DROP, "CM_GeneratePatchFacets: source is > MAX_GRID_SIZE" );
+		CM_PatchError( ERR_DROP, "CM_GeneratePatchFacets: source is > MAX_GRID_SIZE" );
 	}
 
 	// build a grid
-	grid.width = width;
-	grid.height = height;
-	grid.wrapWidth = qfalse;
-	grid.wrapHeight = qfalse;
+	grid = &pwork->grid;
+	grid->width = width;
+	grid->height = height;
+	grid->wrapWidth = qfalse;
+	grid->wrapHeight = qfalse;
 	for ( i = 0 ; i < width ; i++ ) {
 		for ( j = 0 ; j < height ; j++ ) {
-			VectorCopy( points[j*width + i], grid.points[i][j] );
+			VectorCopy( points[j*width + i], grid->points[i][j] );
 		}
 	}
 
 	// subdivide the grid
-	CM_SetGridWrapWidth( &grid );
-	CM_SubdivideGridColumns( &grid );
-	CM_RemoveDegenerateColumns( &grid );
+	CM_SetGridWrapWidth( grid );
+	CM_SubdivideGridColumns( grid );
+	CM_RemoveDegenerateColumns( grid );
 
-	CM_TransposeGrid( &grid );
+	CM_TransposeGrid( grid );
 
-	CM_SetGridWrapWidth( &grid );
-	CM_SubdivideGridColumns( &grid );
-	CM_RemoveDegenerateColumns( &grid );
+	CM_SetGridWrapWidth( grid );
+	CM_SubdivideGridColumns( grid );
+	CM_RemoveDegenerateColumns( grid );
 
 	// we now have a grid of points exactly on the curve
 	// the aproximate surface defined by these points will be
 	// collided against
-	pf = Hunk_Alloc( sizeof( *pf ), h_high );
 	ClearBounds( pf->bounds[0], pf->bounds[1] );
-	for ( i = 0 ; i < grid.width ; i++ ) {
-		for ( j = 0 ; j < grid.height ; j++ ) {
-			AddPointToBounds( grid.points[i][j], pf->bounds[0], pf->bounds[1] );
+	for ( i = 0 ; i < grid->width ; i++ ) {
+		for ( j = 0 ; j < grid->height ; j++ ) {
+			AddPointToBounds( grid->points[i][j], pf->bounds[0], pf->bounds[1] );
 		}
 	}
 
-	c_totalPatchBlocks += ( grid.width - 1 ) * ( grid.height - 1 );
+	*blocks = ( grid->width - 1 ) * ( grid->height - 1 );
 
 	// generate a bsp tree for the surface
-	CM_PatchCollideFromGrid( &grid, pf );
+	CM_PatchCollideFromGrid( grid, pf );
 
 	// expand by one unit for epsilon purposes
 	pf->bounds[0][0] -= 1;
@@ -1239,8 +1300,377 @@ struct patchCollide_s	*CM_GeneratePatchCollide( int width, int height, vec3_t *p
 	pf->bounds[1][1] += 1;
 	pf->bounds[1][2] += 1;
 
-	return pf;
+	return qtrue;
+}
+
+// what a job hands back for one patch, the arrays are malloc'd
+// because jobs can't allocate from the hunk
+typedef struct {
+	patchCollide_t	pc;
+	int				blocks;
+	int				errorCode;
+	int				numWarnings;
+	qboolean		developerWarning;
+	char			message[MAX_STRING_CHARS];
+	qboolean		debugBlock;
+	vec3_t			debugBlockPoints[4];
+} patchResult_t;
+
+typedef struct {
+	const patchSource_t	*sources;
+	patchResult_t		*results;
+	patchWork_t			*works;		// one per thread
+} patchJob_t;
+
+/*
+===================
+CM_GeneratePatchJob
+
+Windings come from the pool in pwork, and polylib errors abandon
+the patch like CM_PatchError does
+===================
+*/
+static void CM_GeneratePatchJob( void *data, int index ) {
+	patchJob_t			*job = data;
+	const patchSource_t	*source = &job->sources[index];
+	patchResult_t		*result = &job->results[index];
+	patchCollide_t		*pc = &result->pc;
+
+	if ( !source->points ) {
+		return;		// not a patch
+	}
+
+	pwork = &job->works[Com_ThreadIndex()];
+	pwork->windings.error = CM_PatchError;
+	SetWindingPool( &pwork->windings );
+
+	if ( !CM_BuildPatchCollide( source->width, source->height, source->points, pc, &result->blocks ) ) {
+		SetWindingPool( NULL );
+		result->errorCode = pwork->errorCode;
+		Q_strncpyz( result->message, pwork->error, sizeof( result->message ) );
+		pc->numPlanes = pc->numFacets = 0;
+		return;
+	}
+	SetWindingPool( NULL );
+
+	result->debugBlock = pwork->debugBlock;
+	Com_Memcpy( result->debugBlockPoints, pwork->debugBlockPoints, sizeof( result->debugBlockPoints ) );
+
+	result->numWarnings = pwork->numWarnings;
+	result->developerWarning = pwork->developerWarning;
+	Q_strncpyz( result->message, pwork->warning, sizeof( result->message ) );
+
+	pc->planes = malloc( pc->numPlanes * sizeof( *pc->planes ) + 1 );
+	pc->facets = malloc( pc->numFacets * sizeof( *pc->facets ) + 1 );
+	if ( !pc->planes || !pc->facets ) {
+		result->errorCode = ERR_FATAL;
+		Q_strncpyz( result->message, "CM_GeneratePatchCollides: out of memory", sizeof( result->message ) );
+		return;
+	}
+	Com_Memcpy( pc->planes, pwork->planes, pc->numPlanes * sizeof( *pc->planes ) );
+	Com_Memcpy( pc->facets, pwork->facets, pc->numFacets * sizeof( *pc->facets ) );
+}
+
+/*
+===================
+CM_GeneratePatchCollides
+
+Builds the collision structure of every source that has points, spread
+over the worker threads, and leaves the others NULL.  The results are
+copied to the hunk in source order, so the level is laid out the same
+however many threads took part.
+===================
+*/
+void CM_GeneratePatchCollides( int count, const patchSource_t *sources, struct patchCollide_s **collides ) {
+	patchJob_t		job;
+	patchResult_t	*result;
+	patchCollide_t	*pf;
+	int				i, errorCode, numThreads;
+	char			error[MAX_STRING_CHARS];
+
+	if ( count <= 0 ) {
+		return;
+	}
+
+	numThreads = Com_NumWorkers() + 1;
+	job.sources = sources;
+	job.works = Hunk_AllocateTempMemory( numThreads * sizeof( *job.works ) );
+	job.results = malloc( count * sizeof( *job.results ) );
+	if ( !job.results ) {
+		Com_Error( ERR_FATAL, "CM_GeneratePatchCollides: out of memory" );
+	}
+	Com_Memset( job.results, 0, count * sizeof( *job.results ) );
+
+	Com_RunParallel( count, CM_GeneratePatchJob, &job );
+
+	Hunk_FreeTempMemory( job.works );
+	pwork = NULL;
+
+	errorCode = 0;
+	for ( i = 0, result = job.results ; i < count ; i++, result++ ) {
+		collides[i] = NULL;
+		if ( !sources[i].points ) {
+			continue;
+		}
+
+		if ( result->errorCode ) {
+			if ( !errorCode ) {
+				errorCode = result->errorCode;
+				Q_strncpyz( error, result->message, sizeof( error ) );
+			}
+		} else if ( !errorCode ) {
+			if ( result->numWarnings ) {
+				if ( result->developerWarning ) {
+					Com_DPrintf( "%s", result->message );
+				} else {
+					Com_Printf( "%s", result->message );
+				}
+				if ( result->numWarnings > 1 ) {
+					Com_DPrintf( "...and %i more patch warnings on surface %i\n", result->numWarnings - 1, i );
+				}
+			}
+
+			c_totalPatchBlocks += result->blocks;
+
+			if ( result->debugBlock && !debugBlock ) {
+				debugBlock = qtrue;
+				Com_Memcpy( debugBlockPoints, result->debugBlockPoints, sizeof( debugBlockPoints ) );
+			}
+
+			pf = Hunk_Alloc( sizeof( *pf ), h_high );
+			*pf = result->pc;
+			pf->planes = Hunk_Alloc( pf->numPlanes * sizeof( *pf->planes ), h_high );
+			Com_Memcpy( pf->planes, result->pc.planes, pf->numPlanes * sizeof( *pf->planes ) );
+			pf->facets = Hunk_Alloc( pf->numFacets * sizeof( *pf->facets ), h_high );
+			Com_Memcpy( pf->facets, result->pc.facets, pf->numFacets * sizeof( *pf->facets ) );
+			collides[i] = pf;
+		}
+
+		free( result->pc.planes );
+		free( result->pc.facets );
+	}
+	free( job.results );
+
+	if ( errorCode ) {
+		Com_Error( errorCode, "%s", error );
+	}
+}
+
+#ifndef BSPC
+/*
+================================================================================
+
+PATCH COLLIDE CACHE
+
+The generated patches of a map can be saved and read back on later
+loads of the same map, which only needs a copy instead of subdividing
+every curve again.  The file is in the native byte order and layout,
+anything that doesn't match exactly is regenerated.
+
+================================================================================
+*/
+
+#define	PATCH_CACHE_IDENT		(('L'<<24)+('O'<<16)+('C'<<8)+'P')	// little-endian "PCOL"
+#define	PATCH_CACHE_VERSION		1
+
+typedef struct {
+	int			ident;
+	int			version;
+	unsigned	checksum;		// CM_Checksum of the map
+	int			numSurfaces;
+	int			numPatches;
+	int			planeSize;
+	int			facetSize;
+} patchCacheHeader_t;
+
+// followed by numPlanes planes and numFacets facets
+typedef struct {
+	int			surfaceNum;
+	vec3_t		bounds[2];
+	int			numPlanes;
+	int			numFacets;
+} patchCacheEntry_t;
+
+/*
+===================
+CM_ValidCachedFacets
+===================
+*/
+static qboolean CM_ValidCachedFacets( const facet_t *facets, int numFacets, int numPlanes ) {
+	int		i, j;
+
+	for ( i = 0 ; i < numFacets ; i++, facets++ ) {
+		if ( facets->surfacePlane < 0 || facets->surfacePlane >= numPlanes ) {
+			return qfalse;
+		}
+		if ( facets->numBorders < 0 || facets->numBorders > ARRAY_LEN( facets->borderPlanes ) ) {
+			return qfalse;
+		}
+		for ( j = 0 ; j < facets->numBorders ; j++ ) {
+			if ( facets->borderPlanes[j] < 0 || facets->borderPlanes[j] >= numPlanes ) {
+				return qfalse;
+			}
+		}
+	}
+	return qtrue;
+}
+
+/*
+===================
+CM_LoadPatchCache
+
+Fills in collides from the cache file when it was written for a map
+with the same checksum and the same patch surfaces as sources.  The
+cache is only read from the home path it was written to, a pk3 can't
+supply one, and it must cover every patch surface exactly once.
+===================
+*/
+qboolean CM_LoadPatchCache( const char *filename, unsigned checksum, int count,
+						   const patchSource_t *sources, struct patchCollide_s **collides ) {
+	union {
+		byte		*b;
+		void		*v;
+	} buf;
+	const patchCacheHeader_t	*header;
+	patchCacheEntry_t	entry;
+	patchCollide_t		*pf;
+	byte				*p, *end, *seen;
+	int					i, numPatches, length, planesSize, facetsSize;
+
+	length = FS_HomeReadFile( filename, &buf.v );
+	if ( !buf.b ) {
+		return qfalse;
+	}
+
+	numPatches = 0;
+	for ( i = 0 ; i < count ; i++ ) {
+		collides[i] = NULL;
+		if ( sources[i].points ) {
+			numPatches++;
+		}
+	}
+
+	header = (const patchCacheHeader_t *)buf.b;
+	if ( length < sizeof( *header ) || header->ident != PATCH_CACHE_IDENT
+		|| header->version != PATCH_CACHE_VERSION || header->checksum != checksum
+		|| header->numSurfaces != count || header->numPatches != numPatches
+		|| header->planeSize != sizeof( patchPlane_t ) || header->facetSize != sizeof( facet_t ) ) {
+		FS_FreeFile( buf.v );
+		return qfalse;
+	}
+
+	// check all of it before anything goes on the hunk
+	seen = Hunk_AllocateTempMemory( count );
+	Com_Memset( seen, 0, count );
+	p = buf.b + sizeof( *header );
+	end = buf.b + length;
+	for ( i = 0 ; i < numPatches ; i++ ) {
+		if ( end - p < sizeof( entry ) ) {
+			break;
+		}
+		Com_Memcpy( &entry, p, sizeof( entry ) );
+		p += sizeof( entry );
+
+		if ( entry.surfaceNum < 0 || entry.surfaceNum >= count || !sources[entry.surfaceNum].points
+			|| seen[entry.surfaceNum] || entry.numPlanes < 0 || entry.numPlanes > MAX_PATCH_PLANES
+			|| entry.numFacets < 0 || entry.numFacets > MAX_FACETS ) {
+			break;
+		}
+
+		planesSize = entry.numPlanes * sizeof( patchPlane_t );
+		facetsSize = entry.numFacets * sizeof( facet_t );
+		if ( end - p < planesSize + facetsSize ) {
+			break;
+		}
+		if ( !CM_ValidCachedFacets( (const facet_t *)( p + planesSize ), entry.numFacets, entry.numPlanes ) ) {
+			break;
+		}
+		seen[entry.surfaceNum] = 1;
+		p += planesSize + facetsSize;
+	}
+	Hunk_FreeTempMemory( seen );
+	// no duplicates and numPatches entries means every patch is covered
+	if ( i != numPatches || p != end ) {
+		Com_Printf( "WARNING: %s is damaged, regenerating it\n", filename );
+		FS_FreeFile( buf.v );
+		return qfalse;
+	}
+
+	p = buf.b + sizeof( *header );
+	for ( i = 0 ; i < numPatches ; i++ ) {
+		Com_Memcpy( &entry, p, sizeof( entry ) );
+		p += sizeof( entry );
+
+		pf = Hunk_Alloc( sizeof( *pf ), h_high );
+		VectorCopy( entry.bounds[0], pf->bounds[0] );
+		VectorCopy( entry.bounds[1], pf->bounds[1] );
+		pf->numPlanes = entry.numPlanes;
+		pf->planes = Hunk_Alloc( entry.numPlanes * sizeof( *pf->planes ), h_high );
+		Com_Memcpy( pf->planes, p, entry.numPlanes * sizeof( *pf->planes ) );
+		p += entry.numPlanes * sizeof( *pf->planes );
+		pf->numFacets = entry.numFacets;
+		pf->facets = Hunk_Alloc( entry.numFacets * sizeof( *pf->facets ), h_high );
+		Com_Memcpy( pf->facets, p, entry.numFacets * sizeof( *pf->facets ) );
+		p += entry.numFacets * sizeof( *pf->facets );
+
+		collides[entry.surfaceNum] = pf;
+	}
+
+	FS_FreeFile( buf.v );
+	return qtrue;
+}
+
+/*
+===================
+CM_WritePatchCache
+===================
+*/
+void CM_WritePatchCache( const char *filename, unsigned checksum, int count,
+						struct patchCollide_s **collides ) {
+	patchCacheHeader_t	header;
+	patchCacheEntry_t	entry;
+	fileHandle_t		f;
+	int					i;
+
+	header.ident = PATCH_CACHE_IDENT;
+	header.version = PATCH_CACHE_VERSION;
+	header.checksum = checksum;
+	header.numSurfaces = count;
+	header.numPatches = 0;
+	header.planeSize = sizeof( patchPlane_t );
+	header.facetSize = sizeof( facet_t );
+	for ( i = 0 ; i < count ; i++ ) {
+		if ( collides[i] ) {
+			header.numPatches++;
+		}
+	}
+
+	f = FS_FOpenFileWrite( filename );
+	if ( !f ) {
+		Com_Printf( "WARNING: couldn't write %s\n", filename );
+		return;
+	}
+
+	FS_Write( &header, sizeof( header ), f );
+	for ( i = 0 ; i < count ; i++ ) {
+		if ( !collides[i] ) {
+			continue;
+		}
+		Com_Memset( &entry, 0, sizeof( entry ) );
+		entry.surfaceNum = i;
+		VectorCopy( collides[i]->bounds[0], entry.bounds[0] );
+		VectorCopy( collides[i]->bounds[1], entry.bounds[1] );
+		entry.numPlanes = collides[i]->numPlanes;
+		entry.numFacets = collides[i]->numFacets;
+		FS_Write( &entry, sizeof( entry ), f );
+		FS_Write( collides[i]->planes, entry.numPlanes * sizeof( patchPlane_t ), f );
+		FS_Write( collides[i]->facets, entry.numFacets * sizeof( facet_t ), f );
+	}
+	FS_FCloseFile( f );
+
+	Com_DPrintf( "wrote %i patches to %s\n", header.numPatches, filename );
 }
+#endif
 
 /*
 ================================================================================
@@ -1326,12 +1756,15 @@ void CM_TracePointThroughPatchCollide( traceWork_t *tw, const struct patchCollid
 		if ( j == facet->numBorders ) {
 			// we hit this facet
 #ifndef BSPC
-			if (!cv) {
-				cv = Cvar_Get( "r_debugSurfaceUpdate", "1", 0 );
-			}
-			if (cv->integer) {
-				debugPatchCollide = pc;
-				debugFacet = facet;
+			// the debug surface belongs to the main thread
+			if (!Com_ThreadIndex()) {
+				if (!cv) {
+					cv = Cvar_Get( "r_debugSurfaceUpdate", "1", 0 );
+				}
+				if (cv->integer) {
+					debugPatchCollide = pc;
+					debugFacet = facet;
+				}
 			}
 #endif //BSPC
 			planes = &pc->planes[facet->surfacePlane];
@@ -1513,12 +1946,15 @@ void CM_TraceThroughPatchCollide( traceWork_t *tw, const struct patchCollide_s *
 					enterFrac = 0;
 				}
 #ifndef BSPC
-				if (!cv) {
-					cv = Cvar_Get( "r_debugSurfaceUpdate", "1", 0 );
-				}
-				if (cv && cv->integer) {
-					debugPatchCollide = pc;
-					debugFacet = facet;
+				// the debug surface belongs to the main thread
+				if (!Com_ThreadIndex()) {
+					if (!cv) {
+						cv = Cvar_Get( "r_debugSurfaceUpdate", "1", 0 );
+					}
+					if (cv && cv->integer) {
+						debugPatchCollide = pc;
+						debugFacet = facet;
+					}
 				}
 #endif //BSPC
 
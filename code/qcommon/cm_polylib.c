@@ -26,13 +26,48 @@ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
 #include "cm_local.h"
 
 
-// counters are only bumped when running single threaded,
-// because they are an awful coherence problem
+// counters are only bumped for zone windings, which are main thread
+// only, because they are an awful coherence problem
 int	c_active_windings;
 int	c_peak_windings;
 int	c_winding_allocs;
 int	c_winding_points;
 
+static	Q_THREADLOCAL windingPool_t	*windingPool;
+
+/*
+=============
+SetWindingPool
+=============
+*/
+void SetWindingPool (windingPool_t *pool)
+{
+	if (pool)
+		Com_Memset (pool->used, 0, sizeof(pool->used));
+	windingPool = pool;
+}
+
+static void QDECL WindingError (int code, const char *fmt, ...) __attribute__ ((noreturn, format(printf, 2, 3)));
+
+/*
+=============
+WindingError
+=============
+*/
+static void QDECL WindingError (int code, const char *fmt, ...)
+{
+	va_list		argptr;
+	char		text[MAX_STRING_CHARS];
+
+	va_start (argptr, fmt);
+	Q_vsnprintf (text, sizeof(text), fmt, argptr);
+	va_end (argptr);
+
+	if (windingPool)
+		windingPool->error (code, "%s", text);
+	Com_Error (code, "%s", text);
+}
+
 void pw(winding_t *w)
 {
 	int		i;
@@ -49,7 +84,24 @@ AllocWinding
 winding_t	*AllocWinding (int points)
 {
 	winding_t	*w;
-	int			s;
+	int			s, i;
+
+	if (windingPool)
+	{
+		if (points > POOL_WINDING_POINTS)
+			WindingError (ERR_DROP, "AllocWinding: %i points", points);
+		for (i=0 ; i<MAX_POOL_WINDINGS ; i++)
+		{
+			if (!windingPool->used[i])
+			{
+				windingPool->used[i] = qtrue;
+				w = (winding_t *)&windingPool->windings[i];
+				Com_Memset (w, 0, sizeof(vec_t)*3*points + sizeof(int));
+				return w;
+			}
+		}
+		WindingError (ERR_DROP, "AllocWinding: pool exhausted");
+	}
 
 	c_winding_allocs++;
 	c_winding_points += points;
@@ -65,8 +117,19 @@ winding_t	*AllocWinding (int points)
 
 void FreeWinding (winding_t *w)
 {
+	int		i;
+
+	if (windingPool)
+	{
+		i = (poolWinding_t *)w - windingPool->windings;
+		if (i < 0 || i >= MAX_POOL_WINDINGS || !windingPool->used[i])
+			WindingError (ERR_FATAL, "FreeWinding: not an allocated winding");
+		windingPool->used[i] = qfalse;
+		return;
+	}
+
 	if (*(unsigned *)w == 0xdeaddead)
-		Com_Error (ERR_FATAL, "FreeWinding: freed a freed winding");
+		WindingError (ERR_FATAL, "FreeWinding: freed a freed winding");
 	*(unsigned *)w = 0xdeaddead;
 
 	c_active_windings--;
@@ -220,7 +283,7 @@ winding_t *BaseWindingForPlane (vec3_t normal, vec_t dist)
 		}
 	}
 	if (x==-1)
-		Com_Error (ERR_DROP, "BaseWindingForPlane: no axis found");
+		WindingError (ERR_DROP, "BaseWindingForPlane: no axis found");
 		
 	VectorCopy (vec3_origin, vup);	
 	switch (x)
@@ -407,9 +470,9 @@ void	ClipWindingEpsilon (winding_t *in, vec3_t normal, vec_t dist,
 	}
 	
 	if (f->numpoints > maxpts || b->numpoints > maxpts)
-		Com_Error (ERR_DROP, "ClipWinding: points exceeded estimate");
+		WindingError (ERR_DROP, "ClipWinding: points exceeded estimate");
 	if (f->numpoints > MAX_POINTS_ON_WINDING || b->numpoints > MAX_POINTS_ON_WINDING)
-		Com_Error (ERR_DROP, "ClipWinding: MAX_POINTS_ON_WINDING");
+		WindingError (ERR_DROP, "ClipWinding: MAX_POINTS_ON_WINDING");
 }
 
 
@@ -506,9 +569,9 @@ void ChopWindingInPlace (winding_t **inout, vec3_t normal, vec_t dist, vec_t eps
 	}
 	
 	if (f->numpoints > maxpts)
-		Com_Error (ERR_DROP, "ClipWinding: points exceeded estimate");
+		WindingError (ERR_DROP, "ClipWinding: points exceeded estimate");
 	if (f->numpoints > MAX_POINTS_ON_WINDING)
-		Com_Error (ERR_DROP, "ClipWinding: MAX_POINTS_ON_WINDING");
+		WindingError (ERR_DROP, "ClipWinding: MAX_POINTS_ON_WINDING");
 
 	FreeWinding (in);
 	*inout = f;
@@ -551,11 +614,11 @@ void CheckWinding (winding_t *w)
 	vec_t	facedist;
 
 	if (w->numpoints < 3)
-		Com_Error (ERR_DROP, "CheckWinding: %i points",w->numpoints);
+		WindingError (ERR_DROP, "CheckWinding: %i points",w->numpoints);
 	
 	area = WindingArea(w);
 	if (area < 1)
-		Com_Error (ERR_DROP, "CheckWinding: %f area", area);
+		WindingError (ERR_DROP, "CheckWinding: %f area", area);
 
 	WindingPlane (w, facenormal, &facedist);
 	
@@ -565,21 +628,21 @@ void CheckWinding (winding_t *w)
 
 		for (j=0 ; j<3 ; j++)
 			if (p1[j] > MAX_MAP_BOUNDS || p1[j] < -MAX_MAP_BOUNDS)
-				Com_Error (ERR_DROP, "CheckFace: BUGUS_RANGE: %f",p1[j]);
+				WindingError (ERR_DROP, "CheckFace: BUGUS_RANGE: %f",p1[j]);
 
 		j = i+1 == w->numpoints ? 0 : i+1;
 		
 	// check the point is on the face plane
 		d = DotProduct (p1, facenormal) - facedist;
 		if (d < -ON_EPSILON || d > ON_EPSILON)
-			Com_Error (ERR_DROP, "CheckWinding: point off plane");
+			WindingError (ERR_DROP, "CheckWinding: point off plane");
 	
 	// check the edge isnt degenerate
 		p2 = w->p[j];
 		VectorSubtract (p2, p1, dir);
 		
 		if (VectorLength (dir) < ON_EPSILON)
-			Com_Error (ERR_DROP, "CheckWinding: degenerate edge");
+			WindingError (ERR_DROP, "CheckWinding: degenerate edge");
 			
 		CrossProduct (facenormal, dir, edgenormal);
 		VectorNormalize2 (edgenormal, edgenormal);
@@ -593,7 +656,7 @@ void CheckWinding (winding_t *w)
 				continue;
 			d = DotProduct (w->p[j], edgenormal);
 			if (d > edgedist)
-				Com_Error (ERR_DROP, "CheckWinding: non-convex");
+				WindingError (ERR_DROP, "CheckWinding: non-convex");
 		}
 	}
 }
@@ -65,4 +65,25 @@ void	AddWindingToConvexHull( winding_t *w, winding_t **hull, vec3_t normal );
 void	ChopWindingInPlace (winding_t **w, vec3_t normal, vec_t dist, vec_t epsilon);
 // frees the original if clipped
 
+// windings come from the zone and errors go to Com_Error, which only the
+// main thread may use.  Other threads install a pool of their own first.
+#define	MAX_POOL_WINDINGS	16
+#define	POOL_WINDING_POINTS	(MAX_POINTS_ON_WINDING+4)	// clipping asks for 4 more than it has
+
+typedef struct
+{
+	int		numpoints;
+	vec3_t	p[POOL_WINDING_POINTS];
+} poolWinding_t;
+
+typedef struct
+{
+	poolWinding_t	windings[MAX_POOL_WINDINGS];
+	qboolean		used[MAX_POOL_WINDINGS];
+	void			(QDECL *error)( int code, const char *fmt, ... ) __attribute__ ((format(printf, 2, 3)));	// must not return
+} windingPool_t;
+
+void	SetWindingPool (windingPool_t *pool);
+// for the calling thread, NULL goes back to the zone
+
 void pw(winding_t *w);
@@ -45,9 +45,14 @@ void		CM_TransformedBoxTrace( trace_t *results, const vec3_t start, const vec3_t
 						  vec3_t mins, vec3_t maxs,
 						  clipHandle_t model, int brushmask,
 						  const vec3_t origin, const vec3_t angles, int capsule );
+void		CM_TraceBench_f( void );
 
 byte		*CM_ClusterPVS (int cluster);
 
+// visible cluster lists, only built when cm_clusterLists is set
+int			CM_ClusterVisRuns( int cluster, const int **runs );
+qboolean	CM_ClusterRangeVisible( int cluster, int first, int last );
+
 int			CM_PointLeafnum( const vec3_t p );
 
 // only returns non-solid leafs
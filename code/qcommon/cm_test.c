@@ -321,6 +321,67 @@ byte	*CM_ClusterPVS (int cluster) {
 	return cm.visibility + cluster * cm.clusterBytes;
 }
 
+/*
+===============
+CM_ClusterVisRuns
+
+Points runs at the ( first cluster, count ) pairs of clusters visible from
+cluster, in increasing order, and returns how many pairs there are.
+Returns 0 when cm_clusterLists was off at map load, callers must then
+use CM_ClusterPVS.
+===============
+*/
+int		CM_ClusterVisRuns( int cluster, const int **runs ) {
+	if ( !cm.clusterRunOfs ) {
+		*runs = NULL;
+		return 0;
+	}
+	if ( cluster < 0 || cluster >= cm.numClusters || !cm.vised ) {
+		cluster = 0;
+	}
+
+	*runs = cm.clusterRuns + cm.clusterRunOfs[cluster] * 2;
+	return cm.clusterRunOfs[cluster + 1] - cm.clusterRunOfs[cluster];
+}
+
+/*
+===============
+CM_ClusterRangeVisible
+
+Returns qtrue if any cluster from first to last is visible from cluster
+===============
+*/
+qboolean CM_ClusterRangeVisible( int cluster, int first, int last ) {
+	const int	*runs;
+	const byte	*vis;
+	int			lo, hi, mid, numRuns;
+
+	numRuns = CM_ClusterVisRuns( cluster, &runs );
+	if ( !runs ) {
+		vis = CM_ClusterPVS( cluster );
+		for ( ; first <= last ; first++ ) {
+			if ( vis[first >> 3] & ( 1 << ( first & 7 ) ) ) {
+				return qtrue;
+			}
+		}
+		return qfalse;
+	}
+
+	// find the first run that ends after first
+	lo = 0;
+	hi = numRuns;
+	while ( lo < hi ) {
+		mid = ( lo + hi ) >> 1;
+		if ( runs[mid * 2] + runs[mid * 2 + 1] <= first ) {
+			lo = mid + 1;
+		} else {
+			hi = mid;
+		}
+	}
+
+	return lo < numRuns && runs[lo * 2] <= last;
+}
+
 
 
 /*
@@ -28,6 +28,45 @@ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
 
 //#define CAPSULE_DEBUG
 
+#ifdef CM_SSE_BRUSHES
+#include <xmmintrin.h>
+
+static qboolean	cm_brushReference;	// test brush planes one at a time
+
+/*
+================
+CM_DotProduct4
+
+Four DotProducts at once, summed in the same order
+================
+*/
+static ID_INLINE __m128 CM_DotProduct4( const __m128 v[3], const __m128 n[3] ) {
+	return _mm_add_ps( _mm_add_ps( _mm_mul_ps( v[0], n[0] ), _mm_mul_ps( v[1], n[1] ) ), _mm_mul_ps( v[2], n[2] ) );
+}
+
+/*
+================
+CM_LoadBrushPlanes
+
+Loads a group of four brush planes and the distances they are pushed
+out by for the trace's box, the corner tw->offsets[ plane->signbits ]
+takes size[1] on the axes where the normal is negative
+================
+*/
+static ID_INLINE __m128 CM_LoadBrushPlanes( const float *p, const __m128 lo[3], const __m128 hi[3], __m128 n[3] ) {
+	__m128	neg, o[3];
+	int		k;
+
+	for ( k = 0 ; k < 3 ; k++ ) {
+		n[k] = _mm_loadu_ps( p + k * 4 );
+		neg = _mm_cmplt_ps( n[k], _mm_setzero_ps() );
+		o[k] = _mm_or_ps( _mm_and_ps( neg, hi[k] ), _mm_andnot_ps( neg, lo[k] ) );
+	}
+
+	return _mm_sub_ps( _mm_loadu_ps( p + 12 ), CM_DotProduct4( o, n ) );
+}
+#endif
+
 /*
 ===============================================================================
 
@@ -207,6 +246,35 @@ void CM_TestBoxInBrush( traceWork_t *tw, cbrush_t *brush ) {
 				return;
 			}
 		}
+#ifdef CM_SSE_BRUSHES
+	} else if ( brush->planes && !cm_brushReference ) {
+		__m128	lo[3], hi[3], s[3], n[3], dist;
+		int		k, out;
+
+		for ( k = 0 ; k < 3 ; k++ ) {
+			lo[k] = _mm_set1_ps( tw->size[0][k] );
+			hi[k] = _mm_set1_ps( tw->size[1][k] );
+			s[k] = _mm_set1_ps( tw->start[k] );
+		}
+
+		// the first six planes are the axial planes, so we only
+		// need to test the remainder, from the middle of the second group
+		for ( i = 4 ; i < brush->numsides ; i += 4 ) {
+			dist = CM_LoadBrushPlanes( brush->planes + i * 4, lo, hi, n );
+
+			// if completely in front of face, no intersection
+			out = _mm_movemask_ps( _mm_cmpgt_ps( _mm_sub_ps( CM_DotProduct4( s, n ), dist ), _mm_setzero_ps() ) );
+			if ( i == 4 ) {
+				out &= ~3;
+			}
+			if ( i + 4 > brush->numsides ) {
+				out &= ( 1 << ( brush->numsides - i ) ) - 1;
+			}
+			if ( out ) {
+				return;
+			}
+		}
+#endif
 	} else {
 		// the first six planes are the axial planes, so we only
 		// need to test the remainder
@@ -249,10 +317,10 @@ void CM_TestInLeaf( traceWork_t *tw, cLeaf_t *leaf ) {
 	for (k=0 ; k<leaf->numLeafBrushes ; k++) {
 		brushnum = cm.leafbrushes[leaf->firstLeafBrush+k];
 		b = &cm.brushes[brushnum];
-		if (b->checkcount == cm.checkcount) {
+		if (b->checkcount == tw->checkcount) {
 			continue;	// already checked this brush in another leaf
 		}
-		b->checkcount = cm.checkcount;
+		b->checkcount = tw->checkcount;
 
 		if ( !(b->contents & tw->contents)) {
 			continue;
@@ -275,10 +343,10 @@ void CM_TestInLeaf( traceWork_t *tw, cLeaf_t *leaf ) {
 			if ( !patch ) {
 				continue;
 			}
-			if ( patch->checkcount == cm.checkcount ) {
+			if ( patch->checkcount == tw->checkcount ) {
 				continue;	// already checked this brush in another leaf
 			}
-			patch->checkcount = cm.checkcount;
+			patch->checkcount = tw->checkcount;
 
 			if ( !(patch->contents & tw->contents)) {
 				continue;
@@ -428,12 +496,9 @@ void CM_PositionTest( traceWork_t *tw ) {
 	ll.lastLeaf = 0;
 	ll.overflowed = qfalse;
 
-	cm.checkcount++;
-
 	CM_BoxLeafnums_r( &ll, 0 );
 
-
-	cm.checkcount++;
+	tw->checkcount = Com_AtomicAdd( &cm.checkcount, 1 ) + 1;
 
 	// test the contents of the leafs
 	for (i=0 ; i < ll.count ; i++) {
@@ -574,6 +639,81 @@ void CM_TraceThroughBrush( traceWork_t *tw, cbrush_t *brush ) {
 				}
 			}
 		}
+#ifdef CM_SSE_BRUSHES
+	} else if ( brush->planes && !cm_brushReference ) {
+		__m128	lo[3], hi[3], s[3], e[3], n[3], dist, vd1, vd2, zero;
+		float	d1s[4], d2s[4];
+		int		j, k;
+
+		for ( k = 0 ; k < 3 ; k++ ) {
+			lo[k] = _mm_set1_ps( tw->size[0][k] );
+			hi[k] = _mm_set1_ps( tw->size[1][k] );
+			s[k] = _mm_set1_ps( tw->start[k] );
+			e[k] = _mm_set1_ps( tw->end[k] );
+		}
+		zero = _mm_setzero_ps();
+
+		//
+		// the same tests four planes at a time, a padded lane
+		// repeats the last plane so it can't change the result
+		//
+		for ( i = 0 ; i < brush->numsides ; i += 4 ) {
+			dist = CM_LoadBrushPlanes( brush->planes + i * 4, lo, hi, n );
+
+			vd1 = _mm_sub_ps( CM_DotProduct4( s, n ), dist );
+			vd2 = _mm_sub_ps( CM_DotProduct4( e, n ), dist );
+
+			// if completely in front of face, no intersection with the entire brush
+			if ( _mm_movemask_ps( _mm_and_ps( _mm_cmpgt_ps( vd1, zero ), _mm_or_ps(
+				_mm_cmpge_ps( vd2, _mm_set1_ps( SURFACE_CLIP_EPSILON ) ), _mm_cmpge_ps( vd2, vd1 ) ) ) ) ) {
+				return;
+			}
+
+			if ( _mm_movemask_ps( _mm_cmpgt_ps( vd2, zero ) ) ) {
+				getout = qtrue;	// endpoint is not in solid
+			}
+			if ( _mm_movemask_ps( _mm_cmpgt_ps( vd1, zero ) ) ) {
+				startout = qtrue;
+			}
+
+			_mm_storeu_ps( d1s, vd1 );
+			_mm_storeu_ps( d2s, vd2 );
+
+			for ( j = 0 ; j < 4 && i + j < brush->numsides ; j++ ) {
+				d1 = d1s[j];
+				d2 = d2s[j];
+
+				// if it doesn't cross the plane, the plane isn't relevent
+				if (d1 <= 0 && d2 <= 0 ) {
+					continue;
+				}
+
+				side = brush->sides + i + j;
+				plane = side->plane;
+
+				// crosses face
+				if (d1 > d2) {	// enter
+					f = (d1-SURFACE_CLIP_EPSILON) / (d1-d2);
+					if ( f < 0 ) {
+						f = 0;
+					}
+					if (f > enterFrac) {
+						enterFrac = f;
+						clipplane = plane;
+						leadside = side;
+					}
+				} else {	// leave
+					f = (d1+SURFACE_CLIP_EPSILON) / (d1-d2);
+					if ( f > 1 ) {
+						f = 1;
+					}
+					if (f < leaveFrac) {
+						leaveFrac = f;
+					}
+				}
+			}
+		}
+#endif
 	} else {
 		//
 		// compare the trace against all planes of the brush
@@ -677,10 +817,10 @@ void CM_TraceThroughLeaf( traceWork_t *tw, cLeaf_t *leaf ) {
 		brushnum = cm.leafbrushes[leaf->firstLeafBrush+k];
 
 		b = &cm.brushes[brushnum];
-		if ( b->checkcount == cm.checkcount ) {
+		if ( b->checkcount == tw->checkcount ) {
 			continue;	// already checked this brush in another leaf
 		}
-		b->checkcount = cm.checkcount;
+		b->checkcount = tw->checkcount;
 
 		if ( !(b->contents & tw->contents) ) {
 			continue;
@@ -708,10 +848,10 @@ void CM_TraceThroughLeaf( traceWork_t *tw, cLeaf_t *leaf ) {
 			if ( !patch ) {
 				continue;
 			}
-			if ( patch->checkcount == cm.checkcount ) {
+			if ( patch->checkcount == tw->checkcount ) {
 				continue;	// already checked this patch in another leaf
 			}
-			patch->checkcount = cm.checkcount;
+			patch->checkcount = tw->checkcount;
 
 			if ( !(patch->contents & tw->contents) ) {
 				continue;
@@ -1139,6 +1279,62 @@ void CM_TraceThroughTree( traceWork_t *tw, int num, float p1f, float p2f, vec3_t
 
 //======================================================================
 
+#define	DEFAULT_TRACE_RECORDS	16384
+#define	MAX_TRACE_RECORDS		( 1 << 20 )
+#define	TRACEBENCH_PASSES		10
+
+typedef struct {
+	vec3_t		start, end;
+	vec3_t		mins, maxs;
+	vec3_t		origin;
+	clipHandle_t	model;
+	int			brushmask;
+	int			capsule;
+	qboolean	useSphere;
+	sphere_t	sphere;
+} traceRecord_t;
+
+static traceRecord_t	*traceRecords;
+static int				numTraceRecords;
+static int				maxTraceRecords;
+static qboolean			traceRecording;
+static char				traceRecordMap[MAX_QPATH];
+
+/*
+==================
+CM_RecordTrace
+
+Box and capsule models are rebuilt for every trace, so only
+traces against the world and inline models are kept
+==================
+*/
+static void CM_RecordTrace( const vec3_t start, const vec3_t end, const vec3_t mins, const vec3_t maxs,
+						  clipHandle_t model, const vec3_t origin, int brushmask, int capsule, const sphere_t *sphere ) {
+	traceRecord_t	*r;
+
+	if ( model < 0 || model >= cm.numSubModels ) {
+		return;
+	}
+
+	r = &traceRecords[numTraceRecords++];
+	VectorCopy( start, r->start );
+	VectorCopy( end, r->end );
+	VectorCopy( mins ? mins : vec3_origin, r->mins );
+	VectorCopy( maxs ? maxs : vec3_origin, r->maxs );
+	VectorCopy( origin, r->origin );
+	r->model = model;
+	r->brushmask = brushmask;
+	r->capsule = capsule;
+	r->useSphere = sphere != NULL;
+	if ( sphere ) {
+		r->sphere = *sphere;
+	}
+
+	if ( numTraceRecords == maxTraceRecords ) {
+		traceRecording = qfalse;
+		Com_Printf( "tracebench: recorded %i traces\n", numTraceRecords );
+	}
+}
 
 /*
 ==================
@@ -1152,14 +1348,19 @@ void CM_Trace( trace_t *results, const vec3_t start, const vec3_t end, vec3_t mi
 	vec3_t		offset;
 	cmodel_t	*cmod;
 
-	cmod = CM_ClipHandleToModel( model );
+	if ( traceRecording && !Com_ThreadIndex() ) {
+		CM_RecordTrace( start, end, mins, maxs, model, origin, brushmask, capsule, sphere );
+	}
 
-	cm.checkcount++;		// for multi-check avoidance
+	cmod = CM_ClipHandleToModel( model );
 
 	c_traces++;				// for statistics, may be zeroed
 
 	// fill in a default trace
 	Com_Memset( &tw, 0, sizeof(tw) );
+
+	// for multi-check avoidance, unique even across threads
+	tw.checkcount = Com_AtomicAdd( &cm.checkcount, 1 ) + 1;
 	tw.trace.fraction = 1;	// assume it goes the entire distance until shown otherwise
 	VectorCopy(origin, tw.modelOrigin);
 
@@ -1468,3 +1669,130 @@ void CM_TransformedBoxTrace( trace_t *results, const vec3_t start, const vec3_t
 
 	*results = trace;
 }
+
+
+/*
+==================
+CM_TracesEqual
+
+Bit for bit, so a float that only differs in rounding shows up
+==================
+*/
+static qboolean CM_TracesEqual( const trace_t *a, const trace_t *b ) {
+	if ( a->allsolid != b->allsolid || a->startsolid != b->startsolid
+		|| a->surfaceFlags != b->surfaceFlags || a->contents != b->contents
+		|| a->entityNum != b->entityNum
+		|| a->plane.type != b->plane.type || a->plane.signbits != b->plane.signbits ) {
+		return qfalse;
+	}
+	if ( memcmp( &a->fraction, &b->fraction, sizeof( a->fraction ) )
+		|| memcmp( a->endpos, b->endpos, sizeof( a->endpos ) )
+		|| memcmp( a->plane.normal, b->plane.normal, sizeof( a->plane.normal ) )
+		|| memcmp( &a->plane.dist, &b->plane.dist, sizeof( a->plane.dist ) ) ) {
+		return qfalse;
+	}
+	return qtrue;
+}
+
+/*
+==================
+CM_TraceBench_f
+
+tracebench record [count]
+tracebench [passes]
+
+Replays the recorded traces with the brush planes tested one at a
+time and four at a time, and checks that every result is identical
+==================
+*/
+void CM_TraceBench_f( void ) {
+	traceRecord_t	*r;
+	trace_t			*results;
+	int				i, pass, passes, msec;
+#ifdef CM_SSE_BRUSHES
+	trace_t			trace;
+	int				mismatches;
+#endif
+
+	if ( Cmd_Argc() > 1 && !Q_stricmp( Cmd_Argv( 1 ), "record" ) ) {
+		if ( !cm.numNodes ) {
+			Com_Printf( "No map loaded.\n" );
+			return;
+		}
+		traceRecording = qfalse;
+		free( traceRecords );
+		numTraceRecords = 0;
+		maxTraceRecords = Cmd_Argc() > 2 ? atoi( Cmd_Argv( 2 ) ) : DEFAULT_TRACE_RECORDS;
+		if ( maxTraceRecords < 1 ) {
+			maxTraceRecords = DEFAULT_TRACE_RECORDS;
+		}
+		maxTraceRecords = MIN( maxTraceRecords, MAX_TRACE_RECORDS );
+		// outside the zone, a long recording would use up most of it
+		traceRecords = malloc( maxTraceRecords * sizeof( *traceRecords ) );
+		if ( !traceRecords ) {
+			Com_Printf( "tracebench: couldn't allocate %i traces\n", maxTraceRecords );
+			return;
+		}
+		traceRecording = qtrue;
+		Q_strncpyz( traceRecordMap, cm.name, sizeof( traceRecordMap ) );
+		Com_Printf( "tracebench: recording %i traces\n", maxTraceRecords );
+		return;
+	}
+
+	traceRecording = qfalse;
+	if ( !numTraceRecords ) {
+		Com_Printf( "tracebench: nothing recorded, use \"tracebench record [count]\" first\n" );
+		return;
+	}
+	if ( !cm.numNodes || Q_stricmp( traceRecordMap, cm.name ) ) {
+		Com_Printf( "tracebench: traces were recorded on %s\n", traceRecordMap );
+		return;
+	}
+
+	passes = Cmd_Argc() > 1 ? atoi( Cmd_Argv( 1 ) ) : TRACEBENCH_PASSES;
+	if ( passes < 1 ) {
+		passes = 1;
+	}
+
+	results = malloc( numTraceRecords * sizeof( *results ) );
+	if ( !results ) {
+		Com_Printf( "tracebench: out of memory\n" );
+		return;
+	}
+
+#ifdef CM_SSE_BRUSHES
+	cm_brushReference = qtrue;
+#endif
+	msec = Sys_Milliseconds();
+	for ( pass = 0 ; pass < passes ; pass++ ) {
+		for ( i = 0, r = traceRecords ; i < numTraceRecords ; i++, r++ ) {
+			CM_Trace( &results[i], r->start, r->end, r->mins, r->maxs, r->model, r->origin,
+				r->brushmask, r->capsule, r->useSphere ? &r->sphere : NULL );
+		}
+	}
+	msec = Sys_Milliseconds() - msec;
+	Com_Printf( "%i traces, %i passes\n", numTraceRecords, passes );
+	Com_Printf( "one plane at a time:   %5i msec, %8.0f traces/sec\n", msec,
+		numTraceRecords * (float)passes * 1000 / ( msec ? msec : 1 ) );
+
+#ifdef CM_SSE_BRUSHES
+	cm_brushReference = qfalse;
+	mismatches = 0;
+	msec = Sys_Milliseconds();
+	for ( pass = 0 ; pass < passes ; pass++ ) {
+		for ( i = 0, r = traceRecords ; i < numTraceRecords ; i++, r++ ) {
+			CM_Trace( &trace, r->start, r->end, r->mins, r->maxs, r->model, r->origin,
+				r->brushmask, r->capsule, r->useSphere ? &r->sphere : NULL );
+			if ( !pass && !CM_TracesEqual( &trace, &results[i] ) ) {
+				mismatches++;
+			}
+		}
+	}
+	msec = Sys_Milliseconds() - msec;
+	Com_Printf( "four planes at a time: %5i msec, %8.0f traces/sec\n", msec,
+		numTraceRecords * (float)passes * 1000 / ( msec ? msec : 1 ) );
+	Com_Printf( "%i traces differ\n", mismatches );
+#endif
+
+	free( results );
+}
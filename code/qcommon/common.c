@@ -742,12 +742,24 @@ The rover can be left pointing at a non-empty block
 
 The zone calls are pretty much only used for small strings and structures,
 all big things are allocated on the hunk.
+
+Allocations up to SLAB_MAX_SIZE bytes don't search the block list. They
+take a slot of the next size class up from a slab, a zone block carved
+into equal slots, so the churn of strings and small structures doesn't
+fragment the zone. Slots keep a memblock_t header with SLABID and a
+pointer to their slab, and Z_Free hands them back to it.
 ==============================================================================
 */
 
 #define	ZONEID	0x1d4a11
+#define	SLABID	0x1d4a12
 #define MINFRAGMENT	64
 
+#define	SLAB_SIZE			8192
+#define	SMALL_SLAB_SIZE		2048	// the small zone is only 512k
+#define	SLAB_MAX_SIZE		256		// larger allocations are zone blocks
+#define	NUM_SLAB_CLASSES	( SLAB_MAX_SIZE / 16 )	// one every 16 bytes
+
 typedef struct zonedebug_s {
 	char *label;
 	char *file;
@@ -765,11 +777,35 @@ typedef struct memblock_s {
 #endif
 } memblock_t;
 
-typedef struct {
+typedef struct slab_s {
+	struct slabClass_s	*cls;
+	struct slab_s		*next, *prev;	// in the partial or full list of the class
+	memblock_t			*free;			// free slots, linked through prev
+	int					used;
+} slab_t;
+
+typedef struct slabClass_s {
+	struct memzone_s	*zone;
+	int			slotSize;		// including the header and trash tester
+	int			slotsPerSlab;
+	slab_t		*partial;		// slabs with free slots
+	slab_t		*full;
+	int			numSlabs;
+	int			numEmpty;		// one empty slab is kept, the others are freed
+
+	int			allocs, frees;
+	int			inUse, peak;
+} slabClass_t;
+
+typedef struct memzone_s {
 	int		size;			// total bytes malloced, including header
 	int		used;			// total bytes used
 	memblock_t	blocklist;	// start / end cap for linked list
 	memblock_t	*rover;
+
+	qboolean	useSlabs;
+	int			slabSize;
+	slabClass_t	slabs[NUM_SLAB_CLASSES];
 } memzone_t;
 
 // main zone for all "dynamic" memory allocation
@@ -780,6 +816,14 @@ memzone_t	*smallzone;
 
 void Z_CheckHeap( void );
 
+#define	Z_SlabClassSize( cls )		( ( (cls) + 1 ) * 16 )
+#define	Z_SlabClassForSize( size )	( (size) ? ( (size) - 1 ) >> 4 : 0 )
+
+static void Z_TraceAlloc( void *ptr, int size, int tag );
+static void Z_TraceFree( void *ptr );
+static qboolean	zoneTracing;
+static qboolean	zoneBenching;	// zonebench replays into scratch zones that may run out
+
 /*
 ========================
 Z_ClearZone
@@ -787,6 +831,8 @@ Z_ClearZone
 */
 void Z_ClearZone( memzone_t *zone, int size ) {
 	memblock_t	*block;
+	slabClass_t	*cls;
+	int			i;
 	
 	// set the entire zone to one free block
 
@@ -803,6 +849,15 @@ void Z_ClearZone( memzone_t *zone, int size ) {
 	block->tag = 0;			// free block
 	block->id = ZONEID;
 	block->size = size - sizeof(memzone_t);
+
+	zone->slabSize = size < SLAB_SIZE * 256 ? SMALL_SLAB_SIZE : SLAB_SIZE;
+	Com_Memset( zone->slabs, 0, sizeof( zone->slabs ) );
+	for ( i = 0 ; i < NUM_SLAB_CLASSES ; i++ ) {
+		cls = &zone->slabs[i];
+		cls->zone = zone;
+		cls->slotSize = PAD( sizeof( memblock_t ) + Z_SlabClassSize( i ) + 4, sizeof( intptr_t ) );
+		cls->slotsPerSlab = ( zone->slabSize - PAD( sizeof( slab_t ), sizeof( intptr_t ) ) ) / cls->slotSize;
+	}
 }
 
 /*
@@ -823,13 +878,329 @@ int Z_AvailableMemory( void ) {
 	return Z_AvailableZoneMemory( mainzone );
 }
 
+/*
+========================
+Z_FreeBlock
+========================
+*/
+static void Z_FreeBlock( memzone_t *zone, memblock_t *block ) {
+	memblock_t	*other;
+
+	zone->used -= block->size;
+	// set the block to something that should cause problems
+	// if it is referenced...
+	Com_Memset( block + 1, 0xaa, block->size - sizeof( *block ) );
+
+	block->tag = 0;		// mark as free
+	
+	other = block->prev;
+	if (!other->tag) {
+		// merge with previous free block
+		other->size += block->size;
+		other->next = block->next;
+		other->next->prev = other;
+		if (block == zone->rover) {
+			zone->rover = other;
+		}
+		block = other;
+	}
+
+	zone->rover = block;
+
+	other = block->next;
+	if ( !other->tag ) {
+		// merge the next free block onto the end
+		block->size += other->size;
+		block->next = other->next;
+		block->next->prev = block;
+	}
+}
+
+/*
+========================
+Z_ZoneAlloc
+
+First fit from the block list, NULL if nothing is big enough
+========================
+*/
+static memblock_t *Z_ZoneAlloc( memzone_t *zone, int size, int tag ) {
+	int			extra;
+	memblock_t	*start, *rover, *new, *base;
+
+	//
+	// scan through the block list looking for the first free block
+	// of sufficient size
+	//
+	size += sizeof(memblock_t);	// account for size of block header
+	size += 4;					// space for memory trash tester
+	size = PAD(size, sizeof(intptr_t));		// align to 32/64 bit boundary
+	
+	base = rover = zone->rover;
+	start = base->prev;
+	
+	do {
+		if (rover == start)	{
+			// scaned all the way around the list
+			return NULL;
+		}
+		if (rover->tag) {
+			base = rover = rover->next;
+		} else {
+			rover = rover->next;
+		}
+	} while (base->tag || base->size < size);
+	
+	//
+	// found a block big enough
+	//
+	extra = base->size - size;
+	if (extra > MINFRAGMENT) {
+		// there will be a free fragment after the allocated block
+		new = (memblock_t *) ((byte *)base + size );
+		new->size = extra;
+		new->tag = 0;			// free block
+		new->prev = base;
+		new->id = ZONEID;
+		new->next = base->next;
+		new->next->prev = new;
+		base->next = new;
+		base->size = size;
+	}
+	
+	base->tag = tag;			// no longer a free block
+	
+	zone->rover = base->next;	// next allocation will start looking here
+	zone->used += base->size;	//
+	
+	base->id = ZONEID;
+
+	// marker for memory trash testing
+	*(int *)((byte *)base + base->size - 4) = ZONEID;
+
+	return base;
+}
+
+/*
+========================
+Z_UnlinkSlab
+========================
+*/
+static void Z_UnlinkSlab( slab_t **list, slab_t *slab ) {
+	if ( slab->prev ) {
+		slab->prev->next = slab->next;
+	} else {
+		*list = slab->next;
+	}
+	if ( slab->next ) {
+		slab->next->prev = slab->prev;
+	}
+}
+
+/*
+========================
+Z_LinkSlab
+========================
+*/
+static void Z_LinkSlab( slab_t **list, slab_t *slab ) {
+	slab->prev = NULL;
+	slab->next = *list;
+	if ( *list ) {
+		(*list)->prev = slab;
+	}
+	*list = slab;
+}
+
+/*
+========================
+Z_NewSlab
+
+NULL if the zone has no room left for another slab
+========================
+*/
+static slab_t *Z_NewSlab( slabClass_t *cls ) {
+	memblock_t	*chunk, *slot;
+	slab_t		*slab;
+	byte		*slots;
+	int			i;
+
+	chunk = Z_ZoneAlloc( cls->zone, cls->zone->slabSize, TAG_SLAB );
+	if ( !chunk ) {
+		return NULL;
+	}
+#ifdef ZONE_DEBUG
+	chunk->d.label = "slab";
+	chunk->d.file = __FILE__;
+	chunk->d.line = __LINE__;
+	chunk->d.allocSize = cls->zone->slabSize;
+#endif
+
+	slab = (slab_t *)( chunk + 1 );
+	slab->cls = cls;
+	slab->used = 0;
+	slab->free = NULL;
+
+	slots = (byte *)slab + PAD( sizeof( slab_t ), sizeof( intptr_t ) );
+	for ( i = cls->slotsPerSlab - 1 ; i >= 0 ; i-- ) {
+		slot = (memblock_t *)( slots + i * cls->slotSize );
+		slot->size = cls->slotSize;
+		slot->tag = 0;
+		slot->id = SLABID;
+		slot->next = (memblock_t *)slab;	// the owner, not a list
+		slot->prev = slab->free;
+		slab->free = slot;
+		*(int *)( (byte *)slot + slot->size - 4 ) = ZONEID;
+	}
+
+	Z_LinkSlab( &cls->partial, slab );
+	cls->numSlabs++;
+	cls->numEmpty++;
+
+	return slab;
+}
+
+/*
+========================
+Z_SlabAlloc
+========================
+*/
+static memblock_t *Z_SlabAlloc( memzone_t *zone, int size, int tag ) {
+	slabClass_t	*cls;
+	slab_t		*slab;
+	memblock_t	*slot;
+
+	cls = &zone->slabs[Z_SlabClassForSize( size )];
+
+	slab = cls->partial;
+	if ( !slab ) {
+		slab = Z_NewSlab( cls );
+		if ( !slab ) {
+			return NULL;
+		}
+	}
+	if ( !slab->used ) {
+		cls->numEmpty--;
+	}
+
+	slot = slab->free;
+	slab->free = slot->prev;
+	slab->used++;
+	if ( !slab->free ) {
+		Z_UnlinkSlab( &cls->partial, slab );
+		Z_LinkSlab( &cls->full, slab );
+	}
+
+	slot->tag = tag;
+	slot->prev = NULL;
+
+	cls->allocs++;
+	if ( ++cls->inUse > cls->peak ) {
+		cls->peak = cls->inUse;
+	}
+
+	return slot;
+}
+
+/*
+========================
+Z_SlabFree
+
+Returns qtrue when the slab itself was freed
+========================
+*/
+static qboolean Z_SlabFree( memblock_t *slot ) {
+	slab_t		*slab = (slab_t *)slot->next;
+	slabClass_t	*cls = slab->cls;
+
+	// set the slot to something that should cause problems
+	// if it is referenced...
+	Com_Memset( slot + 1, 0xaa, slot->size - sizeof( *slot ) - 4 );
+
+	slot->tag = 0;
+	slot->prev = slab->free;
+	slab->free = slot;
+
+	if ( slab->used-- == cls->slotsPerSlab ) {
+		Z_UnlinkSlab( &cls->full, slab );
+		Z_LinkSlab( &cls->partial, slab );
+	}
+
+	cls->frees++;
+	cls->inUse--;
+
+	if ( slab->used ) {
+		return qfalse;
+	}
+	if ( !cls->numEmpty ) {
+		cls->numEmpty++;
+		return qfalse;
+	}
+
+	Z_UnlinkSlab( &cls->partial, slab );
+	cls->numSlabs--;
+	Z_FreeBlock( cls->zone, (memblock_t *)slab - 1 );
+	return qtrue;
+}
+
+/*
+========================
+Z_SlabTagBytes
+
+Bytes of the slots in use with tag in the slab carved out of chunk
+========================
+*/
+static int Z_SlabTagBytes( memblock_t *chunk, int tag ) {
+	slab_t		*slab = (slab_t *)( chunk + 1 );
+	memblock_t	*slot;
+	byte		*slots;
+	int			i, bytes;
+
+	bytes = 0;
+	slots = (byte *)slab + PAD( sizeof( slab_t ), sizeof( intptr_t ) );
+	for ( i = 0 ; i < slab->cls->slotsPerSlab ; i++ ) {
+		slot = (memblock_t *)( slots + i * slab->cls->slotSize );
+		if ( slot->tag == tag ) {
+			bytes += slot->size;
+		}
+	}
+	return bytes;
+}
+
+/*
+========================
+Z_FreeSlabTags
+========================
+*/
+static void Z_FreeSlabTags( memzone_t *zone, int tag ) {
+	slabClass_t	*cls;
+	slab_t		*slab, *next;
+	memblock_t	*slot;
+	byte		*slots;
+	int			i, j, list;
+
+	for ( i = 0 ; i < NUM_SLAB_CLASSES ; i++ ) {
+		cls = &zone->slabs[i];
+		for ( list = 0 ; list < 2 ; list++ ) {
+			for ( slab = list ? cls->partial : cls->full ; slab ; slab = next ) {
+				next = slab->next;
+				slots = (byte *)slab + PAD( sizeof( slab_t ), sizeof( intptr_t ) );
+				for ( j = 0 ; j < cls->slotsPerSlab ; j++ ) {
+					slot = (memblock_t *)( slots + j * cls->slotSize );
+					if ( slot->tag == tag && Z_SlabFree( slot ) ) {
+						break;
+					}
+				}
+			}
+		}
+	}
+}
+
 /*
 ========================
 Z_Free
 ========================
 */
 void Z_Free( void *ptr ) {
-	memblock_t	*block, *other;
+	memblock_t	*block;
 	memzone_t *zone;
 	
 	if (!ptr) {
@@ -837,6 +1208,19 @@ void Z_Free( void *ptr ) {
 	}
 
 	block = (memblock_t *) ( (byte *)ptr - sizeof(memblock_t));
+	if (block->id == SLABID) {
+		if (block->tag == 0) {
+			Com_Error( ERR_FATAL, "Z_Free: freed a freed pointer" );
+		}
+		if ( *(int *)((byte *)block + block->size - 4 ) != ZONEID ) {
+			Com_Error( ERR_FATAL, "Z_Free: memory block wrote past end" );
+		}
+		if ( zoneTracing ) {
+			Z_TraceFree( ptr );
+		}
+		Z_SlabFree( block );
+		return;
+	}
 	if (block->id != ZONEID) {
 		Com_Error( ERR_FATAL, "Z_Free: freed a pointer without ZONEID" );
 	}
@@ -860,34 +1244,10 @@ void Z_Free( void *ptr ) {
 		zone = mainzone;
 	}
 
-	zone->used -= block->size;
-	// set the block to something that should cause problems
-	// if it is referenced...
-	Com_Memset( ptr, 0xaa, block->size - sizeof( *block ) );
-
-	block->tag = 0;		// mark as free
-	
-	other = block->prev;
-	if (!other->tag) {
-		// merge with previous free block
-		other->size += block->size;
-		other->next = block->next;
-		other->next->prev = other;
-		if (block == zone->rover) {
-			zone->rover = other;
-		}
-		block = other;
-	}
-
-	zone->rover = block;
-
-	other = block->next;
-	if ( !other->tag ) {
-		// merge the next free block onto the end
-		block->size += other->size;
-		block->next = other->next;
-		block->next->prev = block;
+	if ( zoneTracing ) {
+		Z_TraceFree( ptr );
 	}
+	Z_FreeBlock( zone, block );
 }
 
 
@@ -906,6 +1266,8 @@ void Z_FreeTags( int tag ) {
 	else {
 		zone = mainzone;
 	}
+	Z_FreeSlabTags( zone, tag );
+
 	count = 0;
 	// use the rover as our pointer, because
 	// Z_Free automatically adjusts it
@@ -928,12 +1290,10 @@ Z_TagMalloc
 */
 #ifdef ZONE_DEBUG
 void *Z_TagMallocDebug( int size, int tag, char *label, char *file, int line ) {
-	int		allocSize;
 #else
 void *Z_TagMalloc( int size, int tag ) {
 #endif
-	int		extra;
-	memblock_t	*start, *rover, *new, *base;
+	memblock_t	*base;
 	memzone_t *zone;
 
 	if (!tag) {
@@ -947,74 +1307,41 @@ void *Z_TagMalloc( int size, int tag ) {
 		zone = mainzone;
 	}
 
+	base = NULL;
+	if ( zone->useSlabs && size <= SLAB_MAX_SIZE ) {
+		base = Z_SlabAlloc( zone, size, tag );
+	}
+	if ( !base ) {
+		// a full zone can still have a gap too small for a whole slab
+		base = Z_ZoneAlloc( zone, size, tag );
+	}
+
+	if ( !base ) {
+		if ( zoneBenching ) {
+			return NULL;
+		}
 #ifdef ZONE_DEBUG
-	allocSize = size;
-#endif
-	//
-	// scan through the block list looking for the first free block
-	// of sufficient size
-	//
-	size += sizeof(memblock_t);	// account for size of block header
-	size += 4;					// space for memory trash tester
-	size = PAD(size, sizeof(intptr_t));		// align to 32/64 bit boundary
-	
-	base = rover = zone->rover;
-	start = base->prev;
-	
-	do {
-		if (rover == start)	{
-			// scaned all the way around the list
-#ifdef ZONE_DEBUG
-			Z_LogHeap();
+		Z_LogHeap();
 
-			Com_Error(ERR_FATAL, "Z_Malloc: failed on allocation of %i bytes from the %s zone: %s, line: %d (%s)",
-								size, zone == smallzone ? "small" : "main", file, line, label);
+		Com_Error(ERR_FATAL, "Z_Malloc: failed on allocation of %i bytes from the %s zone: %s, line: %d (%s)",
+							size, zone == smallzone ? "small" : "main", file, line, label);
 #else
-			Com_Error(ERR_FATAL, "Z_Malloc: failed on allocation of %i bytes from the %s zone",
-								size, zone == smallzone ? "small" : "main");
+		Com_Error(ERR_FATAL, "Z_Malloc: failed on allocation of %i bytes from the %s zone",
+							size, zone == smallzone ? "small" : "main");
 #endif
-			return NULL;
-		}
-		if (rover->tag) {
-			base = rover = rover->next;
-		} else {
-			rover = rover->next;
-		}
-	} while (base->tag || base->size < size);
-	
-	//
-	// found a block big enough
-	//
-	extra = base->size - size;
-	if (extra > MINFRAGMENT) {
-		// there will be a free fragment after the allocated block
-		new = (memblock_t *) ((byte *)base + size );
-		new->size = extra;
-		new->tag = 0;			// free block
-		new->prev = base;
-		new->id = ZONEID;
-		new->next = base->next;
-		new->next->prev = new;
-		base->next = new;
-		base->size = size;
+		return NULL;
 	}
-	
-	base->tag = tag;			// no longer a free block
-	
-	zone->rover = base->next;	// next allocation will start looking here
-	zone->used += base->size;	//
-	
-	base->id = ZONEID;
 
 #ifdef ZONE_DEBUG
 	base->d.label = label;
 	base->d.file = file;
 	base->d.line = line;
-	base->d.allocSize = allocSize;
+	base->d.allocSize = size;
 #endif
 
-	// marker for memory trash testing
-	*(int *)((byte *)base + base->size - 4) = ZONEID;
+	if ( zoneTracing ) {
+		Z_TraceAlloc( base + 1, size, tag );
+	}
 
 	return (void *) ((byte *)base + sizeof(memblock_t));
 }
@@ -1085,10 +1412,15 @@ void Z_LogZoneHeap( memzone_t *zone, char *name ) {
 #ifdef ZONE_DEBUG
 	char dump[32], *ptr;
 	int  i, j;
+	slab_t		*slab;
+	byte		*slots;
+	int			list;
 #endif
 	memblock_t	*block;
+	slabClass_t	*cls;
 	char		buf[4096];
 	int size, allocSize, numBlocks;
+	int			c;
 
 	if (!logfile || !FS_Initialized())
 		return;
@@ -1130,6 +1462,30 @@ void Z_LogZoneHeap( memzone_t *zone, char *name ) {
 	FS_Write(buf, strlen(buf), logfile);
 	Com_sprintf(buf, sizeof(buf), "%d %s memory overhead\r\n", size - allocSize, name);
 	FS_Write(buf, strlen(buf), logfile);
+
+	for (c = 0; c < NUM_SLAB_CLASSES; c++) {
+		cls = &zone->slabs[c];
+		if (!cls->numSlabs && !cls->allocs) {
+			continue;
+		}
+#ifdef ZONE_DEBUG
+		for (list = 0; list < 2; list++) {
+			for (slab = list ? cls->partial : cls->full; slab; slab = slab->next) {
+				slots = (byte *)slab + PAD( sizeof( slab_t ), sizeof( intptr_t ) );
+				for (j = 0; j < cls->slotsPerSlab; j++) {
+					block = (memblock_t *)( slots + j * cls->slotSize );
+					if (block->tag) {
+						Com_sprintf(buf, sizeof(buf), "size = %8d: %s, line: %d (%s) [slab %d]\r\n", block->d.allocSize, block->d.file, block->d.line, block->d.label, Z_SlabClassSize( c ));
+						FS_Write(buf, strlen(buf), logfile);
+					}
+				}
+			}
+		}
+#endif
+		Com_sprintf(buf, sizeof(buf), "slab %3d: %6d in use, %6d peak, %4d slabs, %d allocs, %d frees\r\n",
+			Z_SlabClassSize( c ), cls->inUse, cls->peak, cls->numSlabs, cls->allocs, cls->frees);
+		FS_Write(buf, strlen(buf), logfile);
+	}
 }
 
 /*
@@ -1286,6 +1642,10 @@ void Com_Meminfo_f( void ) {
 				botlibBytes += block->size;
 			} else if ( block->tag == TAG_RENDERER ) {
 				rendererBytes += block->size;
+			} else if ( block->tag == TAG_SLAB ) {
+				// the slab is one block, its slots have the real tags
+				botlibBytes += Z_SlabTagBytes( block, TAG_BOTLIB );
+				rendererBytes += Z_SlabTagBytes( block, TAG_RENDERER );
 			}
 		}
 
@@ -1437,6 +1797,313 @@ void Com_InitZoneMemory( void ) {
 	}
 	Z_ClearZone( mainzone, s_zoneTotal );
 
+	// small allocations come from slabs unless com_zoneSlabs is 0
+	cv = Cvar_Get( "com_zoneSlabs", "1", CVAR_LATCH | CVAR_ARCHIVE );
+	mainzone->useSlabs = smallzone->useSlabs = ( cv->integer != 0 );
+}
+
+/*
+==============================================================================
+
+ZONE TRACES
+
+"zonetrace start" records every zone allocation and free until
+"zonetrace stop", and "zonetrace save <file>" writes them out.
+"zonebench <file> [runs]" replays a saved trace into empty zones the
+size of the real ones, once first fit only and once with the slabs,
+and prints the times and how fragmented the main zone ended up.
+
+==============================================================================
+*/
+
+#define	ZONE_TRACE_IDENT	(('C'<<24)+('R'<<16)+('T'<<8)+'Z')
+#define	ZONE_TRACE_VERSION	1
+#define	MAX_ZONE_TRACE		( 1 << 21 )
+#define	ZONE_TRACE_HASH		( 1 << 21 )		// power of 2
+#define	ZONE_TRACE_DELETED	( (void *)-1 )
+
+typedef struct {
+	int		ident;
+	int		version;
+	int		numEntries;
+	int		numAllocs;
+} zoneTraceHeader_t;
+
+typedef struct {
+	int		size;		// -1 for a free
+	int		tag;
+	int		id;			// the allocation, counted from 0
+} zoneTraceEntry_t;
+
+static zoneTraceEntry_t	*zoneTrace;
+static int				zoneTraceCount, zoneTraceAllocs;
+static void				**zoneTracePtrs;	// live allocations, open addressed
+static int				*zoneTraceIds;
+static int				zoneTraceSlotsUsed;
+
+/*
+========================
+Z_TraceSlot
+========================
+*/
+static int Z_TraceSlot( void *ptr, qboolean insert ) {
+	int		i;
+
+	i = ( (intptr_t)ptr >> 4 ) * 0x9e3779b1 & ( ZONE_TRACE_HASH - 1 );
+	while ( zoneTracePtrs[i] ) {
+		if ( zoneTracePtrs[i] == ptr || ( insert && zoneTracePtrs[i] == ZONE_TRACE_DELETED ) ) {
+			return i;
+		}
+		i = ( i + 1 ) & ( ZONE_TRACE_HASH - 1 );
+	}
+	return insert ? i : -1;
+}
+
+/*
+========================
+Z_TraceFull
+========================
+*/
+static qboolean Z_TraceFull( void ) {
+	if ( zoneTraceCount < MAX_ZONE_TRACE && zoneTraceSlotsUsed < ZONE_TRACE_HASH / 4 * 3 ) {
+		return qfalse;
+	}
+	zoneTracing = qfalse;
+	return qtrue;
+}
+
+/*
+========================
+Z_TraceAlloc
+========================
+*/
+static void Z_TraceAlloc( void *ptr, int size, int tag ) {
+	int		i;
+
+	if ( Z_TraceFull() ) {
+		return;
+	}
+
+	i = Z_TraceSlot( ptr, qtrue );
+	if ( !zoneTracePtrs[i] ) {
+		zoneTraceSlotsUsed++;
+	}
+	zoneTracePtrs[i] = ptr;
+	zoneTraceIds[i] = zoneTraceAllocs;
+
+	zoneTrace[zoneTraceCount].size = size;
+	zoneTrace[zoneTraceCount].tag = tag;
+	zoneTrace[zoneTraceCount].id = zoneTraceAllocs++;
+	zoneTraceCount++;
+}
+
+/*
+========================
+Z_TraceFree
+========================
+*/
+static void Z_TraceFree( void *ptr ) {
+	int		i;
+
+	if ( Z_TraceFull() ) {
+		return;
+	}
+
+	// allocated before the trace started
+	i = Z_TraceSlot( ptr, qfalse );
+	if ( i < 0 ) {
+		return;
+	}
+	zoneTracePtrs[i] = ZONE_TRACE_DELETED;
+
+	zoneTrace[zoneTraceCount].size = -1;
+	zoneTrace[zoneTraceCount].tag = 0;
+	zoneTrace[zoneTraceCount].id = zoneTraceIds[i];
+	zoneTraceCount++;
+}
+
+/*
+========================
+Z_Trace_f
+
+zonetrace <start|stop|save file>
+========================
+*/
+static void Z_Trace_f( void ) {
+	zoneTraceHeader_t	header;
+	fileHandle_t		f;
+	const char			*cmd;
+
+	cmd = Cmd_Argv( 1 );
+	if ( !Q_stricmp( cmd, "start" ) ) {
+		if ( !zoneTrace ) {
+			zoneTrace = malloc( MAX_ZONE_TRACE * sizeof( *zoneTrace ) );
+			zoneTracePtrs = malloc( ZONE_TRACE_HASH * sizeof( *zoneTracePtrs ) );
+			zoneTraceIds = malloc( ZONE_TRACE_HASH * sizeof( *zoneTraceIds ) );
+			if ( !zoneTrace || !zoneTracePtrs || !zoneTraceIds ) {
+				Com_Error( ERR_FATAL, "Z_Trace_f: couldn't allocate the trace" );
+			}
+		}
+		Com_Memset( zoneTracePtrs, 0, ZONE_TRACE_HASH * sizeof( *zoneTracePtrs ) );
+		zoneTraceCount = zoneTraceAllocs = zoneTraceSlotsUsed = 0;
+		zoneTracing = qtrue;
+	} else if ( !Q_stricmp( cmd, "stop" ) ) {
+		zoneTracing = qfalse;
+	} else if ( !Q_stricmp( cmd, "save" ) && Cmd_Argc() == 3 ) {
+		zoneTracing = qfalse;
+		if ( !zoneTrace ) {
+			Com_Printf( "Nothing recorded\n" );
+			return;
+		}
+		f = FS_FOpenFileWrite( Cmd_Argv( 2 ) );
+		if ( !f ) {
+			Com_Printf( "Couldn't write %s\n", Cmd_Argv( 2 ) );
+			return;
+		}
+		header.ident = ZONE_TRACE_IDENT;
+		header.version = ZONE_TRACE_VERSION;
+		header.numEntries = zoneTraceCount;
+		header.numAllocs = zoneTraceAllocs;
+		FS_Write( &header, sizeof( header ), f );
+		FS_Write( zoneTrace, zoneTraceCount * sizeof( *zoneTrace ), f );
+		FS_FCloseFile( f );
+	} else {
+		Com_Printf( "usage: zonetrace <start|stop|save file>\n" );
+		return;
+	}
+
+	Com_Printf( "zone trace: %i entries, %i allocations%s\n", zoneTraceCount, zoneTraceAllocs,
+		zoneTracing ? ", recording" : "" );
+}
+
+/*
+========================
+Z_Bench_f
+
+zonebench <file> [runs]
+========================
+*/
+static void Z_Bench_f( void ) {
+	const zoneTraceHeader_t	*header;
+	const zoneTraceEntry_t	*entries, *e;
+	memzone_t	*saveMain, *saveSmall, *benchMain, *benchSmall;
+	memblock_t	*block;
+	void		*buffer, **ptrs;
+	int64_t		start, usec;
+	long		len;
+	int			i, run, runs, slabs, freeBlocks, largest, failed;
+
+	if ( Cmd_Argc() < 2 ) {
+		Com_Printf( "usage: zonebench <file> [runs]\n" );
+		return;
+	}
+	runs = Cmd_Argc() > 2 ? atoi( Cmd_Argv( 2 ) ) : 10;
+	zoneTracing = qfalse;
+	if ( runs < 1 ) {
+		runs = 1;
+	}
+
+	len = FS_ReadFile( Cmd_Argv( 1 ), &buffer );
+	if ( !buffer ) {
+		Com_Printf( "Couldn't read %s\n", Cmd_Argv( 1 ) );
+		return;
+	}
+
+	// check everything, the replay can't fail half way
+	header = buffer;
+	entries = (const zoneTraceEntry_t *)( header + 1 );
+	if ( len < sizeof( *header ) || header->ident != ZONE_TRACE_IDENT || header->version != ZONE_TRACE_VERSION
+		|| header->numEntries < 0 || header->numAllocs < 0 || header->numAllocs > header->numEntries
+		|| len != sizeof( *header ) + header->numEntries * sizeof( *entries ) ) {
+		Com_Printf( "%s is not a zone trace\n", Cmd_Argv( 1 ) );
+		FS_FreeFile( buffer );
+		return;
+	}
+	for ( i = 0 ; i < header->numEntries ; i++ ) {
+		e = &entries[i];
+		if ( e->id < 0 || e->id >= header->numAllocs || e->size < -1 || e->size > s_zoneTotal / 2
+			|| ( e->size >= 0 && ( e->tag <= TAG_FREE || e->tag > TAG_SMALL ) ) ) {
+			Com_Printf( "%s is damaged at entry %i\n", Cmd_Argv( 1 ), i );
+			FS_FreeFile( buffer );
+			return;
+		}
+	}
+
+	benchMain = calloc( s_zoneTotal, 1 );
+	benchSmall = calloc( s_smallZoneTotal, 1 );
+	ptrs = calloc( header->numAllocs + 1, sizeof( *ptrs ) );
+	if ( !benchMain || !benchSmall || !ptrs ) {
+		Com_Printf( "Couldn't allocate the bench zones\n" );
+		free( benchMain );
+		free( benchSmall );
+		free( ptrs );
+		FS_FreeFile( buffer );
+		return;
+	}
+
+	Com_Printf( "%i allocations and %i frees, %i runs\n", header->numAllocs,
+		header->numEntries - header->numAllocs, runs );
+
+	failed = -1;
+	for ( slabs = 0 ; slabs < 2 ; slabs++ ) {
+		usec = 0;
+		freeBlocks = largest = 0;
+		for ( run = 0 ; run < runs && failed < 0 ; run++ ) {
+			Z_ClearZone( benchMain, s_zoneTotal );
+			Z_ClearZone( benchSmall, s_smallZoneTotal );
+			benchMain->useSlabs = benchSmall->useSlabs = slabs;
+			Com_Memset( ptrs, 0, header->numAllocs * sizeof( *ptrs ) );
+
+			// nothing else may allocate while the zones are swapped
+			saveMain = mainzone;
+			saveSmall = smallzone;
+			mainzone = benchMain;
+			smallzone = benchSmall;
+			zoneBenching = qtrue;
+
+			start = Sys_Microseconds();
+			for ( i = 0, e = entries ; i < header->numEntries ; i++, e++ ) {
+				if ( e->size >= 0 ) {
+					ptrs[e->id] = Z_TagMalloc( e->size, e->tag );
+					if ( !ptrs[e->id] ) {
+						// fragmentation can need more than the trace's peak
+						failed = i;
+						break;
+					}
+				} else if ( ptrs[e->id] ) {
+					Z_Free( ptrs[e->id] );
+					ptrs[e->id] = NULL;
+				}
+			}
+			usec += Sys_Microseconds() - start;
+
+			zoneBenching = qfalse;
+			mainzone = saveMain;
+			smallzone = saveSmall;
+		}
+		if ( failed >= 0 ) {
+			Com_Printf( "%s ran out of zone memory at entry %i\n",
+				slabs ? "slabs" : "first fit", failed );
+			break;
+		}
+
+		for ( block = benchMain->blocklist.next ; block != &benchMain->blocklist ; block = block->next ) {
+			if ( !block->tag ) {
+				freeBlocks++;
+				if ( block->size > largest ) {
+					largest = block->size;
+				}
+			}
+		}
+
+		Com_Printf( "%-10s %8.3f msec per run, main zone %i bytes used, %i free blocks, largest %i\n",
+			slabs ? "slabs" : "first fit", usec / 1000.0 / runs, benchMain->used, freeBlocks, largest );
+	}
+
+	free( benchMain );
+	free( benchSmall );
+	free( ptrs );
+	FS_FreeFile( buffer );
 }
 
 /*
@@ -1565,6 +2232,8 @@ void Com_InitHunkMemory( void ) {
 	Hunk_Clear();
 
 	Cmd_AddCommand( "meminfo", Com_Meminfo_f );
+	Cmd_AddCommand( "zonetrace", Z_Trace_f );
+	Cmd_AddCommand( "zonebench", Z_Bench_f );
 #ifdef ZONE_DEBUG
 	Cmd_AddCommand( "zonelog", Z_LogHeap );
 #endif
@@ -2697,6 +3366,10 @@ void Com_Init( char *commandLine ) {
 	}
 	Cmd_AddCommand ("quit", Com_Quit_f);
 	Cmd_AddCommand ("changeVectors", MSG_ReportChangeVectors_f );
+	Cmd_AddCommand ("huffbench", MSG_HuffBench_f );
+	Cmd_AddCommand ("msgfuzz", MSG_Fuzz_f );
+	Cmd_AddCommand ("msgbench", MSG_Bench_f );
+	Cmd_AddCommand ("tracebench", CM_TraceBench_f );
 	Cmd_AddCommand ("writeconfig", Com_WriteConfig_f );
 	Cmd_SetCommandCompletionFunc( "writeconfig", Cmd_CompleteCfgName );
 	Cmd_AddCommand("game_restart", Com_GameRestart_f);
@@ -2788,6 +3461,8 @@ void Com_Init( char *commandLine ) {
 	Com_RandomBytes( (byte*)&qport, sizeof(int) );
 	Netchan_Init( qport & 0xffff );
 
+	Com_InitThreads();
+
 	VM_Init();
 	SV_Init();
 
@@ -3204,6 +3879,8 @@ void Com_Frame( void ) {
 
 	NET_FlushPacketQueue();
 
+	VM_ProfileFrame();
+
 	//
 	// report timing information
 	//
@@ -3219,7 +3896,14 @@ void Com_Frame( void ) {
 
 		Com_Printf ("frame:%i all:%3i sv:%3i ev:%3i cl:%3i gm:%3i rf:%3i bk:%3i\n", 
 					 com_frameNumber, all, sv, ev, cl, time_game, time_frontend, time_backend );
+
+		if ( c_visCacheHits + c_visCacheMisses ) {
+			Com_Printf ("vis cache: %i hits %i misses (%i%%)\n", c_visCacheHits, c_visCacheMisses,
+						100 * c_visCacheHits / ( c_visCacheHits + c_visCacheMisses ) );
+		}
 	}	
+	c_visCacheHits = 0;
+	c_visCacheMisses = 0;
 
 	//
 	// trace optimization tracking
@@ -3237,6 +3921,8 @@ void Com_Frame( void ) {
 		c_pointcontents = 0;
 	}
 
+	NET_ShowSyscalls();
+
 	Com_ReadFromPipe( );
 
 	com_frameNumber++;
@@ -3263,6 +3949,7 @@ void Com_Shutdown (void) {
 		FS_HomeRemove( com_pipefile->string );
 	}
 
+	Com_ShutdownThreads();
 }
 
 /*
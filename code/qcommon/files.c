@@ -211,6 +211,9 @@ typedef struct fileInPack_s {
 	char					*name;		// name of the file
 	unsigned long			pos;		// file info position in zip
 	unsigned long			len;		// uncompress file size
+	unsigned long			dataPos;	// file data position in the mapped pak, 0 until looked up
+	unsigned long			dataLen;	// compressed file size
+	int						method;		// compression method, -1 if minizip has to read it
 	struct	fileInPack_s*	next;		// next file in the hash
 } fileInPack_t;
 
@@ -219,7 +222,14 @@ typedef struct {
 	char			pakFilename[MAX_OSPATH];	// c:\quake3\baseq3\pak0.pk3
 	char			pakBasename[MAX_OSPATH];	// pak0
 	char			pakGamename[MAX_OSPATH];	// baseq3
-	unzFile			handle;						// handle to zip file
+	unzFile			handle;						// handle to zip file, opened when first needed
+	byte			*mapBase;					// whole pak mapped read only, NULL if it isn't
+	int				mapLength;
+	qboolean		mapTried;
+	int64_t			fileSize;					// for the pak index
+	int64_t			fileTime;
+	int				*headerLongs;				// checksum feed and file crcs
+	int				numHeaderLongs;
 	int				checksum;					// regular checksum
 	int				pure_checksum;				// checksum for pure
 	int				numfiles;					// number of files in pk3
@@ -240,10 +250,13 @@ typedef struct searchpath_s {
 
 	pack_t		*pack;		// only one of pack / dir will be non NULL
 	directory_t	*dir;
+
+	int			rank;		// position in the search order, for the file lookup
 } searchpath_t;
 
 static	char		fs_gamedir[MAX_OSPATH];	// this will be a single file name with no separators
 static	cvar_t		*fs_debug;
+static	cvar_t		*fs_mmap;
 static	cvar_t		*fs_homepath;
 
 #ifdef MACOS_X
@@ -282,6 +295,17 @@ typedef struct {
 	qboolean	zipFile;
 	qboolean	streamed;
 	char		name[MAX_ZPATH];
+
+	// files in mapped paks are read without minizip
+	const byte	*zipData;			// file data in the mapped pak, NULL when minizip reads it
+	int			zipDataLen;			// compressed length
+	int			zipMethod;
+	int			zipOffset;			// uncompressed read position
+	z_stream	*zipStream;			// inflate state for deflated files
+	z_stream	*zipSeekPoints;		// inflate states saved every PK3_SEEK_SPAN bytes
+	int			zipNumSeekPoints;
+	qboolean	prefetched;			// zipData is a prefetched copy, freed on close
+	qboolean	inUse;				// set for handles reading zipData, they have no FILE or unzFile
 } fileHandleData_t;
 
 static fileHandleData_t	fsh[MAX_FILE_HANDLES];
@@ -391,7 +415,7 @@ static fileHandle_t	FS_HandleForFile(void) {
 	int		i;
 
 	for ( i = 1 ; i < MAX_FILE_HANDLES ; i++ ) {
-		if ( fsh[i].handleFiles.file.o == NULL ) {
+		if ( fsh[i].handleFiles.file.o == NULL && !fsh[i].inUse ) {
 			return i;
 		}
 	}
@@ -653,6 +677,396 @@ qboolean FS_SV_FileExists( const char *file )
 }
 
 
+/*
+==========================================================================
+
+FILE LOOKUP
+
+Every file of every search path goes into one hash table when the
+filesystem starts, paks and directories alike, so finding a file only
+looks at the paks that have it instead of walking all search paths.
+The files of a name are kept in search order, and opening still goes
+through FS_FOpenFileReadDir, so the pure rules are unchanged.
+
+Directories are still tried on disk, in their place in the search
+order, whether the table lists the name or not: files can be copied in
+while the game runs, and a map dropped into the home path has to load
+just like it shows up in dir. A name that isn't anywhere therefore
+costs one failed open per directory search path, not one per pak.
+Files written through the filesystem are added as they are created. A
+directory too big for Sys_ListFiles is left out, and names in it are
+looked up the old way.
+
+==========================================================================
+*/
+
+#define	MAX_LOOKUP_PARTIAL	64
+#define	MAX_LOOKUP_DEPTH	16
+#define	LOOKUP_NAMES_BLOCK	65536
+
+typedef struct {
+	const char		*name;
+	searchpath_t	*search;
+	int				next;			// next file in the hash, later in search order
+} fileLookup_t;
+
+typedef struct lookupNames_s {
+	struct lookupNames_s	*next;
+	int						used;
+	char					data[LOOKUP_NAMES_BLOCK];
+} lookupNames_t;
+
+static	cvar_t			*fs_lookupTable;
+static	fileLookup_t	*fs_lookup;
+static	int				fs_numLookup, fs_maxLookup;
+static	int				*fs_lookupHash;		// NULL when lookups walk the search paths
+static	int				fs_lookupHashSize;
+static	lookupNames_t	*fs_lookupNames;
+static	const char		*fs_lookupPartial[MAX_LOOKUP_PARTIAL];	// directories left out
+static	int				fs_numLookupPartial;
+static	searchpath_t	**fs_lookupDirs;	// the directory search paths, in search order
+static	int				fs_numLookupDirs;
+
+/*
+================
+FS_LookupCopyName
+================
+*/
+static const char *FS_LookupCopyName( const char *name ) {
+	lookupNames_t	*block;
+	int				len;
+
+	len = strlen( name ) + 1;
+	block = fs_lookupNames;
+	if ( !block || block->used + len > LOOKUP_NAMES_BLOCK ) {
+		block = Z_Malloc( sizeof( *block ) );
+		block->next = fs_lookupNames;
+		fs_lookupNames = block;
+	}
+	Com_Memcpy( block->data + block->used, name, len );
+	block->used += len;
+
+	return block->data + block->used - len;
+}
+
+/*
+================
+FS_LookupAlloc
+================
+*/
+static fileLookup_t *FS_LookupAlloc( void ) {
+	fileLookup_t	*grown;
+
+	if ( fs_numLookup == fs_maxLookup ) {
+		fs_maxLookup = fs_maxLookup ? fs_maxLookup * 2 : 4096;
+		grown = Z_Malloc( fs_maxLookup * sizeof( *grown ) );
+		if ( fs_lookup ) {
+			Com_Memcpy( grown, fs_lookup, fs_numLookup * sizeof( *grown ) );
+			Z_Free( fs_lookup );
+		}
+		fs_lookup = grown;
+	}
+	return &fs_lookup[fs_numLookup++];
+}
+
+/*
+================
+FS_LookupAddPartial
+================
+*/
+static void FS_LookupAddPartial( const char *prefix ) {
+	if ( fs_numLookupPartial == MAX_LOOKUP_PARTIAL ) {
+		// too many, everything under the root is looked up the old way
+		prefix = "";
+		fs_numLookupPartial = 0;
+	}
+	fs_lookupPartial[fs_numLookupPartial++] = FS_LookupCopyName( prefix );
+}
+
+/*
+================
+FS_LookupIsPartial
+================
+*/
+static qboolean FS_LookupIsPartial( const char *filename ) {
+	const char	*p, *f;
+	int			i, c1, c2;
+
+	for ( i = 0 ; i < fs_numLookupPartial ; i++ ) {
+		for ( p = fs_lookupPartial[i], f = filename ; *p ; p++, f++ ) {
+			c1 = tolower( *p );
+			c2 = tolower( *f );
+			if ( c2 == '\\' ) {
+				c2 = '/';
+			}
+			if ( c1 != c2 ) {
+				break;
+			}
+		}
+		if ( !*p ) {
+			return qtrue;
+		}
+	}
+	return qfalse;
+}
+
+/*
+================
+FS_LookupScanDir
+
+Adds the files of a directory search path, prefix is the qpath of
+the directory being listed
+================
+*/
+static void FS_LookupScanDir( searchpath_t *search, const char *ospath, const char *prefix, int depth ) {
+	char	**list;
+	char	path[MAX_OSPATH], name[MAX_ZPATH];
+	int		i, count;
+	fileLookup_t	*l;
+
+	list = Sys_ListFiles( ospath, NULL, NULL, &count, qfalse );
+	if ( count >= 0x1000 - 1 ) {
+		FS_LookupAddPartial( prefix );
+	}
+	for ( i = 0 ; i < count ; i++ ) {
+		if ( strlen( prefix ) + strlen( list[i] ) >= sizeof( name ) ) {
+			continue;	// too long to be opened anyway
+		}
+		Com_sprintf( name, sizeof( name ), "%s%s", prefix, list[i] );
+		l = FS_LookupAlloc();
+		l->name = FS_LookupCopyName( name );
+		l->search = search;
+	}
+	Sys_FreeFileList( list );
+
+	list = Sys_ListFiles( ospath, "/", NULL, &count, qfalse );
+	for ( i = 0 ; i < count ; i++ ) {
+		if ( !strcmp( list[i], "." ) || !strcmp( list[i], ".." ) ) {
+			continue;
+		}
+		if ( strlen( prefix ) + strlen( list[i] ) + 1 >= sizeof( name ) ) {
+			continue;
+		}
+		Com_sprintf( name, sizeof( name ), "%s%s/", prefix, list[i] );
+		if ( depth == MAX_LOOKUP_DEPTH ) {
+			FS_LookupAddPartial( name );
+			continue;
+		}
+		Com_sprintf( path, sizeof( path ), "%s%c%s", ospath, PATH_SEP, list[i] );
+		FS_LookupScanDir( search, path, name, depth + 1 );
+	}
+	Sys_FreeFileList( list );
+}
+
+/*
+================
+FS_LookupLink
+
+Puts every file in its hash chain, in search order.  A counting sort
+on the search path rank, so it stays linear however many paks there are
+================
+*/
+static void FS_LookupLink( void ) {
+	searchpath_t	*search;
+	int				i, hash, rank, numRanks, *counts, *order, *tails;
+
+	numRanks = 0;
+	for ( search = fs_searchpaths ; search ; search = search->next ) {
+		search->rank = numRanks++;
+	}
+
+	if ( fs_lookupDirs ) {
+		Z_Free( fs_lookupDirs );
+	}
+	fs_lookupDirs = Z_Malloc( numRanks * sizeof( *fs_lookupDirs ) + 1 );
+	fs_numLookupDirs = 0;
+	for ( search = fs_searchpaths ; search ; search = search->next ) {
+		if ( search->dir ) {
+			fs_lookupDirs[fs_numLookupDirs++] = search;
+		}
+	}
+
+	if ( fs_lookupHash ) {
+		Z_Free( fs_lookupHash );
+	}
+	for ( fs_lookupHashSize = 1 ; fs_lookupHashSize < fs_numLookup && fs_lookupHashSize < ( 1 << 20 ) ; fs_lookupHashSize <<= 1 ) {
+	}
+	fs_lookupHash = Z_Malloc( fs_lookupHashSize * sizeof( int ) );
+	for ( i = 0 ; i < fs_lookupHashSize ; i++ ) {
+		fs_lookupHash[i] = -1;
+	}
+
+	counts = Hunk_AllocateTempMemory( ( numRanks + 1 ) * sizeof( int ) );
+	order = Hunk_AllocateTempMemory( ( fs_numLookup + 1 ) * sizeof( int ) );
+	tails = Hunk_AllocateTempMemory( fs_lookupHashSize * sizeof( int ) );
+	Com_Memset( counts, 0, ( numRanks + 1 ) * sizeof( int ) );
+
+	for ( i = 0 ; i < fs_numLookup ; i++ ) {
+		counts[fs_lookup[i].search->rank + 1]++;
+	}
+	for ( rank = 1 ; rank <= numRanks ; rank++ ) {
+		counts[rank] += counts[rank - 1];
+	}
+	for ( i = 0 ; i < fs_numLookup ; i++ ) {
+		order[counts[fs_lookup[i].search->rank]++] = i;
+	}
+
+	for ( i = 0 ; i < fs_numLookup ; i++ ) {
+		fs_lookup[order[i]].next = -1;
+		hash = FS_HashFileName( fs_lookup[order[i]].name, fs_lookupHashSize );
+		if ( fs_lookupHash[hash] == -1 ) {
+			fs_lookupHash[hash] = order[i];
+		} else {
+			fs_lookup[tails[hash]].next = order[i];
+		}
+		tails[hash] = order[i];
+	}
+
+	Hunk_FreeTempMemory( tails );
+	Hunk_FreeTempMemory( order );
+	Hunk_FreeTempMemory( counts );
+}
+
+/*
+================
+FS_FreeLookup
+================
+*/
+static void FS_FreeLookup( void ) {
+	lookupNames_t	*block, *next;
+
+	for ( block = fs_lookupNames ; block ; block = next ) {
+		next = block->next;
+		Z_Free( block );
+	}
+	if ( fs_lookup ) {
+		Z_Free( fs_lookup );
+	}
+	if ( fs_lookupHash ) {
+		Z_Free( fs_lookupHash );
+	}
+	if ( fs_lookupDirs ) {
+		Z_Free( fs_lookupDirs );
+	}
+
+	fs_lookup = NULL;
+	fs_numLookup = fs_maxLookup = 0;
+	fs_lookupHash = NULL;
+	fs_lookupHashSize = 0;
+	fs_lookupNames = NULL;
+	fs_numLookupPartial = 0;
+	fs_lookupDirs = NULL;
+	fs_numLookupDirs = 0;
+}
+
+/*
+================
+FS_BuildLookup
+================
+*/
+static void FS_BuildLookup( void ) {
+	searchpath_t	*search;
+	fileLookup_t	*l;
+	char			*ospath;
+	int				i;
+
+	FS_FreeLookup();
+	if ( !fs_lookupTable->integer ) {
+		return;
+	}
+
+	for ( search = fs_searchpaths ; search ; search = search->next ) {
+		if ( search->pack ) {
+			for ( i = 0 ; i < search->pack->numfiles ; i++ ) {
+				l = FS_LookupAlloc();
+				l->name = search->pack->buildBuffer[i].name;
+				l->search = search;
+			}
+		} else {
+			ospath = FS_BuildOSPath( search->dir->path, search->dir->gamedir, "" );
+			ospath[strlen( ospath ) - 1] = '\0';
+			FS_LookupScanDir( search, ospath, "", 0 );
+		}
+	}
+
+	FS_LookupLink();
+}
+
+/*
+================
+FS_LookupAddFile
+
+A file was created in game under the home path
+================
+*/
+static void FS_LookupAddFile( const char *game, const char *filename ) {
+	searchpath_t	*search;
+	fileLookup_t	*l;
+	int				i, prev, hash;
+
+	if ( !fs_lookupHash ) {
+		return;
+	}
+
+	for ( search = fs_searchpaths ; search ; search = search->next ) {
+		if ( search->dir && !strcmp( search->dir->path, fs_homepath->string ) && !Q_stricmp( search->dir->gamedir, game ) ) {
+			break;
+		}
+	}
+	if ( !search ) {
+		return;
+	}
+
+	if ( filename[0] == '/' || filename[0] == '\\' ) {
+		filename++;
+	}
+	if ( strlen( filename ) >= MAX_ZPATH ) {
+		return;
+	}
+
+	// find where it goes in search order
+	hash = FS_HashFileName( filename, fs_lookupHashSize );
+	prev = -1;
+	for ( i = fs_lookupHash[hash] ; i != -1 ; prev = i, i = fs_lookup[i].next ) {
+		if ( fs_lookup[i].search == search && !FS_FilenameCompare( fs_lookup[i].name, filename ) ) {
+			return;
+		}
+		if ( fs_lookup[i].search->rank > search->rank ) {
+			break;
+		}
+	}
+
+	l = FS_LookupAlloc();
+	l->name = FS_LookupCopyName( filename );
+	l->search = search;
+	l->next = i;
+	if ( prev == -1 ) {
+		fs_lookupHash[hash] = l - fs_lookup;
+	} else {
+		fs_lookup[prev].next = l - fs_lookup;
+	}
+}
+
+/*
+================
+FS_LookupAddHomeFile
+
+Same for a path under the home path that starts with the game directory
+================
+*/
+static void FS_LookupAddHomeFile( const char *path ) {
+	char	game[MAX_OSPATH];
+	int		i;
+
+	for ( i = 0 ; path[i] && path[i] != '/' && path[i] != '\\' ; i++ ) {
+	}
+	if ( !path[i] || i >= sizeof( game ) ) {
+		return;
+	}
+	Q_strncpyz( game, path, i + 1 );
+	FS_LookupAddFile( game, path + i + 1 );
+}
+
 /*
 ===========
 FS_SV_FOpenFileWrite
@@ -691,6 +1105,8 @@ fileHandle_t FS_SV_FOpenFileWrite( const char *filename ) {
 	fsh[f].handleSync = qfalse;
 	if (!fsh[f].handleFiles.file.o) {
 		f = 0;
+	} else {
+		FS_LookupAddHomeFile( filename );
 	}
 	return f;
 }
@@ -808,7 +1224,9 @@ void FS_SV_Rename( const char *from, const char *to, qboolean safe ) {
 		FS_CheckFilenameIsMutable( to_ospath, __func__ );
 	}
 
-	rename(from_ospath, to_ospath);
+	if ( !rename(from_ospath, to_ospath) ) {
+		FS_LookupAddHomeFile( to );
+	}
 }
 
 
@@ -838,81 +1256,451 @@ void FS_Rename( const char *from, const char *to ) {
 
 	FS_CheckFilenameIsMutable( to_ospath, __func__ );
 
-	rename(from_ospath, to_ospath);
+	if ( !rename(from_ospath, to_ospath) ) {
+		FS_LookupAddFile( fs_gamedir, to );
+	}
 }
 
 /*
-==============
-FS_FCloseFile
+==========================================================================
 
-If the FILE pointer is an open pak file, leave it open.
+MAPPED PAK FILES
 
-For some reason, other dll's can't just cal fclose()
-on files returned by FS_FOpenFile...
-==============
+Paks are mapped once, when the first file is read from them, and files
+in them are read straight from the mapping instead of through minizip. Stored files are
+plain copies, deflated ones are inflated into the caller's buffer, and
+seeking in them restarts from the closest inflate state saved on the way.
+
+==========================================================================
 */
-void FS_FCloseFile( fileHandle_t f ) {
-	if ( !fs_searchpaths ) {
-		Com_Error( ERR_FATAL, "Filesystem call made without initialization" );
-	}
 
-	if (fsh[f].zipFile == qtrue) {
-		unzCloseCurrentFile( fsh[f].handleFiles.file.z );
-		if ( fsh[f].handleFiles.unique ) {
-			unzClose( fsh[f].handleFiles.file.z );
-		}
-		Com_Memset( &fsh[f], 0, sizeof( fsh[f] ) );
-		return;
-	}
+#define ZIP_CENTRAL_SIZE	46
+#define ZIP_LOCAL_SIZE		30
+#define ZIP_STORED			0
 
-	// we didn't find it as a pak, so close it as a unique file
-	if (fsh[f].handleFiles.file.o) {
-		fclose (fsh[f].handleFiles.file.o);
-	}
-	Com_Memset( &fsh[f], 0, sizeof( fsh[f] ) );
+#define PK3_SEEK_SPAN		( 512 * 1024 )
+#define PK3_SEEK_BUFFER_SIZE 65536
+
+static ID_INLINE int FS_ZipShort( const byte *p ) {
+	return p[0] | ( p[1] << 8 );
+}
+
+static ID_INLINE unsigned long FS_ZipLong( const byte *p ) {
+	return p[0] | ( p[1] << 8 ) | ( p[2] << 16 ) | ( (unsigned long)p[3] << 24 );
 }
 
 /*
-===========
-FS_FOpenFileWrite
+=================
+FS_PakUnchanged
 
-===========
+The file table and checksums of a pak are read when it is loaded, but
+its mapping, and for paks from the index its minizip handle, are only
+opened on the first read. Checked right after opening them, so a pak
+replaced on disk in between is caught rather than read with the old
+table.
+=================
 */
-fileHandle_t FS_FOpenFileWrite( const char *filename ) {
-	char			*ospath;
-	fileHandle_t	f;
+static qboolean FS_PakUnchanged( pack_t *pak ) {
+	int64_t		fileSize, fileTime;
 
-	if ( !fs_searchpaths ) {
-		Com_Error( ERR_FATAL, "Filesystem call made without initialization" );
+	if ( pak->fileSize < 0 || !Sys_FileStat( pak->pakFilename, &fileSize, &fileTime ) ) {
+		return qfalse;
 	}
+	return fileSize == pak->fileSize && fileTime == pak->fileTime;
+}
 
-	f = FS_HandleForFile();
-	fsh[f].zipFile = qfalse;
-
-	ospath = FS_BuildOSPath( fs_homepath->string, fs_gamedir, filename );
+/*
+=================
+FS_PakHandle
 
-	if ( fs_debug->integer ) {
-		Com_Printf( "FS_FOpenFileWrite: %s\n", ospath );
+Paks from the index don't open a minizip handle until one is needed
+=================
+*/
+static unzFile FS_PakHandle( pack_t *pak ) {
+	if ( !pak->handle ) {
+		pak->handle = unzOpen( pak->pakFilename );
+		if ( !pak->handle ) {
+			Com_Error( ERR_FATAL, "Couldn't open %s", pak->pakFilename );
+		}
+		if ( !FS_PakUnchanged( pak ) ) {
+			unzClose( pak->handle );
+			pak->handle = NULL;
+			Com_Error( ERR_DROP, "%s changed on disk since it was loaded, fs_restart to use the new one",
+				pak->pakFilename );
+		}
 	}
+	return pak->handle;
+}
 
-	FS_CheckFilenameIsMutable( ospath, __func__ );
+/*
+=================
+FS_MapPak
 
-	if( FS_CreatePath( ospath ) ) {
-		return 0;
+A pak that changed isn't mapped, reads then go through minizip, which
+has the loaded file open or catches the change in FS_PakHandle
+=================
+*/
+static qboolean FS_MapPak( pack_t *pak ) {
+	if ( !pak->mapTried ) {
+		pak->mapTried = qtrue;
+		if ( fs_mmap->integer ) {
+			pak->mapBase = Sys_MapFile( pak->pakFilename, &pak->mapLength );
+			if ( pak->mapBase && !FS_PakUnchanged( pak ) ) {
+				Sys_UnmapFile( pak->mapBase, pak->mapLength );
+				pak->mapBase = NULL;
+			}
+		}
 	}
+	return pak->mapBase != NULL;
+}
 
-	// enabling the following line causes a recursive function call loop
-	// when running with +set logfile 1 +set developer 1
-	//Com_DPrintf( "writing to: %s\n", ospath );
-	fsh[f].handleFiles.file.o = Sys_FOpen( ospath, "wb" );
+/*
+=================
+FS_MappedFileData
 
-	Q_strncpyz( fsh[f].name, filename, sizeof( fsh[f].name ) );
+Finds where a file's data starts in the mapped pak, from its central
+directory entry and local header. Returns qfalse if minizip has to read it.
+=================
+*/
+static qboolean FS_MappedFileData( pack_t *pak, fileInPack_t *pakFile ) {
+	const byte		*central, *local;
+	unsigned long	mapLength, ofs, dataPos, dataLen;
+	int				method;
 
-	fsh[f].handleSync = qfalse;
-	if (!fsh[f].handleFiles.file.o) {
-		f = 0;
+	if ( pakFile->dataPos ) {
+		return pakFile->method != -1;
 	}
-	return f;
+
+	// anything wrong leaves it to minizip without looking again
+	pakFile->dataPos = 1;
+	pakFile->method = -1;
+
+	if ( !FS_MapPak( pak ) ) {
+		return qfalse;
+	}
+	mapLength = pak->mapLength;
+
+	ofs = pakFile->pos;
+	if ( mapLength < ZIP_CENTRAL_SIZE || ofs > mapLength - ZIP_CENTRAL_SIZE ) {
+		return qfalse;
+	}
+	central = pak->mapBase + ofs;
+	if ( FS_ZipLong( central ) != 0x02014b50 ) {
+		return qfalse;	// self extracting archive, the offsets are relative
+	}
+	if ( FS_ZipShort( central + 8 ) & 1 ) {
+		return qfalse;	// encrypted
+	}
+	method = FS_ZipShort( central + 10 );
+	if ( method != ZIP_STORED && method != Z_DEFLATED ) {
+		return qfalse;
+	}
+	dataLen = FS_ZipLong( central + 20 );
+	if ( FS_ZipLong( central + 24 ) != pakFile->len || ( method == ZIP_STORED && dataLen != pakFile->len ) ) {
+		return qfalse;
+	}
+
+	ofs = FS_ZipLong( central + 42 );
+	if ( mapLength < ZIP_LOCAL_SIZE || ofs > mapLength - ZIP_LOCAL_SIZE ) {
+		return qfalse;
+	}
+	local = pak->mapBase + ofs;
+	if ( FS_ZipLong( local ) != 0x04034b50 ) {
+		return qfalse;
+	}
+	dataPos = ofs + ZIP_LOCAL_SIZE + FS_ZipShort( local + 26 ) + FS_ZipShort( local + 28 );
+	if ( dataPos > mapLength || dataLen > mapLength - dataPos ) {
+		return qfalse;
+	}
+
+	pakFile->dataPos = dataPos;
+	pakFile->dataLen = dataLen;
+	pakFile->method = method;
+	return qtrue;
+}
+
+/*
+=================
+FS_ZipStream
+
+The inflate state is only set up once a deflated file is actually read
+=================
+*/
+static z_stream *FS_ZipStream( fileHandleData_t *fh ) {
+	if ( !fh->zipStream ) {
+		fh->zipStream = Z_Malloc( sizeof( *fh->zipStream ) );
+		fh->zipStream->next_in = (Bytef *)fh->zipData;
+		fh->zipStream->avail_in = fh->zipDataLen;
+		if ( inflateInit2( fh->zipStream, -MAX_WBITS ) != Z_OK ) {
+			Com_Error( ERR_FATAL, "FS_ZipStream: inflateInit2 failed for %s", fh->name );
+		}
+	}
+	return fh->zipStream;
+}
+
+/*
+=================
+FS_ReadMapped
+=================
+*/
+static int FS_ReadMapped( fileHandleData_t *fh, byte *buffer, int len ) {
+	z_stream	*zs;
+	int			read, block, next, point, err;
+
+	if ( len > fh->zipFileLen - fh->zipOffset ) {
+		len = fh->zipFileLen - fh->zipOffset;
+	}
+	if ( len <= 0 ) {
+		return 0;
+	}
+
+	if ( fh->zipMethod == ZIP_STORED ) {
+		Com_Memcpy( buffer, fh->zipData + fh->zipOffset, len );
+		fh->zipOffset += len;
+		return len;
+	}
+
+	zs = FS_ZipStream( fh );
+	read = 0;
+	while ( read < len ) {
+		block = len - read;
+
+		// stop on the next seek point so the state there can be saved
+		if ( fh->zipSeekPoints ) {
+			next = ( fh->zipOffset / PK3_SEEK_SPAN + 1 ) * PK3_SEEK_SPAN;
+			if ( block > next - fh->zipOffset ) {
+				block = next - fh->zipOffset;
+			}
+		}
+
+		zs->next_out = buffer + read;
+		zs->avail_out = block;
+		err = inflate( zs, Z_SYNC_FLUSH );
+		block -= zs->avail_out;
+		read += block;
+		fh->zipOffset += block;
+
+		point = fh->zipOffset / PK3_SEEK_SPAN - 1;
+		if ( fh->zipSeekPoints && !( fh->zipOffset % PK3_SEEK_SPAN ) && point == fh->zipNumSeekPoints ) {
+			if ( inflateCopy( &fh->zipSeekPoints[point], zs ) == Z_OK ) {
+				fh->zipNumSeekPoints++;
+			}
+		}
+
+		if ( err != Z_OK || !block ) {
+			break;
+		}
+	}
+	return read;
+}
+
+/*
+=================
+FS_SeekMapped
+=================
+*/
+static void FS_SeekMapped( fileHandleData_t *fh, int offset ) {
+	byte		buffer[PK3_SEEK_BUFFER_SIZE];
+	z_stream	*zs;
+	int			point, remaining, block;
+
+	if ( offset < 0 ) {
+		offset = 0;
+	} else if ( offset > fh->zipFileLen ) {
+		offset = fh->zipFileLen;
+	}
+
+	if ( fh->zipMethod == ZIP_STORED ) {
+		fh->zipOffset = offset;
+		return;
+	}
+	if ( offset == fh->zipOffset ) {
+		return;
+	}
+
+	zs = FS_ZipStream( fh );
+
+	// only files that get seeked pay for saved states
+	if ( !fh->zipSeekPoints && fh->zipFileLen >= PK3_SEEK_SPAN ) {
+		fh->zipSeekPoints = Z_Malloc( ( fh->zipFileLen / PK3_SEEK_SPAN ) * sizeof( *fh->zipSeekPoints ) );
+	}
+
+	point = offset / PK3_SEEK_SPAN - 1;
+	if ( point >= fh->zipNumSeekPoints ) {
+		point = fh->zipNumSeekPoints - 1;
+	}
+
+	if ( point >= 0 && ( offset < fh->zipOffset || ( point + 1 ) * PK3_SEEK_SPAN > fh->zipOffset ) ) {
+		inflateEnd( zs );
+		if ( inflateCopy( zs, &fh->zipSeekPoints[point] ) != Z_OK ) {
+			Com_Error( ERR_FATAL, "FS_SeekMapped: inflateCopy failed for %s", fh->name );
+		}
+		fh->zipOffset = ( point + 1 ) * PK3_SEEK_SPAN;
+	} else if ( offset < fh->zipOffset ) {
+		inflateReset( zs );
+		zs->next_in = (Bytef *)fh->zipData;
+		zs->avail_in = fh->zipDataLen;
+		fh->zipOffset = 0;
+	}
+
+	remaining = offset - fh->zipOffset;
+	while ( remaining > 0 ) {
+		block = FS_ReadMapped( fh, buffer, remaining < sizeof( buffer ) ? remaining : sizeof( buffer ) );
+		if ( !block ) {
+			break;
+		}
+		remaining -= block;
+	}
+}
+
+/*
+=================
+FS_InflateData
+
+Inflates a whole deflated file in one go, safe to call from any thread
+=================
+*/
+static qboolean FS_InflateData( const byte *data, int dataLen, byte *buffer, int len ) {
+	z_stream	zs;
+	int			err;
+
+	Com_Memset( &zs, 0, sizeof( zs ) );
+	zs.next_in = (Bytef *)data;
+	zs.avail_in = dataLen;
+	zs.next_out = buffer;
+	zs.avail_out = len;
+
+	if ( inflateInit2( &zs, -MAX_WBITS ) != Z_OK ) {
+		return qfalse;
+	}
+	err = inflate( &zs, Z_FINISH );
+	inflateEnd( &zs );
+
+	return err == Z_STREAM_END && !zs.avail_out;
+}
+
+/*
+=================
+FS_CloseMapped
+=================
+*/
+static void FS_CloseMapped( fileHandleData_t *fh ) {
+	int		i;
+
+	if ( fh->prefetched ) {
+		free( (void *)fh->zipData );
+	}
+	if ( fh->zipStream ) {
+		inflateEnd( fh->zipStream );
+		Z_Free( fh->zipStream );
+	}
+	if ( fh->zipSeekPoints ) {
+		for ( i = 0 ; i < fh->zipNumSeekPoints ; i++ ) {
+			inflateEnd( &fh->zipSeekPoints[i] );
+		}
+		Z_Free( fh->zipSeekPoints );
+	}
+}
+
+/*
+=================
+FS_IsMappedData
+
+Buffers from FS_ReadFileView can point into a mapped pak
+=================
+*/
+static qboolean FS_IsMappedData( const void *buffer ) {
+	searchpath_t	*search;
+	const byte		*p = buffer;
+
+	for ( search = fs_searchpaths ; search ; search = search->next ) {
+		if ( search->pack && search->pack->mapBase
+			&& p >= search->pack->mapBase && p < search->pack->mapBase + search->pack->mapLength ) {
+			return qtrue;
+		}
+	}
+	return qfalse;
+}
+
+/*
+==============
+FS_FCloseFile
+
+If the FILE pointer is an open pak file, leave it open.
+
+For some reason, other dll's can't just cal fclose()
+on files returned by FS_FOpenFile...
+==============
+*/
+void FS_FCloseFile( fileHandle_t f ) {
+	if ( !fs_searchpaths ) {
+		Com_Error( ERR_FATAL, "Filesystem call made without initialization" );
+	}
+
+	if (fsh[f].zipFile == qtrue) {
+		if ( fsh[f].zipData ) {
+			FS_CloseMapped( &fsh[f] );
+			fsh[f].inUse = qfalse;
+		} else {
+			unzCloseCurrentFile( fsh[f].handleFiles.file.z );
+			if ( fsh[f].handleFiles.unique ) {
+				unzClose( fsh[f].handleFiles.file.z );
+			}
+		}
+		Com_Memset( &fsh[f], 0, sizeof( fsh[f] ) );
+		return;
+	}
+
+	// we didn't find it as a pak, so close it as a unique file
+	if (fsh[f].handleFiles.file.o) {
+		fclose (fsh[f].handleFiles.file.o);
+	}
+	Com_Memset( &fsh[f], 0, sizeof( fsh[f] ) );
+}
+
+/*
+===========
+FS_FOpenFileWrite
+
+===========
+*/
+fileHandle_t FS_FOpenFileWrite( const char *filename ) {
+	char			*ospath;
+	fileHandle_t	f;
+
+	if ( !fs_searchpaths ) {
+		Com_Error( ERR_FATAL, "Filesystem call made without initialization" );
+	}
+
+	f = FS_HandleForFile();
+	fsh[f].zipFile = qfalse;
+
+	ospath = FS_BuildOSPath( fs_homepath->string, fs_gamedir, filename );
+
+	if ( fs_debug->integer ) {
+		Com_Printf( "FS_FOpenFileWrite: %s\n", ospath );
+	}
+
+	FS_CheckFilenameIsMutable( ospath, __func__ );
+
+	if( FS_CreatePath( ospath ) ) {
+		return 0;
+	}
+
+	// enabling the following line causes a recursive function call loop
+	// when running with +set logfile 1 +set developer 1
+	//Com_DPrintf( "writing to: %s\n", ospath );
+	fsh[f].handleFiles.file.o = Sys_FOpen( ospath, "wb" );
+
+	Q_strncpyz( fsh[f].name, filename, sizeof( fsh[f].name ) );
+
+	fsh[f].handleSync = qfalse;
+	if (!fsh[f].handleFiles.file.o) {
+		f = 0;
+	} else {
+		FS_LookupAddFile( fs_gamedir, filename );
+	}
+	return f;
 }
 
 /*
@@ -953,6 +1741,8 @@ fileHandle_t FS_FOpenFileAppend( const char *filename ) {
 	fsh[f].handleSync = qfalse;
 	if (!fsh[f].handleFiles.file.o) {
 		f = 0;
+	} else {
+		FS_LookupAddFile( fs_gamedir, filename );
 	}
 	return f;
 }
@@ -1260,7 +2050,15 @@ long FS_FOpenFileReadDir(const char *filename, searchpath_t *search, fileHandle_
 					if(strstr(filename, "ui.qvm"))
 						pak->referenced |= FS_UI_REF;
 
-					if(uniqueFILE)
+					if(FS_MappedFileData(pak, pakFile))
+					{
+						// read it straight from the mapping
+						fsh[*file].zipData = pak->mapBase + pakFile->dataPos;
+						fsh[*file].inUse = qtrue;
+						fsh[*file].zipDataLen = pakFile->dataLen;
+						fsh[*file].zipMethod = pakFile->method;
+					}
+					else if(uniqueFILE)
 					{
 						// open a new file on the pakfile
 						fsh[*file].handleFiles.file.z = unzOpen(pak->pakFilename);
@@ -1269,16 +2067,19 @@ long FS_FOpenFileReadDir(const char *filename, searchpath_t *search, fileHandle_
 							Com_Error(ERR_FATAL, "Couldn't open %s", pak->pakFilename);
 					}
 					else
-						fsh[*file].handleFiles.file.z = pak->handle;
+						fsh[*file].handleFiles.file.z = FS_PakHandle(pak);
 
 					Q_strncpyz(fsh[*file].name, filename, sizeof(fsh[*file].name));
 					fsh[*file].zipFile = qtrue;
 
-					// set the file position in the zip file (also sets the current file info)
-					unzSetOffset(fsh[*file].handleFiles.file.z, pakFile->pos);
+					if(!fsh[*file].zipData)
+					{
+						// set the file position in the zip file (also sets the current file info)
+						unzSetOffset(fsh[*file].handleFiles.file.z, pakFile->pos);
 
-					// open the file in the zip
-					unzOpenCurrentFile(fsh[*file].handleFiles.file.z);
+						// open the file in the zip
+						unzOpenCurrentFile(fsh[*file].handleFiles.file.z);
+					}
 					fsh[*file].zipFilePos = pakFile->pos;
 					fsh[*file].zipFileLen = pakFile->len;
 
@@ -1349,76 +2150,441 @@ long FS_FOpenFileReadDir(const char *filename, searchpath_t *search, fileHandle_
 }
 
 /*
-===========
-FS_FOpenFileRead
+==========================================================================
 
-Finds the file in the search path.
-Returns filesize and an open FILE pointer.
-Used for streaming data out of either a
-separate file or a ZIP file.
-===========
-*/
-long FS_FOpenFileRead(const char *filename, fileHandle_t *file, qboolean uniqueFILE)
-{
-	searchpath_t *search;
-	long len;
+PREFETCH
 
-	if(!fs_searchpaths)
-		Com_Error(ERR_FATAL, "Filesystem call made without initialization");
+FS_PrefetchFile is a hint that a file will be opened soon. The file is
+found right away, on the main thread, so the pure rules and the search
+order are the same as for FS_ReadFile, and the loader threads read and
+inflate it at the lowest priority. The copy is kept until the next open
+of that name takes it, waiting for it if it isn't done yet.
 
-	for(search = fs_searchpaths; search; search = search->next)
-	{
-		len = FS_FOpenFileReadDir(filename, search, file, uniqueFILE, qfalse);
+Files stored uncompressed in a mapped pak are not copied, FS_ReadFileView
+hands out the mapping itself. The loader threads only touch their pages
+so the open doesn't fault them in, and the open goes to the pak as usual.
 
-		if(file == NULL)
-		{
-			if(len > 0)
-				return len;
-		}
-		else
-		{
-			if(len >= 0 && *file)
-				return len;
-		}
+Files in paks that aren't mapped are read on the main thread when they
+are asked for, and config files are never prefetched since they may
+come from the journal.
 
-	}
-	
-#ifdef FS_MISSING
-	if(missingFiles)
-		fprintf(missingFiles, "%s\n", filename);
-#endif
+==========================================================================
+*/
 
-	if(file)
-	{
-		*file = 0;
-		return -1;
-	}
-	else
-	{
-		// When file is NULL, we're querying the existance of the file
-		// If we've got here, it doesn't exist
-		return 0;
-	}
-}
+#define	MAX_PREFETCH_HASH	256
+#define	PREFETCH_PRIORITY	-1
 
-/*
-=================
-FS_FindVM
+typedef struct fsPrefetch_s {
+	backgroundJob_t		job;
+	char				qpath[MAX_ZPATH];
 
-Find a suitable VM file in search path order.
+	// where the data is, found on the main thread
+	const byte			*data;			// in a mapped pak
+	int					dataLen;
+	int					method;
+	FILE				*file;			// or a file in a directory
 
-In each searchpath try:
- - open DLL file if DLL loading enabled
- - open QVM file
+	byte				*buffer;		// malloced, with a trailing 0, NULL when only touched
+	long				length;
+	qboolean			failed;
+	int					touched;		// keeps the page touches from being optimized out
 
-Enable search for DLL by setting enableDll to FSVM_ENABLEDLL
+	struct fsPrefetch_s	*next;
+} fsPrefetch_t;
 
-write found DLL or QVM to "found" and return VMI_NATIVE if DLL, VMI_COMPILED if QVM
-Return the searchpath in "startSearch".
-=================
-*/
+static	cvar_t			*fs_prefetchSize;
+static	fsPrefetch_t	*fs_prefetches[MAX_PREFETCH_HASH];
+static	int				fs_numPrefetches;
+static	int				fs_prefetchBytes;	// malloced copies, held against fs_prefetchSize
 
-int FS_FindVM(void **startSearch, char *found, int foundlen, const char *name, int enableDll)
+// load statistics
+static	int				fs_statOpens;
+static	int				fs_statPrefetched;
+static	int				fs_statTouched;
+static	int64_t			fs_statWaitUsec;
+
+/*
+============
+FS_PrefetchJob
+
+Runs on a loader thread, so it only touches its own request
+============
+*/
+static void FS_PrefetchJob( void *data ) {
+	fsPrefetch_t	*req = data;
+	int				i, sum;
+
+	if ( !req->buffer ) {
+		sum = 0;
+		for ( i = 0 ; i < req->dataLen ; i += 4096 ) {
+			sum += req->data[i];
+		}
+		req->touched = sum;
+	} else if ( req->file ) {
+		req->failed = ( fread( req->buffer, 1, req->length, req->file ) != req->length );
+		fclose( req->file );
+		req->file = NULL;
+	} else if ( req->method == Z_DEFLATED ) {
+		req->failed = !FS_InflateData( req->data, req->dataLen, req->buffer, req->length );
+	} else {
+		Com_Memcpy( req->buffer, req->data, req->length );
+	}
+}
+
+/*
+============
+FS_StartPrefetch
+
+Finds the file and queues the read of it. Returns NULL when the file
+is missing, or when a copy of it would take more than maxBytes.
+============
+*/
+static fsPrefetch_t *FS_StartPrefetch( const char *qpath, long maxBytes ) {
+	fsPrefetch_t	*req;
+	fileHandle_t	h;
+	long			len;
+
+	len = FS_FOpenFileRead( qpath, &h, qfalse );
+	if ( h == 0 ) {
+		return NULL;
+	}
+
+	if ( fsh[h].zipData && !fsh[h].prefetched && fsh[h].zipMethod == ZIP_STORED ) {
+		// the data stays mapped after the handle is closed
+		req = Z_Malloc( sizeof( *req ) );
+		req->data = fsh[h].zipData;
+		req->dataLen = len;
+		req->length = len;
+	} else if ( len > maxBytes || ( fsh[h].zipFile && !fsh[h].zipData ) ) {
+		FS_FCloseFile( h );
+		return NULL;
+	} else {
+		req = Z_Malloc( sizeof( *req ) );
+		req->buffer = malloc( len + 1 );
+		if ( !req->buffer ) {
+			Com_Error( ERR_FATAL, "FS_PrefetchFile: couldn't allocate %li bytes for %s", len + 1, qpath );
+		}
+		req->buffer[len] = 0;
+		req->length = len;
+
+		if ( fsh[h].zipData ) {
+			req->data = fsh[h].zipData;
+			req->dataLen = fsh[h].zipDataLen;
+			req->method = fsh[h].zipMethod;
+		} else {
+			// the loader thread reads and closes it
+			req->file = fsh[h].handleFiles.file.o;
+			fsh[h].handleFiles.file.o = NULL;
+		}
+		fs_readCount += len;
+	}
+	FS_FCloseFile( h );
+
+	Q_strncpyz( req->qpath, qpath, sizeof( req->qpath ) );
+	req->job.func = FS_PrefetchJob;
+	req->job.data = req;
+	req->job.priority = PREFETCH_PRIORITY;
+	req->job.state = BGJOB_DONE;
+	Com_QueueBackgroundJob( &req->job );
+	return req;
+}
+
+/*
+============
+FS_FinishPrefetch
+
+Waits for the request, the buffer is left in it
+============
+*/
+static void FS_FinishPrefetch( fsPrefetch_t *req ) {
+	int64_t		start;
+
+	if ( !Com_BackgroundJobDone( &req->job ) ) {
+		start = Sys_Microseconds();
+		Com_FinishBackgroundJob( &req->job );
+		fs_statWaitUsec += Sys_Microseconds() - start;
+	}
+
+	if ( req->failed ) {
+		Com_Printf( S_COLOR_YELLOW "WARNING: couldn't read %s\n", req->qpath );
+		free( req->buffer );
+		req->buffer = NULL;
+	}
+}
+
+/*
+============
+FS_PrefetchFile
+
+Copies are kept up to fs_prefetchSize megabytes, a file that doesn't
+fit in what is left isn't prefetched
+============
+*/
+void FS_PrefetchFile( const char *qpath ) {
+	fsPrefetch_t	*req;
+	long			hash;
+
+	if ( !fs_searchpaths || !qpath || !qpath[0] ) {
+		return;
+	}
+
+	// qpaths are not supposed to have a leading slash
+	if ( qpath[0] == '/' || qpath[0] == '\\' ) {
+		qpath++;
+	}
+	if ( strlen( qpath ) >= MAX_ZPATH || strstr( qpath, ".cfg" ) ) {
+		return;
+	}
+
+	hash = FS_HashFileName( qpath, MAX_PREFETCH_HASH );
+	for ( req = fs_prefetches[hash] ; req ; req = req->next ) {
+		if ( !FS_FilenameCompare( req->qpath, qpath ) ) {
+			return;
+		}
+	}
+
+	req = FS_StartPrefetch( qpath, fs_prefetchSize->integer * 1024L * 1024L - fs_prefetchBytes );
+	if ( !req ) {
+		return;
+	}
+
+	req->next = fs_prefetches[hash];
+	fs_prefetches[hash] = req;
+	fs_numPrefetches++;
+	if ( req->buffer ) {
+		fs_prefetchBytes += req->length;
+	}
+}
+
+/*
+============
+FS_TakePrefetch
+
+Opens a prefetched copy as a handle that reads from memory. Returns -1
+when there is none, and the file is opened where it is.
+============
+*/
+static long FS_TakePrefetch( const char *qpath, fileHandle_t *file ) {
+	fsPrefetch_t	*req, **prev;
+	long			len;
+
+	if ( qpath[0] == '/' || qpath[0] == '\\' ) {
+		qpath++;
+	}
+
+	prev = &fs_prefetches[FS_HashFileName( qpath, MAX_PREFETCH_HASH )];
+	for ( ; ( req = *prev ) != NULL ; prev = &req->next ) {
+		if ( !FS_FilenameCompare( req->qpath, qpath ) ) {
+			break;
+		}
+	}
+	if ( !req ) {
+		return -1;
+	}
+	*prev = req->next;
+	fs_numPrefetches--;
+	if ( req->buffer ) {
+		fs_prefetchBytes -= req->length;
+	} else {
+		fs_statTouched++;
+	}
+
+	FS_FinishPrefetch( req );
+	len = -1;
+	if ( req->buffer ) {
+		len = req->length;
+		*file = FS_HandleForFile();
+		fsh[*file].zipFile = qtrue;
+		fsh[*file].zipData = req->buffer;
+		fsh[*file].zipDataLen = len;
+		fsh[*file].zipMethod = ZIP_STORED;
+		fsh[*file].zipFileLen = len;
+		fsh[*file].prefetched = qtrue;
+		fsh[*file].inUse = qtrue;
+		Q_strncpyz( fsh[*file].name, qpath, sizeof( fsh[*file].name ) );
+		fs_statPrefetched++;
+	}
+	Z_Free( req );
+
+	return len;
+}
+
+/*
+============
+FS_ClearPrefetch
+
+Drops the prefetched files nobody opened
+============
+*/
+void FS_ClearPrefetch( void ) {
+	fsPrefetch_t	*req;
+	int				i;
+
+	for ( i = 0 ; i < MAX_PREFETCH_HASH ; i++ ) {
+		while ( fs_prefetches[i] ) {
+			req = fs_prefetches[i];
+			fs_prefetches[i] = req->next;
+			Com_FinishBackgroundJob( &req->job );
+			free( req->buffer );
+			Z_Free( req );
+		}
+	}
+	fs_numPrefetches = 0;
+	fs_prefetchBytes = 0;
+}
+
+/*
+============
+FS_ResetLoadStats
+============
+*/
+void FS_ResetLoadStats( void ) {
+	fs_statOpens = 0;
+	fs_statPrefetched = 0;
+	fs_statTouched = 0;
+	fs_statWaitUsec = 0;
+}
+
+/*
+============
+FS_PrintLoadStats
+============
+*/
+void FS_PrintLoadStats( void ) {
+	Com_Printf( "%i files opened, %i prefetched, %i touched in mapped paks, %.1f msec waiting for loaders\n",
+		fs_statOpens, fs_statPrefetched, fs_statTouched, fs_statWaitUsec / 1000.0 );
+}
+
+/*
+===========
+FS_FOpenFileRead
+
+Finds the file in the search path.
+Returns filesize and an open FILE pointer.
+Used for streaming data out of either a
+separate file or a ZIP file.
+===========
+*/
+long FS_FOpenFileRead(const char *filename, fileHandle_t *file, qboolean uniqueFILE)
+{
+	searchpath_t *search;
+	const char *qpath;
+	long len;
+	int i, dir;
+
+	if(!fs_searchpaths)
+		Com_Error(ERR_FATAL, "Filesystem call made without initialization");
+
+	if(file && filename)
+	{
+		fs_statOpens++;
+
+		if(fs_numPrefetches)
+		{
+			len = FS_TakePrefetch(filename, file);
+			if(len >= 0)
+				return len;
+		}
+	}
+
+	if(fs_lookupHash && filename)
+	{
+		qpath = filename;
+		if(qpath[0] == '/' || qpath[0] == '\\')
+			qpath++;
+
+		if(!FS_LookupIsPartial(qpath))
+		{
+			// the paks that have it, and every directory in between
+			dir = 0;
+			i = fs_lookupHash[FS_HashFileName(qpath, fs_lookupHashSize)];
+			for(;;)
+			{
+				while(i != -1 && (fs_lookup[i].search->dir || FS_FilenameCompare(fs_lookup[i].name, qpath)))
+					i = fs_lookup[i].next;
+
+				if(dir < fs_numLookupDirs && (i == -1 || fs_lookupDirs[dir]->rank < fs_lookup[i].search->rank))
+					search = fs_lookupDirs[dir++];
+				else if(i != -1)
+				{
+					search = fs_lookup[i].search;
+					i = fs_lookup[i].next;
+				}
+				else
+					break;
+
+				len = FS_FOpenFileReadDir(filename, search, file, uniqueFILE, qfalse);
+
+				if(file == NULL)
+				{
+					if(len > 0)
+						return len;
+				}
+				else
+				{
+					if(len >= 0 && *file)
+						return len;
+				}
+			}
+
+			goto notfound;
+		}
+	}
+
+	for(search = fs_searchpaths; search; search = search->next)
+	{
+		len = FS_FOpenFileReadDir(filename, search, file, uniqueFILE, qfalse);
+
+		if(file == NULL)
+		{
+			if(len > 0)
+				return len;
+		}
+		else
+		{
+			if(len >= 0 && *file)
+				return len;
+		}
+
+	}
+
+notfound:
+#ifdef FS_MISSING
+	if(missingFiles)
+		fprintf(missingFiles, "%s\n", filename);
+#endif
+
+	if(file)
+	{
+		*file = 0;
+		return -1;
+	}
+	else
+	{
+		// When file is NULL, we're querying the existance of the file
+		// If we've got here, it doesn't exist
+		return 0;
+	}
+}
+
+/*
+=================
+FS_FindVM
+
+Find a suitable VM file in search path order.
+
+In each searchpath try:
+ - open DLL file if DLL loading enabled
+ - open QVM file
+
+Enable search for DLL by setting enableDll to FSVM_ENABLEDLL
+
+write found DLL or QVM to "found" and return VMI_NATIVE if DLL, VMI_COMPILED if QVM
+Return the searchpath in "startSearch".
+=================
+*/
+
+int FS_FindVM(void **startSearch, char *found, int foundlen, const char *name, int enableDll)
 {
 	searchpath_t *search, *lastSearch;
 	directory_t *dir;
@@ -1562,6 +2728,8 @@ int FS_Read( void *buffer, int len, fileHandle_t f ) {
 			buf += read;
 		}
 		return len;
+	} else if (fsh[f].zipData) {
+		return FS_ReadMapped(&fsh[f], buf, len);
 	} else {
 		return unzReadCurrentFile(fsh[f].handleFiles.file.z, buffer, len);
 	}
@@ -1631,8 +2799,6 @@ void QDECL FS_Printf( fileHandle_t h, const char *fmt, ... ) {
 	FS_Write(msg, strlen(msg), h);
 }
 
-#define PK3_SEEK_BUFFER_SIZE 65536
-
 /*
 =================
 FS_Seek
@@ -1655,6 +2821,23 @@ int FS_Seek( fileHandle_t f, long offset, int origin ) {
 		return r;
 	}
 
+	if (fsh[f].zipData) {
+		switch( origin ) {
+			case FS_SEEK_SET:
+				FS_SeekMapped( &fsh[f], offset );
+				return offset;
+			case FS_SEEK_CUR:
+				FS_SeekMapped( &fsh[f], fsh[f].zipOffset + offset );
+				return offset;
+			case FS_SEEK_END:
+				FS_SeekMapped( &fsh[f], fsh[f].zipFileLen + offset );
+				return offset;
+			default:
+				Com_Error( ERR_FATAL, "Bad origin in FS_Seek" );
+				return -1;
+		}
+	}
+
 	if (fsh[f].zipFile == qtrue) {
 		//FIXME: this is really, really crappy
 		//(but better than what was here before)
@@ -1750,6 +2933,7 @@ int	FS_FileIsInPAK(const char *filename, int *pChecksum ) {
 	pack_t			*pak;
 	fileInPack_t	*pakFile;
 	long			hash = 0;
+	int				i;
 
 	if ( !fs_searchpaths ) {
 		Com_Error( ERR_FATAL, "Filesystem call made without initialization" );
@@ -1771,6 +2955,21 @@ int	FS_FileIsInPAK(const char *filename, int *pChecksum ) {
 		return -1;
 	}
 
+	// every pak file is in the lookup table
+	if ( fs_lookupHash ) {
+		for ( i = fs_lookupHash[FS_HashFileName( filename, fs_lookupHashSize )] ; i != -1 ; i = fs_lookup[i].next ) {
+			pak = fs_lookup[i].search->pack;
+			if ( !pak || !FS_PakIsPure( pak ) || FS_FilenameCompare( fs_lookup[i].name, filename ) ) {
+				continue;
+			}
+			if ( pChecksum ) {
+				*pChecksum = pak->pure_checksum;
+			}
+			return 1;
+		}
+		return -1;
+	}
+
 	//
 	// search through the path, one element at a time
 	//
@@ -1871,136 +3070,838 @@ long FS_ReadFileDir(const char *qpath, void *searchPath, qboolean unpure, void *
 			// guarantee that it will have a trailing 0 for string operations
 			buf[len] = 0;
 
-			return len;
-		}
-	} else {
-		isConfig = qfalse;
-	}
+			return len;
+		}
+	} else {
+		isConfig = qfalse;
+	}
+
+	search = searchPath;
+
+	if(search == NULL)
+	{
+		// look for it in the filesystem or pack files
+		len = FS_FOpenFileRead(qpath, &h, qfalse);
+	}
+	else
+	{
+		// look for it in a specific search path only
+		len = FS_FOpenFileReadDir(qpath, search, &h, qfalse, unpure);
+	}
+
+	if ( h == 0 ) {
+		if ( buffer ) {
+			*buffer = NULL;
+		}
+		// if we are journalling and it is a config file, write a zero to the journal file
+		if ( isConfig && com_journal && com_journal->integer == 1 ) {
+			Com_DPrintf( "Writing zero for %s to journal file.\n", qpath );
+			len = 0;
+			FS_Write( &len, sizeof( len ), com_journalDataFile );
+			FS_Flush( com_journalDataFile );
+		}
+		return -1;
+	}
+
+	if ( !buffer ) {
+		if ( isConfig && com_journal && com_journal->integer == 1 ) {
+			Com_DPrintf( "Writing len for %s to journal file.\n", qpath );
+			FS_Write( &len, sizeof( len ), com_journalDataFile );
+			FS_Flush( com_journalDataFile );
+		}
+		FS_FCloseFile( h);
+		return len;
+	}
+
+	fs_loadCount++;
+	fs_loadStack++;
+
+	buf = Hunk_AllocateTempMemory(len+1);
+	*buffer = buf;
+
+	FS_Read (buf, len, h);
+
+	// guarantee that it will have a trailing 0 for string operations
+	buf[len] = 0;
+	FS_FCloseFile( h );
+
+	// if we are journalling and it is a config file, write it to the journal file
+	if ( isConfig && com_journal && com_journal->integer == 1 ) {
+		Com_DPrintf( "Writing %s to journal file.\n", qpath );
+		FS_Write( &len, sizeof( len ), com_journalDataFile );
+		FS_Write( buf, len, com_journalDataFile );
+		FS_Flush( com_journalDataFile );
+	}
+	return len;
+}
+
+/*
+============
+FS_ReadFile
+
+Filename are relative to the quake search path
+a null buffer will just return the file length without loading
+============
+*/
+long FS_ReadFile(const char *qpath, void **buffer)
+{
+	return FS_ReadFileDir(qpath, NULL, qfalse, buffer);
+}
+
+/*
+============
+FS_HomeReadFile
+
+Like FS_ReadFile, but only looks at loose files in the game directory
+under the home path, where FS_FOpenFileWrite puts them.  For files the
+engine writes and trusts itself, which a pk3 must not be able to supply.
+============
+*/
+long FS_HomeReadFile( const char *qpath, void **buffer ) {
+	searchpath_t	*search;
+
+	if ( !fs_searchpaths ) {
+		Com_Error( ERR_FATAL, "Filesystem call made without initialization" );
+	}
+
+	for ( search = fs_searchpaths ; search ; search = search->next ) {
+		if ( search->dir && !strcmp( search->dir->path, fs_homepath->string ) && !Q_stricmp( search->dir->gamedir, fs_gamedir ) ) {
+			return FS_ReadFileDir( qpath, search, qtrue, buffer );
+		}
+	}
+
+	if ( buffer ) {
+		*buffer = NULL;
+	}
+	return -1;
+}
+
+/*
+============
+FS_ReadFileView
+
+Like FS_ReadFile, but the buffer is read only and has no trailing 0.
+Files stored uncompressed in a mapped pak come back as a pointer into
+the mapping without a copy. Free it with FS_FreeFile before the
+filesystem restarts.
+============
+*/
+long FS_ReadFileView( const char *qpath, const void **buffer ) {
+	fileHandle_t	h;
+	byte			*buf;
+	long			len;
+
+	if ( !fs_searchpaths ) {
+		Com_Error( ERR_FATAL, "Filesystem call made without initialization" );
+	}
+
+	if ( !qpath || !qpath[0] ) {
+		Com_Error( ERR_FATAL, "FS_ReadFileView with empty name" );
+	}
+
+	// config files can come from the journal
+	if ( strstr( qpath, ".cfg" ) ) {
+		return FS_ReadFile( qpath, (void **)buffer );
+	}
+
+	len = FS_FOpenFileRead( qpath, &h, qfalse );
+	if ( h == 0 ) {
+		*buffer = NULL;
+		return -1;
+	}
+
+	fs_loadCount++;
+	fs_loadStack++;
+
+	// an unaligned view would fault on some cpus when read as lumps
+	if ( fsh[h].zipData && fsh[h].zipMethod == ZIP_STORED && !fsh[h].prefetched && !( (intptr_t)fsh[h].zipData & 3 ) ) {
+		*buffer = fsh[h].zipData;
+	} else {
+		buf = Hunk_AllocateTempMemory( len + 1 );
+		FS_Read( buf, len, h );
+		buf[len] = 0;
+		*buffer = buf;
+	}
+	FS_FCloseFile( h );
+
+	return len;
+}
+
+typedef struct {
+	const byte	*data;
+	int			dataLen;
+	byte		*buffer;
+	int			len;
+	int			file;
+	qboolean	failed;
+} inflateJob_t;
+
+/*
+============
+FS_InflateJob
+
+Runs on the workers, so it only touches its own job
+============
+*/
+static void FS_InflateJob( void *data, int index ) {
+	inflateJob_t	*job = (inflateJob_t *)data + index;
+
+	job->failed = !FS_InflateData( job->data, job->dataLen, job->buffer, job->len );
+}
+
+/*
+============
+FS_ReadFiles
+
+Loads a batch of files like FS_ReadFile, with the deflated files in
+mapped paks inflated in parallel. Missing files get a NULL buffer and
+a -1 length.
+============
+*/
+void FS_ReadFiles( int count, const char **qpaths, void **buffers, long *lengths ) {
+	inflateJob_t	*jobs;
+	fileHandle_t	h;
+	byte			*buf;
+	long			len;
+	int				i, numJobs;
+
+	if ( !fs_searchpaths ) {
+		Com_Error( ERR_FATAL, "Filesystem call made without initialization" );
+	}
+	if ( count <= 0 ) {
+		return;
+	}
+
+	jobs = Z_Malloc( count * sizeof( *jobs ) );
+	numJobs = 0;
+
+	// the lookups and allocations stay on this thread
+	for ( i = 0 ; i < count ; i++ ) {
+		if ( !qpaths[i] || !qpaths[i][0] ) {
+			Com_Error( ERR_FATAL, "FS_ReadFiles with empty name" );
+		}
+
+		// config files can come from the journal
+		if ( strstr( qpaths[i], ".cfg" ) ) {
+			lengths[i] = FS_ReadFile( qpaths[i], &buffers[i] );
+			continue;
+		}
+
+		len = FS_FOpenFileRead( qpaths[i], &h, qfalse );
+		if ( h == 0 ) {
+			buffers[i] = NULL;
+			lengths[i] = -1;
+			continue;
+		}
+
+		fs_loadCount++;
+		fs_loadStack++;
+
+		buf = Hunk_AllocateTempMemory( len + 1 );
+		buf[len] = 0;
+		buffers[i] = buf;
+		lengths[i] = len;
+
+		if ( fsh[h].zipData && fsh[h].zipMethod == Z_DEFLATED && len > 0 ) {
+			// the data stays mapped after the handle is closed
+			jobs[numJobs].data = fsh[h].zipData;
+			jobs[numJobs].dataLen = fsh[h].zipDataLen;
+			jobs[numJobs].buffer = buf;
+			jobs[numJobs].len = len;
+			jobs[numJobs].file = i;
+			numJobs++;
+			fs_readCount += len;
+		} else {
+			FS_Read( buf, len, h );
+		}
+		FS_FCloseFile( h );
+	}
+
+	Com_RunParallel( numJobs, FS_InflateJob, jobs );
+
+	for ( i = 0 ; i < numJobs ; i++ ) {
+		if ( jobs[i].failed ) {
+			Com_Printf( S_COLOR_YELLOW "WARNING: FS_ReadFiles: couldn't inflate %s\n", qpaths[jobs[i].file] );
+		}
+	}
+
+	Z_Free( jobs );
+}
+
+/*
+=============
+FS_FreeFile
+=============
+*/
+void FS_FreeFile( void *buffer ) {
+	if ( !fs_searchpaths ) {
+		Com_Error( ERR_FATAL, "Filesystem call made without initialization" );
+	}
+	if ( !buffer ) {
+		Com_Error( ERR_FATAL, "FS_FreeFile( NULL )" );
+	}
+	fs_loadStack--;
+
+	if ( !FS_IsMappedData( buffer ) ) {
+		Hunk_FreeTempMemory( buffer );
+	}
+
+	// if all of our temp files are free, clear all of our space
+	if ( fs_loadStack == 0 ) {
+		Hunk_ClearTempMemory();
+	}
+}
+
+/*
+============
+FS_WriteFile
+
+Filename are relative to the quake search path
+============
+*/
+void FS_WriteFile( const char *qpath, const void *buffer, int size ) {
+	fileHandle_t f;
+
+	if ( !fs_searchpaths ) {
+		Com_Error( ERR_FATAL, "Filesystem call made without initialization" );
+	}
+
+	if ( !qpath || !buffer ) {
+		Com_Error( ERR_FATAL, "FS_WriteFile: NULL parameter" );
+	}
+
+	f = FS_FOpenFileWrite( qpath );
+	if ( !f ) {
+		Com_Printf( "Failed to open %s\n", qpath );
+		return;
+	}
+
+	FS_Write( buffer, size, f );
+
+	FS_FCloseFile( f );
+}
+
+
+
+/*
+=================
+FS_AllocPak
+=================
+*/
+static pack_t *FS_AllocPak(const char *zipfile, const char *basename, int hashSize)
+{
+	pack_t	*pack;
+	int		i;
+
+	pack = Z_Malloc( sizeof( pack_t ) + hashSize * sizeof(fileInPack_t *) );
+	pack->hashSize = hashSize;
+	pack->hashTable = (fileInPack_t **) (((char *) pack) + sizeof( pack_t ));
+	for(i = 0; i < pack->hashSize; i++) {
+		pack->hashTable[i] = NULL;
+	}
+
+	Q_strncpyz( pack->pakFilename, zipfile, sizeof( pack->pakFilename ) );
+	Q_strncpyz( pack->pakBasename, basename, sizeof( pack->pakBasename ) );
+
+	// strip .pk3 if needed
+	if ( strlen( pack->pakBasename ) > 4 && !Q_stricmp( pack->pakBasename + strlen( pack->pakBasename ) - 4, ".pk3" ) ) {
+		pack->pakBasename[strlen( pack->pakBasename ) - 4] = 0;
+	}
+
+	return pack;
+}
+
+/*
+=================
+FS_PakChecksums
+
+The pure checksum depends on the checksum feed, so it is computed again
+from the crcs whenever the pak is loaded
+=================
+*/
+static void FS_PakChecksums(pack_t *pack)
+{
+	pack->headerLongs[0] = LittleLong( fs_checksumFeed );
+	pack->checksum = Com_BlockChecksum( &pack->headerLongs[ 1 ], sizeof(*pack->headerLongs) * ( pack->numHeaderLongs - 1 ) );
+	pack->pure_checksum = Com_BlockChecksum( pack->headerLongs, sizeof(*pack->headerLongs) * pack->numHeaderLongs );
+	pack->checksum = LittleLong( pack->checksum );
+	pack->pure_checksum = LittleLong( pack->pure_checksum );
+}
+
+/*
+==========================================================================
+
+PAK INDEX
+
+The file tables of all loaded paks are saved in one index file in the
+home path, so paks that haven't changed since are set up from it without
+opening them or walking their central directories. A pak is only taken
+from the index when its path, size and modification time all match.
+The file is in the native byte order and layout, and anything wrong in
+it throws the whole index away.
+
+==========================================================================
+*/
+
+#define	PAK_INDEX_IDENT		(('X'<<24)+('D'<<16)+('I'<<8)+'P')	// little-endian "PIDX"
+#define	PAK_INDEX_VERSION	1
+#define	PAK_INDEX_NAME		"pakindex.dat"
+#define	PAK_INDEX_MAX_FILES	0x100000
+
+typedef struct {
+	int			ident;
+	int			version;
+	int			numPaks;
+} pakIndexHeader_t;
+
+// followed by the path, the crcs, the files, the hash buckets and the names
+typedef struct {
+	int64_t		fileSize;
+	int64_t		fileTime;
+	int			pathLength;			// with the trailing 0
+	int			numFiles;
+	int			hashSize;
+	int			numHeaderLongs;		// not counting the checksum feed
+	int			namesLength;
+	int			pad;
+} pakIndexEntry_t;
+
+typedef struct {
+	unsigned	pos;
+	unsigned	len;
+	int			name;				// offset in the names
+	int			next;				// next file in the hash, -1 at the end
+} pakIndexFile_t;
+
+typedef struct {
+	pakIndexEntry_t	entry;
+	const char		*path;
+	const byte		*headerLongs;
+	const byte		*files;
+	const byte		*buckets;
+	const char		*names;
+	const byte		*start;
+	int				length;			// of the whole record
+} pakIndexRecord_t;
+
+typedef struct {
+	byte				*data;
+	int					numRecords;
+	pakIndexRecord_t	*records;
+	int					hashSize;
+	int					*hashHeads;
+	int					*hashNext;
+} pakIndex_t;
+
+static	cvar_t		*fs_pakIndex;
+static	pakIndex_t	fs_index;
+static	qboolean	fs_indexDirty;		// a pak was loaded without the index
+
+/*
+=================
+FS_ParseIndexRecord
+
+Checks everything in a record that loading it relies on
+=================
+*/
+static qboolean FS_ParseIndexRecord(const byte *p, const byte *end, pakIndexRecord_t *rec)
+{
+	const pakIndexEntry_t	*e = &rec->entry;
+	pakIndexFile_t			file;
+	int						i, next, steps;
+
+	if(end - p < sizeof(*e))
+		return qfalse;
+	Com_Memcpy(&rec->entry, p, sizeof(*e));
+	rec->start = p;
+
+	if(e->pathLength < 2 || e->pathLength > MAX_OSPATH
+	   || e->numFiles < 0 || e->numFiles > PAK_INDEX_MAX_FILES
+	   || e->hashSize < 1 || e->hashSize > MAX_FILEHASH_SIZE || (e->hashSize & (e->hashSize - 1))
+	   || e->numHeaderLongs < 0 || e->numHeaderLongs > e->numFiles
+	   || e->namesLength < 0 || e->namesLength > e->numFiles * MAX_ZPATH)
+		return qfalse;
+
+	rec->length = sizeof(*e) + e->pathLength + e->numHeaderLongs * sizeof(int)
+		+ e->numFiles * sizeof(pakIndexFile_t) + e->hashSize * sizeof(int) + e->namesLength;
+	if(end - p < rec->length)
+		return qfalse;
+
+	rec->path = (const char *)p + sizeof(*e);
+	rec->headerLongs = (const byte *)rec->path + e->pathLength;
+	rec->files = rec->headerLongs + e->numHeaderLongs * sizeof(int);
+	rec->buckets = rec->files + e->numFiles * sizeof(pakIndexFile_t);
+	rec->names = (const char *)rec->buckets + e->hashSize * sizeof(int);
+
+	if(rec->path[e->pathLength - 1] || (e->namesLength && rec->names[e->namesLength - 1]))
+		return qfalse;
+
+	for(i = 0; i < e->numFiles; i++)
+	{
+		Com_Memcpy(&file, rec->files + i * sizeof(file), sizeof(file));
+		if(file.name < 0 || file.name >= e->namesLength || file.next < -1 || file.next >= e->numFiles)
+			return qfalse;
+	}
+
+	// the hash chains must end, or lookups would never return
+	steps = 0;
+	for(i = 0; i < e->hashSize; i++)
+	{
+		Com_Memcpy(&next, rec->buckets + i * sizeof(int), sizeof(next));
+		while(next != -1)
+		{
+			if(next < -1 || next >= e->numFiles || ++steps > e->numFiles)
+				return qfalse;
+			Com_Memcpy(&file, rec->files + next * sizeof(file), sizeof(file));
+			next = file.next;
+		}
+	}
+
+	return qtrue;
+}
+
+/*
+=================
+FS_FreePakIndex
+=================
+*/
+static void FS_FreePakIndex(void)
+{
+	if(fs_index.data)
+	{
+		Z_Free(fs_index.data);
+		Z_Free(fs_index.records);
+		Z_Free(fs_index.hashHeads);
+	}
+	Com_Memset(&fs_index, 0, sizeof(fs_index));
+}
+
+/*
+=================
+FS_LoadPakIndex
+=================
+*/
+static void FS_LoadPakIndex(const char *ospath)
+{
+	pakIndexHeader_t	header;
+	FILE				*f;
+	byte				*p, *end;
+	long				length;
+	int					i, hash;
+
+	FS_FreePakIndex();
+
+	f = Sys_FOpen(ospath, "rb");
+	if(!f)
+		return;
 
-	search = searchPath;
+	fseek(f, 0, SEEK_END);
+	length = ftell(f);
+	fseek(f, 0, SEEK_SET);
 
-	if(search == NULL)
+	if(length < sizeof(header) || fread(&header, sizeof(header), 1, f) != 1
+	   || header.ident != PAK_INDEX_IDENT || header.version != PAK_INDEX_VERSION
+	   || header.numPaks < 0 || header.numPaks > MAX_SEARCH_PATHS)
 	{
-		// look for it in the filesystem or pack files
-		len = FS_FOpenFileRead(qpath, &h, qfalse);
+		fclose(f);
+		return;
 	}
-	else
+
+	length -= sizeof(header);
+	fs_index.data = Z_Malloc(length + 1);
+	if(fread(fs_index.data, 1, length, f) != length)
 	{
-		// look for it in a specific search path only
-		len = FS_FOpenFileReadDir(qpath, search, &h, qfalse, unpure);
+		fclose(f);
+		FS_FreePakIndex();
+		return;
 	}
+	fclose(f);
 
-	if ( h == 0 ) {
-		if ( buffer ) {
-			*buffer = NULL;
-		}
-		// if we are journalling and it is a config file, write a zero to the journal file
-		if ( isConfig && com_journal && com_journal->integer == 1 ) {
-			Com_DPrintf( "Writing zero for %s to journal file.\n", qpath );
-			len = 0;
-			FS_Write( &len, sizeof( len ), com_journalDataFile );
-			FS_Flush( com_journalDataFile );
-		}
-		return -1;
+	for(fs_index.hashSize = 1; fs_index.hashSize < header.numPaks; fs_index.hashSize <<= 1)
+		;
+	fs_index.records = Z_Malloc(header.numPaks * sizeof(*fs_index.records) + 1);
+	fs_index.hashHeads = Z_Malloc((fs_index.hashSize + header.numPaks) * sizeof(int));
+	fs_index.hashNext = fs_index.hashHeads + fs_index.hashSize;
+	for(i = 0; i < fs_index.hashSize; i++)
+		fs_index.hashHeads[i] = -1;
+
+	p = fs_index.data;
+	end = p + length;
+	for(i = 0; i < header.numPaks; i++)
+	{
+		if(!FS_ParseIndexRecord(p, end, &fs_index.records[i]))
+			break;
+		p += fs_index.records[i].length;
+
+		hash = FS_HashFileName(fs_index.records[i].path, fs_index.hashSize);
+		fs_index.hashNext[i] = fs_index.hashHeads[hash];
+		fs_index.hashHeads[hash] = i;
 	}
 
-	if ( !buffer ) {
-		if ( isConfig && com_journal && com_journal->integer == 1 ) {
-			Com_DPrintf( "Writing len for %s to journal file.\n", qpath );
-			FS_Write( &len, sizeof( len ), com_journalDataFile );
-			FS_Flush( com_journalDataFile );
-		}
-		FS_FCloseFile( h);
-		return len;
+	if(i != header.numPaks || p != end)
+	{
+		Com_Printf(S_COLOR_YELLOW "WARNING: %s is damaged, rebuilding it\n", ospath);
+		FS_FreePakIndex();
+		fs_indexDirty = qtrue;
+		return;
 	}
 
-	fs_loadCount++;
-	fs_loadStack++;
+	fs_index.numRecords = header.numPaks;
+}
 
-	buf = Hunk_AllocateTempMemory(len+1);
-	*buffer = buf;
+/*
+=================
+FS_PakIndexPath
+=================
+*/
+static char *FS_PakIndexPath(void)
+{
+	char	*ospath;
 
-	FS_Read (buf, len, h);
+	ospath = FS_BuildOSPath(fs_homepath->string, PAK_INDEX_NAME, "");
+	ospath[strlen(ospath) - 1] = '\0';
 
-	// guarantee that it will have a trailing 0 for string operations
-	buf[len] = 0;
-	FS_FCloseFile( h );
+	return ospath;
+}
 
-	// if we are journalling and it is a config file, write it to the journal file
-	if ( isConfig && com_journal && com_journal->integer == 1 ) {
-		Com_DPrintf( "Writing %s to journal file.\n", qpath );
-		FS_Write( &len, sizeof( len ), com_journalDataFile );
-		FS_Write( buf, len, com_journalDataFile );
-		FS_Flush( com_journalDataFile );
+/*
+=================
+FS_FindIndexRecord
+=================
+*/
+static const pakIndexRecord_t *FS_FindIndexRecord(const char *zipfile)
+{
+	int		i;
+
+	if(!fs_index.numRecords)
+		return NULL;
+
+	for(i = fs_index.hashHeads[FS_HashFileName(zipfile, fs_index.hashSize)]; i != -1; i = fs_index.hashNext[i])
+	{
+		if(!strcmp(fs_index.records[i].path, zipfile))
+			return &fs_index.records[i];
 	}
-	return len;
+
+	return NULL;
 }
 
 /*
-============
-FS_ReadFile
+=================
+FS_LoadIndexedPak
 
-Filename are relative to the quake search path
-a null buffer will just return the file length without loading
-============
+Sets up a pak from the index if it is there and unchanged
+=================
 */
-long FS_ReadFile(const char *qpath, void **buffer)
+static pack_t *FS_LoadIndexedPak(const char *zipfile, const char *basename, int64_t fileSize, int64_t fileTime)
 {
-	return FS_ReadFileDir(qpath, NULL, qfalse, buffer);
+	const pakIndexRecord_t	*rec;
+	const pakIndexEntry_t	*e;
+	pakIndexFile_t			file;
+	fileInPack_t			*buildBuffer;
+	pack_t					*pack;
+	char					*namePtr;
+	int						i, bucket;
+
+	rec = FS_FindIndexRecord(zipfile);
+	if(!rec)
+		return NULL;
+
+	e = &rec->entry;
+	if(e->fileSize != fileSize || e->fileTime != fileTime)
+		return NULL;
+
+	buildBuffer = Z_Malloc((e->numFiles * sizeof(fileInPack_t)) + e->namesLength);
+	namePtr = ((char *) buildBuffer) + e->numFiles * sizeof(fileInPack_t);
+	Com_Memcpy(namePtr, rec->names, e->namesLength);
+
+	pack = FS_AllocPak(zipfile, basename, e->hashSize);
+	pack->numfiles = e->numFiles;
+	pack->buildBuffer = buildBuffer;
+	pack->fileSize = fileSize;
+	pack->fileTime = fileTime;
+
+	for(i = 0; i < e->numFiles; i++)
+	{
+		Com_Memcpy(&file, rec->files + i * sizeof(file), sizeof(file));
+		buildBuffer[i].name = namePtr + file.name;
+		buildBuffer[i].pos = file.pos;
+		buildBuffer[i].len = file.len;
+		buildBuffer[i].next = file.next == -1 ? NULL : &buildBuffer[file.next];
+	}
+
+	for(i = 0; i < e->hashSize; i++)
+	{
+		Com_Memcpy(&bucket, rec->buckets + i * sizeof(int), sizeof(bucket));
+		pack->hashTable[i] = bucket == -1 ? NULL : &buildBuffer[bucket];
+	}
+
+	pack->numHeaderLongs = e->numHeaderLongs + 1;
+	pack->headerLongs = Z_Malloc(pack->numHeaderLongs * sizeof(int));
+	Com_Memcpy(&pack->headerLongs[1], rec->headerLongs, e->numHeaderLongs * sizeof(int));
+	FS_PakChecksums(pack);
+
+	return pack;
 }
 
 /*
-=============
-FS_FreeFile
-=============
+=================
+FS_WriteIndexRecord
+=================
 */
-void FS_FreeFile( void *buffer ) {
-	if ( !fs_searchpaths ) {
-		Com_Error( ERR_FATAL, "Filesystem call made without initialization" );
-	}
-	if ( !buffer ) {
-		Com_Error( ERR_FATAL, "FS_FreeFile( NULL )" );
+static void FS_WriteIndexRecord(FILE *f, const pack_t *pack)
+{
+	pakIndexEntry_t	e;
+	pakIndexFile_t	file;
+	const char		*names;
+	int				i, bucket;
+
+	names = (const char *)(pack->buildBuffer + pack->numfiles);
+
+	Com_Memset(&e, 0, sizeof(e));
+	e.fileSize = pack->fileSize;
+	e.fileTime = pack->fileTime;
+	e.pathLength = strlen(pack->pakFilename) + 1;
+	e.numFiles = pack->numfiles;
+	e.hashSize = pack->hashSize;
+	e.numHeaderLongs = pack->numHeaderLongs - 1;
+	for(i = 0; i < pack->numfiles; i++)
+		e.namesLength += strlen(pack->buildBuffer[i].name) + 1;
+
+	fwrite(&e, sizeof(e), 1, f);
+	fwrite(pack->pakFilename, e.pathLength, 1, f);
+	fwrite(&pack->headerLongs[1], sizeof(int), e.numHeaderLongs, f);
+
+	for(i = 0; i < pack->numfiles; i++)
+	{
+		file.pos = pack->buildBuffer[i].pos;
+		file.len = pack->buildBuffer[i].len;
+		file.name = pack->buildBuffer[i].name - names;
+		file.next = pack->buildBuffer[i].next ? pack->buildBuffer[i].next - pack->buildBuffer : -1;
+		fwrite(&file, sizeof(file), 1, f);
 	}
-	fs_loadStack--;
-
-	Hunk_FreeTempMemory( buffer );
 
-	// if all of our temp files are free, clear all of our space
-	if ( fs_loadStack == 0 ) {
-		Hunk_ClearTempMemory();
+	for(i = 0; i < pack->hashSize; i++)
+	{
+		bucket = pack->hashTable[i] ? pack->hashTable[i] - pack->buildBuffer : -1;
+		fwrite(&bucket, sizeof(bucket), 1, f);
 	}
+
+	fwrite(names, e.namesLength, 1, f);
 }
 
 /*
-============
-FS_WriteFile
+=================
+FS_WritePakIndex
 
-Filename are relative to the quake search path
-============
+Writes the given paks, and keeps the records of paks that aren't loaded
+now but are still on disk unchanged.  The index is written next to the
+old one and renamed over it, so a crash never leaves half an index.
+=================
 */
-void FS_WriteFile( const char *qpath, const void *buffer, int size ) {
-	fileHandle_t f;
-
-	if ( !fs_searchpaths ) {
-		Com_Error( ERR_FATAL, "Filesystem call made without initialization" );
+static void FS_WritePakIndex(const char *ospath, pack_t **paks, int numPaks)
+{
+	pakIndexHeader_t		header;
+	const pakIndexRecord_t	*rec;
+	qboolean				*keep;
+	int64_t					fileSize, fileTime;
+	char					tmpPath[MAX_OSPATH];
+	FILE					*f;
+	int						i, j;
+	qboolean				failed;
+
+	keep = Z_Malloc(fs_index.numRecords * sizeof(*keep) + 1);
+
+	header.ident = PAK_INDEX_IDENT;
+	header.version = PAK_INDEX_VERSION;
+	header.numPaks = numPaks;
+	for(i = 0; i < fs_index.numRecords; i++)
+	{
+		rec = &fs_index.records[i];
+		for(j = 0; j < numPaks; j++)
+		{
+			if(!strcmp(paks[j]->pakFilename, rec->path))
+				break;
+		}
+		if(j == numPaks && header.numPaks < MAX_SEARCH_PATHS && Sys_FileStat(rec->path, &fileSize, &fileTime)
+		   && fileSize == rec->entry.fileSize && fileTime == rec->entry.fileTime)
+		{
+			keep[i] = qtrue;
+			header.numPaks++;
+		}
 	}
 
-	if ( !qpath || !buffer ) {
-		Com_Error( ERR_FATAL, "FS_WriteFile: NULL parameter" );
+	Com_sprintf(tmpPath, sizeof(tmpPath), "%s.tmp", ospath);
+	f = Sys_FOpen(tmpPath, "wb");
+	if(!f)
+	{
+		Com_Printf(S_COLOR_YELLOW "WARNING: couldn't write %s\n", tmpPath);
+		Z_Free(keep);
+		return;
 	}
 
-	f = FS_FOpenFileWrite( qpath );
-	if ( !f ) {
-		Com_Printf( "Failed to open %s\n", qpath );
-		return;
+	failed = (fwrite(&header, sizeof(header), 1, f) != 1);
+	for(i = 0; i < numPaks; i++)
+		FS_WriteIndexRecord(f, paks[i]);
+	for(i = 0; i < fs_index.numRecords; i++)
+	{
+		if(keep[i])
+			fwrite(fs_index.records[i].start, fs_index.records[i].length, 1, f);
 	}
+	failed |= ferror(f) != 0;
+	failed |= fclose(f) != 0;
 
-	FS_Write( buffer, size, f );
+	if(!failed && rename(tmpPath, ospath))
+	{
+		// windows won't rename over an existing file
+		remove(ospath);
+		failed = rename(tmpPath, ospath) != 0;
+	}
+	if(failed)
+	{
+		Com_Printf(S_COLOR_YELLOW "WARNING: couldn't write %s\n", ospath);
+		remove(tmpPath);
+	}
 
-	FS_FCloseFile( f );
+	Z_Free(keep);
 }
 
+/*
+=================
+FS_UpdatePakIndex
+
+Called after FS_Startup has loaded all paks
+=================
+*/
+static void FS_UpdatePakIndex(void)
+{
+	searchpath_t	*search;
+	pack_t			**paks;
+	int				numPaks;
+
+	if(fs_pakIndex->integer && fs_indexDirty)
+	{
+		numPaks = 0;
+		for(search = fs_searchpaths; search; search = search->next)
+		{
+			if(search->pack && search->pack->fileSize >= 0 && numPaks < MAX_SEARCH_PATHS)
+				numPaks++;
+		}
+
+		paks = Z_Malloc(numPaks * sizeof(*paks) + 1);
+		numPaks = 0;
+		for(search = fs_searchpaths; search; search = search->next)
+		{
+			if(search->pack && search->pack->fileSize >= 0 && numPaks < MAX_SEARCH_PATHS)
+				paks[numPaks++] = search->pack;
+		}
+
+		FS_WritePakIndex(FS_PakIndexPath(), paks, numPaks);
+		Z_Free(paks);
+	}
 
+	FS_FreePakIndex();
+	fs_indexDirty = qfalse;
+}
 
 /*
 ==========================================================================
@@ -2032,6 +3933,13 @@ static pack_t *FS_LoadZipFile(const char *zipfile, const char *basename)
 	int				fs_numHeaderLongs;
 	int				*fs_headerLongs;
 	char			*namePtr;
+	int64_t			fileSize, fileTime;
+
+	// unchanged paks are set up from the index
+	if(!Sys_FileStat(zipfile, &fileSize, &fileTime))
+		fileSize = fileTime = -1;
+	else if((pack = FS_LoadIndexedPak(zipfile, basename, fileSize, fileTime)) != NULL)
+		return pack;
 
 	fs_numHeaderLongs = 0;
 
@@ -2066,20 +3974,7 @@ static pack_t *FS_LoadZipFile(const char *zipfile, const char *basename)
 		}
 	}
 
-	pack = Z_Malloc( sizeof( pack_t ) + i * sizeof(fileInPack_t *) );
-	pack->hashSize = i;
-	pack->hashTable = (fileInPack_t **) (((char *) pack) + sizeof( pack_t ));
-	for(i = 0; i < pack->hashSize; i++) {
-		pack->hashTable[i] = NULL;
-	}
-
-	Q_strncpyz( pack->pakFilename, zipfile, sizeof( pack->pakFilename ) );
-	Q_strncpyz( pack->pakBasename, basename, sizeof( pack->pakBasename ) );
-
-	// strip .pk3 if needed
-	if ( strlen( pack->pakBasename ) > 4 && !Q_stricmp( pack->pakBasename + strlen( pack->pakBasename ) - 4, ".pk3" ) ) {
-		pack->pakBasename[strlen( pack->pakBasename ) - 4] = 0;
-	}
+	pack = FS_AllocPak( zipfile, basename, i );
 
 	pack->handle = uf;
 	pack->numfiles = gi.number_entry;
@@ -2107,12 +4002,18 @@ static pack_t *FS_LoadZipFile(const char *zipfile, const char *basename)
 		unzGoToNextFile(uf);
 	}
 
-	pack->checksum = Com_BlockChecksum( &fs_headerLongs[ 1 ], sizeof(*fs_headerLongs) * ( fs_numHeaderLongs - 1 ) );
-	pack->pure_checksum = Com_BlockChecksum( fs_headerLongs, sizeof(*fs_headerLongs) * fs_numHeaderLongs );
-	pack->checksum = LittleLong( pack->checksum );
-	pack->pure_checksum = LittleLong( pack->pure_checksum );
+	// only index a pak whose whole directory was read
+	if (i != gi.number_entry) {
+		fileSize = -1;
+	}
+	pack->numfiles = i;
+	pack->fileSize = fileSize;
+	pack->fileTime = fileTime;
+	fs_indexDirty = qtrue;
 
-	Z_Free(fs_headerLongs);
+	pack->headerLongs = fs_headerLongs;
+	pack->numHeaderLongs = fs_numHeaderLongs;
+	FS_PakChecksums( pack );
 
 	pack->buildBuffer = buildBuffer;
 	return pack;
@@ -2128,7 +4029,11 @@ Frees a pak structure and releases all associated resources
 
 static void FS_FreePak(pack_t *thepak)
 {
-	unzClose(thepak->handle);
+	if(thepak->handle)
+		unzClose(thepak->handle);
+	if(thepak->mapBase)
+		Sys_UnmapFile(thepak->mapBase, thepak->mapLength);
+	Z_Free(thepak->headerLongs);
 	Z_Free(thepak->buildBuffer);
 	Z_Free(thepak);
 }
@@ -2778,7 +4683,7 @@ void FS_Path_f( void ) {
 
 	Com_Printf( "\n" );
 	for ( i = 1 ; i < MAX_FILE_HANDLES ; i++ ) {
-		if ( fsh[i].handleFiles.file.o ) {
+		if ( fsh[i].handleFiles.file.o || fsh[i].inUse ) {
 			Com_Printf( "handle %i: %s\n", i, fsh[i].name );
 		}
 	}
@@ -2861,6 +4766,210 @@ void FS_Which_f( void ) {
 	Com_Printf("File not found: \"%s\"\n", filename);
 }
 
+/*
+============
+FS_WriteBenchPak
+
+A zip of small stored files, shaped like a custom map pk3
+============
+*/
+#define	BENCH_PAK_FILES		40
+
+static ID_INLINE void FS_PutZipShort( byte *p, int v ) {
+	p[0] = v & 255;
+	p[1] = ( v >> 8 ) & 255;
+}
+
+static ID_INLINE void FS_PutZipLong( byte *p, unsigned long v ) {
+	FS_PutZipShort( p, v & 0xffff );
+	FS_PutZipShort( p + 2, ( v >> 16 ) & 0xffff );
+}
+
+static void FS_BenchPakFile( int pakNum, int fileNum, char name[MAX_QPATH], char data[128] ) {
+	if ( !fileNum ) {
+		Com_sprintf( name, MAX_QPATH, "maps/bench%03i.bsp", pakNum );
+	} else {
+		Com_sprintf( name, MAX_QPATH, "textures/bench%03i/tex%02i.tga", pakNum, fileNum );
+	}
+	Com_sprintf( data, 128, "%s %i", name, pakNum * BENCH_PAK_FILES + fileNum );
+}
+
+static qboolean FS_WriteBenchPak( const char *ospath, int pakNum ) {
+	byte		header[ZIP_CENTRAL_SIZE], *central, *c;
+	char		name[MAX_QPATH], data[128];
+	unsigned long	crc, ofs, offsets[BENCH_PAK_FILES], crcs[BENCH_PAK_FILES];
+	int			i, nameLen, dataLen, centralLen;
+	FILE		*f;
+
+	f = Sys_FOpen( ospath, "wb" );
+	if ( !f ) {
+		return qfalse;
+	}
+
+	// local headers and data
+	ofs = 0;
+	for ( i = 0 ; i < BENCH_PAK_FILES ; i++ ) {
+		FS_BenchPakFile( pakNum, i, name, data );
+		nameLen = strlen( name );
+		dataLen = strlen( data );
+		crc = crc32( 0, (const Bytef *)data, dataLen );
+
+		Com_Memset( header, 0, ZIP_LOCAL_SIZE );
+		FS_PutZipLong( header, 0x04034b50 );
+		FS_PutZipShort( header + 4, 10 );
+		FS_PutZipLong( header + 14, crc );
+		FS_PutZipLong( header + 18, dataLen );
+		FS_PutZipLong( header + 22, dataLen );
+		FS_PutZipShort( header + 26, nameLen );
+		fwrite( header, ZIP_LOCAL_SIZE, 1, f );
+		fwrite( name, nameLen, 1, f );
+		fwrite( data, dataLen, 1, f );
+
+		offsets[i] = ofs;
+		crcs[i] = crc;
+		ofs += ZIP_LOCAL_SIZE + nameLen + dataLen;
+	}
+
+	// central directory
+	central = Z_Malloc( BENCH_PAK_FILES * ( ZIP_CENTRAL_SIZE + MAX_QPATH ) );
+	c = central;
+	for ( i = 0 ; i < BENCH_PAK_FILES ; i++ ) {
+		FS_BenchPakFile( pakNum, i, name, data );
+		nameLen = strlen( name );
+		dataLen = strlen( data );
+
+		Com_Memset( c, 0, ZIP_CENTRAL_SIZE );
+		FS_PutZipLong( c, 0x02014b50 );
+		FS_PutZipShort( c + 4, 20 );
+		FS_PutZipShort( c + 6, 10 );
+		FS_PutZipLong( c + 16, crcs[i] );
+		FS_PutZipLong( c + 20, dataLen );
+		FS_PutZipLong( c + 24, dataLen );
+		FS_PutZipShort( c + 28, nameLen );
+		FS_PutZipLong( c + 42, offsets[i] );
+		Com_Memcpy( c + ZIP_CENTRAL_SIZE, name, nameLen );
+		c += ZIP_CENTRAL_SIZE + nameLen;
+	}
+	centralLen = c - central;
+	fwrite( central, centralLen, 1, f );
+	Z_Free( central );
+
+	// end of central directory
+	Com_Memset( header, 0, 22 );
+	FS_PutZipLong( header, 0x06054b50 );
+	FS_PutZipShort( header + 8, BENCH_PAK_FILES );
+	FS_PutZipShort( header + 10, BENCH_PAK_FILES );
+	FS_PutZipLong( header + 12, centralLen );
+	FS_PutZipLong( header + 16, ofs );
+	fwrite( header, 22, 1, f );
+
+	fclose( f );
+	return qtrue;
+}
+
+/*
+============
+FS_PakBench_f
+
+pakbench [paks]
+
+Times setting up synthetic paks from their zip directories and from
+the pak index, like FS_Startup does.  The paks and the index are written
+to pakbench under the home path and deleted again afterwards.
+============
+*/
+void FS_PakBench_f( void ) {
+	char		(*paths)[MAX_OSPATH];
+	char		indexPath[MAX_OSPATH];
+	pack_t		**paks;
+	int			*checksums;
+	int			i, count, mismatches;
+	int64_t		fileSize, fileTime, start, scanTime, indexTime;
+
+	if ( !com_developer->integer ) {
+		Com_Printf( "pakbench: only runs with developer 1\n" );
+		return;
+	}
+
+	count = Cmd_Argc() > 1 ? atoi( Cmd_Argv( 1 ) ) : 500;
+	if ( count < 1 || count > 2000 ) {
+		Com_Printf( "Usage: pakbench [1-2000 paks]\n" );
+		return;
+	}
+
+	paths = Z_Malloc( count * sizeof( *paths ) );
+	paks = Z_Malloc( count * sizeof( *paks ) );
+	checksums = Z_Malloc( count * 2 * sizeof( *checksums ) );
+
+	Q_strncpyz( indexPath, FS_BuildOSPath( fs_homepath->string, "pakbench", "bench.pidx" ), sizeof( indexPath ) );
+	for ( i = 0 ; i < count ; i++ ) {
+		Q_strncpyz( paths[i], FS_BuildOSPath( fs_homepath->string, "pakbench", va( "bench%03i.pk3", i ) ), sizeof( paths[i] ) );
+	}
+
+	for ( i = 0 ; i < count ; i++ ) {
+		if ( Sys_FileStat( paths[i], &fileSize, &fileTime ) ) {
+			continue;
+		}
+		if ( !i ) {
+			FS_CreatePath( paths[i] );
+		}
+		if ( !FS_WriteBenchPak( paths[i], i ) ) {
+			Com_Printf( "Couldn't write %s\n", paths[i] );
+			goto done;
+		}
+	}
+
+	// reading the zip directories
+	FS_FreePakIndex();
+	start = Sys_Microseconds();
+	for ( i = 0 ; i < count ; i++ ) {
+		paks[i] = FS_LoadZipFile( paths[i], va( "bench%03i.pk3", i ) );
+	}
+	scanTime = Sys_Microseconds() - start;
+
+	FS_WritePakIndex( indexPath, paks, count );
+	for ( i = 0 ; i < count ; i++ ) {
+		checksums[i * 2] = paks[i]->checksum;
+		checksums[i * 2 + 1] = paks[i]->pure_checksum;
+		FS_FreePak( paks[i] );
+	}
+
+	// one read of the index and a stat per pak
+	start = Sys_Microseconds();
+	FS_LoadPakIndex( indexPath );
+	for ( i = 0 ; i < count ; i++ ) {
+		paks[i] = FS_LoadZipFile( paths[i], va( "bench%03i.pk3", i ) );
+	}
+	indexTime = Sys_Microseconds() - start;
+
+	mismatches = 0;
+	for ( i = 0 ; i < count ; i++ ) {
+		if ( paks[i]->checksum != checksums[i * 2] || paks[i]->pure_checksum != checksums[i * 2 + 1] ) {
+			mismatches++;
+		}
+		FS_FreePak( paks[i] );
+	}
+	FS_FreePakIndex();
+	fs_indexDirty = qfalse;
+
+	Com_Printf( "%i paks of %i files\n", count, BENCH_PAK_FILES );
+	Com_Printf( "zip directories: %8.2f msec\n", scanTime / 1000.0 );
+	Com_Printf( "pak index:       %8.2f msec\n", indexTime / 1000.0 );
+	if ( mismatches ) {
+		Com_Printf( S_COLOR_YELLOW "WARNING: %i paks got different checksums from the index\n", mismatches );
+	}
+
+done:
+	for ( i = 0 ; i < count ; i++ ) {
+		remove( paths[i] );
+	}
+	remove( indexPath );
+
+	Z_Free( checksums );
+	Z_Free( paks );
+	Z_Free( paths );
+}
+
 
 //===========================================================================
 
@@ -3192,8 +5301,10 @@ void FS_Shutdown( qboolean closemfp ) {
 	searchpath_t	*p, *next;
 	int	i;
 
+	FS_ClearPrefetch();
+
 	for(i = 0; i < MAX_FILE_HANDLES; i++) {
-		if (fsh[i].fileSize) {
+		if (fsh[i].fileSize || fsh[i].inUse) {
 			FS_FCloseFile(i);
 		}
 	}
@@ -3211,6 +5322,8 @@ void FS_Shutdown( qboolean closemfp ) {
 		Z_Free(p);
 	}
 
+	FS_FreeLookup();
+
 	// any FS_ calls will now be an error until reinitialized
 	fs_searchpaths = NULL;
 
@@ -3219,6 +5332,7 @@ void FS_Shutdown( qboolean closemfp ) {
 	Cmd_RemoveCommand( "fdir" );
 	Cmd_RemoveCommand( "touchFile" );
 	Cmd_RemoveCommand( "which" );
+	Cmd_RemoveCommand( "pakbench" );
 
 #ifdef FS_MISSING
 	if (closemfp) {
@@ -3270,6 +5384,10 @@ static void FS_ReorderPurePaks( void )
 			p_previous = &s->next;
 		}
 	}
+
+	if ( fs_reordered && fs_lookupHash ) {
+		FS_LookupLink();
+	}
 }
 
 /*
@@ -3286,6 +5404,7 @@ static void FS_Startup( const char *gameName )
 	fs_packFiles = 0;
 
 	fs_debug = Cvar_Get( "fs_debug", "0", 0 );
+	fs_mmap = Cvar_Get( "fs_mmap", sizeof( void * ) > 4 ? "1" : "0", CVAR_ARCHIVE );
 	fs_basepath = Cvar_Get ("fs_basepath", Sys_DefaultInstallPath(), CVAR_INIT|CVAR_PROTECTED );
 	fs_basegame = Cvar_Get ("fs_basegame", "", CVAR_INIT );
 	homePath = Sys_DefaultHomePath();
@@ -3294,6 +5413,14 @@ static void FS_Startup( const char *gameName )
 	}
 	fs_homepath = Cvar_Get ("fs_homepath", homePath, CVAR_INIT|CVAR_PROTECTED );
 	fs_gamedirvar = Cvar_Get ("fs_game", "", CVAR_INIT|CVAR_SYSTEMINFO );
+	fs_pakIndex = Cvar_Get ("fs_pakIndex", "1", CVAR_ARCHIVE );
+	fs_lookupTable = Cvar_Get ("fs_lookupTable", "1", CVAR_ARCHIVE );
+	fs_prefetchSize = Cvar_Get ("fs_prefetchSize", "64", CVAR_ARCHIVE );
+
+	fs_indexDirty = qfalse;
+	if (fs_pakIndex->integer && fs_homepath->string[0]) {
+		FS_LoadPakIndex( FS_PakIndexPath() );
+	}
 
 	// add search path elements in reverse priority order
 	fs_steampath = Cvar_Get ("fs_steampath", Sys_SteamPath(), CVAR_INIT|CVAR_PROTECTED );
@@ -3338,6 +5465,12 @@ static void FS_Startup( const char *gameName )
 		}
 	}
 
+	if (fs_homepath->string[0]) {
+		FS_UpdatePakIndex();
+	} else {
+		FS_FreePakIndex();
+	}
+
 #ifndef STANDALONE
 	if(!com_standalone->integer)
 	{
@@ -3357,11 +5490,14 @@ static void FS_Startup( const char *gameName )
 	Cmd_AddCommand ("fdir", FS_NewDir_f );
 	Cmd_AddCommand ("touchFile", FS_TouchFile_f );
 	Cmd_AddCommand ("which", FS_Which_f );
+	Cmd_AddCommand ("pakbench", FS_PakBench_f );
 
 	// https://zerowing.idsoftware.com/bugzilla/show_bug.cgi?id=506
 	// reorder the pure pk3 files according to server order
 	FS_ReorderPurePaks();
 
+	FS_BuildLookup();
+
 	// print the current search paths
 	FS_Path_f();
 
@@ -3375,6 +5511,9 @@ static void FS_Startup( const char *gameName )
 	}
 #endif
 	Com_Printf( "%d files in pk3 files\n", fs_packFiles );
+	if ( fs_lookupHash ) {
+		Com_Printf( "%d files in the lookup table\n", fs_numLookup );
+	}
 }
 
 #ifndef STANDALONE
@@ -4079,7 +6218,9 @@ int		FS_FOpenFileByMode( const char *qpath, fileHandle_t *f, fsMode_t mode ) {
 
 int		FS_FTell( fileHandle_t f ) {
 	int pos;
-	if (fsh[f].zipFile == qtrue) {
+	if (fsh[f].zipData) {
+		pos = fsh[f].zipOffset;
+	} else if (fsh[f].zipFile == qtrue) {
 		pos = unztell(fsh[f].handleFiles.file.z);
 	} else {
 		pos = ftell(fsh[f].handleFiles.file.o);
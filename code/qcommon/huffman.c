@@ -27,10 +27,8 @@ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
 #include "q_shared.h"
 #include "qcommon.h"
 
-static int			bloc = 0;
-
 void	Huff_putBit( int bit, byte *fout, int *offset) {
-	bloc = *offset;
+	int bloc = *offset;
 	if ((bloc&7) == 0) {
 		fout[(bloc>>3)] = 0;
 	}
@@ -39,19 +37,9 @@ void	Huff_putBit( int bit, byte *fout, int *offset) {
 	*offset = bloc;
 }
 
-int		Huff_getBloc(void)
-{
-	return bloc;
-}
-
-void	Huff_setBloc(int _bloc)
-{
-	bloc = _bloc;
-}
-
 int		Huff_getBit( byte *fin, int *offset) {
 	int t;
-	bloc = *offset;
+	int bloc = *offset;
 	t = (fin[(bloc>>3)] >> (bloc&7)) & 0x1;
 	bloc++;
 	*offset = bloc;
@@ -59,19 +47,19 @@ int		Huff_getBit( byte *fin, int *offset) {
 }
 
 /* Add a bit to the output file (buffered) */
-static void add_bit (char bit, byte *fout) {
-	if ((bloc&7) == 0) {
-		fout[(bloc>>3)] = 0;
+static void add_bit (char bit, byte *fout, int *bloc) {
+	if ((*bloc&7) == 0) {
+		fout[(*bloc>>3)] = 0;
 	}
-	fout[(bloc>>3)] |= bit << (bloc&7);
-	bloc++;
+	fout[(*bloc>>3)] |= bit << (*bloc&7);
+	(*bloc)++;
 }
 
 /* Receive one bit from the input file (buffered) */
-static int get_bit (byte *fin) {
+static int get_bit (byte *fin, int *bloc) {
 	int t;
-	t = (fin[(bloc>>3)] >> (bloc&7)) & 0x1;
-	bloc++;
+	t = (fin[(*bloc>>3)] >> (*bloc&7)) & 0x1;
+	(*bloc)++;
 	return t;
 }
 
@@ -263,9 +251,9 @@ void Huff_addRef(huff_t* huff, byte ch) {
 }
 
 /* Get a symbol */
-int Huff_Receive (node_t *node, int *ch, byte *fin) {
+int Huff_Receive (node_t *node, int *ch, byte *fin, int *offset) {
 	while (node && node->symbol == INTERNAL_NODE) {
-		if (get_bit(fin)) {
+		if (get_bit(fin, offset)) {
 			node = node->right;
 		} else {
 			node = node->left;
@@ -280,59 +268,172 @@ int Huff_Receive (node_t *node, int *ch, byte *fin) {
 
 /* Get a symbol */
 void Huff_offsetReceive (node_t *node, int *ch, byte *fin, int *offset) {
-	bloc = *offset;
-	while (node && node->symbol == INTERNAL_NODE) {
-		if (get_bit(fin)) {
-			node = node->right;
-		} else {
-			node = node->left;
-		}
-	}
-	if (!node) {
+	if (!Huff_Receive(node, ch, fin, offset)) {
 		*ch = 0;
-		return;
-//		Com_Error(ERR_DROP, "Illegal tree!");
 	}
-	*ch = node->symbol;
-	*offset = bloc;
 }
 
 /* Send the prefix code for this node */
-static void send(node_t *node, node_t *child, byte *fout) {
+static void send(node_t *node, node_t *child, byte *fout, int *bloc) {
 	if (node->parent) {
-		send(node->parent, node, fout);
+		send(node->parent, node, fout, bloc);
 	}
 	if (child) {
 		if (node->right == child) {
-			add_bit(1, fout);
+			add_bit(1, fout, bloc);
 		} else {
-			add_bit(0, fout);
+			add_bit(0, fout, bloc);
 		}
 	}
 }
 
 /* Send a symbol */
-void Huff_transmit (huff_t *huff, int ch, byte *fout) {
+void Huff_transmit (huff_t *huff, int ch, byte *fout, int *offset) {
 	int i;
 	if (huff->loc[ch] == NULL) { 
 		/* node_t hasn't been transmitted, send a NYT, then the symbol */
-		Huff_transmit(huff, NYT, fout);
+		Huff_transmit(huff, NYT, fout, offset);
 		for (i = 7; i >= 0; i--) {
-			add_bit((char)((ch >> i) & 0x1), fout);
+			add_bit((char)((ch >> i) & 0x1), fout, offset);
 		}
 	} else {
-		send(huff->loc[ch], NULL, fout);
+		send(huff->loc[ch], NULL, fout, offset);
 	}
 }
 
 void Huff_offsetTransmit (huff_t *huff, int ch, byte *fout, int *offset) {
+	send(huff->loc[ch], NULL, fout, offset);
+}
+
+/*
+=================
+Huff_BuildTable
+
+Flattens the current state of a tree into code and lookup tables. The
+tree must not change afterwards, which only holds for a tree that isn't
+used adaptively, such as the one in msg.c.
+=================
+*/
+void Huff_BuildTable( huff_t *huff, huffTable_t *table ) {
+	node_t			*node;
+	unsigned int	code;
+	int				ch, len, i;
+
+	Com_Memset( table, 0, sizeof( *table ) );
+	for ( i = 0 ; i < (1<<HUFF_LOOKUP_BITS) ; i++ ) {
+		table->symbol[i] = -1;
+	}
+
+	for ( ch = 0 ; ch <= HMAX ; ch++ ) {
+		if ( !huff->loc[ch] ) {
+			continue;
+		}
+
+		// walk up to the root, the bit closest to it is sent first
+		code = 0;
+		len = 0;
+		for ( node = huff->loc[ch] ; node->parent ; node = node->parent ) {
+			code = ( code << 1 ) | ( node->parent->right == node );
+			if ( ++len > 32 ) {
+				break;
+			}
+		}
+		if ( len > 32 ) {
+			continue;		// leave it to send()
+		}
+
+		table->code[ch] = code;
+		table->length[ch] = len;
+
+		if ( len > HUFF_LOOKUP_BITS || !len ) {
+			continue;
+		}
+
+		// every lookup index starting with this code decodes to it
+		for ( i = code ; i < (1<<HUFF_LOOKUP_BITS) ; i += 1 << len ) {
+			table->symbol[i] = ch;
+			table->symbolLength[i] = len;
+		}
+	}
+}
+
+/*
+=================
+Huff_tableTransmit
+
+Same bits as Huff_offsetTransmit, written up to a byte at a time
+=================
+*/
+void Huff_tableTransmit( huff_t *huff, huffTable_t *table, int ch, byte *fout, int *offset ) {
+	unsigned int	code;
+	int				len, bloc, n;
+
+	len = table->length[ch];
+	if ( !len ) {
+		send( huff->loc[ch], NULL, fout, offset );
+		return;
+	}
+
+	code = table->code[ch];
 	bloc = *offset;
-	send(huff->loc[ch], NULL, fout);
+	while ( len ) {
+		if ( ( bloc & 7 ) == 0 ) {
+			fout[bloc>>3] = 0;
+		}
+		n = 8 - ( bloc & 7 );
+		if ( n > len ) {
+			n = len;
+		}
+		fout[bloc>>3] |= ( code & ( ( 1 << n ) - 1 ) ) << ( bloc & 7 );
+		code >>= n;
+		len -= n;
+		bloc += n;
+	}
 	*offset = bloc;
 }
 
+/*
+=================
+Huff_tableReceive
+
+Same result as Huff_offsetReceive, decoding short codes with a single
+lookup. Bytes at or past maxsize are never looked at, codes that reach
+them are left to the tree walk.
+=================
+*/
+void Huff_tableReceive( node_t *tree, huffTable_t *table, int *ch, byte *fin, int *offset, int maxsize ) {
+	unsigned int	peek;
+	int				bloc, byteNum, avail, len;
+
+	bloc = *offset;
+	byteNum = bloc >> 3;
+
+	peek = 0;
+	if ( byteNum < maxsize ) {
+		peek = fin[byteNum];
+		if ( byteNum + 1 < maxsize ) {
+			peek |= fin[byteNum + 1] << 8;
+			if ( byteNum + 2 < maxsize ) {
+				peek |= fin[byteNum + 2] << 16;
+			}
+		}
+	}
+	avail = ( maxsize - byteNum ) * 8 - ( bloc & 7 );
+
+	peek = ( peek >> ( bloc & 7 ) ) & ( ( 1 << HUFF_LOOKUP_BITS ) - 1 );
+	len = table->symbolLength[peek];
+
+	if ( table->symbol[peek] < 0 || len > avail ) {
+		Huff_offsetReceive( tree, ch, fin, offset );
+		return;
+	}
+
+	*ch = table->symbol[peek];
+	*offset = bloc + len;
+}
+
 void Huff_Decompress(msg_t *mbuf, int offset) {
-	int			ch, cch, i, j, size;
+	int			ch, cch, i, j, size, bloc;
 	byte		seq[65536];
 	byte*		buffer;
 	huff_t		huff;
@@ -367,11 +468,11 @@ void Huff_Decompress(msg_t *mbuf, int offset) {
 			seq[j] = 0;
 			break;
 		}
-		Huff_Receive(huff.tree, &ch, buffer);				/* Get a character */
+		Huff_Receive(huff.tree, &ch, buffer, &bloc);			/* Get a character */
 		if ( ch == NYT ) {								/* We got a NYT, get the symbol associated with it */
 			ch = 0;
 			for ( i = 0; i < 8; i++ ) {
-				ch = (ch<<1) + get_bit(buffer);
+				ch = (ch<<1) + get_bit(buffer, &bloc);
 			}
 		}
     
@@ -383,10 +484,8 @@ void Huff_Decompress(msg_t *mbuf, int offset) {
 	Com_Memcpy(mbuf->data + offset, seq, cch);
 }
 
-extern 	int oldsize;
-
 void Huff_Compress(msg_t *mbuf, int offset) {
-	int			i, ch, size;
+	int			i, ch, size, bloc;
 	byte		seq[65536];
 	byte*		buffer;
 	huff_t		huff;
@@ -413,7 +512,7 @@ void Huff_Compress(msg_t *mbuf, int offset) {
 
 	for (i=0; i<size; i++ ) {
 		ch = buffer[i];
-		Huff_transmit(&huff, ch, seq);						/* Transmit symbol */
+		Huff_transmit(&huff, ch, seq, &bloc);				/* Transmit symbol */
 		Huff_addRef(&huff, (byte)ch);								/* Do update */
 	}
 
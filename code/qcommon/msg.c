@@ -23,6 +23,8 @@ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
 #include "qcommon.h"
 
 static huffman_t		msgHuff;
+static huffTable_t		msgHuffEncode;		// flattened msgHuff trees
+static huffTable_t		msgHuffDecode;
 
 static qboolean			msgInit = qfalse;
 
@@ -37,9 +39,8 @@ Handles byte ordering and avoids alignment errors
 ==============================================================================
 */
 
-int oldsize = 0;
-
 void MSG_initHuffman( void );
+static void MSG_InitFieldMaps( void );
 
 void MSG_Init( msg_t *buf, byte *data, int length ) {
 	if (!msgInit) {
@@ -101,15 +102,226 @@ bit functions
 =============================================================================
 */
 
-int	overflows;
+/*
+================
+MSG_WorkerError
+
+Snapshots are written in parallel jobs, which must not Com_Error, the
+main thread's share included. There the first error is left in the
+message to be raised after the join and qtrue is returned so the caller
+can give up on the write.
+================
+*/
+static qboolean MSG_WorkerError( msg_t *msg, int code, char *error ) {
+	if ( !Com_InParallelRun() ) {
+		return qfalse;
+	}
+	if ( !msg->error ) {
+		msg->error = error;
+		msg->errorCode = code;
+	}
+	msg->overflowed = qtrue;
+	return qtrue;
+}
+
+/*
+The Huffman coded mode stores the low bits&7 bits of a value as they
+are, then every remaining byte as its msgHuff code, all of it packed
+from the low bit of each byte up.
+
+The functions below collect a whole value in a 64 bit accumulator and
+touch memory a byte at a time instead of going through Huff_putBit and
+the tree for every bit. The reference versions are the original bit by
+bit code, kept around for msgfuzz and msgbench.
+*/
+
+static qboolean	msgBitReference;	// use the bit by bit functions
+
+/*
+=================
+MSG_WriteBitsReference
+=================
+*/
+static void MSG_WriteBitsReference( msg_t *msg, int value, int bits ) {
+	int		i, nbits;
+
+	if (bits&7) {
+		nbits = bits&7;
+		for(i=0;i<nbits;i++) {
+			Huff_putBit((value&1), msg->data, &msg->bit);
+			value = (value>>1);
+		}
+		bits = bits - nbits;
+	}
+	if (bits) {
+		for(i=0;i<bits;i+=8) {
+			Huff_offsetTransmit (&msgHuff.compressor, (value&0xff), msg->data, &msg->bit);
+			value = (value>>8);
+		}
+	}
+}
+
+/*
+=================
+MSG_ReadBitsReference
+=================
+*/
+static int MSG_ReadBitsReference( msg_t *msg, int bits ) {
+	int		i, nbits, get, value;
+
+	value = 0;
+	nbits = 0;
+	if (bits&7) {
+		nbits = bits&7;
+		for(i=0;i<nbits;i++) {
+			value |= (Huff_getBit(msg->data, &msg->bit)<<i);
+		}
+		bits = bits - nbits;
+	}
+	if (bits) {
+		for(i=0;i<bits;i+=8) {
+			Huff_offsetReceive (msgHuff.decompressor.tree, &get, msg->data, &msg->bit);
+			value |= (get<<(i+nbits));
+		}
+	}
+	return value;
+}
+
+/*
+=================
+MSG_WriteHuffBits
+=================
+*/
+static void MSG_WriteHuffBits( msg_t *msg, unsigned int value, int bits ) {
+	uint64_t	acc;
+	int			nacc, pos, nbits, ch, len;
+
+	// pick up the bits already in the last byte
+	pos = msg->bit >> 3;
+	nacc = msg->bit & 7;
+	acc = nacc ? msg->data[pos] & ( ( 1 << nacc ) - 1 ) : 0;
+
+	nbits = bits & 7;
+	if ( nbits ) {
+		acc |= (uint64_t)( value & ( ( 1 << nbits ) - 1 ) ) << nacc;
+		nacc += nbits;
+		value >>= nbits;
+		bits -= nbits;
+	}
+
+	for ( ; bits > 0 ; bits -= 8, value >>= 8 ) {
+		ch = value & 0xff;
+		len = msgHuffEncode.length[ch];
+
+		if ( nacc + len > 64 || !len ) {
+			for ( ; nacc >= 8 ; nacc -= 8 ) {
+				msg->data[pos++] = (byte)acc;
+				acc >>= 8;
+			}
+		}
+
+		if ( !len ) {
+			// too long for the table, let the tree write it
+			msg->data[pos] = (byte)acc;
+			msg->bit = pos * 8 + nacc;
+			Huff_offsetTransmit( &msgHuff.compressor, ch, msg->data, &msg->bit );
+			pos = msg->bit >> 3;
+			nacc = msg->bit & 7;
+			acc = nacc ? msg->data[pos] & ( ( 1 << nacc ) - 1 ) : 0;
+			continue;
+		}
+
+		acc |= (uint64_t)msgHuffEncode.code[ch] << nacc;
+		nacc += len;
+	}
+
+	msg->bit = pos * 8 + nacc;
+	for ( ; nacc > 0 ; nacc -= 8 ) {
+		msg->data[pos++] = (byte)acc;
+		acc >>= 8;
+	}
+}
+
+/*
+=================
+MSG_LoadBits
+
+Returns up to 64 bits starting at bit, and how many of them come from
+inside the buffer
+=================
+*/
+static uint64_t MSG_LoadBits( msg_t *msg, int bit, int *avail ) {
+	uint64_t	window;
+	int			pos, count, i;
+
+	pos = bit >> 3;
+	count = msg->maxsize - pos;
+	if ( count > 8 ) {
+		count = 8;
+	}
+
+	window = 0;
+	for ( i = 0 ; i < count ; i++ ) {
+		window |= (uint64_t)msg->data[pos + i] << ( i * 8 );
+	}
+
+	*avail = count * 8 - ( bit & 7 );
+	return window >> ( bit & 7 );
+}
+
+/*
+=================
+MSG_ReadHuffBits
+=================
+*/
+static int MSG_ReadHuffBits( msg_t *msg, int bits ) {
+	uint64_t	window;
+	int			avail, bit, nbits, i, peek, len, get, value;
+
+	bit = msg->bit;
+	window = MSG_LoadBits( msg, bit, &avail );
+
+	value = 0;
+	nbits = bits & 7;
+	if ( nbits ) {
+		if ( avail < nbits ) {
+			return MSG_ReadBitsReference( msg, bits );
+		}
+		value = window & ( ( 1 << nbits ) - 1 );
+		window >>= nbits;
+		avail -= nbits;
+		bit += nbits;
+		bits -= nbits;
+	}
+
+	for ( i = 0 ; i < bits ; i += 8 ) {
+		peek = window & ( ( 1 << HUFF_LOOKUP_BITS ) - 1 );
+		len = msgHuffDecode.symbolLength[peek];
+
+		if ( msgHuffDecode.symbol[peek] < 0 || len > avail ) {
+			// long code or near the end of the buffer, walk the tree
+			msg->bit = bit;
+			Huff_offsetReceive( msgHuff.decompressor.tree, &get, msg->data, &msg->bit );
+			bit = msg->bit;
+			window = MSG_LoadBits( msg, bit, &avail );
+		} else {
+			get = msgHuffDecode.symbol[peek];
+			window >>= len;
+			avail -= len;
+			bit += len;
+		}
+
+		value |= get << ( i + nbits );
+	}
+
+	msg->bit = bit;
+	return value;
+}
 
 // negative bit values include signs
 void MSG_WriteBits( msg_t *msg, int value, int bits ) {
-	int	i;
 //	FILE*	fp;
 
-	oldsize += bits;
-
 	// this isn't an exact overflow check, but close enough
 	if ( msg->maxsize - msg->cursize < 4 ) {
 		msg->overflowed = qtrue;
@@ -117,25 +329,12 @@ void MSG_WriteBits( msg_t *msg, int value, int bits ) {
 	}
 
 	if ( bits == 0 || bits < -31 || bits > 32 ) {
+		if ( MSG_WorkerError( msg, ERR_DROP, "MSG_WriteBits: bad bits" ) ) {
+			return;
+		}
 		Com_Error( ERR_DROP, "MSG_WriteBits: bad bits %i", bits );
 	}
 
-	// check for overflows
-	if ( bits != 32 ) {
-		if ( bits > 0 ) {
-			if ( value > ( ( 1 << bits ) - 1 ) || value < 0 ) {
-				overflows++;
-			}
-		} else {
-			int	r;
-
-			r = 1 << (bits-1);
-
-			if ( value >  r - 1 || value < -r ) {
-				overflows++;
-			}
-		}
-	}
 	if ( bits < 0 ) {
 		bits = -bits;
 	}
@@ -160,37 +359,106 @@ void MSG_WriteBits( msg_t *msg, int value, int bits ) {
 			msg->cursize += 4;
 			msg->bit += 32;
 		}
-		else 
+		else if ( !MSG_WorkerError( msg, ERR_DROP, "MSG_WriteBits: can't write out of band bits" ) )
 			Com_Error(ERR_DROP, "can't write %d bits", bits);
 	} else {
 //		fp = fopen("c:\\netchan.bin", "a");
 		value &= (0xffffffff>>(32-bits));
-		if (bits&7) {
-			int nbits;
-			nbits = bits&7;
-			for(i=0;i<nbits;i++) {
-				Huff_putBit((value&1), msg->data, &msg->bit);
-				value = (value>>1);
-			}
-			bits = bits - nbits;
-		}
-		if (bits) {
-			for(i=0;i<bits;i+=8) {
-//				fwrite(bp, 1, 1, fp);
-				Huff_offsetTransmit (&msgHuff.compressor, (value&0xff), msg->data, &msg->bit);
-				value = (value>>8);
-			}
+		if (msgBitReference) {
+			MSG_WriteBitsReference(msg, value, bits);
+		} else {
+			MSG_WriteHuffBits(msg, value, bits);
 		}
 		msg->cursize = (msg->bit>>3)+1;
 //		fclose(fp);
 	}
 }
 
+/*
+=================
+MSG_WriteBitBuffer
+
+Appends bits already written by MSG_WriteBits into another message that
+started at bit 0. The coded bits don't depend on where they land, so
+the result is the same as writing the values again. Any bits above the
+last one in data must be clear, as MSG_WriteBits leaves them.
+=================
+*/
+void MSG_WriteBitBuffer( msg_t *msg, const byte *data, int bits ) {
+	int		pos, shift, bytes, i;
+
+	if ( msg->oob ) {
+		if ( MSG_WorkerError( msg, ERR_DROP, "MSG_WriteBitBuffer: out of band message" ) ) {
+			return;
+		}
+		Com_Error( ERR_DROP, "MSG_WriteBitBuffer: out of band message" );
+	}
+
+	if ( bits <= 0 ) {
+		return;
+	}
+
+	bytes = ( bits + 7 ) >> 3;
+
+	// same margin as MSG_WriteBits
+	if ( msg->maxsize - msg->cursize < bytes + 4 ) {
+		msg->overflowed = qtrue;
+		return;
+	}
+
+	pos = msg->bit >> 3;
+	shift = msg->bit & 7;
+
+	if ( !shift ) {
+		Com_Memcpy( msg->data + pos, data, bytes );
+	} else {
+		msg->data[pos] &= ( 1 << shift ) - 1;
+		for ( i = 0 ; i < bytes ; i++ ) {
+			msg->data[pos + i] |= data[i] << shift;
+			msg->data[pos + i + 1] = data[i] >> ( 8 - shift );
+		}
+	}
+
+	msg->bit += bits;
+	msg->cursize = (msg->bit>>3)+1;
+}
+
+/*
+=================
+MSG_ReadBitBuffer
+
+The reverse of MSG_WriteBitBuffer: copies bits already written to the
+message, from bit start on, into data starting at bit 0. The bits above
+the last one copied are cleared, so data can be spliced in again.
+=================
+*/
+void MSG_ReadBitBuffer( msg_t *msg, int start, byte *data, int bits ) {
+	int		pos, shift, bytes, i;
+
+	if ( bits <= 0 ) {
+		return;
+	}
+
+	bytes = ( bits + 7 ) >> 3;
+	pos = start >> 3;
+	shift = start & 7;
+
+	if ( !shift ) {
+		Com_Memcpy( data, msg->data + pos, bytes );
+	} else {
+		for ( i = 0 ; i < bytes ; i++ ) {
+			data[i] = ( msg->data[pos + i] >> shift ) | ( msg->data[pos + i + 1] << ( 8 - shift ) );
+		}
+	}
+
+	if ( bits & 7 ) {
+		data[bytes - 1] &= ( 1 << ( bits & 7 ) ) - 1;
+	}
+}
+
 int MSG_ReadBits( msg_t *msg, int bits ) {
 	int			value;
-	int			get;
 	qboolean	sgn;
-	int			i, nbits;
 //	FILE*	fp;
 
 	value = 0;
@@ -227,22 +495,10 @@ int MSG_ReadBits( msg_t *msg, int bits ) {
 		else
 			Com_Error(ERR_DROP, "can't read %d bits", bits);
 	} else {
-		nbits = 0;
-		if (bits&7) {
-			nbits = bits&7;
-			for(i=0;i<nbits;i++) {
-				value |= (Huff_getBit(msg->data, &msg->bit)<<i);
-			}
-			bits = bits - nbits;
-		}
-		if (bits) {
-//			fp = fopen("c:\\netchan.bin", "a");
-			for(i=0;i<bits;i+=8) {
-				Huff_offsetReceive (msgHuff.decompressor.tree, &get, msg->data, &msg->bit);
-//				fwrite(&get, 1, 1, fp);
-				value |= (get<<(i+nbits));
-			}
-//			fclose(fp);
+		if (msgBitReference) {
+			value = MSG_ReadBitsReference(msg, bits);
+		} else {
+			value = MSG_ReadHuffBits(msg, bits);
 		}
 		msg->readcount = (msg->bit>>3)+1;
 	}
@@ -397,11 +653,9 @@ int MSG_ReadByte( msg_t *msg ) {
 }
 
 int MSG_LookaheadByte( msg_t *msg ) {
-	const int bloc = Huff_getBloc();
 	const int readcount = msg->readcount;
 	const int bit = msg->bit;
 	int c = MSG_ReadByte(msg);
-	Huff_setBloc(bloc);
 	msg->readcount = readcount;
 	msg->bit = bit;
 	return c;
@@ -688,7 +942,6 @@ void MSG_WriteDeltaUsercmdKey( msg_t *msg, int key, usercmd_t *from, usercmd_t *
 		from->buttons == to->buttons &&
 		from->weapon == to->weapon) {
 			MSG_WriteBits( msg, 0, 1 );				// no change
-			oldsize += 7;
 			return;
 	}
 	key ^= to->serverTime;
@@ -832,6 +1085,87 @@ netField_t	entityStateFields[] =
 };
 
 
+/*
+Both states are compared a 32 bit word at a time, straight through the
+struct, into a bit mask with one bit per word. The field tables only
+say in which order the fields are sent; these maps translate between
+field and word numbers so the changed fields can be read off the mask.
+*/
+
+#define	ENTITY_STATE_WORDS	( sizeof( entityState_t ) / 4 )
+#define	PLAYER_STATE_WORDS	( sizeof( playerState_t ) / 4 )
+#define	STATE_MASK_WORDS	( ( PLAYER_STATE_WORDS + 31 ) / 32 )
+
+static byte		entityFieldWord[ARRAY_LEN( entityStateFields )];
+static byte		entityWordField[ENTITY_STATE_WORDS];	// field + 1, 0 if not a field
+
+/*
+==================
+MSG_CompareWords
+
+Sets a bit in mask for every word that differs
+==================
+*/
+static void MSG_CompareWords( const int *from, const int *to, int count, unsigned int *mask ) {
+	int				w, i, n;
+	unsigned int	bits;
+
+	for ( w = 0 ; w < count ; w += 32 ) {
+		n = count - w;
+		if ( n > 32 ) {
+			n = 32;
+		}
+		// no branches, so the compiler is free to vectorize this
+		bits = 0;
+		for ( i = 0 ; i < n ; i++ ) {
+			bits |= (unsigned int)( from[w + i] != to[w + i] ) << i;
+		}
+		mask[w >> 5] = bits;
+	}
+}
+
+#define	MASK_BIT(mask, word)	( ( (mask)[(word) >> 5] >> ( (word) & 31 ) ) & 1 )
+
+/*
+==================
+MSG_LastChangedField
+
+Returns one past the last changed field in send order, 0 if none changed
+==================
+*/
+static int MSG_LastChangedField( const unsigned int *mask, int maskWords, const byte *wordField ) {
+	int				w, bit, lc;
+	unsigned int	bits;
+
+	lc = 0;
+	for ( w = 0 ; w < maskWords ; w++ ) {
+		for ( bits = mask[w] ; bits ; bits &= bits - 1 ) {
+			for ( bit = 0 ; !( bits & ( 1u << bit ) ) ; bit++ ) {
+			}
+			if ( wordField[w * 32 + bit] > lc ) {
+				lc = wordField[w * 32 + bit];
+			}
+		}
+	}
+
+	return lc;
+}
+
+/*
+==================
+MSG_MapFields
+==================
+*/
+static void MSG_MapFields( netField_t *fields, int numFields, byte *fieldWord, byte *wordField, int numWords ) {
+	int		i;
+
+	Com_Memset( wordField, 0, numWords );
+	for ( i = 0 ; i < numFields ; i++ ) {
+		fieldWord[i] = fields[i].offset / 4;
+		wordField[fields[i].offset / 4] = i + 1;
+	}
+}
+
 // if (int)f == f and (int)f + ( 1<<(FLOAT_INT_BITS-1) ) < ( 1 << FLOAT_INT_BITS )
 // the float will be sent with FLOAT_INT_BITS, otherwise all 32 bits will be sent
 #define	FLOAT_INT_BITS	13
@@ -851,19 +1185,17 @@ identical, under the assumption that the in-order delta code will catch it.
 void MSG_WriteDeltaEntity( msg_t *msg, struct entityState_s *from, struct entityState_s *to, 
 						   qboolean force ) {
 	int			i, lc;
-	int			numFields;
 	netField_t	*field;
 	int			trunc;
 	float		fullFloat;
-	int			*fromF, *toF;
-
-	numFields = ARRAY_LEN( entityStateFields );
+	int			*toF;
+	unsigned int	changed[STATE_MASK_WORDS];
 
 	// all fields should be 32 bits to avoid any compiler packing issues
 	// the "number" field is not part of the field list
 	// if this assert fails, someone added a field to the entityState_t
 	// struct without updating the message fields
-	assert( numFields + 1 == sizeof( *from )/4 );
+	assert( ARRAY_LEN( entityStateFields ) + 1 == sizeof( *from )/4 );
 
 	// a NULL to is a delta remove message
 	if ( to == NULL ) {
@@ -876,18 +1208,15 @@ void MSG_WriteDeltaEntity( msg_t *msg, struct entityState_s *from, struct entity
 	}
 
 	if ( to->number < 0 || to->number >= MAX_GENTITIES ) {
+		if ( MSG_WorkerError( msg, ERR_FATAL, "MSG_WriteDeltaEntity: Bad entity number" ) ) {
+			return;
+		}
 		Com_Error (ERR_FATAL, "MSG_WriteDeltaEntity: Bad entity number: %i", to->number );
 	}
 
-	lc = 0;
 	// build the change vector as bytes so it is endien independent
-	for ( i = 0, field = entityStateFields ; i < numFields ; i++, field++ ) {
-		fromF = (int *)( (byte *)from + field->offset );
-		toF = (int *)( (byte *)to + field->offset );
-		if ( *fromF != *toF ) {
-			lc = i+1;
-		}
-	}
+	MSG_CompareWords( (int *)from, (int *)to, ENTITY_STATE_WORDS, changed );
+	lc = MSG_LastChangedField( changed, ( ENTITY_STATE_WORDS + 31 ) / 32, entityWordField );
 
 	if ( lc == 0 ) {
 		// nothing at all changed
@@ -907,13 +1236,11 @@ void MSG_WriteDeltaEntity( msg_t *msg, struct entityState_s *from, struct entity
 
 	MSG_WriteByte( msg, lc );	// # of changes
 
-	oldsize += numFields;
 
 	for ( i = 0, field = entityStateFields ; i < lc ; i++, field++ ) {
-		fromF = (int *)( (byte *)from + field->offset );
 		toF = (int *)( (byte *)to + field->offset );
 
-		if ( *fromF == *toF ) {
+		if ( !MASK_BIT( changed, entityFieldWord[i] ) ) {
 			MSG_WriteBits( msg, 0, 1 );	// no change
 			continue;
 		}
@@ -927,7 +1254,6 @@ void MSG_WriteDeltaEntity( msg_t *msg, struct entityState_s *from, struct entity
 
 			if (fullFloat == 0.0f) {
 					MSG_WriteBits( msg, 0, 1 );
-					oldsize += FLOAT_INT_BITS;
 			} else {
 				MSG_WriteBits( msg, 1, 1 );
 				if ( trunc == fullFloat && trunc + FLOAT_INT_BIAS >= 0 && 
@@ -1145,6 +1471,44 @@ netField_t	playerStateFields[] =
 { PSF(loopSound), 16 }
 };
 
+#define	PS_WORD(x)	( (int)(size_t)&((playerState_t*)0)->x / 4 )
+
+static byte		playerFieldWord[ARRAY_LEN( playerStateFields )];
+static byte		playerWordField[PLAYER_STATE_WORDS];
+
+/*
+==================
+MSG_InitFieldMaps
+==================
+*/
+static void MSG_InitFieldMaps( void ) {
+	MSG_MapFields( entityStateFields, ARRAY_LEN( entityStateFields ),
+		entityFieldWord, entityWordField, ENTITY_STATE_WORDS );
+	MSG_MapFields( playerStateFields, ARRAY_LEN( playerStateFields ),
+		playerFieldWord, playerWordField, PLAYER_STATE_WORDS );
+}
+
+/*
+==================
+MSG_MaskRange
+
+Returns the bits of mask for count words starting at first
+==================
+*/
+static int MSG_MaskRange( const unsigned int *mask, int first, int count ) {
+	unsigned int	bits;
+
+	bits = mask[first >> 5] >> ( first & 31 );
+	if ( ( first & 31 ) + count > 32 ) {
+		bits |= mask[( first >> 5 ) + 1] << ( 32 - ( first & 31 ) );
+	}
+	if ( count < 32 ) {
+		bits &= ( 1u << count ) - 1;
+	}
+
+	return bits;
+}
+
 /*
 =============
 MSG_WriteDeltaPlayerstate
@@ -1158,37 +1522,27 @@ void MSG_WriteDeltaPlayerstate( msg_t *msg, struct playerState_s *from, struct p
 	int				persistantbits;
 	int				ammobits;
 	int				powerupbits;
-	int				numFields;
 	netField_t		*field;
-	int				*fromF, *toF;
+	int				*toF;
 	float			fullFloat;
 	int				trunc, lc;
+	unsigned int	changed[STATE_MASK_WORDS];
 
 	if (!from) {
 		from = &dummy;
 		Com_Memset (&dummy, 0, sizeof(dummy));
 	}
 
-	numFields = ARRAY_LEN( playerStateFields );
-
-	lc = 0;
-	for ( i = 0, field = playerStateFields ; i < numFields ; i++, field++ ) {
-		fromF = (int *)( (byte *)from + field->offset );
-		toF = (int *)( (byte *)to + field->offset );
-		if ( *fromF != *toF ) {
-			lc = i+1;
-		}
-	}
+	MSG_CompareWords( (int *)from, (int *)to, PLAYER_STATE_WORDS, changed );
+	lc = MSG_LastChangedField( changed, STATE_MASK_WORDS, playerWordField );
 
 	MSG_WriteByte( msg, lc );	// # of changes
 
-	oldsize += numFields - lc;
 
 	for ( i = 0, field = playerStateFields ; i < lc ; i++, field++ ) {
-		fromF = (int *)( (byte *)from + field->offset );
 		toF = (int *)( (byte *)to + field->offset );
 
-		if ( *fromF == *toF ) {
+		if ( !MASK_BIT( changed, playerFieldWord[i] ) ) {
 			MSG_WriteBits( msg, 0, 1 );	// no change
 			continue;
 		}
@@ -1221,34 +1575,13 @@ void MSG_WriteDeltaPlayerstate( msg_t *msg, struct playerState_s *from, struct p
 	//
 	// send the arrays
 	//
-	statsbits = 0;
-	for (i=0 ; i<MAX_STATS ; i++) {
-		if (to->stats[i] != from->stats[i]) {
-			statsbits |= 1<<i;
-		}
-	}
-	persistantbits = 0;
-	for (i=0 ; i<MAX_PERSISTANT ; i++) {
-		if (to->persistant[i] != from->persistant[i]) {
-			persistantbits |= 1<<i;
-		}
-	}
-	ammobits = 0;
-	for (i=0 ; i<MAX_WEAPONS ; i++) {
-		if (to->ammo[i] != from->ammo[i]) {
-			ammobits |= 1<<i;
-		}
-	}
-	powerupbits = 0;
-	for (i=0 ; i<MAX_POWERUPS ; i++) {
-		if (to->powerups[i] != from->powerups[i]) {
-			powerupbits |= 1<<i;
-		}
-	}
+	statsbits = MSG_MaskRange( changed, PS_WORD(stats), MAX_STATS );
+	persistantbits = MSG_MaskRange( changed, PS_WORD(persistant), MAX_PERSISTANT );
+	ammobits = MSG_MaskRange( changed, PS_WORD(ammo), MAX_WEAPONS );
+	powerupbits = MSG_MaskRange( changed, PS_WORD(powerups), MAX_POWERUPS );
 
 	if (!statsbits && !persistantbits && !ammobits && !powerupbits) {
 		MSG_WriteBits( msg, 0, 1 );	// no change
-		oldsize += 4;
 		return;
 	}
 	MSG_WriteBits( msg, 1, 1 );	// changed
@@ -1705,6 +2038,7 @@ void MSG_initHuffman( void ) {
 	int i,j;
 
 	msgInit = qtrue;
+	MSG_InitFieldMaps();
 	Huff_Init(&msgHuff);
 	for(i=0;i<256;i++) {
 		for (j=0;j<msg_hData[i];j++) {
@@ -1712,6 +2046,8 @@ void MSG_initHuffman( void ) {
 			Huff_addRef(&msgHuff.decompressor,	(byte)i);			// Do update
 		}
 	}
+	Huff_BuildTable(&msgHuff.compressor, &msgHuffEncode);
+	Huff_BuildTable(&msgHuff.decompressor, &msgHuffDecode);
 }
 
 /*
@@ -1750,3 +2086,362 @@ void MSG_NUinitHuffman() {
 */
 
 //===========================================================================
+
+/*
+=================
+MSG_HuffBench_f
+
+Times the msgHuff tree walk against the lookup tables, either on the
+server messages of a demo or on bytes drawn from msg_hData, and checks
+that both produce the same bits.
+=================
+*/
+#define	HUFFBENCH_SIZE		(1<<20)
+#define	HUFFBENCH_PASSES	8
+
+void MSG_HuffBench_f( void ) {
+	byte	*raw, *symbols, *coded, *check;
+	int		numSymbols, codedBits, checkBits;
+	int		i, j, pass, get, total, r, msec[4];
+	int		len, bit;
+	float	mb;
+
+	if ( !msgInit ) {
+		MSG_initHuffman();
+	}
+
+	symbols = Z_Malloc( HUFFBENCH_SIZE );
+	numSymbols = 0;
+
+	if ( Cmd_Argc() > 1 ) {
+		// the message payloads of a demo, decoded message by message
+		int		fileLen;
+
+		fileLen = FS_ReadFile( Cmd_Argv( 1 ), (void **)&raw );
+		if ( !raw ) {
+			Com_Printf( "couldn't load %s\n", Cmd_Argv( 1 ) );
+			Z_Free( symbols );
+			return;
+		}
+
+		for ( i = 0 ; i + 8 <= fileLen ; i += 8 + len ) {
+			len = LittleLong( ((int *)( raw + i ))[1] );
+			if ( len < 0 || i + 8 + len > fileLen ) {
+				break;
+			}
+			for ( bit = 0 ; ( bit >> 3 ) < len && numSymbols < HUFFBENCH_SIZE ; ) {
+				Huff_offsetReceive( msgHuff.decompressor.tree, &get, raw + i + 8, &bit );
+				symbols[numSymbols++] = get;
+			}
+		}
+		FS_FreeFile( raw );
+	} else {
+		for ( i = 0, total = 0 ; i < 256 ; i++ ) {
+			total += msg_hData[i];
+		}
+		srand( 1 );
+		for ( numSymbols = 0 ; numSymbols < HUFFBENCH_SIZE ; numSymbols++ ) {
+			r = ( ( rand() << 15 ) ^ rand() ) % total;
+			for ( j = 0 ; r >= msg_hData[j] ; j++ ) {
+				r -= msg_hData[j];
+			}
+			symbols[numSymbols] = j;
+		}
+	}
+
+	if ( !numSymbols ) {
+		Com_Printf( "nothing to encode\n" );
+		Z_Free( symbols );
+		return;
+	}
+
+	// codes are at most a few bytes long
+	coded = Z_Malloc( numSymbols * 4 + 4 );
+	check = Z_Malloc( numSymbols * 4 + 4 );
+
+	msec[0] = Sys_Milliseconds();
+	for ( pass = 0 ; pass < HUFFBENCH_PASSES ; pass++ ) {
+		codedBits = 0;
+		for ( i = 0 ; i < numSymbols ; i++ ) {
+			Huff_offsetTransmit( &msgHuff.compressor, symbols[i], coded, &codedBits );
+		}
+	}
+	msec[0] = Sys_Milliseconds() - msec[0];
+
+	msec[1] = Sys_Milliseconds();
+	for ( pass = 0 ; pass < HUFFBENCH_PASSES ; pass++ ) {
+		checkBits = 0;
+		for ( i = 0 ; i < numSymbols ; i++ ) {
+			Huff_tableTransmit( &msgHuff.compressor, &msgHuffEncode, symbols[i], check, &checkBits );
+		}
+	}
+	msec[1] = Sys_Milliseconds() - msec[1];
+
+	if ( checkBits != codedBits || memcmp( coded, check, ( codedBits + 7 ) >> 3 ) ) {
+		Com_Printf( "^1table encoding differs from the tree\n" );
+	}
+
+	msec[2] = Sys_Milliseconds();
+	for ( pass = 0 ; pass < HUFFBENCH_PASSES ; pass++ ) {
+		for ( i = 0, bit = 0 ; i < numSymbols ; i++ ) {
+			Huff_offsetReceive( msgHuff.decompressor.tree, &get, coded, &bit );
+		}
+	}
+	msec[2] = Sys_Milliseconds() - msec[2];
+
+	msec[3] = Sys_Milliseconds();
+	for ( pass = 0 ; pass < HUFFBENCH_PASSES ; pass++ ) {
+		for ( i = 0, bit = 0 ; i < numSymbols ; i++ ) {
+			Huff_tableReceive( msgHuff.decompressor.tree, &msgHuffDecode, &get, coded, &bit, ( codedBits + 7 ) >> 3 );
+			if ( get != symbols[i] ) {
+				Com_Printf( "^1table decoding differs at byte %i\n", i );
+				pass = HUFFBENCH_PASSES;
+				break;
+			}
+		}
+	}
+	msec[3] = Sys_Milliseconds() - msec[3];
+
+	mb = (float)numSymbols * HUFFBENCH_PASSES / ( 1024 * 1024 );
+	Com_Printf( "%i bytes, %i bits coded (%.1f%%)\n", numSymbols, codedBits,
+		100.0f * codedBits / ( numSymbols * 8.0f ) );
+	Com_Printf( "encode: tree %6.1f MB/s  table %6.1f MB/s\n",
+		mb * 1000 / ( msec[0] ? msec[0] : 1 ), mb * 1000 / ( msec[1] ? msec[1] : 1 ) );
+	Com_Printf( "decode: tree %6.1f MB/s  table %6.1f MB/s\n",
+		mb * 1000 / ( msec[2] ? msec[2] : 1 ), mb * 1000 / ( msec[3] ? msec[3] : 1 ) );
+
+	Z_Free( check );
+	Z_Free( coded );
+	Z_Free( symbols );
+}
+
+/*
+=================
+MSG_RandomState
+
+Fills in a state from its field table, with some of the fields taken
+over from a previous state so that deltas stay small.
+=================
+*/
+static void MSG_RandomState( void *state, const void *from, netField_t *fields, int numFields, int keep ) {
+	netField_t	*field;
+	int			i, *toF;
+	float		f;
+
+	for ( i = 0, field = fields ; i < numFields ; i++, field++ ) {
+		toF = (int *)( (byte *)state + field->offset );
+
+		if ( from && rand() % 100 < keep ) {
+			*toF = *(int *)( (byte *)from + field->offset );
+			continue;
+		}
+
+		if ( field->bits == 0 ) {
+			if ( rand() & 1 ) {
+				f = (float)( ( rand() & 0x3fff ) - 0x2000 );	// integral
+			} else {
+				f = ( rand() - RAND_MAX / 2 ) / 7.0f;
+			}
+			*(float *)toF = ( rand() & 7 ) ? f : 0;
+		} else if ( field->bits == 32 ) {
+			*toF = ( rand() << 16 ) ^ rand();
+		} else {
+			*toF = rand() & ( ( 1 << abs( field->bits ) ) - 1 );
+		}
+	}
+}
+
+/*
+=================
+MSG_Fuzz_f
+
+Writes and reads random values and deltas with both the bit by bit and
+the accumulator functions and checks they agree. Some of the values
+are spliced in with MSG_WriteBitBuffer and copied out again with
+MSG_ReadBitBuffer.
+=================
+*/
+void MSG_Fuzz_f( void ) {
+	byte			bufA[MAX_MSGLEN], bufB[MAX_MSGLEN], bufC[MAX_MSGLEN], bufD[MAX_MSGLEN];
+	msg_t			a, b, c;
+	int				count, iter, i, n, errors, split;
+	int				bits[64], values[64];
+	int				va, vb;
+	entityState_t	efrom, eto, ea, eb;
+	playerState_t	pfrom, pto, pa, pb;
+
+	count = Cmd_Argc() > 1 ? atoi( Cmd_Argv( 1 ) ) : 10000;
+	errors = 0;
+	srand( Sys_Milliseconds() );
+
+	for ( iter = 0 ; iter < count && errors < 10 ; iter++ ) {
+		// plain values, including the byte aligned cases
+		n = 1 + rand() % 64;
+		for ( i = 0 ; i < n ; i++ ) {
+			bits[i] = 1 + rand() % 32;
+			if ( bits[i] < 32 && ( rand() & 1 ) ) {
+				bits[i] = -bits[i];
+			}
+			values[i] = ( rand() << 16 ) ^ rand();
+		}
+
+		MSG_Init( &a, bufA, sizeof( bufA ) );
+		MSG_Init( &b, bufB, sizeof( bufB ) );
+		Com_Memset( bufA, 0xaa, sizeof( bufA ) );
+		Com_Memset( bufB, 0x55, sizeof( bufB ) );
+
+		msgBitReference = qtrue;
+		for ( i = 0 ; i < n ; i++ ) {
+			MSG_WriteBits( &a, values[i], bits[i] );
+		}
+		msgBitReference = qfalse;
+		for ( i = 0 ; i < n / 2 ; i++ ) {
+			MSG_WriteBits( &b, values[i], bits[i] );
+		}
+		// the rest goes through MSG_WriteBitBuffer
+		MSG_Init( &c, bufC, sizeof( bufC ) );
+		for ( ; i < n ; i++ ) {
+			MSG_WriteBits( &c, values[i], bits[i] );
+		}
+		split = b.bit;
+		MSG_WriteBitBuffer( &b, bufC, c.bit );
+
+		// the byte at cursize is left alone when the bits end on a byte boundary
+		if ( a.bit != b.bit || a.cursize != b.cursize || memcmp( bufA, bufB, ( a.bit + 7 ) >> 3 ) ) {
+			Com_Printf( "^1msgfuzz: %i values written differently\n", n );
+			errors++;
+			continue;
+		}
+
+		MSG_ReadBitBuffer( &b, split, bufD, c.bit );
+		if ( c.bit && memcmp( bufC, bufD, ( c.bit + 7 ) >> 3 ) ) {
+			Com_Printf( "^1msgfuzz: %i bits copied out differently\n", c.bit );
+			errors++;
+			continue;
+		}
+
+		MSG_BeginReading( &a );
+		MSG_BeginReading( &b );
+		for ( i = 0 ; i < n ; i++ ) {
+			msgBitReference = qtrue;
+			va = MSG_ReadBits( &a, bits[i] );
+			msgBitReference = qfalse;
+			vb = MSG_ReadBits( &b, bits[i] );
+			if ( va != vb || a.bit != b.bit ) {
+				Com_Printf( "^1msgfuzz: value %i of %i bits read back differently\n", i, bits[i] );
+				errors++;
+				break;
+			}
+		}
+
+		// entity and player state deltas
+		Com_Memset( &eto, 0, sizeof( eto ) );
+		Com_Memset( &pfrom, 0, sizeof( pfrom ) );
+		Com_Memset( &pto, 0, sizeof( pto ) );
+		pto.stats[rand() % MAX_STATS] = rand();
+		pto.persistant[rand() % MAX_PERSISTANT] = rand();
+		pto.ammo[rand() % MAX_WEAPONS] = rand();
+		pto.powerups[rand() % MAX_POWERUPS] = rand();
+		MSG_RandomState( &efrom, NULL, entityStateFields, ARRAY_LEN( entityStateFields ), 0 );
+		MSG_RandomState( &eto, &efrom, entityStateFields, ARRAY_LEN( entityStateFields ), rand() % 100 );
+		efrom.number = eto.number = rand() % ( MAX_GENTITIES - 1 );
+		MSG_RandomState( &pfrom, NULL, playerStateFields, ARRAY_LEN( playerStateFields ), 0 );
+		MSG_RandomState( &pto, &pfrom, playerStateFields, ARRAY_LEN( playerStateFields ), rand() % 100 );
+
+		MSG_Init( &a, bufA, sizeof( bufA ) );
+		MSG_Init( &b, bufB, sizeof( bufB ) );
+
+		msgBitReference = qtrue;
+		MSG_WriteDeltaEntity( &a, &efrom, &eto, qtrue );
+		MSG_WriteDeltaPlayerstate( &a, &pfrom, &pto );
+		msgBitReference = qfalse;
+		MSG_WriteDeltaEntity( &b, &efrom, &eto, qtrue );
+		MSG_WriteDeltaPlayerstate( &b, &pfrom, &pto );
+
+		if ( a.bit != b.bit || memcmp( bufA, bufB, ( a.bit + 7 ) >> 3 ) ) {
+			Com_Printf( "^1msgfuzz: deltas written differently\n" );
+			errors++;
+			continue;
+		}
+
+		MSG_BeginReading( &a );
+		MSG_BeginReading( &b );
+		msgBitReference = qtrue;
+		MSG_ReadDeltaEntity( &a, &efrom, &ea, MSG_ReadBits( &a, GENTITYNUM_BITS ) );
+		MSG_ReadDeltaPlayerstate( &a, &pfrom, &pa );
+		msgBitReference = qfalse;
+		MSG_ReadDeltaEntity( &b, &efrom, &eb, MSG_ReadBits( &b, GENTITYNUM_BITS ) );
+		MSG_ReadDeltaPlayerstate( &b, &pfrom, &pb );
+
+		if ( a.bit != b.bit || memcmp( &ea, &eb, sizeof( ea ) ) || memcmp( &pa, &pb, sizeof( pa ) ) ) {
+			Com_Printf( "^1msgfuzz: deltas read back differently\n" );
+			errors++;
+		}
+	}
+
+	msgBitReference = qfalse;
+	Com_Printf( "msgfuzz: %i rounds, %i errors\n", iter, errors );
+}
+
+/*
+=================
+MSG_Bench_f
+
+Times MSG_WriteDeltaEntity and MSG_WriteDeltaPlayerstate with the bit
+by bit and the accumulator functions.
+=================
+*/
+#define	MSGBENCH_STATES		256
+#define	MSGBENCH_ROUNDS		200
+
+void MSG_Bench_f( void ) {
+	static entityState_t	ents[MSGBENCH_STATES][2];
+	static playerState_t	players[MSGBENCH_STATES][2];
+	byte		buf[MAX_MSGLEN];
+	msg_t		msg;
+	int			i, round, ref, msec, bytes;
+	char		*name[2] = { "accumulator", "bit by bit" };
+
+	srand( 1 );
+	for ( i = 0 ; i < MSGBENCH_STATES ; i++ ) {
+		MSG_RandomState( &ents[i][0], NULL, entityStateFields, ARRAY_LEN( entityStateFields ), 0 );
+		MSG_RandomState( &ents[i][1], &ents[i][0], entityStateFields, ARRAY_LEN( entityStateFields ), 80 );
+		ents[i][0].number = ents[i][1].number = i;
+		MSG_RandomState( &players[i][0], NULL, playerStateFields, ARRAY_LEN( playerStateFields ), 0 );
+		MSG_RandomState( &players[i][1], &players[i][0], playerStateFields, ARRAY_LEN( playerStateFields ), 80 );
+	}
+
+	for ( ref = 0 ; ref < 2 ; ref++ ) {
+		msgBitReference = ref;
+
+		msec = Sys_Milliseconds();
+		bytes = 0;
+		for ( round = 0 ; round < MSGBENCH_ROUNDS ; round++ ) {
+			MSG_Init( &msg, buf, sizeof( buf ) );
+			for ( i = 0 ; i < MSGBENCH_STATES ; i++ ) {
+				MSG_WriteDeltaEntity( &msg, &ents[i][0], &ents[i][1], qtrue );
+			}
+			bytes += msg.cursize;
+		}
+		msec = Sys_Milliseconds() - msec;
+		Com_Printf( "%-12s entities:    %6.1f MB/s, %5.0f ns per delta\n", name[ref],
+			bytes / ( 1024.0f * 1024.0f ) * 1000 / ( msec ? msec : 1 ),
+			msec * 1e6f / ( MSGBENCH_ROUNDS * MSGBENCH_STATES ) );
+
+		msec = Sys_Milliseconds();
+		bytes = 0;
+		for ( round = 0 ; round < MSGBENCH_ROUNDS ; round++ ) {
+			MSG_Init( &msg, buf, sizeof( buf ) );
+			for ( i = 0 ; i < MSGBENCH_STATES ; i++ ) {
+				MSG_WriteDeltaPlayerstate( &msg, &players[i][0], &players[i][1] );
+			}
+			bytes += msg.cursize;
+		}
+		msec = Sys_Milliseconds() - msec;
+		Com_Printf( "%-12s playerstates: %6.1f MB/s, %5.0f ns per delta\n", name[ref],
+			bytes / ( 1024.0f * 1024.0f ) * 1000 / ( msec ? msec : 1 ),
+			msec * 1e6f / ( MSGBENCH_ROUNDS * MSGBENCH_STATES ) );
+	}
+
+	msgBitReference = qfalse;
+}
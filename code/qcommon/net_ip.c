@@ -20,6 +20,11 @@ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
 ===========================================================================
 */
 
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+	// recvmmsg() and sendmmsg()
+#	define _GNU_SOURCE
+#endif
+
 #include "../qcommon/q_shared.h"
 #include "../qcommon/qcommon.h"
 #include "net_rina.h"
@@ -82,6 +87,12 @@ static qboolean	winsockInitialized = qfalse;
 #		include <sys/filio.h>
 #	endif
 
+#	ifdef __linux__
+#		include <sys/epoll.h>
+#		include <pthread.h>
+#		include <time.h>
+#	endif
+
 typedef int SOCKET;
 #	define INVALID_SOCKET		-1
 #	define SOCKET_ERROR		-1
@@ -112,6 +123,9 @@ static cvar_t	*net_mcast6iface;
 
 static cvar_t	*net_dropsim;
 
+static cvar_t	*net_batch;
+static cvar_t	*net_showsyscalls;
+
 static struct sockaddr	socksRelayAddr;
 
 static SOCKET	ip_socket         = INVALID_SOCKET;
@@ -119,6 +133,57 @@ static SOCKET	ip6_socket        = INVALID_SOCKET;
 static SOCKET	socks_socket      = INVALID_SOCKET;
 static SOCKET	multicast6_socket = INVALID_SOCKET;
 
+#ifdef __linux__
+// the IP sockets and the RINA flow set all live in one epoll wait set
+#define	NET_MAX_EVENTS	8
+static int	net_epollfd       = -1;
+
+static void NET_WakeBench_f(void);
+static SOCKET	net_benchSocket   = INVALID_SOCKET;	// net_wakebench receiver, waited on too
+
+// batched receive, one recvmmsg() fills a ring that NET_GetPacket empties
+#define	NET_RECV_BATCH	32
+
+typedef struct
+{
+	struct mmsghdr		hdrs[NET_RECV_BATCH];
+	struct iovec		iov[NET_RECV_BATCH];
+	struct sockaddr_storage	from[NET_RECV_BATCH];
+	byte			data[NET_RECV_BATCH][MAX_MSGLEN + 1];
+	int			head;
+	int			count;
+} netRecvBatch_t;
+
+// batched send, queued packets go out with one sendmmsg() per socket
+#define	NET_SEND_BATCH		MAX_CLIENTS
+#define	NET_SEND_PACKETLEN	1400	// MAX_PACKETLEN in net_chan.c
+
+typedef struct
+{
+	struct mmsghdr		hdrs[NET_SEND_BATCH];
+	struct iovec		iov[NET_SEND_BATCH];
+	struct sockaddr_storage	to[NET_SEND_BATCH];
+	byte			data[NET_SEND_BATCH][NET_SEND_PACKETLEN];
+	int			count;
+} netSendBatch_t;
+
+static netRecvBatch_t	ip_recvBatch;
+static netRecvBatch_t	ip6_recvBatch;
+static netSendBatch_t	ip_sendBatch;
+static netSendBatch_t	ip6_sendBatch;
+static qboolean		net_batching = qfalse;
+
+#define	NET_BATCH(b)		(&(b))
+#define	NET_BATCH_PENDING(b)	((b).count > 0)
+#else
+#define	NET_BATCH(b)		NULL
+#define	NET_BATCH_PENDING(b)	qfalse
+#endif
+
+// socket syscalls and packets since the last NET_ShowSyscalls
+static int	c_recvcalls, c_recvpackets;
+static int	c_sendcalls, c_sendpackets;
+
 // Keep track of currently joined multicast group.
 static struct ipv6_mreq curgroup;
 // And the currently bound address.
@@ -386,7 +451,7 @@ qboolean NET_CompareBaseAdrMask(netadr_t a, netadr_t b, int netmask)
 	int curbyte;
 
 	if (a.type == NA_RINA && b.type  == NA_RINA)
-		return a.fd == b.fd ? qtrue : qfalse;
+		return a.fd == b.fd && a.gen == b.gen ? qtrue : qfalse;
 
         if (a.type != b.type)
 		return qfalse;
@@ -483,7 +548,7 @@ const char	*NET_AdrToStringwPort (netadr_t a)
 qboolean	NET_CompareAdr (netadr_t a, netadr_t b)
 {
         if (a.type == NA_RINA && b.type  == NA_RINA)
-                return a.fd == b.fd ? qtrue : qfalse;
+                return a.fd == b.fd && a.gen == b.gen ? qtrue : qfalse;
 
 	if(!NET_CompareBaseAdr(a, b))
 		return qfalse;
@@ -506,6 +571,94 @@ qboolean	NET_IsLocalAddress( netadr_t adr )
 
 //=============================================================================
 
+#ifdef __linux__
+/*
+==================
+NET_RecvBatch
+
+Pops the oldest packet off a receive ring, refilling it with a single
+recvmmsg() when it runs empty. net_message is pointed at the ring slot
+rather than copied, the slot stays valid until the next call.
+==================
+*/
+static int NET_RecvBatch(SOCKET s, netRecvBatch_t *batch, msg_t *net_message,
+	struct sockaddr_storage *from, socklen_t *fromlen)
+{
+	struct mmsghdr *hdr;
+	int i, ret;
+
+	if(!batch->count)
+	{
+		for(i = 0; i < NET_RECV_BATCH; i++)
+		{
+			batch->iov[i].iov_base = batch->data[i];
+			batch->iov[i].iov_len = sizeof(batch->data[i]);
+
+			hdr = &batch->hdrs[i];
+			Com_Memset(&hdr->msg_hdr, 0, sizeof(hdr->msg_hdr));
+			hdr->msg_hdr.msg_name = &batch->from[i];
+			hdr->msg_hdr.msg_namelen = sizeof(batch->from[i]);
+			hdr->msg_hdr.msg_iov = &batch->iov[i];
+			hdr->msg_hdr.msg_iovlen = 1;
+		}
+
+		c_recvcalls++;
+		ret = recvmmsg(s, batch->hdrs, NET_RECV_BATCH, MSG_DONTWAIT, NULL);
+		if(ret <= 0)
+			return SOCKET_ERROR;
+
+		batch->head = 0;
+		batch->count = ret;
+	}
+
+	i = batch->head++;
+	batch->count--;
+
+	hdr = &batch->hdrs[i];
+	*fromlen = hdr->msg_hdr.msg_namelen;
+	Com_Memcpy(from, &batch->from[i], *fromlen);
+
+	net_message->data = batch->data[i];
+	net_message->maxsize = sizeof(batch->data[i]);
+
+	return hdr->msg_len;
+}
+#endif
+
+/*
+==================
+NET_RecvFrom
+
+recvfrom() on one of our sockets, served from its receive ring when
+net_batch is on. batch may be NULL for sockets that are never batched.
+==================
+*/
+static int NET_RecvFrom(SOCKET s, void *batch, msg_t *net_message,
+	struct sockaddr_storage *from, socklen_t *fromlen)
+{
+	int ret;
+
+#ifdef __linux__
+	netRecvBatch_t *ring = batch;
+
+	// a ring that still holds packets is emptied even when net_batch
+	// was just turned off
+	if(ring && (ring->count || net_batch->integer))
+		ret = NET_RecvBatch(s, ring, net_message, from, fromlen);
+	else
+#endif
+	{
+		c_recvcalls++;
+		ret = recvfrom(s, (void *) net_message->data, net_message->maxsize, 0,
+			(struct sockaddr *) from, fromlen);
+	}
+
+	if(ret != SOCKET_ERROR)
+		c_recvpackets++;
+
+	return ret;
+}
+
 /*
 ==================
 NET_GetPacket
@@ -520,14 +673,9 @@ qboolean NET_GetPacket(netadr_t *net_from, msg_t *net_message, fd_set *fdr)
 	socklen_t	fromlen;
 	int		err;
 
-	if(ip_socket != INVALID_SOCKET && FD_ISSET(ip_socket, fdr)) {
+	if(ip_socket != INVALID_SOCKET && (FD_ISSET(ip_socket, fdr) || NET_BATCH_PENDING(ip_recvBatch))) {
 		fromlen = sizeof(from);
-		ret = recvfrom( ip_socket,
-                                (void *) net_message->data,
-                                net_message->maxsize,
-                                0,
-                                (struct sockaddr *) &from,
-                                &fromlen );
+		ret = NET_RecvFrom(ip_socket, NET_BATCH(ip_recvBatch), net_message, &from, &fromlen);
 
 		if (ret == SOCKET_ERROR) {
 			err = socketError;
@@ -568,15 +716,10 @@ qboolean NET_GetPacket(netadr_t *net_from, msg_t *net_message, fd_set *fdr)
 		}
 	}
 
-	if( ip6_socket != INVALID_SOCKET && FD_ISSET(ip6_socket, fdr))
+	if( ip6_socket != INVALID_SOCKET && (FD_ISSET(ip6_socket, fdr) || NET_BATCH_PENDING(ip6_recvBatch)))
 	{
 		fromlen = sizeof(from);
-		ret = recvfrom(ip6_socket,
-                               (void *) net_message->data,
-                               net_message->maxsize,
-                               0,
-                               (struct sockaddr *) &from,
-                               &fromlen);
+		ret = NET_RecvFrom(ip6_socket, NET_BATCH(ip6_recvBatch), net_message, &from, &fromlen);
 
 		if (ret == SOCKET_ERROR) {
 			err = socketError;
@@ -601,12 +744,7 @@ qboolean NET_GetPacket(netadr_t *net_from, msg_t *net_message, fd_set *fdr)
             multicast6_socket != ip6_socket &&
             FD_ISSET(multicast6_socket, fdr)) {
 		fromlen = sizeof(from);
-		ret = recvfrom (multicast6_socket,
-                                (void *) net_message->data,
-                                net_message->maxsize,
-                                0,
-                                (struct sockaddr *) &from,
-                                &fromlen);
+		ret = NET_RecvFrom(multicast6_socket, NULL, net_message, &from, &fromlen);
 
 		if (ret == SOCKET_ERROR) {
 			err = socketError;
@@ -627,11 +765,14 @@ qboolean NET_GetPacket(netadr_t *net_from, msg_t *net_message, fd_set *fdr)
 		}
 	}
 
-	/* RINA */
-        ret = RINA_Recvfrom(net_message, net_from);
-        if (ret > 0) {
-		return qtrue;
-        }
+	/* RINA, only when the flow wait set reported an SDU */
+	ret = RINA_PollFd();
+	if (ret < 0 || FD_ISSET(ret, fdr)) {
+		ret = RINA_Recvfrom(net_message, net_from);
+		if (ret > 0) {
+			return qtrue;
+		}
+	}
 
 	return qfalse;
 }
@@ -640,6 +781,154 @@ qboolean NET_GetPacket(netadr_t *net_from, msg_t *net_message, fd_set *fdr)
 
 static char socksBuf[4096];
 
+#ifdef __linux__
+/*
+==================
+NET_FlushSendBatch
+
+Sends everything queued for one socket with as few sendmmsg() calls
+as the kernel allows.
+==================
+*/
+static void NET_FlushSendBatch(SOCKET s, netSendBatch_t *batch)
+{
+	int sent = 0, ret;
+
+	while(sent < batch->count)
+	{
+		c_sendcalls++;
+		ret = sendmmsg(s, &batch->hdrs[sent], batch->count - sent, 0);
+
+		if(ret == SOCKET_ERROR)
+		{
+			// the packet at the head failed, report it and skip it
+			if(socketError != EAGAIN)
+				Com_Printf("Sys_SendPacket: %s\n", NET_ErrorString());
+			ret = 1;
+		}
+		else
+			c_sendpackets += ret;
+
+		sent += ret;
+	}
+
+	batch->count = 0;
+}
+
+/*
+==================
+NET_BeginBatch
+
+Starts collecting outgoing IP packets when net_batch is on, so that
+NET_FlushBatch can hand them to the kernel in one go.
+==================
+*/
+void NET_BeginBatch(void)
+{
+	net_batching = net_batch->integer ? qtrue : qfalse;
+}
+
+/*
+==================
+NET_FlushBatch
+==================
+*/
+void NET_FlushBatch(void)
+{
+	net_batching = qfalse;
+
+	if(ip_sendBatch.count)
+		NET_FlushSendBatch(ip_socket, &ip_sendBatch);
+	if(ip6_sendBatch.count)
+		NET_FlushSendBatch(ip6_socket, &ip6_sendBatch);
+}
+#else
+void NET_BeginBatch(void)
+{
+}
+
+void NET_FlushBatch(void)
+{
+}
+#endif
+
+/*
+==================
+NET_SendTo
+
+sendto() on one of our sockets, or queued on its send batch between
+NET_BeginBatch and NET_FlushBatch.
+==================
+*/
+static int NET_SendTo(SOCKET s, void *batch, const void *data, int length,
+	const struct sockaddr *to, socklen_t tolen)
+{
+	int ret;
+
+#ifdef __linux__
+	netSendBatch_t *queue = batch;
+	struct mmsghdr *hdr;
+
+	if(queue && net_batching)
+	{
+		// keep the order towards each client, flush before anything
+		// that does not fit in a slot goes out on its own
+		if(queue->count == NET_SEND_BATCH || length > NET_SEND_PACKETLEN)
+			NET_FlushSendBatch(s, queue);
+
+		if(length <= NET_SEND_PACKETLEN)
+		{
+			hdr = &queue->hdrs[queue->count];
+
+			Com_Memcpy(queue->data[queue->count], data, length);
+			Com_Memcpy(&queue->to[queue->count], to, tolen);
+
+			queue->iov[queue->count].iov_base = queue->data[queue->count];
+			queue->iov[queue->count].iov_len = length;
+
+			Com_Memset(&hdr->msg_hdr, 0, sizeof(hdr->msg_hdr));
+			hdr->msg_hdr.msg_name = &queue->to[queue->count];
+			hdr->msg_hdr.msg_namelen = tolen;
+			hdr->msg_hdr.msg_iov = &queue->iov[queue->count];
+			hdr->msg_hdr.msg_iovlen = 1;
+
+			queue->count++;
+			return length;
+		}
+	}
+#endif
+
+	c_sendcalls++;
+	ret = sendto(s, data, length, 0, to, tolen);
+
+	if(ret != SOCKET_ERROR)
+		c_sendpackets++;
+
+	return ret;
+}
+
+/*
+==================
+NET_ShowSyscalls
+
+Prints the socket syscalls made since the last call when
+net_showsyscalls is set. Called once per frame.
+==================
+*/
+void NET_ShowSyscalls(void)
+{
+	if(net_showsyscalls && net_showsyscalls->integer)
+	{
+		Com_Printf("net: recv %3i calls %3i packets, send %3i calls %3i packets\n",
+			c_recvcalls, c_recvpackets, c_sendcalls, c_sendpackets);
+	}
+
+	c_recvcalls = 0;
+	c_recvpackets = 0;
+	c_sendcalls = 0;
+	c_sendpackets = 0;
+}
+
 /*
 ==================
 Sys_SendPacket
@@ -683,27 +972,27 @@ void Sys_SendPacket( int length, const void *data, netadr_t to )
 		*(int *)&socksBuf[4] = ((struct sockaddr_in *)&addr)->sin_addr.s_addr;
 		*(short *)&socksBuf[8] = ((struct sockaddr_in *)&addr)->sin_port;
 		memcpy(&socksBuf[10], data, length);
-		ret = sendto(ip_socket,
-                             socksBuf,
-                             length+10,
-                             0,
-                             &socksRelayAddr,
-                             sizeof(socksRelayAddr));
+		ret = NET_SendTo(ip_socket,
+                                 NULL,
+                                 socksBuf,
+                                 length+10,
+                                 &socksRelayAddr,
+                                 sizeof(socksRelayAddr));
 	} else {
 		if(addr.ss_family == AF_INET)
-			ret = sendto(ip_socket,
-                                     data,
-                                     length,
-                                     0,
-                                     (struct sockaddr *) &addr,
-                                     sizeof(struct sockaddr_in));
+			ret = NET_SendTo(ip_socket,
+                                         NET_BATCH(ip_sendBatch),
+                                         data,
+                                         length,
+                                         (struct sockaddr *) &addr,
+                                         sizeof(struct sockaddr_in));
 		else if(addr.ss_family == AF_INET6)
-			ret = sendto(ip6_socket,
-                                     data,
-                                     length,
-                                     0,
-                                     (struct sockaddr *) &addr,
-                                     sizeof(struct sockaddr_in6));
+			ret = NET_SendTo(ip6_socket,
+                                         NET_BATCH(ip6_sendBatch),
+                                         data,
+                                         length,
+                                         (struct sockaddr *) &addr,
+                                         sizeof(struct sockaddr_in6));
 	}
 	if (ret == SOCKET_ERROR) {
 		int err = socketError;
@@ -723,6 +1012,22 @@ void Sys_SendPacket( int length, const void *data, netadr_t to )
 }
 
 
+//=============================================================================
+
+/*
+==================
+NET_CloseAdr
+
+Releases the transport state kept for a peer that has gone away.
+Only RINA flows carry any.
+==================
+*/
+void NET_CloseAdr( netadr_t adr )
+{
+	if (adr.type == NA_RINA)
+		RINA_Close(&adr);
+}
+
 //=============================================================================
 
 /*
@@ -1388,6 +1693,30 @@ static void NET_GetLocalAddress( void )
 }
 #endif
 
+/*
+====================
+NET_WatchSocket
+
+Adds a socket to the wait set used by NET_Sleep. Closing the socket
+removes it again.
+====================
+*/
+static void NET_WatchSocket(SOCKET s)
+{
+#ifdef __linux__
+	struct epoll_event ev;
+
+	if(net_epollfd == -1 || s == INVALID_SOCKET)
+		return;
+
+	ev.events = EPOLLIN;
+	ev.data.fd = s;
+
+	if(epoll_ctl(net_epollfd, EPOLL_CTL_ADD, s, &ev) == -1)
+		Com_Printf("WARNING: NET_WatchSocket: %s\n", NET_ErrorString());
+#endif
+}
+
 /*
 ====================
 NET_OpenIP
@@ -1419,6 +1748,7 @@ void NET_OpenIP( void )
                                                    &err);
 			if (ip6_socket != INVALID_SOCKET)
 			{
+				NET_WatchSocket(ip6_socket);
 				Cvar_SetValue( "net_port6", port6 + i );
 				break;
 			}
@@ -1437,6 +1767,7 @@ void NET_OpenIP( void )
 		for( i = 0 ; i < 10 ; i++ ) {
 			ip_socket = NET_IPSocket( net_ip->string, port + i, &err );
 			if (ip_socket != INVALID_SOCKET) {
+				NET_WatchSocket(ip_socket);
 				Cvar_SetValue( "net_port", port + i );
 
 				if (net_socksEnabled->integer)
@@ -1530,6 +1861,9 @@ static qboolean NET_GetCvars( void ) {
 
 	net_dropsim = Cvar_Get("net_dropsim", "", CVAR_TEMP);
 
+	net_batch = Cvar_Get("net_batch", "0", CVAR_ARCHIVE);
+	net_showsyscalls = Cvar_Get("net_showsyscalls", "0", CVAR_TEMP);
+
 	return modified ? qtrue : qfalse;
 }
 
@@ -1602,6 +1936,13 @@ void NET_Config( qboolean enableNetworking ) {
 			socks_socket = INVALID_SOCKET;
 		}
 
+#ifdef __linux__
+		ip_recvBatch.count = 0;
+		ip6_recvBatch.count = 0;
+		ip_sendBatch.count = 0;
+		ip6_sendBatch.count = 0;
+#endif
+
 	}
 
 	if( start )
@@ -1633,15 +1974,30 @@ void NET_Init( void ) {
 	Com_Printf( "Winsock Initialized\n" );
 #endif
 
+#ifdef __linux__
+	if(net_epollfd == -1)
+	{
+		net_epollfd = epoll_create1(EPOLL_CLOEXEC);
+
+		if(net_epollfd == -1)
+			Com_Printf("WARNING: epoll_create1: %s, falling back to select()\n", NET_ErrorString());
+	}
+#endif
+
 	NET_Config( qtrue );
 
 	Cmd_AddCommand ("net_restart", NET_Restart_f);
+#ifdef __linux__
+	Cmd_AddCommand ("net_wakebench", NET_WakeBench_f);
+#endif
 
 #ifdef DEDICATED
         RINA_Init(1);
 #else
         RINA_Init(0);
 #endif
+
+	NET_WatchSocket(RINA_PollFd());
 }
 
 
@@ -1663,6 +2019,14 @@ void NET_Shutdown( void ) {
         RINA_Fini(0);
 #endif
 
+#ifdef __linux__
+	if(net_epollfd != -1)
+	{
+		close(net_epollfd);
+		net_epollfd = -1;
+	}
+#endif
+
 #ifdef _WIN32
 	WSACleanup();
 	winsockInitialized = qfalse;
@@ -1673,7 +2037,7 @@ void NET_Shutdown( void ) {
 ====================
 NET_Event
 
-Called from NET_Sleep which uses select() to determine which sockets have seen action.
+Called from NET_Sleep which waits until the sockets or RINA flows have seen action.
 ====================
 */
 
@@ -1709,57 +2073,279 @@ void NET_Event(fd_set *fdr)
 
 /*
 ====================
-NET_Sleep
+NET_Wait
 
-Sleeps msec or until something happens on the network
+Blocks for up to msec milliseconds until an IP socket or a RINA flow
+becomes readable. Every descriptor with pending data is flagged in fdr.
+Returns the number of ready descriptors or SOCKET_ERROR.
 ====================
 */
-void NET_Sleep(int msec)
+static int NET_Wait(int msec, fd_set *fdr)
 {
 	struct timeval timeout;
-	fd_set fdr;
 	int retval;
 	SOCKET highestfd = INVALID_SOCKET;
+	SOCKET rinafd = RINA_PollFd();
 
 	if(msec < 0)
 		msec = 0;
-	FD_ZERO(&fdr);
+	FD_ZERO(fdr);
+
+#ifdef __linux__
+	if(net_epollfd != -1)
+	{
+		struct epoll_event events[NET_MAX_EVENTS];
+		int i;
+
+		retval = epoll_wait(net_epollfd, events, NET_MAX_EVENTS, msec);
+
+		if(retval == SOCKET_ERROR && socketError == EINTR)
+			return 0;
+
+		for(i = 0; i < retval; i++)
+			FD_SET(events[i].data.fd, fdr);
+
+		return retval;
+	}
+#endif
 
 	if(ip_socket != INVALID_SOCKET)
 	{
-		FD_SET(ip_socket, &fdr);
+		FD_SET(ip_socket, fdr);
 
 		highestfd = ip_socket;
 	}
 	if(ip6_socket != INVALID_SOCKET)
 	{
-		FD_SET(ip6_socket, &fdr);
+		FD_SET(ip6_socket, fdr);
 
 		if(highestfd == INVALID_SOCKET || ip6_socket > highestfd)
 			highestfd = ip6_socket;
 	}
+	if(rinafd != INVALID_SOCKET)
+	{
+		FD_SET(rinafd, fdr);
+
+		if(highestfd == INVALID_SOCKET || rinafd > highestfd)
+			highestfd = rinafd;
+	}
+#ifdef __linux__
+	if(net_benchSocket != INVALID_SOCKET)
+	{
+		FD_SET(net_benchSocket, fdr);
+
+		if(highestfd == INVALID_SOCKET || net_benchSocket > highestfd)
+			highestfd = net_benchSocket;
+	}
+#endif
 
 #ifdef _WIN32
 	if(highestfd == INVALID_SOCKET)
 	{
 		// windows ain't happy when select is called without valid FDs
 		SleepEx(msec, 0);
-		return;
+		return 0;
 	}
 #endif
 
 	timeout.tv_sec = msec/1000;
 	timeout.tv_usec = (msec%1000)*1000;
 
-	retval = select(highestfd + 1, &fdr, NULL, NULL, &timeout);
+	retval = select(highestfd + 1, fdr, NULL, NULL, &timeout);
+
+	// a signal such as the profiler's SIGPROF, the caller sleeps again
+	if(retval == SOCKET_ERROR && socketError == EINTR)
+	{
+		FD_ZERO(fdr);
+		return 0;
+	}
+
+	return retval;
+}
+
+/*
+====================
+NET_Sleep
+
+Sleeps msec or until something happens on the network
+====================
+*/
+void NET_Sleep(int msec)
+{
+	fd_set fdr;
+	int retval;
+
+	retval = NET_Wait(msec, &fdr);
 
 	if(retval == SOCKET_ERROR)
-		Com_Printf("Warning: select() syscall failed: %s\n", NET_ErrorString());
+		Com_Printf("Warning: NET_Sleep failed: %s\n", NET_ErrorString());
 	else {
                 NET_Event(&fdr);
 	}
 }
 
+#ifdef __linux__
+/*
+====================
+NET_WakeBench_f
+
+Measures how long it takes NET_Wait to return after a packet is sent,
+once through a private UDP socket pair over loopback and once through a
+socketpair that stands in for a RINA flow on a loopback DIF. Neither
+touches the game sockets, but run it on an idle server for stable numbers.
+====================
+*/
+typedef struct
+{
+	int			fd;		// sending end
+	int			drainfd;	// receiving end
+	struct sockaddr_in	to;
+	qboolean		datagram;
+	int			delay;		// microseconds
+	struct timespec		sent;
+} netWakeProbe_t;
+
+static void *NET_WakeProbe(void *arg)
+{
+	netWakeProbe_t *probe = arg;
+	char ping = 0;
+
+	usleep(probe->delay);
+	clock_gettime(CLOCK_MONOTONIC, &probe->sent);
+
+	if(probe->datagram)
+		sendto(probe->fd, &ping, 1, 0, (struct sockaddr *) &probe->to, sizeof(probe->to));
+	else
+		write(probe->fd, &ping, 1);
+
+	return NULL;
+}
+
+static int NET_WakeBenchRun(netWakeProbe_t *probe, SOCKET readyfd, int count)
+{
+	int i, total = 0, min = 0, max = 0, ready = 0;
+	int usec;
+	qboolean failed;
+	fd_set fdr;
+	char buf[16];
+	struct timespec woke;
+	pthread_t thread;
+
+	for(i = 0; i < count; i++)
+	{
+		probe->delay = 1000 + (rand() % 4000);
+
+		if(pthread_create(&thread, NULL, NET_WakeProbe, probe))
+			return 0;
+
+		do
+		{
+			failed = (NET_Wait(100, &fdr) == SOCKET_ERROR);
+		} while(!failed && !FD_ISSET(readyfd, &fdr));
+
+		clock_gettime(CLOCK_MONOTONIC, &woke);
+		pthread_join(thread, NULL);
+
+		// the receiving end is private, only probes arrive there
+		while(recv(probe->drainfd, buf, sizeof(buf), MSG_DONTWAIT) > 0)
+			;
+
+		if(failed)
+		{
+			Com_Printf("  wait failed: %s\n", NET_ErrorString());
+			continue;
+		}
+
+		usec = (woke.tv_sec - probe->sent.tv_sec) * 1000000 +
+			(woke.tv_nsec - probe->sent.tv_nsec) / 1000;
+
+		if(!ready || usec < min)
+			min = usec;
+		if(!ready || usec > max)
+			max = usec;
+
+		total += usec;
+		ready++;
+	}
+
+	if(ready)
+		Com_Printf("  min %5i avg %5i max %5i usec\n", min, total / ready, max);
+
+	return ready;
+}
+
+static void NET_WakeBench_f(void)
+{
+	netWakeProbe_t probe;
+	int count, pair[2];
+	SOCKET recvfd, sendfd;
+	socklen_t len;
+
+	count = (Cmd_Argc() > 1) ? atoi(Cmd_Argv(1)) : 100;
+	if(count < 1)
+		count = 1;
+
+	Com_Printf("%s wake-up delay over %i packets:\n",
+		(net_epollfd != -1) ? "epoll" : "select", count);
+
+	Com_Memset(&probe, 0, sizeof(probe));
+	probe.to.sin_family = AF_INET;
+	probe.to.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	len = sizeof(probe.to);
+
+	// a socket pair of its own, so no client packet is read and dropped
+	recvfd = socket(PF_INET, SOCK_DGRAM, IPPROTO_UDP);
+	sendfd = socket(PF_INET, SOCK_DGRAM, IPPROTO_UDP);
+
+	if(recvfd != INVALID_SOCKET && sendfd != INVALID_SOCKET &&
+		bind(recvfd, (struct sockaddr *) &probe.to, sizeof(probe.to)) == 0 &&
+		getsockname(recvfd, (struct sockaddr *) &probe.to, &len) == 0)
+	{
+		probe.fd = sendfd;
+		probe.drainfd = recvfd;
+		probe.datagram = qtrue;
+
+		net_benchSocket = recvfd;
+		NET_WatchSocket(recvfd);
+
+		Com_Printf("IP (private loopback socket):\n");
+		NET_WakeBenchRun(&probe, recvfd, count);
+
+		if(net_epollfd != -1)
+			epoll_ctl(net_epollfd, EPOLL_CTL_DEL, recvfd, NULL);
+		net_benchSocket = INVALID_SOCKET;
+	}
+	else
+		Com_Printf("IP: couldn't open a loopback socket, skipped\n");
+
+	if(recvfd != INVALID_SOCKET)
+		closesocket(recvfd);
+	if(sendfd != INVALID_SOCKET)
+		closesocket(sendfd);
+
+	if(RINA_PollFd() == -1 || socketpair(AF_UNIX, SOCK_SEQPACKET, 0, pair))
+	{
+		Com_Printf("RINA: no flow wait set, skipped\n");
+		return;
+	}
+
+	// the receiving end sits in the RINA flow set, but not in the flow
+	// table, so RINA_Recvfrom will never try to read from it
+	RINA_WatchFd(pair[0]);
+
+	probe.fd = pair[1];
+	probe.drainfd = pair[0];
+	probe.datagram = qfalse;
+
+	Com_Printf("RINA (loopback stand-in):\n");
+	NET_WakeBenchRun(&probe, RINA_PollFd(), count);
+
+	RINA_UnwatchFd(pair[0]);
+	close(pair[0]);
+	close(pair[1]);
+}
+#endif
+
 /*
 ====================
 NET_Restart_f
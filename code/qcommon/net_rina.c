@@ -35,6 +35,7 @@
 #include <pthread.h>
 #include <unistd.h>
 #include <stdlib.h>
+#include <sys/epoll.h>
 
 #include <librina-c/librina-c.h>
 
@@ -42,18 +43,173 @@
 #define CLI_NAME "client.ioq3"
 #define DIF_NAME "*"
 #define FDS_SIZE 255
+#define NO_SLOT  FDS_SIZE
+#define BURST    8  /* SDUs read from one flow before moving on */
+#define EVENTS   64
 
-int fds[FDS_SIZE];
+/*
+ * Flow table. Each accepted or allocated flow owns a slot, and the slot
+ * index is what the epoll set hands back, so a readiness event maps to
+ * its flow without a search. The listener thread fills free slots, the
+ * main thread empties them; the lock only guards slot ownership.
+ *
+ * A flow's generation is handed out with its address and checked on
+ * every use, so an address kept after its flow hung up can not reach
+ * the next flow that gets the same fd. Generations of a slot are always
+ * congruent to the slot index, which makes them a slot lookup as well.
+ */
+static int             fds[FDS_SIZE];
+static int             gens[FDS_SIZE];
+static pthread_mutex_t fds_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/*
+ * Flows known to have SDUs waiting, in the order they will be served.
+ * Only the main thread touches the ring.
+ */
+static int ready[FDS_SIZE];
+static int queued[FDS_SIZE];
+static int ready_head;
+static int ready_count;
+static int burst;
 
-static void add_fd(int fd)
+/*
+ * Every flow is registered in this epoll set as soon as it is allocated
+ * or accepted. The set itself is a pollable descriptor, so NET_Sleep
+ * waits on it next to the IP sockets and wakes up when an SDU arrives.
+ */
+static int poll_fd = -1;
+
+static int watch_fd(int fd, int slot)
+{
+        struct epoll_event ev;
+
+        if (poll_fd < 0)
+                return -1;
+
+        ev.events   = EPOLLIN;
+        ev.data.u64 = slot;
+
+        return epoll_ctl(poll_fd, EPOLL_CTL_ADD, fd, &ev);
+}
+
+void RINA_WatchFd(int fd)
+{
+        if (watch_fd(fd, NO_SLOT))
+                printf("Failed to watch fd %d\n", fd);
+}
+
+void RINA_UnwatchFd(int fd)
+{
+        struct epoll_event ev;
+
+        if (poll_fd < 0)
+                return;
+
+        epoll_ctl(poll_fd, EPOLL_CTL_DEL, fd, &ev);
+}
+
+int RINA_PollFd(void)
+{
+        return poll_fd;
+}
+
+static int add_fd(int fd)
 {
         int i;
+        int gen = 0;
+
+        pthread_mutex_lock(&fds_lock);
+
         for (i = 0; i < FDS_SIZE; i++) {
                 if (fds[i] == -1) {
-                        fds[i] = fd;
+                        fds[i]  = fd;
+                        gens[i] += FDS_SIZE;
+                        gen     = gens[i];
                         break;
                 }
         }
+
+        pthread_mutex_unlock(&fds_lock);
+
+        if (i == FDS_SIZE) {
+                printf("Flow table full, dropping flow %d\n", fd);
+                flow_dealloc(fd);
+                return 0;
+        }
+
+        if (watch_fd(fd, i))
+                printf("Failed to watch flow %d\n", fd);
+
+        return gen;
+}
+
+/* the slot still holding the flow of an address, or NO_SLOT; needs the lock */
+static int find_slot(const netadr_t * a)
+{
+        int slot = a->gen % FDS_SIZE;
+
+        if (a->gen <= 0 || fds[slot] != a->fd || gens[slot] != a->gen)
+                return NO_SLOT;
+
+        return slot;
+}
+
+static void del_slot(int slot)
+{
+        if (fds[slot] != -1) {
+                RINA_UnwatchFd(fds[slot]);
+                flow_dealloc(fds[slot]);
+                fds[slot] = -1;
+        }
+}
+
+static void del_fd(int slot)
+{
+        pthread_mutex_lock(&fds_lock);
+        del_slot(slot);
+        pthread_mutex_unlock(&fds_lock);
+}
+
+static void push_ready(int slot)
+{
+        if (queued[slot])
+                return;
+
+        ready[(ready_head + ready_count) % FDS_SIZE] = slot;
+        queued[slot] = 1;
+        ready_count++;
+}
+
+static void pop_ready(void)
+{
+        queued[ready[ready_head]] = 0;
+        ready_head = (ready_head + 1) % FDS_SIZE;
+        ready_count--;
+        burst = 0;
+}
+
+/* queues the flows the epoll set reports, releases hung up ones */
+static int poll_ready(void)
+{
+        struct epoll_event events[EVENTS];
+        int n;
+        int i;
+        int slot;
+
+        n = epoll_wait(poll_fd, events, EVENTS, 0);
+
+        for (i = 0; i < n; i++) {
+                slot = events[i].data.u64;
+                if (slot == NO_SLOT)
+                        continue;
+
+                if (events[i].events & (EPOLLHUP | EPOLLERR))
+                        del_fd(slot);
+                else if (events[i].events & EPOLLIN)
+                        push_ready(slot);
+        }
+
+        return ready_count;
 }
 
 void RINA_Resolve(const char * s, netadr_t * a)
@@ -78,37 +234,84 @@ void RINA_Resolve(const char * s, netadr_t * a)
 
         flow_cntl(fd, FLOW_F_SETFL, FLOW_O_NONBLOCK);
 
-        a->fd = fd;
+        a->fd  = fd;
+        a->gen = add_fd(fd);
+}
+
+void RINA_Close(netadr_t * a)
+{
+        int slot;
 
-        add_fd(fd);
+        pthread_mutex_lock(&fds_lock);
+
+        slot = find_slot(a);
+        if (slot != NO_SLOT)
+                del_slot(slot);
+
+        pthread_mutex_unlock(&fds_lock);
 }
 
+/* addresses of flows that have since gone are dropped, not sent to */
 void RINA_Sendto(int length, const void * data, netadr_t * to)
 {
+        int slot;
+
+        pthread_mutex_lock(&fds_lock);
+        slot = find_slot(to);
+        pthread_mutex_unlock(&fds_lock);
+
+        if (slot == NO_SLOT)
+                return;
+
         flow_write(to->fd, (void *) data, length);
 }
 
+/*
+ * Serves the flow at the head of the ready ring for up to BURST SDUs,
+ * then rotates it to the back so one busy client cannot starve the
+ * others. A flow leaves the ring once it reads dry. The epoll set is
+ * only asked again when the ring is empty.
+ */
 int RINA_Recvfrom(msg_t * msg, netadr_t * from)
 {
         ssize_t count = 0;
-        int i         = 0;
+        int slot;
+        int fd;
 
-        for (i = 0; i < FDS_SIZE; i++) {
-                if (fds[i] == -1)
-                        break;
+        if (poll_fd < 0)
+                return 0;
 
-                count = flow_read(fds[i], msg->data, msg->maxsize);
-                if (count < 0) {
+        if (ready_count == 0)
+                poll_ready();
+
+        while (ready_count > 0) {
+                slot = ready[ready_head];
+                fd   = fds[slot];
+
+                if (fd == -1) {
+                        pop_ready();
+                        continue;
+                }
+
+                count = flow_read(fd, msg->data, msg->maxsize);
+                if (count <= 0) {
+                        pop_ready();
                         continue;
                 }
 
+                if (++burst >= BURST) {
+                        pop_ready();
+                        push_ready(slot);
+                }
+
                 if (count > msg->maxsize) {
                         printf("Oversized packet received");
                         return 0;
                 }
 
                 from->type = NA_RINA;
-                from->fd = fds[i];
+                from->fd   = fd;
+                from->gen  = gens[slot];
                 msg->cursize = count;
                 msg->readcount = 0;
 
@@ -155,9 +358,19 @@ void RINA_Init(int server)
         int i = 0;
 
         for (i = 0; i < FDS_SIZE; i++) {
-                fds[i] = -1;
+                fds[i]    = -1;
+                gens[i]   = i;
+                queued[i] = 0;
         }
 
+        ready_head  = 0;
+        ready_count = 0;
+        burst       = 0;
+
+        poll_fd = epoll_create1(EPOLL_CLOEXEC);
+        if (poll_fd < 0)
+                printf("Failed to create flow wait set.\n");
+
         if (server) {
 
                 if (ap_init(SERV_NAME)) {
@@ -195,4 +408,9 @@ void RINA_Fini(int server)
         }
 
         ap_fini();
+
+        if (poll_fd >= 0) {
+                close(poll_fd);
+                poll_fd = -1;
+        }
 }
@@ -39,8 +39,13 @@ void RINA_Init(int server);
 void RINA_Fini(int server);
 
 void RINA_Resolve(const char * s, netadr_t * a);
+void RINA_Close(netadr_t * a);
 
 int  RINA_Recvfrom(msg_t * msg, netadr_t * from);
 void RINA_Sendto(int length, const void * data, netadr_t * to);
 
+int  RINA_PollFd(void);
+void RINA_WatchFd(int fd);
+void RINA_UnwatchFd(int fd);
+
 #endif //NET_RINA_H
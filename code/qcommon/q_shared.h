@@ -120,6 +120,16 @@ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
 #define Q_EXPORT
 #endif
 
+// one instance of the variable per thread, only needed by code that the
+// engine may run on its worker threads
+#if (defined Q3_VM)
+#define Q_THREADLOCAL
+#elif (defined _MSC_VER)
+#define Q_THREADLOCAL __declspec(thread)
+#else
+#define Q_THREADLOCAL __thread
+#endif
+
 /**********************************************************************
   VM Considerations
 
@@ -48,6 +48,8 @@ typedef struct {
 	int		cursize;
 	int		readcount;
 	int		bit;				// for bitwise reads and writes
+	char	*error;				// set instead of a Com_Error on a worker thread
+	int		errorCode;
 } msg_t;
 
 void MSG_Init (msg_t *buf, byte *data, int length);
@@ -67,6 +69,8 @@ struct entityState_s;
 struct playerState_s;
 
 void MSG_WriteBits( msg_t *msg, int value, int bits );
+void MSG_WriteBitBuffer( msg_t *msg, const byte *data, int bits );
+void MSG_ReadBitBuffer( msg_t *msg, int start, byte *data, int bits );
 
 void MSG_WriteChar (msg_t *sb, int c);
 void MSG_WriteByte (msg_t *sb, int c);
@@ -108,6 +112,9 @@ void MSG_ReadDeltaPlayerstate( msg_t *msg, struct playerState_s *from, struct pl
 
 
 void MSG_ReportChangeVectors_f( void );
+void MSG_HuffBench_f( void );
+void MSG_Fuzz_f( void );
+void MSG_Bench_f( void );
 
 //============================================================================
 
@@ -164,6 +171,7 @@ typedef struct {
 	unsigned short	port;
 	unsigned long	scope_id;	// Needed for IPv6 link-local addresses
         int             fd; // Needed for RINA support
+        int             gen; // RINA flow generation, tells reused fds apart
 } netadr_t;
 
 void		NET_Init( void );
@@ -172,6 +180,10 @@ void		NET_Restart_f( void );
 void		NET_Config( qboolean enableNetworking );
 void		NET_FlushPacketQueue(void);
 void		NET_SendPacket (netsrc_t sock, int length, const void *data, netadr_t to);
+void		NET_CloseAdr( netadr_t adr );
+void		NET_BeginBatch( void );
+void		NET_FlushBatch( void );
+void		NET_ShowSyscalls( void );
 void		QDECL NET_OutOfBandPrint( netsrc_t net_socket, netadr_t adr, const char *format, ...) __attribute__ ((format (printf, 3, 4)));
 void		QDECL NET_OutOfBandData( netsrc_t sock, netadr_t adr, byte *format, int len );
 
@@ -367,9 +379,12 @@ vm_t	*VM_Restart(vm_t *vm, qboolean unpure);
 intptr_t		QDECL VM_Call( vm_t *vm, int callNum, ... );
 
 void	VM_Debug( int level );
+void	VM_ProfileFrame( void );
 
 void	*VM_ArgPtr( intptr_t intValue );
 void	*VM_ExplicitArgPtr( vm_t *vm, intptr_t intValue );
+void	*VM_ArgArray( intptr_t intValue, int count, int size );
+qboolean	VM_IsNative( vm_t *vm );
 
 #define	VMA(x) VM_ArgPtr(args[x])
 static ID_INLINE float _vmf(intptr_t x)
@@ -671,11 +686,27 @@ long	FS_ReadFile(const char *qpath, void **buffer);
 // the buffer should be considered read-only, because it may be cached
 // for other uses.
 
+long	FS_ReadFileView( const char *qpath, const void **buffer );
+// really read-only and without the trailing 0, because stored files
+// in mapped paks come straight from the mapping
+
+void	FS_ReadFiles( int count, const char **qpaths, void **buffers, long *lengths );
+// FS_ReadFile for many files, the deflated ones in mapped paks are
+// inflated in parallel
+
+void	FS_PrefetchFile( const char *qpath );
+// reads the file in the background for the next open of it
+void	FS_ClearPrefetch( void );
+// drops the prefetched files that were never opened
+
+void	FS_ResetLoadStats( void );
+void	FS_PrintLoadStats( void );
+
 void	FS_ForceFlush( fileHandle_t f );
 // forces flush on files we're writing to.
 
 void	FS_FreeFile( void *buffer );
-// frees the memory returned by FS_ReadFile
+// frees the memory returned by FS_ReadFile, FS_ReadFileView and FS_ReadFiles
 
 void	FS_WriteFile( const char *qpath, const void *buffer, int size );
 // writes a complete file, creating any subdirectories needed
@@ -730,6 +761,8 @@ void FS_Rename( const char *from, const char *to );
 
 void FS_Remove( const char *osPath );
 void FS_HomeRemove( const char *homePath );
+long FS_HomeReadFile( const char *qpath, void **buffer );
+// loose file in the home path game directory only, never a pk3
 
 void	FS_FilenameCompletion( const char *dir, const char *ext,
 		qboolean stripExt, void(*callback)(const char *s), qboolean allowNonPureFilesOnDisk );
@@ -839,6 +872,46 @@ void		Com_StartupVariable( const char *match );
 // if match is NULL, all set commands will be executed, otherwise
 // only a set with the exact name.  Only used during startup.
 
+// threads.c
+#define	MAX_WORKERS		32
+
+void		Com_InitThreads( void );
+void		Com_ShutdownThreads( void );
+int			Com_NumWorkers( void );
+int			Com_ThreadIndex( void );
+// 0 on the main thread, 1 to MAX_WORKERS on a worker thread
+qboolean	Com_InParallelRun( void );
+// jobs may be running on other threads, errors must wait for the join
+void		Com_RunParallel( int count, void (*func)( void *data, int index ), void *data );
+// runs func for every index in [0, count), spread over the worker threads
+int			Com_AtomicAdd( volatile int *value, int add );
+// returns the value before the add
+qboolean	Com_AtomicCompareSwap( volatile int *value, int oldValue, int newValue );
+int			Com_AtomicLoad( volatile int *value );
+// sees everything written before a Com_AtomicCompareSwap that stored the value
+
+#define	MAX_LOADERS		8
+
+enum {
+	BGJOB_QUEUED,
+	BGJOB_RUNNING,
+	BGJOB_DONE
+};
+
+typedef struct backgroundJob_s {
+	void		(*func)( void *data );
+	void		*data;
+	int			priority;		// higher runs first
+	volatile int	state;		// BGJOB_*
+	struct backgroundJob_s	*next;
+} backgroundJob_t;
+
+void		Com_QueueBackgroundJob( backgroundJob_t *job );
+// runs job->func( job->data ) on a loader thread, Com_ThreadIndex is -1 there
+qboolean	Com_BackgroundJobDone( backgroundJob_t *job );
+void		Com_FinishBackgroundJob( backgroundJob_t *job );
+// waits for the job, or runs it on the calling thread if it hasn't started
+
 
 extern	cvar_t	*com_developer;
 extern	cvar_t	*com_dedicated;
@@ -878,6 +951,7 @@ extern	cvar_t	*com_legacyprotocol;
 extern	int		time_game;
 extern	int		time_frontend;
 extern	int		time_backend;		// renderer backend time
+extern	int		c_visCacheHits, c_visCacheMisses;	// snapshot visibility cache
 
 extern	int		com_frameTime;
 
@@ -893,7 +967,8 @@ typedef enum {
 	TAG_BOTLIB,
 	TAG_RENDERER,
 	TAG_SMALL,
-	TAG_STATIC
+	TAG_STATIC,
+	TAG_SLAB				// a zone block carved into small allocations
 } memtag_t;
 
 /*
@@ -1075,6 +1150,7 @@ void	Sys_Print( const char *msg );
 // Sys_Milliseconds should only be used for profiling purposes,
 // any game related timing information should come from event timestamps
 int		Sys_Milliseconds (void);
+int64_t	Sys_Microseconds (void);	// monotonic, for timing short calls
 
 qboolean Sys_RandomBytes( byte *string, int len );
 
@@ -1096,6 +1172,9 @@ void		Sys_ShowIP(void);
 FILE	*Sys_FOpen( const char *ospath, const char *mode );
 qboolean Sys_Mkdir( const char *path );
 FILE	*Sys_Mkfifo( const char *ospath );
+void	*Sys_MapFile( const char *ospath, int *length );	// read only view, NULL if it can't be mapped
+void	Sys_UnmapFile( void *base, int length );
+qboolean Sys_FileStat( const char *ospath, int64_t *size, int64_t *mtime );
 char	*Sys_Cwd( void );
 void	Sys_SetDefaultInstallPath(const char *path);
 char	*Sys_DefaultInstallPath(void);
@@ -1117,6 +1196,14 @@ void	Sys_Sleep(int msec);
 
 qboolean Sys_LowPhysicalMemory( void );
 
+void	Sys_ThreadStackStarted( void );
+// every engine thread calls this first, the profiler walks only those stacks
+qboolean Sys_StartProfiler( int hz, void (*sample)( void *pc, void **sp, void **fp, void **stackEnd ) );
+// calls sample from a signal handler hz times per second of cpu time,
+// stackEnd is NULL on threads that never called Sys_ThreadStackStarted
+void	Sys_StopProfiler( void );
+void	Sys_SymbolForAddress( void *address, char *name, int size );
+
 void Sys_SetEnv(const char *name, const char *value);
 
 typedef enum
@@ -1176,20 +1263,30 @@ typedef struct {
 	huff_t		decompressor;
 } huffman_t;
 
+// precomputed codes for a tree that no longer changes, such as the
+// one msg.c builds at startup
+#define	HUFF_LOOKUP_BITS	11
+
+typedef struct {
+	unsigned int	code[HMAX+1];				// first bit sent in bit 0
+	byte			length[HMAX+1];				// 0 when the code doesn't fit
+	short			symbol[1<<HUFF_LOOKUP_BITS];	// -1 for longer codes
+	byte			symbolLength[1<<HUFF_LOOKUP_BITS];
+} huffTable_t;
+
 void	Huff_Compress(msg_t *buf, int offset);
 void	Huff_Decompress(msg_t *buf, int offset);
 void	Huff_Init(huffman_t *huff);
 void	Huff_addRef(huff_t* huff, byte ch);
-int		Huff_Receive (node_t *node, int *ch, byte *fin);
-void	Huff_transmit (huff_t *huff, int ch, byte *fout);
+int		Huff_Receive (node_t *node, int *ch, byte *fin, int *offset);
+void	Huff_transmit (huff_t *huff, int ch, byte *fout, int *offset);
 void	Huff_offsetReceive (node_t *node, int *ch, byte *fin, int *offset);
 void	Huff_offsetTransmit (huff_t *huff, int ch, byte *fout, int *offset);
 void	Huff_putBit( int bit, byte *fout, int *offset);
 int		Huff_getBit( byte *fout, int *offset);
-
-// don't use if you don't know what you're doing.
-int		Huff_getBloc(void);
-void	Huff_setBloc(int _bloc);
+void	Huff_BuildTable( huff_t *huff, huffTable_t *table );
+void	Huff_tableTransmit( huff_t *huff, huffTable_t *table, int ch, byte *fout, int *offset );
+void	Huff_tableReceive( node_t *tree, huffTable_t *table, int *ch, byte *fin, int *offset, int maxsize );
 
 
 extern huffman_t clientHuffTables;
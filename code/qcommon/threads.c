@@ -0,0 +1,653 @@
+/*
+===========================================================================
+Copyright (C) 1999-2005 Id Software, Inc.
+
+This file is part of Quake III Arena source code.
+
+Quake III Arena source code is free software; you can redistribute it
+and/or modify it under the terms of the GNU General Public License as
+published by the Free Software Foundation; either version 2 of the License,
+or (at your option) any later version.
+
+Quake III Arena source code is distributed in the hope that it will be
+useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Quake III Arena source code; if not, write to the Free Software
+Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+===========================================================================
+*/
+// threads.c -- worker pool for fork/join jobs
+
+#include "q_shared.h"
+#include "qcommon.h"
+
+#ifdef _WIN32
+#	include <windows.h>
+#else
+#	include <pthread.h>
+#endif
+
+/*
+=============================================================================
+
+A small pool of worker threads that helps the main thread run the
+iterations of Com_RunParallel. Jobs must only touch data that belongs to
+their own index, must not allocate from the zone or hunk, and must not
+call Com_Printf or Com_Error; failures are recorded and reported by the
+caller once the jobs have finished.
+
+com_workers 0 disables the pool and everything runs on the main thread.
+
+=============================================================================
+*/
+
+static cvar_t	*com_workers;
+
+static int		numWorkers;
+static qboolean	jobsRunning;	// a Com_RunParallel is in progress
+static qboolean	jobsQuit;
+
+static void		(*jobFunc)( void *data, int index );
+static void		*jobData;
+static int		jobCount;
+static volatile int	jobNext;		// next index to hand out
+static int		jobGeneration;	// bumped for every Com_RunParallel
+static int		jobWorking;		// workers inside the current generation
+
+static Q_THREADLOCAL int	threadIndex;	// 0 on the main thread
+
+#ifdef _WIN32
+static HANDLE			workerThreads[MAX_WORKERS];
+static CRITICAL_SECTION	jobLock;
+static HANDLE			jobWake;		// semaphore, one count per worker
+static HANDLE			jobDone;		// auto reset event
+
+#define	Job_Lock()		EnterCriticalSection( &jobLock )
+#define	Job_Unlock()	LeaveCriticalSection( &jobLock )
+#define	Job_Claim()		( InterlockedIncrement( (LONG volatile *)&jobNext ) - 1 )
+#else
+static pthread_t		workerThreads[MAX_WORKERS];
+static pthread_mutex_t	jobLock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t	jobWake = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t	jobDone = PTHREAD_COND_INITIALIZER;
+
+#define	Job_Lock()		pthread_mutex_lock( &jobLock )
+#define	Job_Unlock()	pthread_mutex_unlock( &jobLock )
+#define	Job_Claim()		__sync_fetch_and_add( &jobNext, 1 )
+#endif
+
+/*
+=================
+Com_DoJobs
+
+Runs iterations of the current job until all of them have been handed out
+=================
+*/
+static void Com_DoJobs( void ) {
+	int		index;
+
+	while ( ( index = Job_Claim() ) < jobCount ) {
+		jobFunc( jobData, index );
+	}
+}
+
+/*
+=================
+Com_WorkerLoop
+=================
+*/
+static void Com_WorkerLoop( void ) {
+	int		seen = 0;
+
+	while ( 1 ) {
+		Job_Lock();
+#ifdef _WIN32
+		while ( seen == jobGeneration && !jobsQuit ) {
+			Job_Unlock();
+			WaitForSingleObject( jobWake, INFINITE );
+			Job_Lock();
+		}
+#else
+		while ( seen == jobGeneration && !jobsQuit ) {
+			pthread_cond_wait( &jobWake, &jobLock );
+		}
+#endif
+		if ( jobsQuit ) {
+			Job_Unlock();
+			return;
+		}
+		seen = jobGeneration;
+		jobWorking++;
+		Job_Unlock();
+
+		Com_DoJobs();
+
+		Job_Lock();
+		if ( --jobWorking == 0 ) {
+#ifdef _WIN32
+			SetEvent( jobDone );
+#else
+			pthread_cond_signal( &jobDone );
+#endif
+		}
+		Job_Unlock();
+	}
+}
+
+#ifdef _WIN32
+static DWORD WINAPI Com_WorkerThread( LPVOID arg ) {
+	threadIndex = (int)(intptr_t)arg;
+	Sys_ThreadStackStarted();
+	Com_WorkerLoop();
+	return 0;
+}
+#else
+static void *Com_WorkerThread( void *arg ) {
+	threadIndex = (int)(intptr_t)arg;
+	Sys_ThreadStackStarted();
+	Com_WorkerLoop();
+	return NULL;
+}
+#endif
+
+/*
+=================
+Com_WaitForWorkers
+
+Waits, with the lock held, until no worker is inside a generation any more.
+Only then may the job description be changed. A worker that wakes up late
+can still enter a generation after the main thread finished its work.
+=================
+*/
+static void Com_WaitForWorkers( void ) {
+	while ( jobWorking ) {
+#ifdef _WIN32
+		Job_Unlock();
+		WaitForSingleObject( jobDone, INFINITE );
+		Job_Lock();
+#else
+		pthread_cond_wait( &jobDone, &jobLock );
+#endif
+	}
+}
+
+/*
+=================
+Com_NumWorkers
+
+Number of threads, besides the main thread, that run parallel jobs
+=================
+*/
+int Com_NumWorkers( void ) {
+	return numWorkers;
+}
+
+/*
+=================
+Com_ThreadIndex
+
+Lets code that may run inside a job pick per-thread scratch data
+=================
+*/
+int Com_ThreadIndex( void ) {
+	return threadIndex;
+}
+
+/*
+=================
+Com_InParallelRun
+
+True on the worker and loader threads, and on the main thread while it
+takes its share of a Com_RunParallel. Com_Error can't be used there.
+=================
+*/
+qboolean Com_InParallelRun( void ) {
+	return threadIndex != 0 || jobsRunning;
+}
+
+/*
+=================
+Com_RunParallel
+
+Calls func( data, index ) for every index in [0, count) and returns
+once all of them are done. The main thread takes part in the work.
+Calls made while a parallel run is in progress, including those from
+inside a job, simply run serially.
+=================
+*/
+void Com_RunParallel( int count, void (*func)( void *data, int index ), void *data ) {
+	int		i;
+
+	if ( count <= 0 ) {
+		return;
+	}
+
+	if ( !numWorkers || jobsRunning || count == 1 ) {
+		for ( i = 0 ; i < count ; i++ ) {
+			func( data, i );
+		}
+		return;
+	}
+
+	Job_Lock();
+	Com_WaitForWorkers();
+	jobsRunning = qtrue;
+	jobFunc = func;
+	jobData = data;
+	jobCount = count;
+	jobNext = 0;
+	jobGeneration++;
+#ifdef _WIN32
+	ResetEvent( jobDone );
+	ReleaseSemaphore( jobWake, numWorkers, NULL );
+#else
+	pthread_cond_broadcast( &jobWake );
+#endif
+	Job_Unlock();
+
+	Com_DoJobs();
+
+	Job_Lock();
+	Com_WaitForWorkers();
+	jobsRunning = qfalse;
+	Job_Unlock();
+}
+
+/*
+=================
+Com_AtomicAdd
+=================
+*/
+int Com_AtomicAdd( volatile int *value, int add ) {
+#ifdef _WIN32
+	return InterlockedExchangeAdd( (LONG volatile *)value, add );
+#else
+	return __sync_fetch_and_add( value, add );
+#endif
+}
+
+/*
+=================
+Com_AtomicCompareSwap
+=================
+*/
+qboolean Com_AtomicCompareSwap( volatile int *value, int oldValue, int newValue ) {
+#ifdef _WIN32
+	return InterlockedCompareExchange( (LONG volatile *)value, newValue, oldValue ) == oldValue;
+#else
+	return __sync_bool_compare_and_swap( value, oldValue, newValue );
+#endif
+}
+
+/*
+=================
+Com_AtomicLoad
+=================
+*/
+int Com_AtomicLoad( volatile int *value ) {
+#ifdef _WIN32
+	return *value;		// volatile reads have acquire semantics in MSVC
+#else
+	return __atomic_load_n( value, __ATOMIC_ACQUIRE );
+#endif
+}
+
+/*
+=============================================================================
+
+BACKGROUND JOBS
+
+Loader threads run queued jobs while the main thread goes on, highest
+priority first and in queue order within a priority. They are separate
+from the workers, which only help out inside Com_RunParallel. The same
+rules apply to background jobs, and they must not call Com_RunParallel
+or use per-thread scratch data either.
+
+com_loaderThreads 0 runs every job as soon as it is queued.
+
+=============================================================================
+*/
+
+static cvar_t	*com_loaderThreads;
+
+static int				numLoaders;
+static backgroundJob_t	*bgQueue;		// sorted by priority
+static qboolean			bgQuit;
+
+#ifdef _WIN32
+static HANDLE			loaderThreads[MAX_LOADERS];
+static CRITICAL_SECTION	bgLock;
+static HANDLE			bgWake;			// semaphore, one count per queued job
+static HANDLE			bgDone;			// manual reset event, set when any job finishes
+
+#define	Bg_Lock()		EnterCriticalSection( &bgLock )
+#define	Bg_Unlock()		LeaveCriticalSection( &bgLock )
+#else
+static pthread_t		loaderThreads[MAX_LOADERS];
+static pthread_mutex_t	bgLock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t	bgWake = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t	bgDone = PTHREAD_COND_INITIALIZER;
+
+#define	Bg_Lock()		pthread_mutex_lock( &bgLock )
+#define	Bg_Unlock()		pthread_mutex_unlock( &bgLock )
+#endif
+
+/*
+=================
+Com_FinishJob
+
+Called with the lock held after a loader ran a job
+=================
+*/
+static void Com_FinishJob( backgroundJob_t *job ) {
+	job->state = BGJOB_DONE;
+#ifdef _WIN32
+	SetEvent( bgDone );
+#else
+	pthread_cond_broadcast( &bgDone );
+#endif
+}
+
+/*
+=================
+Com_LoaderLoop
+=================
+*/
+static void Com_LoaderLoop( void ) {
+	backgroundJob_t	*job;
+
+	Bg_Lock();
+	while ( 1 ) {
+#ifdef _WIN32
+		while ( !bgQueue && !bgQuit ) {
+			Bg_Unlock();
+			WaitForSingleObject( bgWake, INFINITE );
+			Bg_Lock();
+		}
+#else
+		while ( !bgQueue && !bgQuit ) {
+			pthread_cond_wait( &bgWake, &bgLock );
+		}
+#endif
+		if ( bgQuit ) {
+			break;
+		}
+
+		job = bgQueue;
+		bgQueue = job->next;
+		job->state = BGJOB_RUNNING;
+		Bg_Unlock();
+
+		job->func( job->data );
+
+		Bg_Lock();
+		Com_FinishJob( job );
+	}
+	Bg_Unlock();
+}
+
+#ifdef _WIN32
+static DWORD WINAPI Com_LoaderThread( LPVOID arg ) {
+	threadIndex = -1;
+	Sys_ThreadStackStarted();
+	Com_LoaderLoop();
+	return 0;
+}
+#else
+static void *Com_LoaderThread( void *arg ) {
+	threadIndex = -1;
+	Sys_ThreadStackStarted();
+	Com_LoaderLoop();
+	return NULL;
+}
+#endif
+
+/*
+=================
+Com_QueueBackgroundJob
+
+The job must stay allocated until Com_FinishBackgroundJob returns
+or Com_BackgroundJobDone says it is done
+=================
+*/
+void Com_QueueBackgroundJob( backgroundJob_t *job ) {
+	backgroundJob_t	**prev;
+
+	if ( !numLoaders ) {
+		job->state = BGJOB_RUNNING;
+		job->func( job->data );
+		job->state = BGJOB_DONE;
+		return;
+	}
+
+	Bg_Lock();
+	job->state = BGJOB_QUEUED;
+	for ( prev = &bgQueue ; *prev && (*prev)->priority >= job->priority ; prev = &(*prev)->next ) {
+	}
+	job->next = *prev;
+	*prev = job;
+#ifdef _WIN32
+	ReleaseSemaphore( bgWake, 1, NULL );
+#else
+	pthread_cond_signal( &bgWake );
+#endif
+	Bg_Unlock();
+}
+
+/*
+=================
+Com_BackgroundJobDone
+=================
+*/
+qboolean Com_BackgroundJobDone( backgroundJob_t *job ) {
+	return Com_AtomicLoad( &job->state ) == BGJOB_DONE;
+}
+
+/*
+=================
+Com_FinishBackgroundJob
+
+Returns once the job is done. A job no loader has started yet is
+taken off the queue and run right here instead of waited for.
+=================
+*/
+void Com_FinishBackgroundJob( backgroundJob_t *job ) {
+	backgroundJob_t	**prev;
+
+	if ( Com_BackgroundJobDone( job ) ) {
+		return;
+	}
+
+	Bg_Lock();
+	if ( job->state == BGJOB_QUEUED ) {
+		for ( prev = &bgQueue ; *prev != job ; prev = &(*prev)->next ) {
+		}
+		*prev = job->next;
+		job->state = BGJOB_RUNNING;
+		Bg_Unlock();
+
+		job->func( job->data );
+
+		Bg_Lock();
+		job->state = BGJOB_DONE;
+		Bg_Unlock();
+		return;
+	}
+
+	while ( job->state != BGJOB_DONE ) {
+#ifdef _WIN32
+		ResetEvent( bgDone );
+		Bg_Unlock();
+		WaitForSingleObject( bgDone, INFINITE );
+		Bg_Lock();
+#else
+		pthread_cond_wait( &bgDone, &bgLock );
+#endif
+	}
+	Bg_Unlock();
+}
+
+/*
+=================
+Com_InitLoaders
+=================
+*/
+static void Com_InitLoaders( void ) {
+	int		i, count;
+
+	com_loaderThreads = Cvar_Get( "com_loaderThreads", "2", CVAR_ARCHIVE | CVAR_LATCH );
+	Cvar_CheckRange( com_loaderThreads, 0, MAX_LOADERS, qtrue );
+
+	count = com_loaderThreads->integer;
+	if ( count <= 0 ) {
+		return;
+	}
+
+#ifdef _WIN32
+	InitializeCriticalSection( &bgLock );
+	bgWake = CreateSemaphore( NULL, 0, 0x7fffffff, NULL );
+	bgDone = CreateEvent( NULL, TRUE, FALSE, NULL );
+#endif
+
+	bgQuit = qfalse;
+
+	for ( i = 0 ; i < count ; i++ ) {
+#ifdef _WIN32
+		loaderThreads[i] = CreateThread( NULL, 0, Com_LoaderThread, NULL, 0, NULL );
+		if ( !loaderThreads[i] ) {
+			break;
+		}
+#else
+		if ( pthread_create( &loaderThreads[i], NULL, Com_LoaderThread, NULL ) ) {
+			break;
+		}
+#endif
+	}
+
+	numLoaders = i;
+	Com_Printf( "%i loader threads started\n", numLoaders );
+}
+
+/*
+=================
+Com_ShutdownLoaders
+
+Jobs still queued are run on the calling thread
+=================
+*/
+static void Com_ShutdownLoaders( void ) {
+	backgroundJob_t	*job;
+	int				i;
+
+	if ( !numLoaders ) {
+		return;
+	}
+
+	Bg_Lock();
+	bgQuit = qtrue;
+#ifdef _WIN32
+	ReleaseSemaphore( bgWake, numLoaders, NULL );
+#else
+	pthread_cond_broadcast( &bgWake );
+#endif
+	Bg_Unlock();
+
+	for ( i = 0 ; i < numLoaders ; i++ ) {
+#ifdef _WIN32
+		WaitForSingleObject( loaderThreads[i], INFINITE );
+		CloseHandle( loaderThreads[i] );
+#else
+		pthread_join( loaderThreads[i], NULL );
+#endif
+	}
+
+	numLoaders = 0;
+
+	while ( bgQueue ) {
+		job = bgQueue;
+		bgQueue = job->next;
+		job->func( job->data );
+		job->state = BGJOB_DONE;
+	}
+}
+
+/*
+=================
+Com_InitThreads
+=================
+*/
+void Com_InitThreads( void ) {
+	int		i, count;
+
+	Com_InitLoaders();
+
+	com_workers = Cvar_Get( "com_workers", "0", CVAR_ARCHIVE | CVAR_LATCH );
+	Cvar_CheckRange( com_workers, 0, MAX_WORKERS, qtrue );
+
+	count = com_workers->integer;
+	if ( count <= 0 ) {
+		return;
+	}
+
+#ifdef _WIN32
+	InitializeCriticalSection( &jobLock );
+	jobWake = CreateSemaphore( NULL, 0, 0x7fffffff, NULL );
+	jobDone = CreateEvent( NULL, FALSE, FALSE, NULL );
+#endif
+
+	jobsQuit = qfalse;
+
+	for ( i = 0 ; i < count ; i++ ) {
+#ifdef _WIN32
+		workerThreads[i] = CreateThread( NULL, 0, Com_WorkerThread, (LPVOID)(intptr_t)( i + 1 ), 0, NULL );
+		if ( !workerThreads[i] ) {
+			break;
+		}
+#else
+		if ( pthread_create( &workerThreads[i], NULL, Com_WorkerThread, (void *)(intptr_t)( i + 1 ) ) ) {
+			break;
+		}
+#endif
+	}
+
+	numWorkers = i;
+	Com_Printf( "%i worker threads started\n", numWorkers );
+}
+
+/*
+=================
+Com_ShutdownThreads
+=================
+*/
+void Com_ShutdownThreads( void ) {
+	int		i;
+
+	Com_ShutdownLoaders();
+
+	if ( !numWorkers ) {
+		return;
+	}
+
+	Job_Lock();
+	jobsQuit = qtrue;
+#ifdef _WIN32
+	ReleaseSemaphore( jobWake, numWorkers, NULL );
+#else
+	pthread_cond_broadcast( &jobWake );
+#endif
+	Job_Unlock();
+
+	for ( i = 0 ; i < numWorkers ; i++ ) {
+#ifdef _WIN32
+		WaitForSingleObject( workerThreads[i], INFINITE );
+		CloseHandle( workerThreads[i] );
+#else
+		pthread_join( workerThreads[i], NULL );
+#endif
+	}
+
+	numWorkers = 0;
+}
@@ -43,7 +43,6 @@ int		vm_debugLevel;
 // used by Com_Error to get rid of running vm's before longjmp
 static int forced_unload;
 
-#define	MAX_VM		3
 vm_t	vmTable[MAX_VM];
 
 
@@ -73,6 +72,7 @@ void VM_Init( void ) {
 	Cvar_Get( "vm_cgame", "2", CVAR_ARCHIVE );	// !@# SHIP WITH SET TO 2
 	Cvar_Get( "vm_game", "2", CVAR_ARCHIVE );	// !@# SHIP WITH SET TO 2
 	Cvar_Get( "vm_ui", "2", CVAR_ARCHIVE );		// !@# SHIP WITH SET TO 2
+	Cvar_Get( "vm_optimize", "0", CVAR_ARCHIVE );	// register allocating compiler, x86_64 only
 
 	Cmd_AddCommand ("vmprofile", VM_VmProfile_f );
 	Cmd_AddCommand ("vminfo", VM_VmInfo_f );
@@ -152,12 +152,41 @@ int VM_SymbolToValue( vm_t *vm, const char *symbol ) {
 }
 
 
+/*
+=====================
+VM_CompiledInstruction
+
+The bytecode instruction a pointer into compiled code belongs to,
+-1 for the code the compiler emits ahead of the first instruction
+=====================
+*/
+int VM_CompiledInstruction( vm_t *vm, void *code ) {
+	int			low, high, mid;
+
+	if ( (intptr_t)code < vm->instructionPointers[0] ) {
+		return -1;
+	}
+
+	// the instruction pointers are in ascending order
+	low = 0;
+	high = vm->instructionCount - 1;
+	while ( low < high ) {
+		mid = ( low + high + 1 ) / 2;
+		if ( vm->instructionPointers[mid] <= (intptr_t)code ) {
+			low = mid;
+		} else {
+			high = mid - 1;
+		}
+	}
+
+	return low;
+}
+
 /*
 =====================
 VM_SymbolForCompiledPointer
 =====================
 */
-#if 0 // 64bit!
 const char *VM_SymbolForCompiledPointer( vm_t *vm, void *code ) {
 	int			i;
 
@@ -169,17 +198,14 @@ const char *VM_SymbolForCompiledPointer( vm_t *vm, void *code ) {
 	}
 
 	// find which original instruction it is after
-	for ( i = 0 ; i < vm->codeLength ; i++ ) {
-		if ( (void *)vm->instructionPointers[i] > code ) {
-			break;
-		}
+	i = VM_CompiledInstruction( vm, code );
+	if ( i < 0 ) {
+		return "Compiler stub";
 	}
-	i--;
 
 	// now look up the bytecode instruction pointer
 	return VM_ValueToSymbol( vm, i );
 }
-#endif
 
 
 
@@ -231,8 +257,8 @@ void VM_LoadSymbols( vm_t *vm ) {
 	int		segment;
 	int		numInstructions;
 
-	// don't load symbols if not developer
-	if ( !com_developer->integer ) {
+	// don't load symbols if not developer or profiling
+	if ( !com_developer->integer && !VM_ProfileRunning() ) {
 		return;
 	}
 
@@ -281,8 +307,9 @@ void VM_LoadSymbols( vm_t *vm ) {
 		prev = &sym->next;
 		sym->next = NULL;
 
-		// convert value from an instruction number to a code offset
-		if ( value >= 0 && value < numInstructions ) {
+		// convert value from an instruction number to a code offset,
+		// compiled code is looked up by instruction number
+		if ( !vm->compiled && value >= 0 && value < numInstructions ) {
 			value = vm->instructionPointers[value];
 		}
 
@@ -704,6 +731,9 @@ void VM_Free( vm_t *vm ) {
 		}
 	}
 
+	// samples in compiled code can't be resolved once it is gone
+	VM_ProfileDrain();
+
 	if(vm->destroy)
 		vm->destroy(vm);
 
@@ -759,6 +789,42 @@ void *VM_ArgPtr( intptr_t intValue ) {
 	}
 }
 
+/*
+==============
+VM_ArgArray
+
+VM_ArgPtr for an array of count elements of size bytes. A qvm's array
+has to lie in its data segment as a whole, anything else is dropped.
+==============
+*/
+void *VM_ArgArray( intptr_t intValue, int count, int size ) {
+	if ( count < 0 || size <= 0 ) {
+		Com_Error( ERR_DROP, "VM_ArgArray: bad count %i of %i bytes", count, size );
+	}
+
+	if ( !count || currentVM == NULL || currentVM->entryPoint ) {
+		return VM_ArgPtr( intValue );
+	}
+
+	if ( intValue <= 0 || (int64_t)intValue + (int64_t)count * size > (int64_t)currentVM->dataMask + 1 ) {
+		Com_Error( ERR_DROP, "VM_ArgArray: %i elements of %i bytes at %ld are out of range",
+			count, size, (long int)intValue );
+	}
+
+	return (void *)( currentVM->dataBase + intValue );
+}
+
+/*
+==============
+VM_IsNative
+
+Native modules share the address space and can be handed to worker threads
+==============
+*/
+qboolean VM_IsNative( vm_t *vm ) {
+	return vm->dllHandle != NULL;
+}
+
 void *VM_ExplicitArgPtr( vm_t *vm, intptr_t intValue ) {
 	if ( !intValue ) {
 		return NULL;
@@ -899,6 +965,10 @@ void VM_VmProfile_f( void ) {
 	int			i;
 	double		total;
 
+	if ( VM_ProfileCommand() ) {
+		return;
+	}
+
 	if ( !lastVM ) {
 		return;
 	}
@@ -0,0 +1,460 @@
+/*
+===========================================================================
+Copyright (C) 1999-2005 Id Software, Inc.
+
+This file is part of Quake III Arena source code.
+
+Quake III Arena source code is free software; you can redistribute it
+and/or modify it under the terms of the GNU General Public License as
+published by the Free Software Foundation; either version 2 of the License,
+or (at your option) any later version.
+
+Quake III Arena source code is distributed in the hope that it will be
+useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Quake III Arena source code; if not, write to the Free Software
+Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+===========================================================================
+*/
+// vm_profile.c -- sampling profiler for compiled and native modules
+
+#include "vm_local.h"
+
+/*
+=============================================================================
+
+vmprofile start [hz] samples the whole process on a cpu time timer and
+records the call stack of every sample.  Frames in compiled qvm code are
+named after the qvm symbols, everything else after the nearest exported
+symbol of its module, so native game modules and the engine show up too.
+
+Compiled qvm code keeps no frame pointer, but the only code pointers it
+leaves on the native stack are its own return addresses, so its frames
+are found by scanning the stack up to the C frame that called into it.
+Native frames are followed through the frame pointer chain and need to
+be built with frame pointers to show more than the leaf.  Every read
+stays between the interrupted stack pointer and the top of the stack
+the thread recorded when it started; threads the engine did not start
+only get their leaf.
+
+The samples are collected into folded stacks, one "root;...;leaf count"
+line per distinct stack, which flamegraph tools read directly.  Every
+map gets its own file, profile/<mapname>.folded, and a summary of the
+functions that took the most samples when the map ends or the profiler
+is stopped.
+
+=============================================================================
+*/
+
+#define	PROFILE_DEPTH		32
+#define	PROFILE_SAMPLES		4096		// must be a power of two
+#define	PROFILE_HASH		1024
+#define	PROFILE_SCAN_WORDS	512			// stack scanned when there is no frame pointer
+#define	PROFILE_SUMMARY		20
+
+typedef struct {
+	volatile int	ready;
+	int				depth;
+	void			*pcs[PROFILE_DEPTH];	// leaf first
+} profileSample_t;
+
+typedef struct profileCount_s {
+	struct profileCount_s	*next;
+	int						count;
+	char					text[1];		// variable sized
+} profileCount_t;
+
+static qboolean			profiling;
+static profileSample_t	profileSamples[PROFILE_SAMPLES];
+static volatile int		profileWrite;		// claimed by the signal handler
+static volatile int		profileRead;		// drained by the main thread
+static volatile int		profileDropped;
+
+static profileCount_t	*profileStacks[PROFILE_HASH];
+static profileCount_t	*profileFuncs[PROFILE_HASH];
+static int				profileTotal;
+static char				profileMap[MAX_QPATH];
+
+/*
+=================
+VM_ProfileCompiledVM
+
+Safe to call from the signal handler
+=================
+*/
+static vm_t *VM_ProfileCompiledVM( void *pc ) {
+	vm_t	*vm;
+	int		i;
+
+	for ( i = 0, vm = vmTable ; i < MAX_VM ; i++, vm++ ) {
+		if ( vm->compiled && vm->codeBase && (byte *)pc >= vm->codeBase
+			&& (byte *)pc < vm->codeBase + vm->codeLength ) {
+			return vm;
+		}
+	}
+
+	return NULL;
+}
+
+static qboolean VM_ProfileFrameValid( void **fp, void **sp, void **stackEnd ) {
+	return fp > sp && fp + 2 <= stackEnd
+		&& !( (intptr_t)fp & ( sizeof( void * ) - 1 ) );
+}
+
+/*
+=================
+VM_ProfileSample
+
+Called from the signal handler with the interrupted registers,
+so it only reads memory and claims a slot with atomics.  Nothing
+above stackEnd is read, and without it only the pc is recorded.
+=================
+*/
+static void VM_ProfileSample( void *pc, void **sp, void **fp, void **stackEnd ) {
+	profileSample_t	*sample;
+	void			**scan, **limit;
+	int				write;
+
+	if ( !profiling ) {
+		return;
+	}
+
+	do {
+		write = Com_AtomicLoad( &profileWrite );
+		if ( write - profileRead >= PROFILE_SAMPLES ) {
+			Com_AtomicAdd( &profileDropped, 1 );
+			return;
+		}
+	} while ( !Com_AtomicCompareSwap( &profileWrite, write, write + 1 ) );
+
+	sample = &profileSamples[write & ( PROFILE_SAMPLES - 1 )];
+	sample->pcs[0] = pc;
+	sample->depth = 1;
+
+	while ( stackEnd && sp < stackEnd && sample->depth < PROFILE_DEPTH ) {
+		if ( VM_ProfileCompiledVM( pc ) ) {
+			// the frame pointer still belongs to the C function that called the vm
+			limit = VM_ProfileFrameValid( fp, sp, stackEnd ) ? fp : sp + PROFILE_SCAN_WORDS;
+			if ( limit > stackEnd ) {
+				limit = stackEnd;
+			}
+			for ( scan = sp ; scan < limit && sample->depth < PROFILE_DEPTH ; scan++ ) {
+				if ( VM_ProfileCompiledVM( *scan ) ) {
+					sample->pcs[sample->depth++] = *scan;
+				}
+			}
+		}
+
+		if ( !VM_ProfileFrameValid( fp, sp, stackEnd ) || sample->depth == PROFILE_DEPTH ) {
+			break;
+		}
+
+		// fp[0] is the caller's frame pointer, fp[1] the return address
+		pc = fp[1];
+		sp = fp + 2;
+		fp = fp[0];
+		if ( !pc ) {
+			break;
+		}
+		sample->pcs[sample->depth++] = pc;
+	}
+
+	Com_AtomicCompareSwap( &sample->ready, 0, 1 );
+}
+
+/*
+=================
+VM_ProfileCount
+=================
+*/
+static void VM_ProfileCount( profileCount_t **table, const char *text ) {
+	profileCount_t	*c;
+	unsigned		hash;
+	int				len;
+
+	hash = 0;
+	for ( len = 0 ; text[len] ; len++ ) {
+		hash = hash * 31 + text[len];
+	}
+	hash &= PROFILE_HASH - 1;
+
+	for ( c = table[hash] ; c ; c = c->next ) {
+		if ( !strcmp( c->text, text ) ) {
+			c->count++;
+			return;
+		}
+	}
+
+	c = Z_Malloc( sizeof( *c ) + len );
+	Com_Memcpy( c->text, text, len + 1 );
+	c->count = 1;
+	c->next = table[hash];
+	table[hash] = c;
+}
+
+static void VM_ProfileClearTable( profileCount_t **table ) {
+	profileCount_t	*c, *next;
+	int				i;
+
+	for ( i = 0 ; i < PROFILE_HASH ; i++ ) {
+		for ( c = table[i] ; c ; c = next ) {
+			next = c->next;
+			Z_Free( c );
+		}
+		table[i] = NULL;
+	}
+}
+
+/*
+=================
+VM_ProfileSymbol
+
+Names the function pc is in, or returns qfalse for the
+compiler's own call and syscall stubs.  Leaf samples in
+compiled code also count for the plain vmprofile listing.
+=================
+*/
+static qboolean VM_ProfileSymbol( void *pc, qboolean leaf, char *name, int size ) {
+	vm_t		*vm;
+	vmSymbol_t	*sym;
+	int			instruction;
+
+	vm = VM_ProfileCompiledVM( pc );
+	if ( !vm ) {
+		Sys_SymbolForAddress( pc, name, size );
+		return qtrue;
+	}
+
+	instruction = VM_CompiledInstruction( vm, pc );
+	if ( instruction < 0 ) {
+		return qfalse;
+	}
+
+	sym = VM_ValueToFunctionSymbol( vm, instruction );
+	if ( sym->symName[0] ) {
+		if ( leaf ) {
+			sym->profileCount++;
+		}
+		Com_sprintf( name, size, "%s:%s", vm->name, sym->symName );
+	} else {
+		Q_strncpyz( name, vm->name, size );
+	}
+
+	return qtrue;
+}
+
+/*
+=================
+VM_ProfileDrain
+
+Folds the samples taken so far, this has to run before
+a compiled vm goes away
+=================
+*/
+void VM_ProfileDrain( void ) {
+	profileSample_t	*sample;
+	char			stack[MAX_STRING_CHARS];
+	char			name[MAX_QPATH];
+	char			leaf[MAX_QPATH];
+	int				i, len;
+
+	while ( 1 ) {
+		sample = &profileSamples[profileRead & ( PROFILE_SAMPLES - 1 )];
+		if ( !Com_AtomicLoad( &sample->ready ) ) {
+			break;
+		}
+
+		// root first, return addresses point behind their call
+		stack[0] = 0;
+		leaf[0] = 0;
+		len = 0;
+		for ( i = sample->depth - 1 ; i >= 0 ; i-- ) {
+			if ( !VM_ProfileSymbol( i ? (byte *)sample->pcs[i] - 1 : sample->pcs[i], !i, name, sizeof( name ) ) ) {
+				continue;
+			}
+			Q_strncpyz( leaf, name, sizeof( leaf ) );
+			if ( len + strlen( name ) + 2 > sizeof( stack ) ) {
+				break;
+			}
+			if ( len ) {
+				stack[len++] = ';';
+			}
+			strcpy( stack + len, name );
+			len += strlen( name );
+		}
+
+		if ( len ) {
+			VM_ProfileCount( profileStacks, stack );
+			VM_ProfileCount( profileFuncs, leaf );
+			profileTotal++;
+		}
+
+		sample->ready = 0;
+		Com_AtomicAdd( &profileRead, 1 );
+	}
+}
+
+static int QDECL VM_ProfileCountSort( const void *a, const void *b ) {
+	return (*(profileCount_t **)b)->count - (*(profileCount_t **)a)->count;
+}
+
+/*
+=================
+VM_ProfileFinishMap
+
+Writes the folded stacks of the current map and prints its summary
+=================
+*/
+static void VM_ProfileFinishMap( const char *filename ) {
+	profileCount_t	**sorted, *c;
+	fileHandle_t	f;
+	int				i, count;
+
+	VM_ProfileDrain();
+
+	if ( !profileTotal ) {
+		return;
+	}
+
+	f = FS_FOpenFileWrite( filename );
+	if ( f ) {
+		for ( i = 0 ; i < PROFILE_HASH ; i++ ) {
+			for ( c = profileStacks[i] ; c ; c = c->next ) {
+				FS_Printf( f, "%s %i\n", c->text, c->count );
+			}
+		}
+		FS_FCloseFile( f );
+	} else {
+		Com_Printf( S_COLOR_YELLOW "WARNING: couldn't write %s\n", filename );
+	}
+
+	count = 0;
+	for ( i = 0 ; i < PROFILE_HASH ; i++ ) {
+		for ( c = profileFuncs[i] ; c ; c = c->next ) {
+			count++;
+		}
+	}
+	sorted = Z_Malloc( count * sizeof( *sorted ) );
+	count = 0;
+	for ( i = 0 ; i < PROFILE_HASH ; i++ ) {
+		for ( c = profileFuncs[i] ; c ; c = c->next ) {
+			sorted[count++] = c;
+		}
+	}
+	qsort( sorted, count, sizeof( *sorted ), VM_ProfileCountSort );
+
+	Com_Printf( "%i samples on %s, %i dropped, written to %s\n",
+		profileTotal, profileMap[0] ? profileMap : "no map", profileDropped, filename );
+	for ( i = 0 ; i < count && i < PROFILE_SUMMARY ; i++ ) {
+		Com_Printf( "%5.1f%% %7i %s\n", 100.0f * sorted[i]->count / profileTotal,
+			sorted[i]->count, sorted[i]->text );
+	}
+
+	Z_Free( sorted );
+
+	VM_ProfileClearTable( profileStacks );
+	VM_ProfileClearTable( profileFuncs );
+	profileTotal = 0;
+	profileDropped = 0;
+}
+
+static const char *VM_ProfileFilename( void ) {
+	return va( "profile/%s.folded", profileMap[0] ? profileMap : "nomap" );
+}
+
+/*
+=================
+VM_ProfileFrame
+
+Called once a frame, starts a new profile when the map changes
+=================
+*/
+void VM_ProfileFrame( void ) {
+	const char	*mapname;
+
+	if ( !profiling ) {
+		return;
+	}
+
+	mapname = Cvar_VariableString( "mapname" );
+	if ( strcmp( mapname, profileMap ) ) {
+		VM_ProfileFinishMap( VM_ProfileFilename() );
+		Q_strncpyz( profileMap, mapname, sizeof( profileMap ) );
+	}
+
+	VM_ProfileDrain();
+}
+
+qboolean VM_ProfileRunning( void ) {
+	return profiling;
+}
+
+/*
+=================
+VM_ProfileCommand
+
+vmprofile start [hz]
+vmprofile stop [file]
+=================
+*/
+qboolean VM_ProfileCommand( void ) {
+	const char	*cmd;
+	int			i, hz;
+
+	if ( Cmd_Argc() < 2 ) {
+		return qfalse;
+	}
+	cmd = Cmd_Argv( 1 );
+
+	if ( !Q_stricmp( cmd, "start" ) ) {
+		if ( profiling ) {
+			Com_Printf( "vmprofile: already running\n" );
+			return qtrue;
+		}
+
+		hz = Cmd_Argc() > 2 ? atoi( Cmd_Argv( 2 ) ) : 1000;
+		if ( hz < 1 || hz > 10000 ) {
+			hz = 1000;
+		}
+
+		Q_strncpyz( profileMap, Cvar_VariableString( "mapname" ), sizeof( profileMap ) );
+		profileWrite = profileRead = profileDropped = 0;
+		for ( i = 0 ; i < PROFILE_SAMPLES ; i++ ) {
+			profileSamples[i].ready = 0;
+		}
+
+		profiling = qtrue;
+		if ( !Sys_StartProfiler( hz, VM_ProfileSample ) ) {
+			profiling = qfalse;
+			Com_Printf( "vmprofile: sampling is not supported on this platform\n" );
+			return qtrue;
+		}
+		Com_Printf( "vmprofile: sampling at %i Hz\n", hz );
+
+		for ( i = 0 ; i < MAX_VM ; i++ ) {
+			if ( vmTable[i].compiled && !vmTable[i].numSymbols ) {
+				Com_Printf( "vmprofile: no symbols for %s yet, they load with the next map\n",
+					vmTable[i].name );
+			}
+		}
+		return qtrue;
+	}
+
+	if ( !Q_stricmp( cmd, "stop" ) ) {
+		if ( !profiling ) {
+			Com_Printf( "vmprofile: not running\n" );
+			return qtrue;
+		}
+
+		Sys_StopProfiler();
+		VM_ProfileFinishMap( Cmd_Argc() > 2 ? Cmd_Argv( 2 ) : VM_ProfileFilename() );
+		profiling = qfalse;
+		return qtrue;
+	}
+
+	Com_Printf( "usage: vmprofile [start [hz] | stop [file]]\n" );
+	return qtrue;
+}
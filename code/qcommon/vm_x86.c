@@ -1062,6 +1062,948 @@ qboolean ConstOptimize(vm_t *vm, int callProcOfsSyscall)
 	return qfalse;
 }
 
+#if idx64
+/*
+=============================================================================
+
+OPTIMIZING TIER
+
+With vm_optimize set, x86_64 code is translated with a model of the top
+of the opStack.  The values an instruction pushes are not stored right
+away but kept as pending operands: constants, addresses of locals, or
+values held in r10d - r15d.  The instructions that consume them work on
+registers and immediates, so constants, local addresses and compares
+fold into the loads, stores and branches that use them.  The pending
+operands are only written to [edi + ebx * 4] where the memory opStack
+has to be exact: before jump targets, calls, returns and the few
+instructions that still work on memory.  Every load and store keeps the
+dataMask of the other tier.
+
+=============================================================================
+*/
+
+#define	MAX_OPERANDS	8
+
+typedef enum {
+	OPND_CONST,		// value is the constant
+	OPND_LOCAL,		// value is the offset from the program stack
+	OPND_REG		// value is the register holding it
+} operandType_t;
+
+typedef struct {
+	operandType_t	type;
+	int				value;
+} operand_t;
+
+static	operand_t	operands[MAX_OPERANDS];	// the top of the opStack, last is topmost
+static	int			numOperands;
+static	int			regsUsed;				// bit per register number
+
+#define	REG_EAX		0
+#define	REG_ECX		1
+#define	REG_EDX		2
+#define	REG_ESI		6
+#define	REG_FIRST	10		// r10d - r15d hold operands
+#define	REG_LAST	15
+
+#define	REX_B		0x41
+#define	REX_X		0x42
+#define	REX_R		0x44
+
+/*
+=================
+EmitOpcode
+Optional prefix, REX byte if needed and the one or two byte opcode
+=================
+*/
+static void EmitOpcode(int prefix, int rex, int opcode)
+{
+	if(prefix)
+		Emit1(prefix);
+	if(rex)
+		Emit1(rex);
+	if(opcode > 0xFF)
+		Emit1(opcode >> 8);
+	Emit1(opcode & 0xFF);
+}
+
+static int RexForRegs(int reg, int index, int base)
+{
+	int rex = 0;
+
+	if(reg & 8)
+		rex |= REX_R;
+	if(index & 8)
+		rex |= REX_X;
+	if(base & 8)
+		rex |= REX_B;
+
+	return rex;
+}
+
+// op reg, rm
+static void EmitRegReg(int prefix, int opcode, int reg, int rm)
+{
+	EmitOpcode(prefix, RexForRegs(reg, 0, rm), opcode);
+	Emit1(0xC0 | ((reg & 7) << 3) | (rm & 7));
+}
+
+// op reg, [r9 + index]
+static void EmitRegData(int prefix, int opcode, int reg, int index)
+{
+	EmitOpcode(prefix, RexForRegs(reg, index, 9), opcode);
+	Emit1(0x04 | ((reg & 7) << 3));
+	Emit1(((index & 7) << 3) | (9 & 7));
+}
+
+// op reg, [r9 + ofs]
+static void EmitRegDataOfs(int prefix, int opcode, int reg, int ofs)
+{
+	EmitOpcode(prefix, RexForRegs(reg, 0, 9), opcode);
+	Emit1(0x80 | ((reg & 7) << 3) | (9 & 7));
+	Emit4(ofs);
+}
+
+// op reg, ofs[edi + ebx * 4]
+static void EmitRegOpStack(int opcode, int reg, int ofs)
+{
+	EmitOpcode(0, RexForRegs(reg, 0, 0), opcode);
+	Emit1(0x44 | ((reg & 7) << 3));
+	Emit1(0x9F);
+	Emit1(ofs);
+}
+
+// add, or, and, sub, xor or cmp reg, 0x12345678 picked by ext
+static void EmitAluImm(int ext, int reg, int v)
+{
+	if(iss8(v))
+	{
+		EmitRegReg(0, 0x83, ext, reg);
+		Emit1(v);
+	}
+	else
+	{
+		EmitRegReg(0, 0x81, ext, reg);
+		Emit4(v);
+	}
+}
+
+// mov reg, 0x12345678
+static void EmitMovRegImm(int reg, int v)
+{
+	EmitOpcode(0, RexForRegs(0, 0, reg), 0xB8 + (reg & 7));
+	Emit4(v);
+}
+
+// lea reg, [esi + 0x12345678]
+static void EmitLeaLocal(int reg, int ofs)
+{
+	EmitOpcode(0, RexForRegs(reg, 0, 0), 0x8D);
+	Emit1(0x86 | ((reg & 7) << 3));
+	Emit4(ofs);
+}
+
+/*
+=================
+FlushOperands
+Stores the count bottommost pending operands to the memory opStack
+=================
+*/
+static void FlushOperands(int count)
+{
+	operand_t *opnd;
+	int i, ofs;
+
+	if(count <= 0)
+		return;
+
+	STACK_PUSH(count);					// add bl, count
+
+	for(i = 0; i < count; i++)
+	{
+		opnd = &operands[i];
+		ofs = (i - count + 1) * 4;
+
+		switch(opnd->type)
+		{
+		case OPND_CONST:
+			EmitRegOpStack(0xC7, 0, ofs);		// mov dword ptr ofs[edi + ebx * 4], 0x12345678
+			Emit4(opnd->value);
+			break;
+		case OPND_LOCAL:
+			// no scratch register here, callers may hold an address
+			// in eax across AllocReg
+			EmitRegOpStack(0x89, REG_ESI, ofs);	// mov dword ptr ofs[edi + ebx * 4], esi
+			EmitRegOpStack(0x81, 0, ofs);		// add dword ptr ofs[edi + ebx * 4], 0x12345678
+			Emit4(opnd->value);
+			break;
+		case OPND_REG:
+			EmitRegOpStack(0x89, opnd->value, ofs);	// mov dword ptr ofs[edi + ebx * 4], reg
+			regsUsed &= ~(1 << opnd->value);
+			break;
+		}
+	}
+
+	numOperands -= count;
+	for(i = 0; i < numOperands; i++)
+		operands[i] = operands[i + count];
+}
+
+static void FlushAllOperands(void)
+{
+	FlushOperands(numOperands);
+}
+
+/*
+=================
+AllocReg
+Writes out the oldest pending operands until a register is free
+=================
+*/
+static int AllocReg(void)
+{
+	int reg;
+
+	while(1)
+	{
+		for(reg = REG_FIRST; reg <= REG_LAST; reg++)
+		{
+			if(!(regsUsed & (1 << reg)))
+			{
+				regsUsed |= 1 << reg;
+				return reg;
+			}
+		}
+
+		if(!numOperands)
+		{
+			VMFREE_BUFFERS();
+			Com_Error(ERR_DROP, "VM_CompileX86: out of registers at offset %d", pc);
+		}
+		FlushOperands(1);
+	}
+}
+
+static void FreeOperand(const operand_t *opnd)
+{
+	if(opnd->type == OPND_REG)
+		regsUsed &= ~(1 << opnd->value);
+}
+
+static void PushOperand(operandType_t type, int value)
+{
+	if(numOperands == MAX_OPERANDS)
+		FlushOperands(1);
+
+	operands[numOperands].type = type;
+	operands[numOperands].value = value;
+	numOperands++;
+}
+
+static void PopOperand(operand_t *opnd)
+{
+	if(numOperands)
+	{
+		*opnd = operands[--numOperands];
+		return;
+	}
+
+	opnd->type = OPND_REG;
+	opnd->value = AllocReg();
+	EmitRegOpStack(0x8B, opnd->value, 0);		// mov reg, dword ptr [edi + ebx * 4]
+	STACK_POP(1);					// sub bl, 1
+}
+
+static int OperandToReg(operand_t *opnd)
+{
+	int reg;
+
+	if(opnd->type == OPND_REG)
+		return opnd->value;
+
+	reg = AllocReg();
+	if(opnd->type == OPND_CONST)
+		EmitMovRegImm(reg, opnd->value);	// mov reg, 0x12345678
+	else
+		EmitLeaLocal(reg, opnd->value);		// lea reg, [esi + 0x12345678]
+
+	opnd->type = OPND_REG;
+	opnd->value = reg;
+
+	return reg;
+}
+
+/*
+=================
+AddressIndex
+Returns the register holding the masked data address of a non constant operand
+=================
+*/
+static int AddressIndex(operand_t *opnd, int mask)
+{
+	int reg;
+
+	if(opnd->type == OPND_REG)
+		reg = opnd->value;
+	else
+	{
+		reg = REG_EAX;
+		EmitLeaLocal(REG_EAX, opnd->value);	// lea eax, [esi + 0x12345678]
+	}
+	EmitAluImm(4, reg, mask);			// and reg, 0x12345678
+
+	return reg;
+}
+
+/*
+=================
+FoldConstants
+=================
+*/
+static qboolean FoldConstants(int op, int a, int b, int *result)
+{
+	unsigned int ua = a, ub = b;
+
+	switch(op)
+	{
+	case OP_ADD:
+		*result = ua + ub;
+		return qtrue;
+	case OP_SUB:
+		*result = ua - ub;
+		return qtrue;
+	case OP_MULI:
+	case OP_MULU:
+		*result = ua * ub;
+		return qtrue;
+	case OP_BAND:
+		*result = ua & ub;
+		return qtrue;
+	case OP_BOR:
+		*result = ua | ub;
+		return qtrue;
+	case OP_BXOR:
+		*result = ua ^ ub;
+		return qtrue;
+	case OP_LSH:
+		*result = ua << (ub & 31);
+		return qtrue;
+	case OP_RSHI:
+		*result = a >> (ub & 31);
+		return qtrue;
+	case OP_RSHU:
+		*result = ua >> (ub & 31);
+		return qtrue;
+	default:
+		// divisions are left to fault at run time
+		return qfalse;
+	}
+}
+
+static void EmitLoadOpt(vm_t *vm, int op)
+{
+	operand_t addr;
+	int opcode, reg;
+
+	if(op == OP_LOAD4)
+		opcode = 0x8B;				// mov
+	else if(op == OP_LOAD2)
+		opcode = 0x0FB7;			// movzx word
+	else
+		opcode = 0x0FB6;			// movzx byte
+
+	PopOperand(&addr);
+	if(addr.type == OPND_CONST)
+	{
+		reg = AllocReg();
+		EmitRegDataOfs(0, opcode, reg, addr.value & vm->dataMask);	// mov reg, [r9 + 0x12345678]
+	}
+	else
+	{
+		reg = AddressIndex(&addr, vm->dataMask);
+		if(reg == REG_EAX)
+			reg = AllocReg();
+		EmitRegData(0, opcode, reg, addr.type == OPND_REG ? addr.value : REG_EAX);	// mov reg, [r9 + index]
+	}
+
+	PushOperand(OPND_REG, reg);
+}
+
+static void EmitStoreOpt(vm_t *vm, int op)
+{
+	operand_t value, addr;
+	int prefix, opcode, reg, mask;
+
+	PopOperand(&value);
+	PopOperand(&addr);
+
+	prefix = 0;
+	if(op == OP_STORE4)
+		mask = vm->dataMask & ~3;
+	else if(op == OP_STORE2)
+	{
+		mask = vm->dataMask & ~1;
+		prefix = 0x66;
+	}
+	else
+		mask = vm->dataMask;
+
+	if(value.type == OPND_CONST)
+	{
+		opcode = (op == OP_STORE1) ? 0xC6 : 0xC7;	// mov [], 0x12345678
+		reg = 0;
+	}
+	else
+	{
+		opcode = (op == OP_STORE1) ? 0x88 : 0x89;	// mov [], reg
+		reg = OperandToReg(&value);
+	}
+
+	if(addr.type == OPND_CONST)
+		EmitRegDataOfs(prefix, opcode, reg, addr.value & mask);
+	else
+		EmitRegData(prefix, opcode, reg, AddressIndex(&addr, mask));
+
+	if(value.type == OPND_CONST)
+	{
+		if(op == OP_STORE4)
+			Emit4(value.value);
+		else if(op == OP_STORE2)
+			Emit2(value.value);
+		else
+			Emit1(value.value);
+	}
+
+	FreeOperand(&value);
+	FreeOperand(&addr);
+}
+
+static void EmitArgOpt(vm_t *vm, int ofs)
+{
+	operand_t value;
+
+	PopOperand(&value);
+
+	EmitLeaLocal(REG_EAX, ofs);			// lea eax, [esi + 0x12]
+	EmitAluImm(4, REG_EAX, vm->dataMask);		// and eax, 0x12345678
+	if(value.type == OPND_CONST)
+	{
+		EmitRegData(0, 0xC7, 0, REG_EAX);	// mov dword ptr [r9 + eax], 0x12345678
+		Emit4(value.value);
+	}
+	else
+		EmitRegData(0, 0x89, OperandToReg(&value), REG_EAX);	// mov dword ptr [r9 + eax], reg
+
+	FreeOperand(&value);
+}
+
+static void EmitBinaryOpt(int op)
+{
+	operand_t a, b;
+	int reg, v;
+
+	PopOperand(&b);
+	PopOperand(&a);
+
+	if(a.type == OPND_CONST && b.type == OPND_CONST && FoldConstants(op, a.value, b.value, &v))
+	{
+		PushOperand(OPND_CONST, v);
+		return;
+	}
+
+	// addresses of locals and struct members
+	if(a.type == OPND_LOCAL && b.type == OPND_CONST && (op == OP_ADD || op == OP_SUB))
+	{
+		PushOperand(OPND_LOCAL, op == OP_ADD ? a.value + b.value : a.value - b.value);
+		return;
+	}
+	if(a.type == OPND_CONST && b.type == OPND_LOCAL && op == OP_ADD)
+	{
+		PushOperand(OPND_LOCAL, a.value + b.value);
+		return;
+	}
+
+	reg = OperandToReg(&a);
+
+	switch(op)
+	{
+	case OP_ADD:
+	case OP_SUB:
+	case OP_BAND:
+	case OP_BOR:
+	case OP_BXOR:
+		if(b.type == OPND_CONST)
+		{
+			if(op == OP_ADD)
+				EmitAluImm(0, reg, b.value);		// add reg, 0x12345678
+			else if(op == OP_SUB)
+				EmitAluImm(5, reg, b.value);		// sub reg, 0x12345678
+			else if(op == OP_BAND)
+				EmitAluImm(4, reg, b.value);		// and reg, 0x12345678
+			else if(op == OP_BOR)
+				EmitAluImm(1, reg, b.value);		// or reg, 0x12345678
+			else
+				EmitAluImm(6, reg, b.value);		// xor reg, 0x12345678
+		}
+		else
+		{
+			OperandToReg(&b);
+			if(op == OP_ADD)
+				EmitRegReg(0, 0x03, reg, b.value);	// add reg, b
+			else if(op == OP_SUB)
+				EmitRegReg(0, 0x2B, reg, b.value);	// sub reg, b
+			else if(op == OP_BAND)
+				EmitRegReg(0, 0x23, reg, b.value);	// and reg, b
+			else if(op == OP_BOR)
+				EmitRegReg(0, 0x0B, reg, b.value);	// or reg, b
+			else
+				EmitRegReg(0, 0x33, reg, b.value);	// xor reg, b
+		}
+		break;
+
+	case OP_MULI:
+	case OP_MULU:
+		if(b.type == OPND_CONST)
+		{
+			if(iss8(b.value))
+			{
+				EmitRegReg(0, 0x6B, reg, reg);		// imul reg, reg, 0x7F
+				Emit1(b.value);
+			}
+			else
+			{
+				EmitRegReg(0, 0x69, reg, reg);		// imul reg, reg, 0x12345678
+				Emit4(b.value);
+			}
+		}
+		else
+			EmitRegReg(0, 0x0FAF, reg, OperandToReg(&b));	// imul reg, b
+		break;
+
+	case OP_LSH:
+	case OP_RSHI:
+	case OP_RSHU:
+		v = (op == OP_LSH) ? 4 : (op == OP_RSHI) ? 7 : 5;	// shl, sar, shr
+		if(b.type == OPND_CONST)
+		{
+			EmitRegReg(0, 0xC1, v, reg);			// shift reg, 0x12
+			Emit1(b.value & 31);
+		}
+		else
+		{
+			EmitRegReg(0, 0x8B, REG_ECX, OperandToReg(&b));	// mov ecx, b
+			EmitRegReg(0, 0xD3, v, reg);			// shift reg, cl
+		}
+		break;
+
+	case OP_DIVI:
+	case OP_DIVU:
+	case OP_MODI:
+	case OP_MODU:
+		OperandToReg(&b);
+		EmitRegReg(0, 0x8B, REG_EAX, reg);			// mov eax, reg
+		if(op == OP_DIVI || op == OP_MODI)
+		{
+			EmitString("99");				// cdq
+			EmitRegReg(0, 0xF7, 7, b.value);		// idiv b
+		}
+		else
+		{
+			EmitString("31 D2");				// xor edx, edx
+			EmitRegReg(0, 0xF7, 6, b.value);		// div b
+		}
+		if(op == OP_DIVI || op == OP_DIVU)
+			EmitRegReg(0, 0x8B, reg, REG_EAX);		// mov reg, eax
+		else
+			EmitRegReg(0, 0x8B, reg, REG_EDX);		// mov reg, edx
+		break;
+
+	case OP_ADDF:
+	case OP_SUBF:
+	case OP_MULF:
+	case OP_DIVF:
+		EmitRegReg(0x66, 0x0F6E, 0, reg);			// movd xmm0, reg
+		EmitRegReg(0x66, 0x0F6E, 1, OperandToReg(&b));		// movd xmm1, b
+		if(op == OP_ADDF)
+			EmitString("F3 0F 58 C1");			// addss xmm0, xmm1
+		else if(op == OP_SUBF)
+			EmitString("F3 0F 5C C1");			// subss xmm0, xmm1
+		else if(op == OP_MULF)
+			EmitString("F3 0F 59 C1");			// mulss xmm0, xmm1
+		else
+			EmitString("F3 0F 5E C1");			// divss xmm0, xmm1
+		EmitRegReg(0x66, 0x0F7E, 0, reg);			// movd reg, xmm0
+		break;
+	}
+
+	FreeOperand(&b);
+	PushOperand(OPND_REG, reg);
+}
+
+static void EmitUnaryOpt(int op)
+{
+	operand_t a;
+	int reg;
+
+	PopOperand(&a);
+
+	if(a.type == OPND_CONST)
+	{
+		switch(op)
+		{
+		case OP_NEGI:
+			PushOperand(OPND_CONST, -(unsigned int) a.value);
+			return;
+		case OP_BCOM:
+			PushOperand(OPND_CONST, ~a.value);
+			return;
+		case OP_SEX8:
+			PushOperand(OPND_CONST, (signed char) a.value);
+			return;
+		case OP_SEX16:
+			PushOperand(OPND_CONST, (short) a.value);
+			return;
+		}
+	}
+
+	reg = OperandToReg(&a);
+
+	switch(op)
+	{
+	case OP_NEGI:
+		EmitRegReg(0, 0xF7, 3, reg);			// neg reg
+		break;
+	case OP_BCOM:
+		EmitRegReg(0, 0xF7, 2, reg);			// not reg
+		break;
+	case OP_SEX8:
+		EmitRegReg(0, 0x0FBE, reg, reg);		// movsx reg, reg8
+		break;
+	case OP_SEX16:
+		EmitRegReg(0, 0x0FBF, reg, reg);		// movsx reg, reg16
+		break;
+	case OP_NEGF:
+		EmitAluImm(6, reg, 0x80000000);			// xor reg, 0x80000000
+		break;
+	case OP_CVIF:
+		EmitRegReg(0xF3, 0x0F2A, 0, reg);		// cvtsi2ss xmm0, reg
+		EmitRegReg(0x66, 0x0F7E, 0, reg);		// movd reg, xmm0
+		break;
+	case OP_CVFI:
+		EmitRegReg(0x66, 0x0F6E, 0, reg);		// movd xmm0, reg
+		EmitRegReg(0xF3, 0x0F2C, reg, 0);		// cvttss2si reg, xmm0
+		break;
+	}
+
+	PushOperand(OPND_REG, reg);
+}
+
+/*
+=================
+EmitCompareOpt
+Folds both operands into the compare, the rest of the opStack is written
+out before it as a branch ends the block
+=================
+*/
+static void EmitCompareOpt(vm_t *vm, int op)
+{
+	operand_t a, b;
+	int reg, v;
+
+	PopOperand(&b);
+	PopOperand(&a);
+	FlushAllOperands();
+
+	reg = OperandToReg(&a);
+
+	switch(op)
+	{
+	case OP_EQ:
+	case OP_NE:
+	case OP_LTI:
+	case OP_LEI:
+	case OP_GTI:
+	case OP_GEI:
+	case OP_LTU:
+	case OP_LEU:
+	case OP_GTU:
+	case OP_GEU:
+		if(b.type == OPND_CONST)
+			EmitAluImm(7, reg, b.value);			// cmp reg, 0x12345678
+		else
+			EmitRegReg(0, 0x3B, reg, OperandToReg(&b));	// cmp reg, b
+		EmitBranchConditions(vm, op);
+		break;
+
+	default:
+		// the same results as the interpreter, unordered compares are false
+		EmitRegReg(0x66, 0x0F6E, 0, reg);			// movd xmm0, a
+		EmitRegReg(0x66, 0x0F6E, 1, OperandToReg(&b));		// movd xmm1, b
+		v = Constant4();
+
+		switch(op)
+		{
+		case OP_EQF:
+			EmitString("0F 2E C1");				// ucomiss xmm0, xmm1
+			EmitString("7A 06");				// jp +6
+			EmitJumpIns(vm, "0F 84", v);			// je 0x12345678
+			break;
+		case OP_NEF:
+			EmitString("0F 2E C1");				// ucomiss xmm0, xmm1
+			EmitJumpIns(vm, "0F 8A", v);			// jp 0x12345678
+			EmitJumpIns(vm, "0F 85", v);			// jne 0x12345678
+			break;
+		case OP_LTF:
+			EmitString("0F 2E C8");				// ucomiss xmm1, xmm0
+			EmitJumpIns(vm, "0F 87", v);			// ja 0x12345678
+			break;
+		case OP_LEF:
+			EmitString("0F 2E C8");				// ucomiss xmm1, xmm0
+			EmitJumpIns(vm, "0F 83", v);			// jae 0x12345678
+			break;
+		case OP_GTF:
+			EmitString("0F 2E C1");				// ucomiss xmm0, xmm1
+			EmitJumpIns(vm, "0F 87", v);			// ja 0x12345678
+			break;
+		case OP_GEF:
+			EmitString("0F 2E C1");				// ucomiss xmm0, xmm1
+			EmitJumpIns(vm, "0F 83", v);			// jae 0x12345678
+			break;
+		}
+		break;
+	}
+
+	FreeOperand(&a);
+	FreeOperand(&b);
+}
+
+/*
+=================
+EmitEntryStub
+Calls instruction 0, saving r12 - r15 for the caller
+=================
+*/
+static int EmitEntryStub(void)
+{
+	int entryOfs, callOfs, codeOfs;
+
+	entryOfs = compiledOfs;
+
+	EmitString("41 54");		// push r12
+	EmitString("41 55");		// push r13
+	EmitString("41 56");		// push r14
+	EmitString("41 57");		// push r15
+	EmitString("E8");		// call instruction 0
+	callOfs = compiledOfs;
+	compiledOfs += 4;
+	EmitString("41 5F");		// pop r15
+	EmitString("41 5E");		// pop r14
+	EmitString("41 5D");		// pop r13
+	EmitString("41 5C");		// pop r12
+	EmitString("C3");		// ret
+
+	// instruction 0 follows
+	codeOfs = compiledOfs;
+	compiledOfs = callOfs;
+	Emit4(codeOfs - (callOfs + 4));
+	compiledOfs = codeOfs;
+
+	return entryOfs;
+}
+
+/*
+=================
+VM_CompileOptimized
+=================
+*/
+static void VM_CompileOptimized(vm_t *vm, vmHeader_t *header, int maxLength,
+	int callProcOfs, int callProcOfsSyscall, int callDoSyscallOfs)
+{
+	int op, v;
+	int codeOfs;
+
+	codeOfs = compiledOfs;
+
+	for(pass = 0; pass < 3; pass++)
+	{
+		pc = 0;
+		instruction = 0;
+		compiledOfs = codeOfs;
+		numOperands = 0;
+		regsUsed = 0;
+
+		while(instruction < header->instructionCount)
+		{
+			if(compiledOfs > maxLength - 256)
+			{
+				VMFREE_BUFFERS();
+				Com_Error(ERR_DROP, "VM_CompileX86: maxLength exceeded");
+			}
+
+			// jump targets start with everything in memory
+			if(jused[instruction])
+				FlushAllOperands();
+
+			vm->instructionPointers[instruction] = compiledOfs;
+			instruction++;
+
+			if(pc > header->codeLength)
+			{
+				VMFREE_BUFFERS();
+				Com_Error(ERR_DROP, "VM_CompileX86: pc > header->codeLength");
+			}
+
+			op = code[pc];
+			pc++;
+			switch(op)
+			{
+			case 0:
+				break;
+			case OP_BREAK:
+				FlushAllOperands();
+				EmitString("CC");			// int 3
+				break;
+			case OP_ENTER:
+				FlushAllOperands();
+				EmitString("81 EE");			// sub esi, 0x12345678
+				Emit4(Constant4());
+				break;
+			case OP_LEAVE:
+				FlushAllOperands();
+				EmitString("81 C6");			// add esi, 0x12345678
+				Emit4(Constant4());
+				EmitString("C3");			// ret
+				break;
+			case OP_CONST:
+				PushOperand(OPND_CONST, Constant4());
+				break;
+			case OP_LOCAL:
+				PushOperand(OPND_LOCAL, Constant4());
+				break;
+			case OP_ARG:
+				EmitArgOpt(vm, Constant1() & 0xFF);
+				break;
+			case OP_CALL:
+				if(numOperands && operands[numOperands - 1].type == OPND_CONST)
+				{
+					v = operands[--numOperands].value;
+					FlushAllOperands();
+					EmitCallConst(vm, v, callProcOfsSyscall);
+				}
+				else
+				{
+					FlushAllOperands();
+					EmitCallRel(vm, callProcOfs);
+				}
+				break;
+			case OP_PUSH:
+				FlushAllOperands();
+				STACK_PUSH(1);				// add bl, 1
+				break;
+			case OP_POP:
+				if(numOperands)
+					FreeOperand(&operands[--numOperands]);
+				else
+					STACK_POP(1);			// sub bl, 1
+				break;
+			case OP_LOAD4:
+			case OP_LOAD2:
+			case OP_LOAD1:
+				EmitLoadOpt(vm, op);
+				break;
+			case OP_STORE4:
+			case OP_STORE2:
+			case OP_STORE1:
+				EmitStoreOpt(vm, op);
+				break;
+			case OP_EQ:
+			case OP_NE:
+			case OP_LTI:
+			case OP_LEI:
+			case OP_GTI:
+			case OP_GEI:
+			case OP_LTU:
+			case OP_LEU:
+			case OP_GTU:
+			case OP_GEU:
+			case OP_EQF:
+			case OP_NEF:
+			case OP_LTF:
+			case OP_LEF:
+			case OP_GTF:
+			case OP_GEF:
+				EmitCompareOpt(vm, op);
+				break;
+			case OP_NEGI:
+			case OP_BCOM:
+			case OP_SEX8:
+			case OP_SEX16:
+			case OP_NEGF:
+			case OP_CVIF:
+			case OP_CVFI:
+				EmitUnaryOpt(op);
+				break;
+			case OP_ADD:
+			case OP_SUB:
+			case OP_DIVI:
+			case OP_DIVU:
+			case OP_MODI:
+			case OP_MODU:
+			case OP_MULI:
+			case OP_MULU:
+			case OP_BAND:
+			case OP_BOR:
+			case OP_BXOR:
+			case OP_LSH:
+			case OP_RSHI:
+			case OP_RSHU:
+			case OP_ADDF:
+			case OP_SUBF:
+			case OP_DIVF:
+			case OP_MULF:
+				EmitBinaryOpt(op);
+				break;
+			case OP_BLOCK_COPY:
+				FlushAllOperands();
+				EmitString("B8");			// mov eax, 0x12345678
+				Emit4(VM_BLOCK_COPY);
+				EmitString("B9");			// mov ecx, 0x12345678
+				Emit4(Constant4());
+
+				EmitCallRel(vm, callDoSyscallOfs);
+
+				STACK_POP(2);				// sub bl, 2
+				break;
+			case OP_JUMP:
+				if(numOperands && operands[numOperands - 1].type == OPND_CONST)
+				{
+					v = operands[--numOperands].value;
+					FlushAllOperands();
+					EmitJumpIns(vm, "E9", v);	// jmp 0x12345678
+				}
+				else
+				{
+					FlushAllOperands();
+					STACK_POP(1);			// sub bl, 1
+					EmitString("8B 44 9F 04");	// mov eax, dword ptr 4[edi + ebx * 4]
+					EmitString("81 F8");		// cmp eax, vm->instructionCount
+					Emit4(vm->instructionCount);
+					EmitString("73 04");		// jae +4
+					EmitRexString(0x49, "FF 24 C0");	// jmp qword ptr [r8 + eax * 8]
+					EmitCallErrJump(vm, callDoSyscallOfs);
+				}
+				break;
+			default:
+				VMFREE_BUFFERS();
+				Com_Error(ERR_DROP, "VM_CompileX86: bad opcode %i at offset %i", op, pc);
+			}
+		}
+
+		FlushAllOperands();
+	}
+}
+#endif
+
 /*
 =================
 VM_Compile
@@ -1074,11 +2016,17 @@ void VM_Compile(vm_t *vm, vmHeader_t *header)
 	int		v;
 	int		i;
         int		callProcOfsSyscall, callProcOfs, callDoSyscallOfs;
+	qboolean	optimize = qfalse;
 
 	jusedSize = header->instructionCount + 2;
 
+#if idx64
+	// the optimizing tier relies on knowing all jump targets
+	optimize = Cvar_VariableIntegerValue( "vm_optimize" ) && vm->jumpTableTargets;
+#endif
+
 	// allocate a very large temp buffer, we will shrink it later
-	maxLength = header->codeLength * 8 + 64;
+	maxLength = header->codeLength * ( optimize ? 16 : 8 ) + 64;
 	buf = Z_Malloc(maxLength);
 	jused = Z_Malloc(jusedSize);
 	code = Z_Malloc(header->codeLength+32);
@@ -1107,6 +2055,14 @@ void VM_Compile(vm_t *vm, vmHeader_t *header)
 	callProcOfsSyscall = EmitCallProcedure(vm, callDoSyscallOfs);
 	vm->entryOfs = compiledOfs;
 
+#if idx64
+	if(optimize)
+	{
+		vm->entryOfs = EmitEntryStub();
+		VM_CompileOptimized(vm, header, maxLength, callProcOfs, callProcOfsSyscall, callDoSyscallOfs);
+	}
+	else
+#endif
 	for(pass=0; pass < 3; pass++) {
 	oc0 = -23423;
 	oc1 = -234354;
@@ -1680,10 +2636,18 @@ void VM_Compile(vm_t *vm, vmHeader_t *header)
 	Z_Free( code );
 	Z_Free( buf );
 	Z_Free( jused );
-	Com_Printf( "VM file %s compiled to %i bytes of code\n", vm->name, compiledOfs );
+	Com_Printf( "VM file %s compiled to %i bytes of %scode\n", vm->name, compiledOfs, optimize ? "optimized " : "" );
 
 	vm->destroy = VM_Destroy_Compiled;
 
+	// instructions that ConstOptimize merged into the one before
+	// share its address, so the table stays sorted for lookups
+	for ( i = 1 ; i < header->instructionCount ; i++ ) {
+		if ( !vm->instructionPointers[i] ) {
+			vm->instructionPointers[i] = vm->instructionPointers[i - 1];
+		}
+	}
+
 	// offset all the instruction pointers for the new location
 	for ( i = 0 ; i < header->instructionCount ; i++ ) {
 		vm->instructionPointers[i] += (intptr_t) vm->codeBase;
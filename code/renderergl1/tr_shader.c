@@ -2939,6 +2939,9 @@ static void ScanAndLoadShaderFiles( void )
 {
 	char **shaderFiles;
 	char *buffers[MAX_SHADER_FILES] = {0};
+	static char filenames[MAX_SHADER_FILES][MAX_QPATH];
+	const char *names[MAX_SHADER_FILES];
+	long lengths[MAX_SHADER_FILES];
 	char *p;
 	int numShaderFiles;
 	int i;
@@ -2961,14 +2964,21 @@ static void ScanAndLoadShaderFiles( void )
 		numShaderFiles = MAX_SHADER_FILES;
 	}
 
-	// load and parse shader files
+	// load the shader files together, so the compressed ones inflate in parallel
 	for ( i = 0; i < numShaderFiles; i++ )
 	{
-		char filename[MAX_QPATH];
+		Com_sprintf( filenames[i], sizeof( filenames[i] ), "scripts/%s", shaderFiles[i] );
+		ri.Printf( PRINT_DEVELOPER, "...loading '%s'\n", filenames[i] );
+		names[i] = filenames[i];
+	}
+	ri.FS_ReadFiles( numShaderFiles, names, (void **)buffers, lengths );
+
+	// parse shader files
+	for ( i = 0; i < numShaderFiles; i++ )
+	{
+		char *filename = filenames[i];
 
-		Com_sprintf( filename, sizeof( filename ), "scripts/%s", shaderFiles[i] );
-		ri.Printf( PRINT_DEVELOPER, "...loading '%s'\n", filename );
-		summand = ri.FS_ReadFile( filename, (void **)&buffers[i] );
+		summand = lengths[i];
 		
 		if ( !buffers[i] )
 			ri.Error( ERR_DROP, "Couldn't load %s", filename );
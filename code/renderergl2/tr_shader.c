@@ -3544,6 +3544,9 @@ static void ScanAndLoadShaderFiles( void )
 {
 	char **shaderFiles;
 	char *buffers[MAX_SHADER_FILES] = {NULL};
+	static char filenames[MAX_SHADER_FILES][MAX_QPATH];
+	const char *names[MAX_SHADER_FILES];
+	long lengths[MAX_SHADER_FILES];
 	char *p;
 	int numShaderFiles;
 	int i;
@@ -3566,15 +3569,15 @@ static void ScanAndLoadShaderFiles( void )
 		numShaderFiles = MAX_SHADER_FILES;
 	}
 
-	// load and parse shader files
+	// load the shader files together, so the compressed ones inflate in parallel
 	for ( i = 0; i < numShaderFiles; i++ )
 	{
-		char filename[MAX_QPATH];
+		char *filename = filenames[i];
 
 		// look for a .mtr file first
 		{
 			char *ext;
-			Com_sprintf( filename, sizeof( filename ), "scripts/%s", shaderFiles[i] );
+			Com_sprintf( filename, sizeof( filenames[i] ), "scripts/%s", shaderFiles[i] );
 			if ( (ext = strrchr(filename, '.')) )
 			{
 				strcpy(ext, ".mtr");
@@ -3582,12 +3585,21 @@ static void ScanAndLoadShaderFiles( void )
 
 			if ( ri.FS_ReadFile( filename, NULL ) <= 0 )
 			{
-				Com_sprintf( filename, sizeof( filename ), "scripts/%s", shaderFiles[i] );
+				Com_sprintf( filename, sizeof( filenames[i] ), "scripts/%s", shaderFiles[i] );
 			}
 		}
 		
 		ri.Printf( PRINT_DEVELOPER, "...loading '%s'\n", filename );
-		summand = ri.FS_ReadFile( filename, (void **)&buffers[i] );
+		names[i] = filename;
+	}
+	ri.FS_ReadFiles( numShaderFiles, names, (void **)buffers, lengths );
+
+	// parse shader files
+	for ( i = 0; i < numShaderFiles; i++ )
+	{
+		char *filename = filenames[i];
+
+		summand = lengths[i];
 		
 		if ( !buffers[i] )
 			ri.Error( ERR_DROP, "Couldn't load %s", filename );
@@ -57,7 +57,8 @@ typedef struct svEntity_s {
 	int			clusternums[MAX_ENT_CLUSTERS];
 	int			lastCluster;		// if all the clusters don't fit in clusternums
 	int			areanum, areanum2;
-	int			snapshotCounter;	// used to prevent double adding from portal views
+	int			snapshotFrame;		// SV_SendClientMessages call that last stored the state
+	int			snapshotState;		// where in svs.snapshotEntities
 } svEntity_t;
 
 typedef enum {
@@ -75,7 +76,6 @@ typedef struct {
 	// https://zerowing.idsoftware.com/bugzilla/show_bug.cgi?id=475
 	// the serverId associated with the current checksumFeed (always <= serverId)
 	int       checksumFeedServerId;	
-	int				snapshotCounter;	// incremented for each snapshot built
 	int				timeResidual;		// <= 1000 / sv_frame->value
 	int				nextFrameTime;		// when time > nextFrameTime, process world
 	char			*configstrings[MAX_CONFIGSTRINGS];
@@ -104,9 +104,10 @@ typedef struct {
 	byte			areabits[MAX_MAP_AREA_BYTES];		// portalarea visibility bits
 	playerState_t	ps;
 	int				num_entities;
-	int				first_entity;		// into the circular sv_packet_entities[]
+	unsigned int	first_entity;		// into the circular svs.snapshotEntityRefs[]
 										// the entities MUST be in increasing state number
 										// order, otherwise the delta compression will fail
+	unsigned int	first_state;		// no older svs.snapshotEntities[] are referenced
 	int				messageSent;		// time the message was transmitted
 	int				messageAcked;		// time the message was acked
 	int				messageSize;		// used to rate drop packets
@@ -235,9 +236,17 @@ typedef struct {
 	int			snapFlagServerBit;			// ^= SNAPFLAG_SERVERCOUNT every SV_SpawnServer()
 
 	client_t	*clients;					// [sv_maxclients->integer];
+	// every entity state sent in a frame is stored once in snapshotEntities,
+	// client frames refer to them through snapshotEntityRefs. Both are rings
+	// indexed by counters that are allowed to wrap, the refs ring has a power
+	// of two size.
 	int			numSnapshotEntities;		// sv_maxclients->integer*PACKET_BACKUP*MAX_SNAPSHOT_ENTITIES
-	int			nextSnapshotEntities;		// next snapshotEntities to use
-	entityState_t	*snapshotEntities;		// [numSnapshotEntities]
+	unsigned int	nextSnapshotEntities;	// next snapshotEntityRefs to use
+	int			*snapshotEntityRefs;		// [numSnapshotEntities] into snapshotEntities
+	int			numSnapshotStates;
+	unsigned int	nextSnapshotStates;		// counts the stored states
+	int			snapshotStatePos;			// next snapshotEntities to use
+	entityState_t	*snapshotEntities;		// [numSnapshotStates]
 	int			nextHeartbeatTime;
 	challenge_t	challenges[MAX_CHALLENGES];	// to prevent invalid IPs from connecting
 	netadr_t	redirectAddress;			// for rcon return messages
@@ -276,6 +285,10 @@ extern	cvar_t	*sv_master[MAX_MASTER_SERVERS];
 extern	cvar_t	*sv_reconnectlimit;
 extern	cvar_t	*sv_showloss;
 extern	cvar_t	*sv_padPackets;
+extern	cvar_t	*sv_parallelSnapshots;
+extern	cvar_t	*sv_worldTree;
+extern	cvar_t	*sv_traceCache;
+extern	cvar_t	*sv_syscallStats;
 extern	cvar_t	*sv_killserver;
 extern	cvar_t	*sv_mapname;
 extern	cvar_t	*sv_mapChecksum;
@@ -353,6 +366,7 @@ void SV_SetUserinfo( int index, const char *val );
 void SV_GetUserinfo( int index, char *buffer, int bufferSize );
 
 void SV_ChangeMaxClients( void );
+void SV_SizeSnapshotEntities( void );
 void SV_SpawnServer( char *server, qboolean killBots );
 
 
@@ -397,6 +411,11 @@ void SV_WriteFrameToClient (client_t *client, msg_t *msg);
 void SV_SendMessageToClient( msg_t *msg, client_t *client );
 void SV_SendClientMessages( void );
 void SV_SendClientSnapshot( client_t *client );
+void SV_SnapshotRingTest_f( void );
+
+// entity state i of a client frame
+#define	SV_SnapshotEntity( frame, i ) \
+	( &svs.snapshotEntities[svs.snapshotEntityRefs[( (frame)->first_entity + (i) ) & ( svs.numSnapshotEntities - 1 )]] )
 
 //
 // sv_game.c
@@ -410,6 +429,8 @@ void		SV_InitGameProgs ( void );
 void		SV_ShutdownGameProgs ( void );
 void		SV_RestartGameProgs( void );
 qboolean	SV_inPVS (const vec3_t p1, const vec3_t p2);
+void		SV_GameBench_f( void );
+void		SV_VmStats_f( void );
 
 //
 // sv_bot.c
@@ -453,6 +474,9 @@ clipHandle_t SV_ClipHandleForEntity( const sharedEntity_t *ent );
 
 
 void SV_SectorList_f( void );
+void SV_WorldBench_f( void );
+void SV_TraceCache_f( void );
+void SV_FlushTraceCache( void );
 
 
 int SV_AreaEntities( const vec3_t mins, const vec3_t maxs, int *entityList, int maxcount );
@@ -483,6 +507,9 @@ void SV_Trace( trace_t *results, const vec3_t start, vec3_t mins, vec3_t maxs, c
 void SV_ClipToEntity( trace_t *trace, const vec3_t start, const vec3_t mins, const vec3_t maxs, const vec3_t end, int entityNum, int contentmask, int capsule );
 // clip to a specific entity
 
+void SV_TraceBatch( trace_t *results, const traceRequest_t *requests, int numRequests );
+// the same as an SV_Trace for each request
+
 //
 // sv_net_chan.c
 //
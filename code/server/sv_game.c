@@ -282,14 +282,275 @@ static int	FloatAsInt( float f ) {
 	return fi.i;
 }
 
+/*
+==============================================================================
+
+SYSCALL STATISTICS
+
+While sv_syscallStats is set every game trap is counted and timed per
+thread, the fast traps included, and vmstats prints the totals.  Times
+are inclusive, so G_RUN_PARALLEL also holds the traps its jobs made.
+
+==============================================================================
+*/
+
+#define	MAX_GAME_SYSCALLS	1024
+
+typedef struct {
+	int			count;
+	int64_t		usec;
+} syscallStat_t;
+
+static syscallStat_t	syscallStats[MAX_WORKERS + 1][MAX_GAME_SYSCALLS];
+
+typedef struct {
+	int			num;
+	const char	*name;
+} syscallName_t;
+
+#define	SYSCALL(x)	{ x, #x }
+
+static const syscallName_t	syscallNames[] = {
+	SYSCALL( G_PRINT ), SYSCALL( G_ERROR ), SYSCALL( G_MILLISECONDS ),
+	SYSCALL( G_CVAR_REGISTER ), SYSCALL( G_CVAR_UPDATE ), SYSCALL( G_CVAR_SET ),
+	SYSCALL( G_CVAR_VARIABLE_INTEGER_VALUE ), SYSCALL( G_CVAR_VARIABLE_STRING_BUFFER ), SYSCALL( G_ARGC ),
+	SYSCALL( G_ARGV ), SYSCALL( G_FS_FOPEN_FILE ), SYSCALL( G_FS_READ ),
+	SYSCALL( G_FS_WRITE ), SYSCALL( G_FS_FCLOSE_FILE ), SYSCALL( G_SEND_CONSOLE_COMMAND ),
+	SYSCALL( G_LOCATE_GAME_DATA ), SYSCALL( G_DROP_CLIENT ), SYSCALL( G_SEND_SERVER_COMMAND ),
+	SYSCALL( G_SET_CONFIGSTRING ), SYSCALL( G_GET_CONFIGSTRING ), SYSCALL( G_GET_USERINFO ),
+	SYSCALL( G_SET_USERINFO ), SYSCALL( G_GET_SERVERINFO ), SYSCALL( G_SET_BRUSH_MODEL ),
+	SYSCALL( G_TRACE ), SYSCALL( G_POINT_CONTENTS ), SYSCALL( G_IN_PVS ),
+	SYSCALL( G_IN_PVS_IGNORE_PORTALS ), SYSCALL( G_ADJUST_AREA_PORTAL_STATE ), SYSCALL( G_AREAS_CONNECTED ),
+	SYSCALL( G_LINKENTITY ), SYSCALL( G_UNLINKENTITY ), SYSCALL( G_ENTITIES_IN_BOX ),
+	SYSCALL( G_ENTITY_CONTACT ), SYSCALL( G_BOT_ALLOCATE_CLIENT ), SYSCALL( G_BOT_FREE_CLIENT ),
+	SYSCALL( G_GET_USERCMD ), SYSCALL( G_GET_ENTITY_TOKEN ), SYSCALL( G_FS_GETFILELIST ),
+	SYSCALL( G_DEBUG_POLYGON_CREATE ), SYSCALL( G_DEBUG_POLYGON_DELETE ), SYSCALL( G_REAL_TIME ),
+	SYSCALL( G_SNAPVECTOR ), SYSCALL( G_TRACECAPSULE ), SYSCALL( G_ENTITY_CONTACTCAPSULE ),
+	SYSCALL( G_FS_SEEK ), SYSCALL( G_TRACE_BATCH ), SYSCALL( G_RUN_PARALLEL ),
+	SYSCALL( G_FAST_TRAPS ), SYSCALL( BOTLIB_SETUP ), SYSCALL( BOTLIB_SHUTDOWN ),
+	SYSCALL( BOTLIB_LIBVAR_SET ), SYSCALL( BOTLIB_LIBVAR_GET ), SYSCALL( BOTLIB_PC_ADD_GLOBAL_DEFINE ),
+	SYSCALL( BOTLIB_START_FRAME ), SYSCALL( BOTLIB_LOAD_MAP ), SYSCALL( BOTLIB_UPDATENTITY ),
+	SYSCALL( BOTLIB_TEST ), SYSCALL( BOTLIB_GET_SNAPSHOT_ENTITY ), SYSCALL( BOTLIB_GET_CONSOLE_MESSAGE ),
+	SYSCALL( BOTLIB_USER_COMMAND ), SYSCALL( BOTLIB_AAS_ENABLE_ROUTING_AREA ), SYSCALL( BOTLIB_AAS_BBOX_AREAS ),
+	SYSCALL( BOTLIB_AAS_AREA_INFO ), SYSCALL( BOTLIB_AAS_ENTITY_INFO ), SYSCALL( BOTLIB_AAS_INITIALIZED ),
+	SYSCALL( BOTLIB_AAS_PRESENCE_TYPE_BOUNDING_BOX ), SYSCALL( BOTLIB_AAS_TIME ), SYSCALL( BOTLIB_AAS_POINT_AREA_NUM ),
+	SYSCALL( BOTLIB_AAS_TRACE_AREAS ), SYSCALL( BOTLIB_AAS_POINT_CONTENTS ), SYSCALL( BOTLIB_AAS_NEXT_BSP_ENTITY ),
+	SYSCALL( BOTLIB_AAS_VALUE_FOR_BSP_EPAIR_KEY ), SYSCALL( BOTLIB_AAS_VECTOR_FOR_BSP_EPAIR_KEY ), SYSCALL( BOTLIB_AAS_FLOAT_FOR_BSP_EPAIR_KEY ),
+	SYSCALL( BOTLIB_AAS_INT_FOR_BSP_EPAIR_KEY ), SYSCALL( BOTLIB_AAS_AREA_REACHABILITY ), SYSCALL( BOTLIB_AAS_AREA_TRAVEL_TIME_TO_GOAL_AREA ),
+	SYSCALL( BOTLIB_AAS_SWIMMING ), SYSCALL( BOTLIB_AAS_PREDICT_CLIENT_MOVEMENT ), SYSCALL( BOTLIB_EA_SAY ),
+	SYSCALL( BOTLIB_EA_SAY_TEAM ), SYSCALL( BOTLIB_EA_COMMAND ), SYSCALL( BOTLIB_EA_ACTION ),
+	SYSCALL( BOTLIB_EA_GESTURE ), SYSCALL( BOTLIB_EA_TALK ), SYSCALL( BOTLIB_EA_ATTACK ),
+	SYSCALL( BOTLIB_EA_USE ), SYSCALL( BOTLIB_EA_RESPAWN ), SYSCALL( BOTLIB_EA_CROUCH ),
+	SYSCALL( BOTLIB_EA_MOVE_UP ), SYSCALL( BOTLIB_EA_MOVE_DOWN ), SYSCALL( BOTLIB_EA_MOVE_FORWARD ),
+	SYSCALL( BOTLIB_EA_MOVE_BACK ), SYSCALL( BOTLIB_EA_MOVE_LEFT ), SYSCALL( BOTLIB_EA_MOVE_RIGHT ),
+	SYSCALL( BOTLIB_EA_SELECT_WEAPON ), SYSCALL( BOTLIB_EA_JUMP ), SYSCALL( BOTLIB_EA_DELAYED_JUMP ),
+	SYSCALL( BOTLIB_EA_MOVE ), SYSCALL( BOTLIB_EA_VIEW ), SYSCALL( BOTLIB_EA_END_REGULAR ),
+	SYSCALL( BOTLIB_EA_GET_INPUT ), SYSCALL( BOTLIB_EA_RESET_INPUT ), SYSCALL( BOTLIB_AI_LOAD_CHARACTER ),
+	SYSCALL( BOTLIB_AI_FREE_CHARACTER ), SYSCALL( BOTLIB_AI_CHARACTERISTIC_FLOAT ), SYSCALL( BOTLIB_AI_CHARACTERISTIC_BFLOAT ),
+	SYSCALL( BOTLIB_AI_CHARACTERISTIC_INTEGER ), SYSCALL( BOTLIB_AI_CHARACTERISTIC_BINTEGER ), SYSCALL( BOTLIB_AI_CHARACTERISTIC_STRING ),
+	SYSCALL( BOTLIB_AI_ALLOC_CHAT_STATE ), SYSCALL( BOTLIB_AI_FREE_CHAT_STATE ), SYSCALL( BOTLIB_AI_QUEUE_CONSOLE_MESSAGE ),
+	SYSCALL( BOTLIB_AI_REMOVE_CONSOLE_MESSAGE ), SYSCALL( BOTLIB_AI_NEXT_CONSOLE_MESSAGE ), SYSCALL( BOTLIB_AI_NUM_CONSOLE_MESSAGE ),
+	SYSCALL( BOTLIB_AI_INITIAL_CHAT ), SYSCALL( BOTLIB_AI_REPLY_CHAT ), SYSCALL( BOTLIB_AI_CHAT_LENGTH ),
+	SYSCALL( BOTLIB_AI_ENTER_CHAT ), SYSCALL( BOTLIB_AI_STRING_CONTAINS ), SYSCALL( BOTLIB_AI_FIND_MATCH ),
+	SYSCALL( BOTLIB_AI_MATCH_VARIABLE ), SYSCALL( BOTLIB_AI_UNIFY_WHITE_SPACES ), SYSCALL( BOTLIB_AI_REPLACE_SYNONYMS ),
+	SYSCALL( BOTLIB_AI_LOAD_CHAT_FILE ), SYSCALL( BOTLIB_AI_SET_CHAT_GENDER ), SYSCALL( BOTLIB_AI_SET_CHAT_NAME ),
+	SYSCALL( BOTLIB_AI_RESET_GOAL_STATE ), SYSCALL( BOTLIB_AI_RESET_AVOID_GOALS ), SYSCALL( BOTLIB_AI_PUSH_GOAL ),
+	SYSCALL( BOTLIB_AI_POP_GOAL ), SYSCALL( BOTLIB_AI_EMPTY_GOAL_STACK ), SYSCALL( BOTLIB_AI_DUMP_AVOID_GOALS ),
+	SYSCALL( BOTLIB_AI_DUMP_GOAL_STACK ), SYSCALL( BOTLIB_AI_GOAL_NAME ), SYSCALL( BOTLIB_AI_GET_TOP_GOAL ),
+	SYSCALL( BOTLIB_AI_GET_SECOND_GOAL ), SYSCALL( BOTLIB_AI_CHOOSE_LTG_ITEM ), SYSCALL( BOTLIB_AI_CHOOSE_NBG_ITEM ),
+	SYSCALL( BOTLIB_AI_TOUCHING_GOAL ), SYSCALL( BOTLIB_AI_ITEM_GOAL_IN_VIS_BUT_NOT_VISIBLE ), SYSCALL( BOTLIB_AI_GET_LEVEL_ITEM_GOAL ),
+	SYSCALL( BOTLIB_AI_AVOID_GOAL_TIME ), SYSCALL( BOTLIB_AI_INIT_LEVEL_ITEMS ), SYSCALL( BOTLIB_AI_UPDATE_ENTITY_ITEMS ),
+	SYSCALL( BOTLIB_AI_LOAD_ITEM_WEIGHTS ), SYSCALL( BOTLIB_AI_FREE_ITEM_WEIGHTS ), SYSCALL( BOTLIB_AI_SAVE_GOAL_FUZZY_LOGIC ),
+	SYSCALL( BOTLIB_AI_ALLOC_GOAL_STATE ), SYSCALL( BOTLIB_AI_FREE_GOAL_STATE ), SYSCALL( BOTLIB_AI_RESET_MOVE_STATE ),
+	SYSCALL( BOTLIB_AI_MOVE_TO_GOAL ), SYSCALL( BOTLIB_AI_MOVE_IN_DIRECTION ), SYSCALL( BOTLIB_AI_RESET_AVOID_REACH ),
+	SYSCALL( BOTLIB_AI_RESET_LAST_AVOID_REACH ), SYSCALL( BOTLIB_AI_REACHABILITY_AREA ), SYSCALL( BOTLIB_AI_MOVEMENT_VIEW_TARGET ),
+	SYSCALL( BOTLIB_AI_ALLOC_MOVE_STATE ), SYSCALL( BOTLIB_AI_FREE_MOVE_STATE ), SYSCALL( BOTLIB_AI_INIT_MOVE_STATE ),
+	SYSCALL( BOTLIB_AI_CHOOSE_BEST_FIGHT_WEAPON ), SYSCALL( BOTLIB_AI_GET_WEAPON_INFO ), SYSCALL( BOTLIB_AI_LOAD_WEAPON_WEIGHTS ),
+	SYSCALL( BOTLIB_AI_ALLOC_WEAPON_STATE ), SYSCALL( BOTLIB_AI_FREE_WEAPON_STATE ), SYSCALL( BOTLIB_AI_RESET_WEAPON_STATE ),
+	SYSCALL( BOTLIB_AI_GENETIC_PARENTS_AND_CHILD_SELECTION ), SYSCALL( BOTLIB_AI_INTERBREED_GOAL_FUZZY_LOGIC ), SYSCALL( BOTLIB_AI_MUTATE_GOAL_FUZZY_LOGIC ),
+	SYSCALL( BOTLIB_AI_GET_NEXT_CAMP_SPOT_GOAL ), SYSCALL( BOTLIB_AI_GET_MAP_LOCATION_GOAL ), SYSCALL( BOTLIB_AI_NUM_INITIAL_CHATS ),
+	SYSCALL( BOTLIB_AI_GET_CHAT_MESSAGE ), SYSCALL( BOTLIB_AI_REMOVE_FROM_AVOID_GOALS ), SYSCALL( BOTLIB_AI_PREDICT_VISIBLE_POSITION ),
+	SYSCALL( BOTLIB_AI_SET_AVOID_GOAL_TIME ), SYSCALL( BOTLIB_AI_ADD_AVOID_SPOT ), SYSCALL( BOTLIB_AAS_ALTERNATIVE_ROUTE_GOAL ),
+	SYSCALL( BOTLIB_AAS_PREDICT_ROUTE ), SYSCALL( BOTLIB_AAS_POINT_REACHABILITY_AREA_INDEX ), SYSCALL( BOTLIB_PC_LOAD_SOURCE ),
+	SYSCALL( BOTLIB_PC_FREE_SOURCE ), SYSCALL( BOTLIB_PC_READ_TOKEN ), SYSCALL( BOTLIB_PC_SOURCE_FILE_AND_LINE ),
+};
+
 /*
 ====================
-SV_GameSystemCalls
+SV_SyscallStart
+====================
+*/
+static ID_INLINE int64_t SV_SyscallStart( void ) {
+	return sv_syscallStats->integer ? Sys_Microseconds() : 0;
+}
+
+/*
+====================
+SV_SyscallEnd
+====================
+*/
+static ID_INLINE void SV_SyscallEnd( intptr_t num, int64_t start ) {
+	syscallStat_t	*stat;
+
+	if ( !start ) {
+		return;
+	}
+	if ( num < 0 || num >= MAX_GAME_SYSCALLS ) {
+		num = MAX_GAME_SYSCALLS - 1;
+	}
+	stat = &syscallStats[Com_ThreadIndex()][num];
+	stat->count++;
+	stat->usec += Sys_Microseconds() - start;
+}
+
+/*
+====================
+SV_SyscallName
+====================
+*/
+static const char *SV_SyscallName( int num ) {
+	int		i;
+
+	for ( i = 0 ; i < ARRAY_LEN( syscallNames ) ; i++ ) {
+		if ( syscallNames[i].num == num ) {
+			return syscallNames[i].name;
+		}
+	}
+	return va( "trap %i", num );
+}
+
+/*
+====================
+SV_VmStats_f
+
+vmstats [reset]
+====================
+*/
+void SV_VmStats_f( void ) {
+	syscallStat_t	totals[MAX_GAME_SYSCALLS];
+	int				order[MAX_GAME_SYSCALLS];
+	int				i, j, num, count;
+	int64_t			usec;
+
+	if ( !Q_stricmp( Cmd_Argv( 1 ), "reset" ) ) {
+		Com_Memset( syscallStats, 0, sizeof( syscallStats ) );
+		return;
+	}
+
+	Com_Memset( totals, 0, sizeof( totals ) );
+	for ( i = 0 ; i <= MAX_WORKERS ; i++ ) {
+		for ( j = 0 ; j < MAX_GAME_SYSCALLS ; j++ ) {
+			totals[j].count += syscallStats[i][j].count;
+			totals[j].usec += syscallStats[i][j].usec;
+		}
+	}
+
+	// sort the used traps by time
+	count = 0;
+	for ( i = 0 ; i < MAX_GAME_SYSCALLS ; i++ ) {
+		if ( !totals[i].count ) {
+			continue;
+		}
+		for ( j = count ; j > 0 && totals[order[j - 1]].usec < totals[i].usec ; j-- ) {
+			order[j] = order[j - 1];
+		}
+		order[j] = i;
+		count++;
+	}
+
+	Com_Printf( "sv_syscallStats is %s\n", sv_syscallStats->integer ? "on" : "off" );
+	Com_Printf( "      calls        usec  usec/call  trap\n" );
+	usec = 0;
+	for ( i = 0 ; i < count ; i++ ) {
+		num = order[i];
+		Com_Printf( "%11i %11lld %10.3f  %s\n", totals[num].count, (long long)totals[num].usec,
+			(double)totals[num].usec / totals[num].count, SV_SyscallName( num ) );
+		usec += totals[num].usec;
+	}
+	Com_Printf( "%lld usec in %i traps\n", (long long)usec, count );
+}
+
+/*
+==============================================================================
+
+FAST TRAPS
+
+==============================================================================
+*/
+
+static void SV_FastTrace( trace_t *results, const vec3_t start, vec3_t mins, vec3_t maxs, const vec3_t end, int passEntityNum, int contentmask, int capsule ) {
+	int64_t		time = SV_SyscallStart();
+
+	SV_Trace( results, start, mins, maxs, end, passEntityNum, contentmask, capsule );
+	SV_SyscallEnd( capsule ? G_TRACECAPSULE : G_TRACE, time );
+}
+
+static int SV_FastPointContents( const vec3_t point, int passEntityNum ) {
+	int64_t		time = SV_SyscallStart();
+	int			contents;
+
+	contents = SV_PointContents( point, passEntityNum );
+	SV_SyscallEnd( G_POINT_CONTENTS, time );
+	return contents;
+}
+
+static void SV_FastLinkEntity( sharedEntity_t *ent ) {
+	int64_t		time = SV_SyscallStart();
+
+	SV_LinkEntity( ent );
+	SV_SyscallEnd( G_LINKENTITY, time );
+}
+
+static void SV_FastUnlinkEntity( sharedEntity_t *ent ) {
+	int64_t		time = SV_SyscallStart();
+
+	SV_UnlinkEntity( ent );
+	SV_SyscallEnd( G_UNLINKENTITY, time );
+}
+
+static int SV_FastEntitiesInBox( const vec3_t mins, const vec3_t maxs, int *list, int maxcount ) {
+	int64_t		time = SV_SyscallStart();
+	int			count;
+
+	count = SV_AreaEntities( mins, maxs, list, maxcount );
+	SV_SyscallEnd( G_ENTITIES_IN_BOX, time );
+	return count;
+}
+
+static void SV_FastGetUsercmd( int clientNum, usercmd_t *cmd ) {
+	int64_t		time = SV_SyscallStart();
+
+	SV_GetUsercmd( clientNum, cmd );
+	SV_SyscallEnd( G_GET_USERCMD, time );
+}
+
+static int SV_FastBotGetSnapshotEntity( int clientNum, int sequence ) {
+	int64_t		time = SV_SyscallStart();
+	int			entityNum;
+
+	entityNum = SV_BotGetSnapshotEntity( clientNum, sequence );
+	SV_SyscallEnd( BOTLIB_GET_SNAPSHOT_ENTITY, time );
+	return entityNum;
+}
+
+static const gameFastTraps_t	gameFastTraps = {
+	SV_FastTrace,
+	SV_FastPointContents,
+	SV_FastLinkEntity,
+	SV_FastUnlinkEntity,
+	SV_FastEntitiesInBox,
+	SV_FastGetUsercmd,
+	SV_FastBotGetSnapshotEntity
+};
+
+/*
+====================
+SV_GameSyscall
 
 The module is making a system call
 ====================
 */
-intptr_t SV_GameSystemCalls( intptr_t *args ) {
+static intptr_t SV_GameSyscall( intptr_t *args ) {
 	switch( args[0] ) {
 	case G_PRINT:
 		Com_Printf( "%s", (const char*)VMA(1) );
@@ -365,6 +626,25 @@ intptr_t SV_GameSystemCalls( intptr_t *args ) {
 	case G_TRACECAPSULE:
 		SV_Trace( VMA(1), VMA(2), VMA(3), VMA(4), VMA(5), args[6], args[7], /*int capsule*/ qtrue );
 		return 0;
+	case G_TRACE_BATCH:
+		if ( args[3] < 0 || args[3] > MAX_TRACE_REQUESTS ) {
+			Com_Error( ERR_DROP, "G_TRACE_BATCH: bad request count %ld", (long int)args[3] );
+		}
+		SV_TraceBatch( VM_ArgArray( args[1], args[3], sizeof( trace_t ) ),
+			VM_ArgArray( args[2], args[3], sizeof( traceRequest_t ) ), args[3] );
+		return 0;
+	case G_RUN_PARALLEL:
+		// a qvm can't hand out function pointers, it runs the jobs itself
+		if ( !VM_IsNative( gvm ) ) {
+			return qfalse;
+		}
+		Com_RunParallel( args[3], (void (*)( void *, int ))args[1], (void *)args[2] );
+		return qtrue;
+	case G_FAST_TRAPS:
+		if ( !VM_IsNative( gvm ) || args[1] != sizeof( gameFastTraps_t ) ) {
+			return 0;
+		}
+		return (intptr_t)&gameFastTraps;
 	case G_POINT_CONTENTS:
 		return SV_PointContents( VMA(1), args[2] );
 	case G_SET_BRUSH_MODEL:
@@ -843,6 +1123,22 @@ intptr_t SV_GameSystemCalls( intptr_t *args ) {
 	return 0;
 }
 
+/*
+====================
+SV_GameSystemCalls
+
+Counts and times the trap when sv_syscallStats is set
+====================
+*/
+intptr_t SV_GameSystemCalls( intptr_t *args ) {
+	int64_t		time = SV_SyscallStart();
+	intptr_t	ret;
+
+	ret = SV_GameSyscall( args );
+	SV_SyscallEnd( args[0], time );
+	return ret;
+}
+
 /*
 ===============
 SV_ShutdownGameProgs
@@ -955,3 +1251,66 @@ qboolean SV_GameCommand( void ) {
 	return VM_Call( gvm, GAME_CONSOLE_COMMAND );
 }
 
+
+/*
+====================
+SV_GameBench_f
+
+gamebench [frames]
+
+Runs the bot AI and the game frame back to back without waiting
+for real time, to compare vm_game and vm_optimize settings on the
+same map.  Only runs with nothing but bots connected.  Game time moves
+forward by the frames that were run, the game has run them, but the
+server's real time clock is put back.
+====================
+*/
+#define	GAMEBENCH_FRAMES	1000
+
+void SV_GameBench_f( void ) {
+	client_t	*cl;
+	int			i, frames, frameMsec, bots, msec, savedTime;
+
+	if ( sv.state != SS_GAME ) {
+		Com_Printf( "Server is not running.\n" );
+		return;
+	}
+
+	frames = Cmd_Argc() > 1 ? atoi( Cmd_Argv( 1 ) ) : GAMEBENCH_FRAMES;
+	if ( frames < 1 ) {
+		frames = 1;
+	}
+	frameMsec = sv_fps->integer > 0 ? 1000 / sv_fps->integer : 50;
+
+	bots = 0;
+	for ( i = 0, cl = svs.clients ; i < sv_maxclients->integer ; i++, cl++ ) {
+		if ( cl->state < CS_CONNECTED ) {
+			continue;
+		}
+		if ( cl->netchan.remoteAddress.type != NA_BOT ) {
+			Com_Printf( "gamebench: only runs with no players connected\n" );
+			return;
+		}
+		bots++;
+	}
+
+	savedTime = svs.time;
+	msec = Sys_Milliseconds();
+	for ( i = 0 ; i < frames ; i++ ) {
+		svs.time += frameMsec;
+		sv.time += frameMsec;
+
+		SV_BotFrame( sv.time );
+		SV_FlushTraceCache();
+		VM_Call( gvm, GAME_RUN_FRAME, sv.time );
+	}
+	msec = Sys_Milliseconds() - msec;
+
+	// sv.time has to stay where the game's level time is now, but the
+	// timeouts and snapshot rates go by svs.time
+	svs.time = savedTime;
+
+	Com_Printf( "%i frames, %i bots, vm_game %i, vm_optimize %i\n", frames, bots,
+		Cvar_VariableIntegerValue( "vm_game" ), Cvar_VariableIntegerValue( "vm_optimize" ) );
+	Com_Printf( "%i msec, %.3f msec per frame\n", msec, (float)msec / frames );
+}
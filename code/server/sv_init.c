@@ -253,6 +253,31 @@ static void SV_BoundMaxClients( int minimum ) {
 }
 
 
+/*
+===============
+SV_SizeSnapshotEntities
+
+The refs ring is indexed with a counter that wraps around, so its size
+has to be a power of two. Every stored state is referenced at least once,
+so a state ring as long as the one ring of old never loses a state before
+that ring would have lost it, whatever the snapshot rates of the clients.
+===============
+*/
+void SV_SizeSnapshotEntities( void ) {
+	int		refs;
+
+	if ( com_dedicated->integer ) {
+		refs = sv_maxclients->integer * PACKET_BACKUP * MAX_SNAPSHOT_ENTITIES;
+	} else {
+		// we don't need nearly as many when playing locally
+		refs = sv_maxclients->integer * 4 * MAX_SNAPSHOT_ENTITIES;
+	}
+
+	svs.numSnapshotStates = refs;
+	for ( svs.numSnapshotEntities = 1 ; svs.numSnapshotEntities < refs ; svs.numSnapshotEntities <<= 1 ) {
+	}
+}
+
 /*
 ===============
 SV_Startup
@@ -270,12 +295,7 @@ static void SV_Startup( void ) {
 	SV_BoundMaxClients( 1 );
 
 	svs.clients = Z_Malloc (sizeof(client_t) * sv_maxclients->integer );
-	if ( com_dedicated->integer ) {
-		svs.numSnapshotEntities = sv_maxclients->integer * PACKET_BACKUP * MAX_SNAPSHOT_ENTITIES;
-	} else {
-		// we don't need nearly as many when playing locally
-		svs.numSnapshotEntities = sv_maxclients->integer * 4 * MAX_SNAPSHOT_ENTITIES;
-	}
+	SV_SizeSnapshotEntities();
 	svs.initialized = qtrue;
 
 	// Don't respect sv_killserver unless a server is actually running
@@ -348,12 +368,7 @@ void SV_ChangeMaxClients( void ) {
 	Hunk_FreeTempMemory( oldClients );
 	
 	// allocate new snapshot entities
-	if ( com_dedicated->integer ) {
-		svs.numSnapshotEntities = sv_maxclients->integer * PACKET_BACKUP * MAX_SNAPSHOT_ENTITIES;
-	} else {
-		// we don't need nearly as many when playing locally
-		svs.numSnapshotEntities = sv_maxclients->integer * 4 * MAX_SNAPSHOT_ENTITIES;
-	}
+	SV_SizeSnapshotEntities();
 }
 
 /*
@@ -439,8 +454,11 @@ void SV_SpawnServer( char *server, qboolean killBots ) {
 	FS_ClearPakReferences(0);
 
 	// allocate the snapshot entities on the hunk
-	svs.snapshotEntities = Hunk_Alloc( sizeof(entityState_t)*svs.numSnapshotEntities, h_high );
+	svs.snapshotEntityRefs = Hunk_Alloc( sizeof(int)*svs.numSnapshotEntities, h_high );
 	svs.nextSnapshotEntities = 0;
+	svs.snapshotEntities = Hunk_Alloc( sizeof(entityState_t)*svs.numSnapshotStates, h_high );
+	svs.nextSnapshotStates = 0;
+	svs.snapshotStatePos = 0;
 
 	// toggle the server bit so clients can detect that a
 	// server has changed
@@ -683,6 +701,10 @@ void SV_Init (void)
 	sv_reconnectlimit = Cvar_Get ("sv_reconnectlimit", "3", 0);
 	sv_showloss = Cvar_Get ("sv_showloss", "0", 0);
 	sv_padPackets = Cvar_Get ("sv_padPackets", "0", 0);
+	sv_parallelSnapshots = Cvar_Get ("sv_parallelSnapshots", "1", CVAR_ARCHIVE );
+	sv_worldTree = Cvar_Get ("sv_worldTree", "1", CVAR_ARCHIVE );
+	sv_traceCache = Cvar_Get ("sv_traceCache", "0", CVAR_ARCHIVE );
+	sv_syscallStats = Cvar_Get ("sv_syscallStats", "0", 0 );
 	sv_killserver = Cvar_Get ("sv_killserver", "0", 0);
 	sv_mapChecksum = Cvar_Get ("sv_mapChecksum", "", CVAR_ROM);
 	sv_lanForceRate = Cvar_Get ("sv_lanForceRate", "1", CVAR_ARCHIVE );
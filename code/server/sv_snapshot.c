@@ -45,6 +45,147 @@ A normal server packet will look like:
 =============================================================================
 */
 
+/*
+=============================================================================
+
+Delta memo
+
+Clients that acknowledged the same frame get the same entity deltas.
+While SV_SendClientMessages runs, every encoded delta is remembered under
+the svs.snapshotEntities indices of the two states it came from, which
+are shared by all clients since they are stored once per frame. Other
+clients splice the bits into their message instead of encoding them
+again. Deltas from a baseline use -1 for the from state, as the to state
+already tells the entity.
+
+Entries are published with a compare and swap on the hash slot so the
+worker threads writing snapshot messages can share them.
+
+=============================================================================
+*/
+
+#define	DELTA_MEMO_HASH		4096
+#define	MAX_DELTA_MEMOS		2048
+#define	DELTA_MEMO_BYTES	(256*1024)
+#define	DELTA_MEMO_PROBES	8
+#define	MAX_DELTA_BYTES		1024		// more than a full entityState_t delta
+
+typedef struct {
+	int				from, to;	// svs.snapshotEntities indices
+	int				bits;
+	int				offset;		// into deltaMemoData
+} deltaMemo_t;
+
+static qboolean		deltaMemoActive;
+static volatile int	deltaMemoHash[DELTA_MEMO_HASH];	// memo number + 1, 0 when empty
+static volatile int	numDeltaMemos;
+static volatile int	deltaMemoBytes;
+static deltaMemo_t	deltaMemos[MAX_DELTA_MEMOS];
+static byte			deltaMemoData[DELTA_MEMO_BYTES];
+
+/*
+===============
+SV_BeginDeltaMemo
+===============
+*/
+static void SV_BeginDeltaMemo( void ) {
+	Com_Memset( (void *)deltaMemoHash, 0, sizeof( deltaMemoHash ) );
+	numDeltaMemos = 0;
+	deltaMemoBytes = 0;
+	deltaMemoActive = qtrue;
+}
+
+/*
+===============
+SV_EndDeltaMemo
+===============
+*/
+static void SV_EndDeltaMemo( void ) {
+	deltaMemoActive = qfalse;
+}
+
+/*
+===============
+SV_WriteDeltaEntity
+
+MSG_WriteDeltaEntity for a state in a snapshot, through the memo when
+it is active. from is either a stored state or the entity's baseline.
+===============
+*/
+static void SV_WriteDeltaEntity( msg_t *msg, entityState_t *from, entityState_t *to, qboolean force ) {
+	unsigned int	hash;
+	int				i, slot, index, offset, fromIndex, toIndex, start, bits, bytes;
+	deltaMemo_t		*memo;
+
+	if ( !deltaMemoActive || !to ) {
+		MSG_WriteDeltaEntity( msg, from, to, force );
+		return;
+	}
+
+	toIndex = to - svs.snapshotEntities;
+	if ( from >= svs.snapshotEntities && from < svs.snapshotEntities + svs.numSnapshotStates ) {
+		fromIndex = from - svs.snapshotEntities;
+	} else {
+		fromIndex = -1;
+	}
+
+	hash = ( (unsigned int)fromIndex * 0x9e3779b1 ) ^ ( (unsigned int)toIndex * 0x85ebca6b );
+	hash ^= hash >> 16;
+
+	for ( i = 0 ; i < DELTA_MEMO_PROBES ; i++ ) {
+		slot = ( hash + i ) & ( DELTA_MEMO_HASH - 1 );
+		index = Com_AtomicLoad( &deltaMemoHash[slot] );
+		if ( !index ) {
+			break;
+		}
+
+		memo = &deltaMemos[index - 1];
+		if ( memo->from == fromIndex && memo->to == toIndex ) {
+			MSG_WriteBitBuffer( msg, deltaMemoData + memo->offset, memo->bits );
+			return;
+		}
+	}
+
+	start = msg->bit;
+	MSG_WriteDeltaEntity( msg, from, to, force );
+	bits = msg->bit - start;
+
+	// unchanged entities write nothing and are cheaper to compare again
+	if ( i == DELTA_MEMO_PROBES || msg->overflowed || !bits ) {
+		return;
+	}
+
+	bytes = ( bits + 7 ) >> 3;
+	if ( bytes > MAX_DELTA_BYTES ) {
+		return;
+	}
+
+	index = Com_AtomicAdd( &numDeltaMemos, 1 );
+	if ( index >= MAX_DELTA_MEMOS ) {
+		return;
+	}
+	offset = Com_AtomicAdd( &deltaMemoBytes, bytes );
+	if ( offset + bytes > DELTA_MEMO_BYTES ) {
+		return;
+	}
+
+	memo = &deltaMemos[index];
+	memo->from = fromIndex;
+	memo->to = toIndex;
+	memo->bits = bits;
+	memo->offset = offset;
+	MSG_ReadBitBuffer( msg, start, deltaMemoData + offset, bits );
+
+	// another thread may have taken the slot meanwhile, then this one
+	// just isn't remembered
+	for ( ; i < DELTA_MEMO_PROBES ; i++ ) {
+		slot = ( hash + i ) & ( DELTA_MEMO_HASH - 1 );
+		if ( Com_AtomicCompareSwap( &deltaMemoHash[slot], 0, index + 1 ) ) {
+			break;
+		}
+	}
+}
+
 /*
 =============
 SV_EmitPacketEntities
@@ -73,14 +214,14 @@ static void SV_EmitPacketEntities( clientSnapshot_t *from, clientSnapshot_t *to,
 		if ( newindex >= to->num_entities ) {
 			newnum = 9999;
 		} else {
-			newent = &svs.snapshotEntities[(to->first_entity+newindex) % svs.numSnapshotEntities];
+			newent = SV_SnapshotEntity( to, newindex );
 			newnum = newent->number;
 		}
 
 		if ( oldindex >= from_num_entities ) {
 			oldnum = 9999;
 		} else {
-			oldent = &svs.snapshotEntities[(from->first_entity+oldindex) % svs.numSnapshotEntities];
+			oldent = SV_SnapshotEntity( from, oldindex );
 			oldnum = oldent->number;
 		}
 
@@ -88,7 +229,7 @@ static void SV_EmitPacketEntities( clientSnapshot_t *from, clientSnapshot_t *to,
 			// delta update from old position
 			// because the force parm is qfalse, this will not result
 			// in any bytes being emited if the entity has not changed at all
-			MSG_WriteDeltaEntity (msg, oldent, newent, qfalse );
+			SV_WriteDeltaEntity (msg, oldent, newent, qfalse );
 			oldindex++;
 			newindex++;
 			continue;
@@ -96,7 +237,7 @@ static void SV_EmitPacketEntities( clientSnapshot_t *from, clientSnapshot_t *to,
 
 		if ( newnum < oldnum ) {
 			// this is a new entity, send it from the baseline
-			MSG_WriteDeltaEntity (msg, &sv.svEntities[newnum].baseline, newent, qtrue );
+			SV_WriteDeltaEntity (msg, &sv.svEntities[newnum].baseline, newent, qtrue );
 			newindex++;
 			continue;
 		}
@@ -116,42 +257,57 @@ static void SV_EmitPacketEntities( clientSnapshot_t *from, clientSnapshot_t *to,
 
 /*
 ==================
-SV_WriteSnapshotToClient
+SV_SnapshotDeltaFrame
+
+Picks the previous frame the snapshot being created will be delta
+compressed against, or NULL when it has to be sent in full.
 ==================
 */
-static void SV_WriteSnapshotToClient( client_t *client, msg_t *msg ) {
-	clientSnapshot_t	*frame, *oldframe;
-	int					lastframe;
-	int					i;
-	int					snapFlags;
-
-	// this is the snapshot we are creating
-	frame = &client->frames[ client->netchan.outgoingSequence & PACKET_MASK ];
+static clientSnapshot_t *SV_SnapshotDeltaFrame( client_t *client, int *lastframe ) {
+	clientSnapshot_t	*oldframe;
 
 	// try to use a previous frame as the source for delta compressing the snapshot
 	if ( client->deltaMessage <= 0 || client->state != CS_ACTIVE ) {
 		// client is asking for a retransmit
 		oldframe = NULL;
-		lastframe = 0;
+		*lastframe = 0;
 	} else if ( client->netchan.outgoingSequence - client->deltaMessage 
 		>= (PACKET_BACKUP - 3) ) {
 		// client hasn't gotten a good message through in a long time
 		Com_DPrintf ("%s: Delta request from out of date packet.\n", client->name);
 		oldframe = NULL;
-		lastframe = 0;
+		*lastframe = 0;
 	} else {
 		// we have a valid snapshot to delta from
 		oldframe = &client->frames[ client->deltaMessage & PACKET_MASK ];
-		lastframe = client->netchan.outgoingSequence - client->deltaMessage;
+		*lastframe = client->netchan.outgoingSequence - client->deltaMessage;
 
-		// the snapshot's entities may still have rolled off the buffer, though
-		if ( oldframe->first_entity <= svs.nextSnapshotEntities - svs.numSnapshotEntities ) {
+		// the snapshot's entities may still have rolled off the buffers, though.
+		// the counters wrap around, only their distance matters
+		if ( svs.nextSnapshotEntities - oldframe->first_entity >= (unsigned)svs.numSnapshotEntities
+			|| svs.nextSnapshotStates - oldframe->first_state >= (unsigned)svs.numSnapshotStates ) {
 			Com_DPrintf ("%s: Delta request from out of date entities.\n", client->name);
 			oldframe = NULL;
-			lastframe = 0;
+			*lastframe = 0;
 		}
 	}
 
+	return oldframe;
+}
+
+/*
+==================
+SV_WriteSnapshotToClient
+==================
+*/
+static void SV_WriteSnapshotToClient( client_t *client, msg_t *msg, clientSnapshot_t *oldframe, int lastframe ) {
+	clientSnapshot_t	*frame;
+	int					i;
+	int					snapFlags;
+
+	// this is the snapshot we are creating
+	frame = &client->frames[ client->netchan.outgoingSequence & PACKET_MASK ];
+
 	MSG_WriteByte (msg, svc_snapshot);
 
 	// NOTE, MRE: now sent at the start of every message from server to client
@@ -238,6 +394,8 @@ Build a client snapshot structure
 typedef struct {
 	int		numSnapshotEntities;
 	int		snapshotEntities[MAX_SNAPSHOT_ENTITIES];	
+	byte	added[MAX_GENTITIES/8];		// prevents double adding from portal views
+	char	*error;						// for Com_Error once the snapshot is built
 } snapshotEntityNumbers_t;
 
 /*
@@ -251,15 +409,14 @@ static int QDECL SV_QsortEntityNumbers( const void *a, const void *b ) {
 	ea = (int *)a;
 	eb = (int *)b;
 
-	if ( *ea == *eb ) {
-		Com_Error( ERR_DROP, "SV_QsortEntityStates: duplicated entity" );
-	}
-
 	if ( *ea < *eb ) {
 		return -1;
 	}
+	if ( *ea > *eb ) {
+		return 1;
+	}
 
-	return 1;
+	return 0;
 }
 
 
@@ -268,12 +425,14 @@ static int QDECL SV_QsortEntityNumbers( const void *a, const void *b ) {
 SV_AddEntToSnapshot
 ===============
 */
-static void SV_AddEntToSnapshot( svEntity_t *svEnt, sharedEntity_t *gEnt, snapshotEntityNumbers_t *eNums ) {
+static void SV_AddEntToSnapshot( sharedEntity_t *gEnt, snapshotEntityNumbers_t *eNums ) {
+	int		e = gEnt->s.number;
+
 	// if we have already added this entity to this snapshot, don't add again
-	if ( svEnt->snapshotCounter == sv.snapshotCounter ) {
+	if ( eNums->added[e >> 3] & (1 << (e & 7)) ) {
 		return;
 	}
-	svEnt->snapshotCounter = sv.snapshotCounter;
+	eNums->added[e >> 3] |= 1 << (e & 7);
 
 	// if we are full, silently discard entities
 	if ( eNums->numSnapshotEntities == MAX_SNAPSHOT_ENTITIES ) {
@@ -285,36 +444,68 @@ static void SV_AddEntToSnapshot( svEntity_t *svEnt, sharedEntity_t *gEnt, snapsh
 }
 
 /*
-===============
-SV_AddEntitiesVisibleFromPoint
-===============
+=============================================================================
+
+Visibility cache
+
+What can be seen from a point only depends on its cluster and area, and
+many clients usually share those. The entities that pass the area and PVS
+tests are collected once per (cluster, area) and server frame and shared
+by every viewpoint that falls into it; the per client flags are then
+applied to a copy of the bits.
+
+The cache is only valid inside SV_SendClientMessages, where the entities
+can't move. Entries are only added by the main thread; worker threads
+compute the viewpoints that are missing, such as portal views, on their own.
+
+Portal cameras look up their viewpoint the same way. That gives the same
+entities as testing from the camera position, since only its cluster and
+area matter. As before, a portal entity that is also SVF_BROADCAST is sent
+without adding what its camera sees.
+
+=============================================================================
 */
-static void SV_AddEntitiesVisibleFromPoint( vec3_t origin, clientSnapshot_t *frame, 
-									snapshotEntityNumbers_t *eNums, qboolean portal ) {
-	int		e, i;
-	sharedEntity_t *ent;
-	svEntity_t	*svEnt;
-	int		l;
-	int		clientarea, clientcluster;
-	int		leafnum;
-	byte	*clientpvs;
-	byte	*bitvector;
 
-	// during an error shutdown message we may need to transmit
-	// the shutdown message after the server has shutdown, so
-	// specfically check for it
-	if ( !sv.state ) {
-		return;
-	}
+#define	MAX_VIS_CACHE		(MAX_CLIENTS*2)
+#define	VIS_WORDS			(MAX_GENTITIES/32)
 
-	leafnum = CM_PointLeafnum (origin);
-	clientarea = CM_LeafArea (leafnum);
-	clientcluster = CM_LeafCluster (leafnum);
+typedef struct {
+	int		cluster;
+	int		area;
+	int		areabytes;
+	byte	areabits[MAX_MAP_AREA_BYTES];
+	int		visible[VIS_WORDS];			// entities passing the area and PVS tests
+} visCacheEntry_t;
 
-	// calculate the visible areas
-	frame->areabytes = CM_WriteAreaBits( frame->areabits, clientarea );
+typedef struct {
+	qboolean	active;					// entries can be used
+	qboolean	locked;					// worker threads are reading the entries
 
-	clientpvs = CM_ClusterPVS (clientcluster);
+	int			sendable[VIS_WORDS];	// linked entities that can be sent at all
+	int			numFiltered;
+	int			filtered[MAX_GENTITIES];	// sendable entities with per client flags
+
+	int			numEntries;
+	visCacheEntry_t	entries[MAX_VIS_CACHE];
+} visCache_t;
+
+static visCache_t	svVis;
+
+int		c_visCacheHits, c_visCacheMisses;	// for com_speeds
+
+/*
+===============
+SV_ClassifyEntities
+
+Sorts out the entities that can be sent this frame
+===============
+*/
+static void SV_ClassifyEntities( void ) {
+	int				e;
+	sharedEntity_t	*ent;
+
+	Com_Memset( svVis.sendable, 0, sizeof( svVis.sendable ) );
+	svVis.numFiltered = 0;
 
 	for ( e = 0 ; e < sv.num_entities ; e++ ) {
 		ent = SV_GentityNum(e);
@@ -324,9 +515,9 @@ static void SV_AddEntitiesVisibleFromPoint( vec3_t origin, clientSnapshot_t *fra
 			continue;
 		}
 
+		// SV_SendClientMessages fixes these up first
 		if (ent->s.number != e) {
-			Com_DPrintf ("FIXING ENT->S.NUMBER!!!\n");
-			ent->s.number = e;
+			continue;
 		}
 
 		// entities can be flagged to explicitly not be sent to the client
@@ -334,101 +525,269 @@ static void SV_AddEntitiesVisibleFromPoint( vec3_t origin, clientSnapshot_t *fra
 			continue;
 		}
 
+		svVis.sendable[e >> 5] |= 1 << (e & 31);
+
+		if ( ent->r.svFlags & (SVF_SINGLECLIENT | SVF_NOTSINGLECLIENT | SVF_CLIENTMASK) ) {
+			svVis.filtered[svVis.numFiltered++] = e;
+		}
+	}
+}
+
+/*
+===============
+SV_BeginVisCache
+===============
+*/
+static void SV_BeginVisCache( void ) {
+	SV_ClassifyEntities();
+	svVis.numEntries = 0;
+	svVis.locked = qfalse;
+	svVis.active = qtrue;
+}
+
+/*
+===============
+SV_EndVisCache
+===============
+*/
+static void SV_EndVisCache( void ) {
+	svVis.active = qfalse;
+}
+
+/*
+===============
+SV_ComputeVisibility
+===============
+*/
+static void SV_ComputeVisibility( int clientcluster, int clientarea, visCacheEntry_t *vis ) {
+	int		e, i, w;
+	sharedEntity_t *ent;
+	svEntity_t	*svEnt;
+	int		l;
+	byte	*clientpvs;
+	byte	*bitvector;
+
+	vis->cluster = clientcluster;
+	vis->area = clientarea;
+
+	// calculate the visible areas
+	Com_Memset( vis->areabits, 0, sizeof( vis->areabits ) );
+	vis->areabytes = CM_WriteAreaBits( vis->areabits, clientarea );
+
+	clientpvs = CM_ClusterPVS (clientcluster);
+
+	Com_Memset( vis->visible, 0, sizeof( vis->visible ) );
+
+	for ( w = 0 ; w < VIS_WORDS ; w++ ) {
+		if ( !svVis.sendable[w] ) {
+			continue;
+		}
+		for ( e = w << 5 ; e < (w + 1) << 5 ; e++ ) {
+			if ( !( svVis.sendable[w] & (1 << (e & 31)) ) ) {
+				continue;
+			}
+
+			ent = SV_GentityNum(e);
+			svEnt = SV_SvEntityForGentity( ent );
+
+			// broadcast entities are always sent
+			if ( ent->r.svFlags & SVF_BROADCAST ) {
+				vis->visible[w] |= 1 << (e & 31);
+				continue;
+			}
+
+			// ignore if not touching a PV leaf
+			// check area
+			if ( !CM_AreasConnected( clientarea, svEnt->areanum ) ) {
+				// doors can legally straddle two areas, so
+				// we may need to check another one
+				if ( !CM_AreasConnected( clientarea, svEnt->areanum2 ) ) {
+					continue;		// blocked by a door
+				}
+			}
+
+			bitvector = clientpvs;
+
+			// check individual leafs
+			if ( !svEnt->numClusters ) {
+				continue;
+			}
+			l = 0;
+			for ( i=0 ; i < svEnt->numClusters ; i++ ) {
+				l = svEnt->clusternums[i];
+				if ( bitvector[l >> 3] & (1 << (l&7) ) ) {
+					break;
+				}
+			}
+
+			// if we haven't found it to be visible,
+			// check overflow clusters that coudln't be stored
+			if ( i == svEnt->numClusters ) {
+				if ( !svEnt->lastCluster || !CM_ClusterRangeVisible( clientcluster, l, svEnt->lastCluster ) ) {
+					continue;	// not visible
+				}
+			}
+
+			vis->visible[w] |= 1 << (e & 31);
+		}
+	}
+}
+
+/*
+===============
+SV_ClusterVisibility
+
+Returns the cached visibility for the given cluster and area, or fills
+in scratch when it can't be cached.
+===============
+*/
+static visCacheEntry_t *SV_ClusterVisibility( int cluster, int area, visCacheEntry_t *scratch ) {
+	visCacheEntry_t	*vis;
+	int				i;
+
+	if ( svVis.active ) {
+		for ( i = 0, vis = svVis.entries ; i < svVis.numEntries ; i++, vis++ ) {
+			if ( vis->cluster == cluster && vis->area == area ) {
+				// worker threads look things up too
+				Com_AtomicAdd( &c_visCacheHits, 1 );
+				return vis;
+			}
+		}
+
+		Com_AtomicAdd( &c_visCacheMisses, 1 );
+		if ( !svVis.locked && svVis.numEntries < MAX_VIS_CACHE ) {
+			vis = &svVis.entries[svVis.numEntries++];
+			SV_ComputeVisibility( cluster, area, vis );
+			return vis;
+		}
+	}
+
+	SV_ComputeVisibility( cluster, area, scratch );
+	return scratch;
+}
+
+/*
+===============
+SV_AddEntitiesVisibleFromPoint
+===============
+*/
+static void SV_AddEntitiesVisibleFromPoint( vec3_t origin, clientSnapshot_t *frame, 
+									snapshotEntityNumbers_t *eNums, qboolean portal ) {
+	int		e, i, w;
+	sharedEntity_t *ent;
+	int		leafnum;
+	visCacheEntry_t	*vis, scratch;
+	int		visible[VIS_WORDS];
+
+	// during an error shutdown message we may need to transmit
+	// the shutdown message after the server has shutdown, so
+	// specfically check for it
+	if ( !sv.state ) {
+		return;
+	}
+
+	leafnum = CM_PointLeafnum (origin);
+	vis = SV_ClusterVisibility( CM_LeafCluster( leafnum ), CM_LeafArea( leafnum ), &scratch );
+
+	// the visible areas
+	frame->areabytes = vis->areabytes;
+	for ( i = 0 ; i < MAX_MAP_AREA_BYTES ; i++ ) {
+		frame->areabits[i] |= vis->areabits[i];
+	}
+
+	Com_Memcpy( visible, vis->visible, sizeof( visible ) );
+
+	// apply the per client flags
+	for ( i = 0 ; i < svVis.numFiltered ; i++ ) {
+		e = svVis.filtered[i];
+		ent = SV_GentityNum(e);
+
 		// entities can be flagged to be sent to only one client
 		if ( ent->r.svFlags & SVF_SINGLECLIENT ) {
 			if ( ent->r.singleClient != frame->ps.clientNum ) {
-				continue;
+				visible[e >> 5] &= ~(1 << (e & 31));
 			}
 		}
 		// entities can be flagged to be sent to everyone but one client
 		if ( ent->r.svFlags & SVF_NOTSINGLECLIENT ) {
 			if ( ent->r.singleClient == frame->ps.clientNum ) {
-				continue;
+				visible[e >> 5] &= ~(1 << (e & 31));
 			}
 		}
 		// entities can be flagged to be sent to a given mask of clients
 		if ( ent->r.svFlags & SVF_CLIENTMASK ) {
-			if (frame->ps.clientNum >= 32)
-				Com_Error( ERR_DROP, "SVF_CLIENTMASK: clientNum >= 32" );
-			if (~ent->r.singleClient & (1 << frame->ps.clientNum))
-				continue;
-		}
-
-		svEnt = SV_SvEntityForGentity( ent );
-
-		// don't double add an entity through portals
-		if ( svEnt->snapshotCounter == sv.snapshotCounter ) {
-			continue;
+			if (frame->ps.clientNum >= 32) {
+				eNums->error = "SVF_CLIENTMASK: clientNum >= 32";
+				visible[e >> 5] &= ~(1 << (e & 31));
+			}
+			else if (~ent->r.singleClient & (1 << frame->ps.clientNum))
+				visible[e >> 5] &= ~(1 << (e & 31));
 		}
+	}
 
-		// broadcast entities are always sent
-		if ( ent->r.svFlags & SVF_BROADCAST ) {
-			SV_AddEntToSnapshot( svEnt, ent, eNums );
+	for ( w = 0 ; w < VIS_WORDS ; w++ ) {
+		if ( !visible[w] ) {
 			continue;
 		}
-
-		// ignore if not touching a PV leaf
-		// check area
-		if ( !CM_AreasConnected( clientarea, svEnt->areanum ) ) {
-			// doors can legally straddle two areas, so
-			// we may need to check another one
-			if ( !CM_AreasConnected( clientarea, svEnt->areanum2 ) ) {
-				continue;		// blocked by a door
+		for ( e = w << 5 ; e < (w + 1) << 5 ; e++ ) {
+			if ( !( visible[w] & (1 << (e & 31)) ) ) {
+				continue;
 			}
-		}
-
-		bitvector = clientpvs;
 
-		// check individual leafs
-		if ( !svEnt->numClusters ) {
-			continue;
-		}
-		l = 0;
-		for ( i=0 ; i < svEnt->numClusters ; i++ ) {
-			l = svEnt->clusternums[i];
-			if ( bitvector[l >> 3] & (1 << (l&7) ) ) {
-				break;
+			// don't double add an entity through portals
+			if ( eNums->added[e >> 3] & (1 << (e & 7)) ) {
+				continue;
 			}
-		}
 
-		// if we haven't found it to be visible,
-		// check overflow clusters that coudln't be stored
-		if ( i == svEnt->numClusters ) {
-			if ( svEnt->lastCluster ) {
-				for ( ; l <= svEnt->lastCluster ; l++ ) {
-					if ( bitvector[l >> 3] & (1 << (l&7) ) ) {
-						break;
+			// add it
+			ent = SV_GentityNum(e);
+			SV_AddEntToSnapshot( ent, eNums );
+
+			// if it's a portal entity, add everything visible from its camera position,
+			// a broadcast portal is only sent itself
+			if ( ( ent->r.svFlags & ( SVF_PORTAL | SVF_BROADCAST ) ) == SVF_PORTAL ) {
+				if ( ent->s.generic1 ) {
+					vec3_t dir;
+					VectorSubtract(ent->s.origin, origin, dir);
+					if ( VectorLengthSquared(dir) > (float) ent->s.generic1 * ent->s.generic1 ) {
+						continue;
 					}
 				}
-				if ( l == svEnt->lastCluster ) {
-					continue;	// not visible
-				}
-			} else {
-				continue;
+				SV_AddEntitiesVisibleFromPoint( ent->s.origin2, frame, eNums, qtrue );
 			}
 		}
+	}
+}
 
-		// add it
-		SV_AddEntToSnapshot( svEnt, ent, eNums );
+/*
+=============
+SV_PrimeVisCache
 
-		// if it's a portal entity, add everything visible from its camera position
-		if ( ent->r.svFlags & SVF_PORTAL ) {
-			if ( ent->s.generic1 ) {
-				vec3_t dir;
-				VectorSubtract(ent->s.origin, origin, dir);
-				if ( VectorLengthSquared(dir) > (float) ent->s.generic1 * ent->s.generic1 ) {
-					continue;
-				}
-			}
-			SV_AddEntitiesVisibleFromPoint( ent->s.origin2, frame, eNums, qtrue );
-		}
+Adds the client's viewpoint to the cache before the worker threads
+start looking things up.
+=============
+*/
+static void SV_PrimeVisCache( client_t *client ) {
+	playerState_t	*ps;
+	vec3_t			org;
+	int				leafnum;
+	visCacheEntry_t	scratch;
 
+	if ( !sv.state || !client->gentity || client->state == CS_ZOMBIE ) {
+		return;
 	}
+
+	ps = SV_GameClientNum( client - svs.clients );
+	VectorCopy( ps->origin, org );
+	org[2] += ps->viewheight;
+
+	leafnum = CM_PointLeafnum (org);
+	SV_ClusterVisibility( CM_LeafCluster( leafnum ), CM_LeafArea( leafnum ), &scratch );
 }
 
 /*
 =============
-SV_BuildClientSnapshot
+SV_BuildClientEntityList
 
 Decides which entities are going to be visible to the client, and
 copies off the playerstate and areabits.
@@ -437,28 +796,26 @@ This properly handles multiple recursive portals, but the render
 currently doesn't.
 
 For viewing through other player's eyes, clent can be something other than client->gentity
+
+Only touches the client's own frame and eNums, so it may run on a
+worker thread. Errors are left in eNums->error.
 =============
 */
-static void SV_BuildClientSnapshot( client_t *client ) {
+static void SV_BuildClientEntityList( client_t *client, snapshotEntityNumbers_t *eNums ) {
 	vec3_t						org;
 	clientSnapshot_t			*frame;
-	snapshotEntityNumbers_t		entityNumbers;
 	int							i;
-	sharedEntity_t				*ent;
-	entityState_t				*state;
-	svEntity_t					*svEnt;
 	sharedEntity_t				*clent;
 	int							clientNum;
 	playerState_t				*ps;
 
-	// bump the counter used to prevent double adding
-	sv.snapshotCounter++;
-
 	// this is the frame we are creating
 	frame = &client->frames[ client->netchan.outgoingSequence & PACKET_MASK ];
 
 	// clear everything in this snapshot
-	entityNumbers.numSnapshotEntities = 0;
+	eNums->numSnapshotEntities = 0;
+	eNums->error = NULL;
+	Com_Memset( eNums->added, 0, sizeof( eNums->added ) );
 	Com_Memset( frame->areabits, 0, sizeof( frame->areabits ) );
 
   // https://zerowing.idsoftware.com/bugzilla/show_bug.cgi?id=62
@@ -477,11 +834,10 @@ static void SV_BuildClientSnapshot( client_t *client ) {
 	// be regenerated from the playerstate
 	clientNum = frame->ps.clientNum;
 	if ( clientNum < 0 || clientNum >= MAX_GENTITIES ) {
-		Com_Error( ERR_DROP, "SV_SvEntityForGentity: bad gEnt" );
+		eNums->error = "SV_SvEntityForGentity: bad gEnt";
+		return;
 	}
-	svEnt = &sv.svEntities[ clientNum ];
-
-	svEnt->snapshotCounter = sv.snapshotCounter;
+	eNums->added[clientNum >> 3] |= 1 << (clientNum & 7);
 
 	// find the client's viewpoint
 	VectorCopy( ps->origin, org );
@@ -489,35 +845,107 @@ static void SV_BuildClientSnapshot( client_t *client ) {
 
 	// add all the entities directly visible to the eye, which
 	// may include portal entities that merge other viewpoints
-	SV_AddEntitiesVisibleFromPoint( org, frame, &entityNumbers, qfalse );
+	SV_AddEntitiesVisibleFromPoint( org, frame, eNums, qfalse );
 
 	// if there were portals visible, there may be out of order entities
 	// in the list which will need to be resorted for the delta compression
 	// to work correctly.  This also catches the error condition
 	// of an entity being included twice.
-	qsort( entityNumbers.snapshotEntities, entityNumbers.numSnapshotEntities, 
-		sizeof( entityNumbers.snapshotEntities[0] ), SV_QsortEntityNumbers );
+	qsort( eNums->snapshotEntities, eNums->numSnapshotEntities, 
+		sizeof( eNums->snapshotEntities[0] ), SV_QsortEntityNumbers );
+	for ( i = 1 ; i < eNums->numSnapshotEntities && !eNums->error ; i++ ) {
+		if ( eNums->snapshotEntities[i] == eNums->snapshotEntities[i-1] ) {
+			eNums->error = "SV_QsortEntityStates: duplicated entity";
+			break;
+		}
+	}
 
 	// now that all viewpoint's areabits have been OR'd together, invert
 	// all of them to make it a mask vector, which is what the renderer wants
 	for ( i = 0 ; i < MAX_MAP_AREA_BYTES/4 ; i++ ) {
 		((int *)frame->areabits)[i] = ((int *)frame->areabits)[i] ^ -1;
 	}
+}
+
+static int				snapshotFrame;		// SV_BeginSnapshotStates calls
+static unsigned int		snapshotFirstState;	// svs.nextSnapshotStates at that point
+
+/*
+=============
+SV_BeginSnapshotStates
+
+Entity states stored after this are shared by all the snapshots built
+until the next call. Must be called again whenever the entities may
+have changed.
+=============
+*/
+static void SV_BeginSnapshotStates( void ) {
+	snapshotFrame++;
+	if ( !snapshotFrame ) {
+		snapshotFrame++;	// a cleared svEntity_t has 0
+	}
+	snapshotFirstState = svs.nextSnapshotStates;
+}
+
+/*
+=============
+SV_StoreSnapshotEntities
+
+Points the client's frame at the states of its entities, storing those
+that no other snapshot stored yet.
+=============
+*/
+static void SV_StoreSnapshotEntities( client_t *client, snapshotEntityNumbers_t *eNums ) {
+	clientSnapshot_t			*frame;
+	int							i, e;
+	svEntity_t					*svEnt;
+
+	frame = &client->frames[ client->netchan.outgoingSequence & PACKET_MASK ];
 
-	// copy the entity states out
-	frame->num_entities = 0;
 	frame->first_entity = svs.nextSnapshotEntities;
-	for ( i = 0 ; i < entityNumbers.numSnapshotEntities ; i++ ) {
-		ent = SV_GentityNum(entityNumbers.snapshotEntities[i]);
-		state = &svs.snapshotEntities[svs.nextSnapshotEntities % svs.numSnapshotEntities];
-		*state = ent->s;
-		svs.nextSnapshotEntities++;
-		// this should never hit, map should always be restarted first in SV_Frame
-		if ( svs.nextSnapshotEntities >= 0x7FFFFFFE ) {
-			Com_Error(ERR_FATAL, "svs.nextSnapshotEntities wrapped");
+	frame->first_state = snapshotFirstState;
+	frame->num_entities = eNums->numSnapshotEntities;
+
+	for ( i = 0 ; i < eNums->numSnapshotEntities ; i++ ) {
+		e = eNums->snapshotEntities[i];
+		svEnt = &sv.svEntities[e];
+
+		if ( svEnt->snapshotFrame != snapshotFrame ) {
+			svEnt->snapshotFrame = snapshotFrame;
+			svEnt->snapshotState = svs.snapshotStatePos;
+			svs.snapshotEntities[svEnt->snapshotState] = SV_GentityNum(e)->s;
+			svs.nextSnapshotStates++;
+			if ( ++svs.snapshotStatePos == svs.numSnapshotStates ) {
+				svs.snapshotStatePos = 0;
+			}
 		}
-		frame->num_entities++;
+
+		svs.snapshotEntityRefs[svs.nextSnapshotEntities & ( svs.numSnapshotEntities - 1 )] = svEnt->snapshotState;
+		svs.nextSnapshotEntities++;
+	}
+}
+
+/*
+=============
+SV_BuildClientSnapshot
+=============
+*/
+static void SV_BuildClientSnapshot( client_t *client ) {
+	snapshotEntityNumbers_t		entityNumbers;
+
+	// not called from SV_SendClientMessages, so nothing has been set up
+	if ( !svVis.active ) {
+		SV_ClassifyEntities();
+		SV_BeginSnapshotStates();
 	}
+
+	SV_BuildClientEntityList( client, &entityNumbers );
+
+	if ( entityNumbers.error ) {
+		Com_Error( ERR_DROP, "%s", entityNumbers.error );
+	}
+
+	SV_StoreSnapshotEntities( client, &entityNumbers );
 }
 
 #ifdef USE_VOIP
@@ -586,6 +1014,46 @@ void SV_SendMessageToClient(msg_t *msg, client_t *client)
 }
 
 
+/*
+=======================
+SV_WriteClientSnapshot
+
+Writes everything but the VoIP data that goes into a snapshot message.
+Only touches the client's own state, so it may run on a worker thread.
+=======================
+*/
+static void SV_WriteClientSnapshot( client_t *client, msg_t *msg, clientSnapshot_t *oldframe, int lastframe ) {
+	// NOTE, MRE: all server->client messages now acknowledge
+	// let the client know which reliable clientCommands we have received
+	MSG_WriteLong( msg, client->lastClientCommand );
+
+	// (re)send any reliable server commands
+	SV_UpdateServerCommandsToClient( client, msg );
+
+	// send over all the relevant entityState_t
+	// and the playerState_t
+	SV_WriteSnapshotToClient( client, msg, oldframe, lastframe );
+}
+
+/*
+=======================
+SV_TransmitClientSnapshot
+=======================
+*/
+static void SV_TransmitClientSnapshot( client_t *client, msg_t *msg ) {
+#ifdef USE_VOIP
+	SV_WriteVoipToClient( client, msg );
+#endif
+
+	// check for overflow
+	if ( msg->overflowed ) {
+		Com_Printf ("WARNING: msg overflowed for %s\n", client->name);
+		MSG_Clear (msg);
+	}
+
+	SV_SendMessageToClient( msg, client );
+}
+
 /*
 =======================
 SV_SendClientSnapshot
@@ -597,6 +1065,8 @@ Also called by SV_FinalMessage
 void SV_SendClientSnapshot( client_t *client ) {
 	byte		msg_buf[MAX_MSGLEN];
 	msg_t		msg;
+	clientSnapshot_t	*oldframe;
+	int			lastframe;
 
 	// build the snapshot
 	SV_BuildClientSnapshot( client );
@@ -610,28 +1080,130 @@ void SV_SendClientSnapshot( client_t *client ) {
 	MSG_Init (&msg, msg_buf, sizeof(msg_buf));
 	msg.allowoverflow = qtrue;
 
-	// NOTE, MRE: all server->client messages now acknowledge
-	// let the client know which reliable clientCommands we have received
-	MSG_WriteLong( &msg, client->lastClientCommand );
+	oldframe = SV_SnapshotDeltaFrame( client, &lastframe );
+	SV_WriteClientSnapshot( client, &msg, oldframe, lastframe );
 
-	// (re)send any reliable server commands
-	SV_UpdateServerCommandsToClient( client, &msg );
+	SV_TransmitClientSnapshot( client, &msg );
+}
 
-	// send over all the relevant entityState_t
-	// and the playerState_t
-	SV_WriteSnapshotToClient( client, &msg );
+/*
+=============================================================================
 
-#ifdef USE_VOIP
-	SV_WriteVoipToClient( client, &msg );
-#endif
+Parallel snapshot generation
 
-	// check for overflow
-	if ( msg.overflowed ) {
-		Com_Printf ("WARNING: msg overflowed for %s\n", client->name);
-		MSG_Clear (&msg);
+The snapshots of all clients that are due this frame are built in two
+parallel passes. The first decides what each client sees, then the main
+thread stores the entity states in client order, the same layout the
+serial path produces. The second encodes the messages, which are sent
+in client order afterwards.
+
+Each job owns its entity number list and message buffer, so the workers
+share nothing but read-only world state.
+
+=============================================================================
+*/
+
+typedef struct {
+	client_t				*client;
+	qboolean				bot;
+	snapshotEntityNumbers_t	entityNumbers;
+	clientSnapshot_t		*oldframe;
+	int						lastframe;
+	msg_t					msg;
+	byte					msgBuffer[MAX_MSGLEN];
+} snapshotJob_t;
+
+static snapshotJob_t	snapshotJobs[MAX_CLIENTS];
+
+/*
+=======================
+SV_SnapshotEntitiesJob
+=======================
+*/
+static void SV_SnapshotEntitiesJob( void *data, int index ) {
+	snapshotJob_t	*job = (snapshotJob_t *)data + index;
+
+	SV_BuildClientEntityList( job->client, &job->entityNumbers );
+}
+
+/*
+=======================
+SV_SnapshotMessageJob
+=======================
+*/
+static void SV_SnapshotMessageJob( void *data, int index ) {
+	snapshotJob_t	*job = (snapshotJob_t *)data + index;
+
+	if ( job->bot ) {
+		return;
+	}
+
+	MSG_Init( &job->msg, job->msgBuffer, sizeof( job->msgBuffer ) );
+	job->msg.allowoverflow = qtrue;
+
+	SV_WriteClientSnapshot( job->client, &job->msg, job->oldframe, job->lastframe );
+}
+
+/*
+=======================
+SV_SendClientSnapshots
+
+Builds and sends the snapshots of the given clients, in parallel
+when worker threads are available.
+=======================
+*/
+static void SV_SendClientSnapshots( client_t **clients, int numClients ) {
+	snapshotJob_t	*job;
+	int				i;
+
+	if ( !numClients ) {
+		return;
+	}
+
+	if ( !sv_parallelSnapshots->integer || !Com_NumWorkers() || numClients == 1 ) {
+		for ( i = 0 ; i < numClients ; i++ ) {
+			SV_SendClientSnapshot( clients[i] );
+		}
+		return;
+	}
+
+	for ( i = 0, job = snapshotJobs ; i < numClients ; i++, job++ ) {
+		job->client = clients[i];
+		job->bot = ( job->client->gentity && job->client->gentity->r.svFlags & SVF_BOT ) ? qtrue : qfalse;
+		SV_PrimeVisCache( job->client );
+	}
+
+	svVis.locked = qtrue;
+	Com_RunParallel( numClients, SV_SnapshotEntitiesJob, snapshotJobs );
+	svVis.locked = qfalse;
+
+	for ( i = 0, job = snapshotJobs ; i < numClients ; i++, job++ ) {
+		if ( job->entityNumbers.error ) {
+			Com_Error( ERR_DROP, "%s", job->entityNumbers.error );
+		}
+		SV_StoreSnapshotEntities( job->client, &job->entityNumbers );
+	}
+
+	// the delta frames are checked once all the states of this frame are stored
+	for ( i = 0, job = snapshotJobs ; i < numClients ; i++, job++ ) {
+		if ( !job->bot ) {
+			job->oldframe = SV_SnapshotDeltaFrame( job->client, &job->lastframe );
+		}
 	}
 
-	SV_SendMessageToClient( &msg, client );
+	Com_RunParallel( numClients, SV_SnapshotMessageJob, snapshotJobs );
+
+	for ( i = 0, job = snapshotJobs ; i < numClients ; i++, job++ ) {
+		if ( !job->bot && job->msg.error ) {
+			Com_Error( job->msg.errorCode, "%s", job->msg.error );
+		}
+	}
+
+	for ( i = 0, job = snapshotJobs ; i < numClients ; i++, job++ ) {
+		if ( !job->bot ) {
+			SV_TransmitClientSnapshot( job->client, &job->msg );
+		}
+	}
 }
 
 
@@ -644,8 +1216,22 @@ void SV_SendClientMessages(void)
 {
 	int		i;
 	client_t	*c;
+	client_t	*due[MAX_CLIENTS];
+	int		numDue;
+	sharedEntity_t	*ent;
+
+	// the snapshot builders skip entities with a bad number, fix them
+	// here once instead
+	for ( i = 0 ; sv.state && i < sv.num_entities ; i++ ) {
+		ent = SV_GentityNum( i );
+		if ( ent->r.linked && ent->s.number != i ) {
+			Com_DPrintf ("FIXING ENT->S.NUMBER!!!\n");
+			ent->s.number = i;
+		}
+	}
 
 	// send a message to each connected client
+	numDue = 0;
 	for(i=0; i < sv_maxclients->integer; i++)
 	{
 		c = &svs.clients[i];
@@ -679,8 +1265,158 @@ void SV_SendClientMessages(void)
 		}
 
 		// generate and send a new message
-		SV_SendClientSnapshot(c);
-		c->lastSnapshotTime = svs.time;
-		c->rateDelayed = qfalse;
+		due[numDue++] = c;
+	}
+
+	SV_BeginVisCache();
+	SV_BeginSnapshotStates();
+	SV_BeginDeltaMemo();
+	SV_SendClientSnapshots( due, numDue );
+	SV_EndDeltaMemo();
+	SV_EndVisCache();
+
+	for(i=0; i < numDue; i++)
+	{
+		due[i]->lastSnapshotTime = svs.time;
+		due[i]->rateDelayed = qfalse;
+	}
+}
+
+/*
+=================
+SV_SnapshotRingTest_f
+
+snapshotringtest [snaps] [visible] [lag]
+
+Drives the snapshot rings sized for sv_maxclients the way a server at
+sv_fps would. Every frame all clients but one get a snapshot of their
+own visible entities, the last one only gets one every 1000 / snaps msec
+and always deltas from the snapshot lag of its own back. Any of those
+sent in full although a single ring of the old size would still have held
+the entities is a failure. It borrows svs and sv, so it is a developer
+test that refuses to run while a server is up.
+=================
+*/
+void SV_SnapshotRingTest_f( void ) {
+	snapshotEntityNumbers_t	*eNums;
+	client_t				*clients, *fast, *slow;
+	clientSnapshot_t		*oldframe;
+	sharedEntity_t			*gentities;
+	int						*refs;
+	entityState_t			*states;
+	int						snaps, visible, lag, every, numFast, oneRing;
+	int						frame, i, j, lastframe, sent, deltas, full, failures;
+	static serverStatic_t	saved;
+	sharedEntity_t			*savedGentities;
+	int						savedGentitySize;
+
+	if ( !com_developer->integer ) {
+		Com_Printf( "snapshotringtest: only runs with developer 1\n" );
+		return;
 	}
+	if ( com_sv_running->integer || svs.initialized || sv.state != SS_DEAD ) {
+		Com_Printf( "snapshotringtest: only runs while no server is running\n" );
+		return;
+	}
+
+	snaps = Cmd_Argc() > 1 ? atoi( Cmd_Argv( 1 ) ) : 20;
+	visible = Cmd_Argc() > 2 ? atoi( Cmd_Argv( 2 ) ) : 64;
+	lag = Cmd_Argc() > 3 ? atoi( Cmd_Argv( 3 ) ) : PACKET_BACKUP - 4;
+	numFast = sv_maxclients->integer - 1;
+	if ( snaps < 1 || sv_fps->integer < 1 || numFast < 1 ) {
+		Com_Printf( "snapshotringtest: needs snaps, sv_fps and sv_maxclients - 1 above 0\n" );
+		return;
+	}
+	visible = Com_Clamp( 1, MAX_SNAPSHOT_ENTITIES, visible );
+	lag = Com_Clamp( 1, PACKET_BACKUP - 4, lag );
+	every = sv_fps->integer / snaps;
+	if ( every < 1 ) {
+		every = 1;
+	}
+
+	// the single ring the states used to be kept in
+	oneRing = sv_maxclients->integer * ( com_dedicated->integer ? PACKET_BACKUP : 4 ) * MAX_SNAPSHOT_ENTITIES;
+
+	saved = svs;
+	savedGentities = sv.gentities;
+	savedGentitySize = sv.gentitySize;
+
+	SV_SizeSnapshotEntities();
+	refs = calloc( svs.numSnapshotEntities, sizeof( *refs ) );
+	states = calloc( svs.numSnapshotStates, sizeof( *states ) );
+	gentities = calloc( MAX_GENTITIES, sizeof( *gentities ) );
+	clients = calloc( 2, sizeof( *clients ) );
+	eNums = calloc( 1, sizeof( *eNums ) );
+
+	if ( refs && states && gentities && clients && eNums ) {
+		svs.snapshotEntityRefs = refs;
+		svs.snapshotEntities = states;
+		svs.nextSnapshotEntities = svs.nextSnapshotStates = 0;
+		svs.snapshotStatePos = 0;
+		sv.gentities = gentities;
+		sv.gentitySize = sizeof( *gentities );
+		for ( i = 0 ; i < MAX_GENTITIES ; i++ ) {
+			gentities[i].s.number = i;
+		}
+
+		fast = &clients[0];
+		slow = &clients[1];
+		slow->state = CS_ACTIVE;
+		slow->netchan.outgoingSequence = 1;
+		Q_strncpyz( slow->name, "snapshotringtest", sizeof( slow->name ) );
+
+		sent = deltas = full = failures = 0;
+		for ( frame = 0 ; sent < PACKET_BACKUP * 4 ; frame++ ) {
+			SV_BeginSnapshotStates();
+
+			// every client sees entities of its own
+			for ( i = 0 ; i <= numFast ; i++ ) {
+				if ( i == numFast && frame % every ) {
+					break;
+				}
+				eNums->numSnapshotEntities = visible;
+				for ( j = 0 ; j < visible ; j++ ) {
+					eNums->snapshotEntities[j] = ( i * visible + j ) % ENTITYNUM_MAX_NORMAL;
+				}
+				SV_StoreSnapshotEntities( i == numFast ? slow : fast, eNums );
+			}
+
+			if ( i <= numFast ) {
+				continue;
+			}
+
+			slow->deltaMessage = slow->netchan.outgoingSequence - lag;
+			if ( slow->deltaMessage > 0 ) {
+				oldframe = SV_SnapshotDeltaFrame( slow, &lastframe );
+				if ( oldframe ) {
+					deltas++;
+				} else {
+					full++;
+					oldframe = &slow->frames[slow->deltaMessage & PACKET_MASK];
+					if ( svs.nextSnapshotEntities - oldframe->first_entity < (unsigned)oneRing ) {
+						failures++;
+					}
+				}
+				sent++;
+			}
+			slow->netchan.outgoingSequence++;
+		}
+
+		Com_Printf( "%ssnapshotringtest: %i clients at %i fps, one at %i snaps %i behind: "
+			"%i deltas, %i full, %i of them too early\n", failures ? S_COLOR_RED : "",
+			numFast, sv_fps->integer, snaps, lag, deltas, full, failures );
+	} else {
+		Com_Printf( "snapshotringtest: out of memory\n" );
+	}
+
+	free( refs );
+	free( states );
+	free( gentities );
+	free( clients );
+	free( eNums );
+
+	svs = saved;
+	sv.gentities = savedGentities;
+	sv.gentitySize = savedGentitySize;
+	Com_Memset( sv.svEntities, 0, sizeof( sv.svEntities ) );
 }
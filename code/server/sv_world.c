@@ -54,9 +54,18 @@ clipHandle_t SV_ClipHandleForEntity( const sharedEntity_t *ent ) {
 ENTITY CHECKING
 
 To avoid linearly searching through lists of entities during environment testing,
-the world is carved up with an evenly spaced, axially aligned bsp tree.  Entities
-are kept in chains either at the final leafs, or at the first node that splits
-them, which prevents having to deal with multiple fragments of a single entity.
+entities are kept in a spatial index.  Two indexes are available, selected by
+sv_worldTree when the world is cleared for a new map:
+
+The sector tree carves the world up with an evenly spaced, axially aligned bsp
+tree.  Entities are kept in chains either at the final leafs, or at the first
+node that splits them, which prevents having to deal with multiple fragments of
+a single entity.
+
+The entity tree is a dynamic bounding volume hierarchy with one leaf per linked
+entity.  Leaf boxes are fattened by a margin so that small moves relink without
+touching the tree, and the tree is rebalanced with rotations as leafs come and
+go, so it follows wherever the entities actually are.
 
 ===============================================================================
 */
@@ -74,6 +83,36 @@ typedef struct worldSector_s {
 worldSector_t	sv_worldSectors[AREA_NODES];
 int			sv_numworldSectors;
 
+#define	ENTITY_TREE_MARGIN	16			// fattening of entity leaf boxes
+#define	ENTITY_TREE_SLACK	(ENTITY_TREE_MARGIN*4)	// refatten leafs that have shrunk more than this
+#define	MAX_ENTITY_NODES	(MAX_GENTITIES*2)
+#define	MAX_ENTITY_STACK	128
+
+typedef struct {
+	vec3_t	mins, maxs;		// fattened entity box on leafs
+	int		parent;			// next free node when not in use
+	int		children[2];	// -1 on leafs
+	int		height;			// 0 on leafs
+	int		entityNum;
+} entityNode_t;
+
+typedef struct {
+	entityNode_t	nodes[MAX_ENTITY_NODES];
+	int				leafs[MAX_GENTITIES];	// leaf of each entity, -1 = not linked
+	int				root;
+	int				freeNodes;
+	int				numNodes;
+} entityTree_t;
+
+static entityTree_t	sv_entityTree;
+
+typedef enum {
+	WORLD_SECTORS,
+	WORLD_TREE
+} worldIndex_t;
+
+static worldIndex_t	sv_worldIndex;
+
 
 /*
 ===============
@@ -85,6 +124,18 @@ void SV_SectorList_f( void ) {
 	worldSector_t	*sec;
 	svEntity_t		*ent;
 
+	if ( sv_worldIndex == WORLD_TREE ) {
+		c = 0;
+		for ( i = 0 ; i < MAX_GENTITIES ; i++ ) {
+			if ( sv_entityTree.leafs[i] != -1 ) {
+				c++;
+			}
+		}
+		Com_Printf( "entity tree: %i entities, %i nodes, height %i\n", c, sv_entityTree.numNodes,
+			sv_entityTree.root == -1 ? 0 : sv_entityTree.nodes[sv_entityTree.root].height );
+		return;
+	}
+
 	for ( i = 0 ; i < AREA_NODES ; i++ ) {
 		sec = &sv_worldSectors[i];
 
@@ -140,38 +191,59 @@ static worldSector_t *SV_CreateworldSector( int depth, vec3_t mins, vec3_t maxs
 
 /*
 ===============
-SV_ClearWorld
+SV_ClearSectors
 
+Empties the sector chains without rebuilding the tree
 ===============
 */
-void SV_ClearWorld( void ) {
-	clipHandle_t	h;
-	vec3_t			mins, maxs;
+static void SV_ClearSectors( void ) {
+	int		i;
 
-	Com_Memset( sv_worldSectors, 0, sizeof(sv_worldSectors) );
-	sv_numworldSectors = 0;
-
-	// get world map bounds
-	h = CM_InlineModel( 0 );
-	CM_ModelBounds( h, mins, maxs );
-	SV_CreateworldSector( 0, mins, maxs );
+	for ( i = 0 ; i < AREA_NODES ; i++ ) {
+		sv_worldSectors[i].entities = NULL;
+	}
+	for ( i = 0 ; i < MAX_GENTITIES ; i++ ) {
+		sv.svEntities[i].worldSector = NULL;
+	}
 }
 
-
 /*
 ===============
-SV_UnlinkEntity
+SV_LinkSector
 
+Links the entity at the first world sector node that its box crosses
 ===============
 */
-void SV_UnlinkEntity( sharedEntity_t *gEnt ) {
-	svEntity_t		*ent;
-	svEntity_t		*scan;
-	worldSector_t	*ws;
+static void SV_LinkSector( svEntity_t *ent, const sharedEntity_t *gEnt ) {
+	worldSector_t	*node;
 
-	ent = SV_SvEntityForGentity( gEnt );
+	node = sv_worldSectors;
+	while (1)
+	{
+		if (node->axis == -1)
+			break;
+		if ( gEnt->r.absmin[node->axis] > node->dist)
+			node = node->children[0];
+		else if ( gEnt->r.absmax[node->axis] < node->dist)
+			node = node->children[1];
+		else
+			break;		// crosses the node
+	}
+	
+	// link it in
+	ent->worldSector = node;
+	ent->nextEntityInWorldSector = node->entities;
+	node->entities = ent;
+}
 
-	gEnt->r.linked = qfalse;
+/*
+===============
+SV_UnlinkSector
+===============
+*/
+static void SV_UnlinkSector( svEntity_t *ent ) {
+	svEntity_t		*scan;
+	worldSector_t	*ws;
 
 	ws = ent->worldSector;
 	if ( !ws ) {
@@ -194,6 +266,380 @@ void SV_UnlinkEntity( sharedEntity_t *gEnt ) {
 	Com_Printf( "WARNING: SV_UnlinkEntity: not found in worldSector\n" );
 }
 
+/*
+===============
+SV_ClearEntityTree
+===============
+*/
+static void SV_ClearEntityTree( void ) {
+	int		i;
+
+	for ( i = 0 ; i < MAX_ENTITY_NODES ; i++ ) {
+		sv_entityTree.nodes[i].parent = i + 1;
+	}
+	sv_entityTree.nodes[MAX_ENTITY_NODES - 1].parent = -1;
+	sv_entityTree.freeNodes = 0;
+	sv_entityTree.numNodes = 0;
+	sv_entityTree.root = -1;
+
+	for ( i = 0 ; i < MAX_GENTITIES ; i++ ) {
+		sv_entityTree.leafs[i] = -1;
+	}
+}
+
+/*
+===============
+SV_AllocTreeNode
+
+There are always enough nodes, a tree with one leaf per
+entity never has more than MAX_GENTITIES-1 interior nodes
+===============
+*/
+static int SV_AllocTreeNode( void ) {
+	entityNode_t	*node;
+	int				index;
+
+	index = sv_entityTree.freeNodes;
+	node = &sv_entityTree.nodes[index];
+	sv_entityTree.freeNodes = node->parent;
+	sv_entityTree.numNodes++;
+
+	node->parent = -1;
+	node->children[0] = node->children[1] = -1;
+	node->height = 0;
+	node->entityNum = -1;
+
+	return index;
+}
+
+/*
+===============
+SV_FreeTreeNode
+===============
+*/
+static void SV_FreeTreeNode( int index ) {
+	sv_entityTree.nodes[index].parent = sv_entityTree.freeNodes;
+	sv_entityTree.freeNodes = index;
+	sv_entityTree.numNodes--;
+}
+
+/*
+===============
+SV_BoxCost
+
+Half the surface area of the union of two boxes, the
+chance of a random ray hitting it up to a constant
+===============
+*/
+static float SV_BoxCost( const vec3_t mins1, const vec3_t maxs1, const vec3_t mins2, const vec3_t maxs2 ) {
+	vec3_t	size;
+	int		i;
+
+	for ( i = 0 ; i < 3 ; i++ ) {
+		size[i] = ( maxs1[i] > maxs2[i] ? maxs1[i] : maxs2[i] ) - ( mins1[i] < mins2[i] ? mins1[i] : mins2[i] );
+	}
+
+	return size[0] * size[1] + size[1] * size[2] + size[2] * size[0];
+}
+
+/*
+===============
+SV_UnionBounds
+===============
+*/
+static void SV_UnionBounds( entityNode_t *node, const entityNode_t *a, const entityNode_t *b ) {
+	int		i;
+
+	for ( i = 0 ; i < 3 ; i++ ) {
+		node->mins[i] = a->mins[i] < b->mins[i] ? a->mins[i] : b->mins[i];
+		node->maxs[i] = a->maxs[i] > b->maxs[i] ? a->maxs[i] : b->maxs[i];
+	}
+	node->height = 1 + ( a->height > b->height ? a->height : b->height );
+}
+
+/*
+===============
+SV_RotateTreeNode
+
+Lifts the taller child of a node up into its place, the
+grandchild that gets left behind is the shorter one
+===============
+*/
+static int SV_RotateTreeNode( int index, int side ) {
+	entityNode_t	*nodes = sv_entityTree.nodes;
+	entityNode_t	*a, *b;
+	int				up, tall, low;
+
+	a = &nodes[index];
+	up = a->children[side];
+	b = &nodes[up];
+
+	// the new parent takes the old one's place
+	b->parent = a->parent;
+	a->parent = up;
+	if ( b->parent != -1 ) {
+		if ( nodes[b->parent].children[0] == index ) {
+			nodes[b->parent].children[0] = up;
+		} else {
+			nodes[b->parent].children[1] = up;
+		}
+	} else {
+		sv_entityTree.root = up;
+	}
+
+	if ( nodes[b->children[0]].height > nodes[b->children[1]].height ) {
+		tall = b->children[0];
+		low = b->children[1];
+	} else {
+		tall = b->children[1];
+		low = b->children[0];
+	}
+
+	b->children[0] = index;
+	b->children[1] = tall;
+	a->children[side] = low;
+	nodes[low].parent = index;
+
+	SV_UnionBounds( a, &nodes[a->children[0]], &nodes[a->children[1]] );
+	SV_UnionBounds( b, a, &nodes[tall] );
+
+	return up;
+}
+
+/*
+===============
+SV_RefitTree
+
+Walks up from a node restoring bounds, heights and balance
+===============
+*/
+static void SV_RefitTree( int index ) {
+	entityNode_t	*nodes = sv_entityTree.nodes;
+	entityNode_t	*node;
+	int				balance;
+
+	while ( index != -1 ) {
+		node = &nodes[index];
+		balance = nodes[node->children[1]].height - nodes[node->children[0]].height;
+		if ( balance > 1 ) {
+			index = SV_RotateTreeNode( index, 1 );
+		} else if ( balance < -1 ) {
+			index = SV_RotateTreeNode( index, 0 );
+		}
+
+		node = &nodes[index];
+		SV_UnionBounds( node, &nodes[node->children[0]], &nodes[node->children[1]] );
+		index = node->parent;
+	}
+}
+
+/*
+===============
+SV_InsertTreeLeaf
+
+Pairs the leaf with the sibling that grows the tree's
+total surface area the least
+===============
+*/
+static void SV_InsertTreeLeaf( int leaf ) {
+	entityNode_t	*nodes = sv_entityTree.nodes;
+	entityNode_t	*node, *child;
+	int				index, sibling, parent, oldParent;
+	int				i, best;
+	float			area, cost, inherit, childCost[2];
+
+	if ( sv_entityTree.root == -1 ) {
+		sv_entityTree.root = leaf;
+		nodes[leaf].parent = -1;
+		return;
+	}
+
+	node = &nodes[leaf];
+	index = sv_entityTree.root;
+	while ( nodes[index].children[0] != -1 ) {
+		area = SV_BoxCost( nodes[index].mins, nodes[index].maxs, nodes[index].mins, nodes[index].maxs );
+		cost = SV_BoxCost( nodes[index].mins, nodes[index].maxs, node->mins, node->maxs );
+
+		// the cost of pairing here, and what descending adds to every ancestor
+		inherit = cost - area;
+		cost = 2 * cost;
+
+		for ( i = 0 ; i < 2 ; i++ ) {
+			child = &nodes[nodes[index].children[i]];
+			childCost[i] = SV_BoxCost( child->mins, child->maxs, node->mins, node->maxs ) + 2 * inherit;
+			if ( child->children[0] != -1 ) {
+				childCost[i] -= SV_BoxCost( child->mins, child->maxs, child->mins, child->maxs );
+			}
+		}
+
+		if ( cost < childCost[0] && cost < childCost[1] ) {
+			break;
+		}
+		best = childCost[0] < childCost[1] ? 0 : 1;
+		index = nodes[index].children[best];
+	}
+	sibling = index;
+
+	oldParent = nodes[sibling].parent;
+	parent = SV_AllocTreeNode();
+	nodes[parent].parent = oldParent;
+	nodes[parent].children[0] = sibling;
+	nodes[parent].children[1] = leaf;
+	SV_UnionBounds( &nodes[parent], &nodes[sibling], node );
+
+	if ( oldParent != -1 ) {
+		if ( nodes[oldParent].children[0] == sibling ) {
+			nodes[oldParent].children[0] = parent;
+		} else {
+			nodes[oldParent].children[1] = parent;
+		}
+	} else {
+		sv_entityTree.root = parent;
+	}
+	nodes[sibling].parent = parent;
+	node->parent = parent;
+
+	SV_RefitTree( oldParent );
+}
+
+/*
+===============
+SV_RemoveTreeLeaf
+===============
+*/
+static void SV_RemoveTreeLeaf( int leaf ) {
+	entityNode_t	*nodes = sv_entityTree.nodes;
+	int				parent, grandParent, sibling;
+
+	if ( leaf == sv_entityTree.root ) {
+		sv_entityTree.root = -1;
+		return;
+	}
+
+	parent = nodes[leaf].parent;
+	grandParent = nodes[parent].parent;
+	sibling = nodes[parent].children[0] == leaf ? nodes[parent].children[1] : nodes[parent].children[0];
+
+	nodes[sibling].parent = grandParent;
+	if ( grandParent != -1 ) {
+		if ( nodes[grandParent].children[0] == parent ) {
+			nodes[grandParent].children[0] = sibling;
+		} else {
+			nodes[grandParent].children[1] = sibling;
+		}
+	} else {
+		sv_entityTree.root = sibling;
+	}
+	SV_FreeTreeNode( parent );
+
+	SV_RefitTree( grandParent );
+}
+
+/*
+===============
+SV_LinkTree
+
+Moves the entity's leaf only when its box has left the
+fattened leaf box, or has shrunk well inside of it
+===============
+*/
+static void SV_LinkTree( int entityNum, const sharedEntity_t *gEnt ) {
+	entityNode_t	*node;
+	int				leaf;
+	int				i;
+
+	leaf = sv_entityTree.leafs[entityNum];
+	if ( leaf != -1 ) {
+		node = &sv_entityTree.nodes[leaf];
+		for ( i = 0 ; i < 3 ; i++ ) {
+			if ( gEnt->r.absmin[i] < node->mins[i] || gEnt->r.absmax[i] > node->maxs[i] ) {
+				break;
+			}
+			if ( ( node->maxs[i] - node->mins[i] ) - ( gEnt->r.absmax[i] - gEnt->r.absmin[i] ) > ENTITY_TREE_SLACK ) {
+				break;
+			}
+		}
+		if ( i == 3 ) {
+			return;		// still fits
+		}
+		SV_RemoveTreeLeaf( leaf );
+	} else {
+		leaf = SV_AllocTreeNode();
+		sv_entityTree.leafs[entityNum] = leaf;
+		node = &sv_entityTree.nodes[leaf];
+		node->entityNum = entityNum;
+	}
+
+	for ( i = 0 ; i < 3 ; i++ ) {
+		node->mins[i] = gEnt->r.absmin[i] - ENTITY_TREE_MARGIN;
+		node->maxs[i] = gEnt->r.absmax[i] + ENTITY_TREE_MARGIN;
+	}
+
+	SV_InsertTreeLeaf( leaf );
+}
+
+/*
+===============
+SV_UnlinkTree
+===============
+*/
+static void SV_UnlinkTree( int entityNum ) {
+	int		leaf;
+
+	leaf = sv_entityTree.leafs[entityNum];
+	if ( leaf == -1 ) {
+		return;		// not linked in anywhere
+	}
+	sv_entityTree.leafs[entityNum] = -1;
+
+	SV_RemoveTreeLeaf( leaf );
+	SV_FreeTreeNode( leaf );
+}
+
+/*
+===============
+SV_ClearWorld
+
+===============
+*/
+void SV_ClearWorld( void ) {
+	clipHandle_t	h;
+	vec3_t			mins, maxs;
+
+	Com_Memset( sv_worldSectors, 0, sizeof(sv_worldSectors) );
+	sv_numworldSectors = 0;
+
+	// get world map bounds
+	h = CM_InlineModel( 0 );
+	CM_ModelBounds( h, mins, maxs );
+	SV_CreateworldSector( 0, mins, maxs );
+
+	SV_ClearEntityTree();
+	SV_FlushTraceCache();
+
+	sv_worldIndex = sv_worldTree->integer ? WORLD_TREE : WORLD_SECTORS;
+}
+
+
+/*
+===============
+SV_UnlinkEntity
+
+===============
+*/
+void SV_UnlinkEntity( sharedEntity_t *gEnt ) {
+	svEntity_t		*ent;
+
+	ent = SV_SvEntityForGentity( gEnt );
+
+	gEnt->r.linked = qfalse;
+
+	SV_FlushTraceCache();
+
+	SV_UnlinkSector( ent );
+	SV_UnlinkTree( ent - sv.svEntities );
+}
+
 
 /*
 ===============
@@ -203,7 +649,6 @@ SV_LinkEntity
 */
 #define MAX_TOTAL_ENT_LEAFS		128
 void SV_LinkEntity( sharedEntity_t *gEnt ) {
-	worldSector_t	*node;
 	int			leafs[MAX_TOTAL_ENT_LEAFS];
 	int			cluster;
 	int			num_leafs;
@@ -215,6 +660,9 @@ void SV_LinkEntity( sharedEntity_t *gEnt ) {
 
 	ent = SV_SvEntityForGentity( gEnt );
 
+	SV_FlushTraceCache();
+
+	// the entity tree refits leafs in place instead
 	if ( ent->worldSector ) {
 		SV_UnlinkEntity( gEnt );	// unlink from old position
 	}
@@ -291,6 +739,7 @@ void SV_LinkEntity( sharedEntity_t *gEnt ) {
 	// if none of the leafs were inside the map, the
 	// entity is outside the world and can be considered unlinked
 	if ( !num_leafs ) {
+		SV_UnlinkEntity( gEnt );
 		return;
 	}
 
@@ -332,24 +781,11 @@ void SV_LinkEntity( sharedEntity_t *gEnt ) {
 
 	gEnt->r.linkcount++;
 
-	// find the first world sector node that the ent's box crosses
-	node = sv_worldSectors;
-	while (1)
-	{
-		if (node->axis == -1)
-			break;
-		if ( gEnt->r.absmin[node->axis] > node->dist)
-			node = node->children[0];
-		else if ( gEnt->r.absmax[node->axis] < node->dist)
-			node = node->children[1];
-		else
-			break;		// crosses the node
+	if ( sv_worldIndex == WORLD_TREE ) {
+		SV_LinkTree( ent - sv.svEntities, gEnt );
+	} else {
+		SV_LinkSector( ent, gEnt );
 	}
-	
-	// link it in
-	ent->worldSector = node;
-	ent->nextEntityInWorldSector = node->entities;
-	node->entities = ent;
 
 	gEnt->r.linked = qtrue;
 }
@@ -418,12 +854,72 @@ static void SV_AreaEntities_r( worldSector_t *node, areaParms_t *ap ) {
 	}
 }
 
+/*
+====================
+SV_AreaEntitiesTree
+
+====================
+*/
+static void SV_AreaEntitiesTree( areaParms_t *ap ) {
+	entityNode_t	*nodes = sv_entityTree.nodes;
+	entityNode_t	*node;
+	sharedEntity_t	*gcheck;
+	int				stack[MAX_ENTITY_STACK];
+	int				depth;
+
+	if ( sv_entityTree.root == -1 ) {
+		return;
+	}
+
+	stack[0] = sv_entityTree.root;
+	depth = 1;
+	while ( depth ) {
+		node = &nodes[stack[--depth]];
+
+		if ( node->mins[0] > ap->maxs[0]
+		|| node->mins[1] > ap->maxs[1]
+		|| node->mins[2] > ap->maxs[2]
+		|| node->maxs[0] < ap->mins[0]
+		|| node->maxs[1] < ap->mins[1]
+		|| node->maxs[2] < ap->mins[2]) {
+			continue;
+		}
+
+		if ( node->children[0] != -1 ) {
+			// the tree is kept balanced, so its height stays far below the stack size
+			stack[depth++] = node->children[1];
+			stack[depth++] = node->children[0];
+			continue;
+		}
+
+		// the leaf box is fattened, check the real one
+		gcheck = SV_GentityNum( node->entityNum );
+
+		if ( gcheck->r.absmin[0] > ap->maxs[0]
+		|| gcheck->r.absmin[1] > ap->maxs[1]
+		|| gcheck->r.absmin[2] > ap->maxs[2]
+		|| gcheck->r.absmax[0] < ap->mins[0]
+		|| gcheck->r.absmax[1] < ap->mins[1]
+		|| gcheck->r.absmax[2] < ap->mins[2]) {
+			continue;
+		}
+
+		if ( ap->count == ap->maxcount ) {
+			Com_Printf ("SV_AreaEntities: MAXCOUNT\n");
+			return;
+		}
+
+		ap->list[ap->count] = node->entityNum;
+		ap->count++;
+	}
+}
+
 /*
 ================
-SV_AreaEntities
+SV_QueryEntities
 ================
 */
-int SV_AreaEntities( const vec3_t mins, const vec3_t maxs, int *entityList, int maxcount ) {
+static int SV_QueryEntities( const vec3_t mins, const vec3_t maxs, int *entityList, int maxcount ) {
 	areaParms_t		ap;
 
 	ap.mins = mins;
@@ -432,12 +928,81 @@ int SV_AreaEntities( const vec3_t mins, const vec3_t maxs, int *entityList, int
 	ap.count = 0;
 	ap.maxcount = maxcount;
 
-	SV_AreaEntities_r( sv_worldSectors, &ap );
+	if ( sv_worldIndex == WORLD_TREE ) {
+		SV_AreaEntitiesTree( &ap );
+	} else {
+		SV_AreaEntities_r( sv_worldSectors, &ap );
+	}
 
 	return ap.count;
 }
 
 
+/*
+============================================================================
+
+QUERY RECORDING
+
+The area and trace queries of a stretch of play can be recorded and then
+replayed against both entity indexes to compare them.
+============================================================================
+*/
+
+#define	DEFAULT_WORLD_QUERIES	16384
+#define	MAX_WORLD_QUERIES		( 1 << 20 )
+#define	WORLDBENCH_PASSES		10
+
+typedef struct {
+	vec3_t		start, end;		// area queries only use mins / maxs
+	vec3_t		mins, maxs;
+	int			passEntityNum;
+	int			contentmask;
+	int			capsule;		// -1 = area query
+} worldQuery_t;
+
+static worldQuery_t	*worldQueries;
+static int			numWorldQueries;
+static int			maxWorldQueries;
+static qboolean		worldRecording;
+
+/*
+================
+SV_RecordQuery
+================
+*/
+static void SV_RecordQuery( const vec3_t start, const vec3_t mins, const vec3_t maxs, const vec3_t end,
+						   int passEntityNum, int contentmask, int capsule ) {
+	worldQuery_t	*q;
+
+	q = &worldQueries[numWorldQueries++];
+	VectorCopy( start, q->start );
+	VectorCopy( end, q->end );
+	VectorCopy( mins, q->mins );
+	VectorCopy( maxs, q->maxs );
+	q->passEntityNum = passEntityNum;
+	q->contentmask = contentmask;
+	q->capsule = capsule;
+
+	if ( numWorldQueries == maxWorldQueries ) {
+		worldRecording = qfalse;
+		Com_Printf( "worldbench: recorded %i queries\n", numWorldQueries );
+	}
+}
+
+/*
+================
+SV_AreaEntities
+================
+*/
+int SV_AreaEntities( const vec3_t mins, const vec3_t maxs, int *entityList, int maxcount ) {
+	if ( worldRecording && !Com_ThreadIndex() ) {
+		SV_RecordQuery( vec3_origin, mins, maxs, vec3_origin, ENTITYNUM_NONE, 0, -1 );
+	}
+
+	return SV_QueryEntities( mins, maxs, entityList, maxcount );
+}
+
+
 
 //===========================================================================
 
@@ -499,21 +1064,18 @@ void SV_ClipToEntity( trace_t *trace, const vec3_t start, const vec3_t mins, con
 
 /*
 ====================
-SV_ClipMoveToEntities
+SV_ClipMoveToList
 
 ====================
 */
-static void SV_ClipMoveToEntities( moveclip_t *clip ) {
-	int			i, num;
-	int			touchlist[MAX_GENTITIES];
+static void SV_ClipMoveToList( moveclip_t *clip, const int *touchlist, int num ) {
+	int			i;
 	sharedEntity_t *touch;
 	int			passOwnerNum;
 	trace_t		trace;
 	clipHandle_t	clipHandle;
 	float		*origin, *angles;
 
-	num = SV_AreaEntities( clip->boxmins, clip->boxmaxs, touchlist, MAX_GENTITIES);
-
 	if ( clip->passEntityNum != ENTITYNUM_NONE ) {
 		passOwnerNum = ( SV_GentityNum( clip->passEntityNum ) )->r.ownerNum;
 		if ( passOwnerNum == ENTITYNUM_NONE ) {
@@ -585,16 +1147,31 @@ static void SV_ClipMoveToEntities( moveclip_t *clip ) {
 }
 
 
+/*
+====================
+SV_ClipMoveToEntities
+
+====================
+*/
+static void SV_ClipMoveToEntities( moveclip_t *clip ) {
+	int			num;
+	int			touchlist[MAX_GENTITIES];
+
+	num = SV_QueryEntities( clip->boxmins, clip->boxmaxs, touchlist, MAX_GENTITIES);
+
+	SV_ClipMoveToList( clip, touchlist, num );
+}
+
+
 /*
 ==================
-SV_Trace
+SV_ClipMoveToWorld
 
-Moves the given mins/maxs volume through the world from start to end.
-passEntityNum and entities owned by passEntityNum are explicitly not checked.
+Starts a move with the clip to the world, returns qfalse
+when the world blocks it immediately
 ==================
 */
-void SV_Trace( trace_t *results, const vec3_t start, vec3_t mins, vec3_t maxs, const vec3_t end, int passEntityNum, int contentmask, int capsule ) {
-	moveclip_t	clip;
+static qboolean SV_ClipMoveToWorld( moveclip_t *clip, const vec3_t start, vec3_t mins, vec3_t maxs, const vec3_t end, int passEntityNum, int contentmask, int capsule ) {
 	int			i;
 
 	if ( !mins ) {
@@ -604,24 +1181,27 @@ void SV_Trace( trace_t *results, const vec3_t start, vec3_t mins, vec3_t maxs, c
 		maxs = vec3_origin;
 	}
 
-	Com_Memset ( &clip, 0, sizeof ( moveclip_t ) );
+	if ( worldRecording && !Com_ThreadIndex() ) {
+		SV_RecordQuery( start, mins, maxs, end, passEntityNum, contentmask, capsule );
+	}
+
+	Com_Memset ( clip, 0, sizeof ( moveclip_t ) );
 
 	// clip to world
-	CM_BoxTrace( &clip.trace, start, end, mins, maxs, 0, contentmask, capsule );
-	clip.trace.entityNum = clip.trace.fraction != 1.0 ? ENTITYNUM_WORLD : ENTITYNUM_NONE;
-	if ( clip.trace.fraction == 0 ) {
-		*results = clip.trace;
-		return;		// blocked immediately by the world
-	}
-
-	clip.contentmask = contentmask;
-	clip.start = start;
-//	VectorCopy( clip.trace.endpos, clip.end );
-	VectorCopy( end, clip.end );
-	clip.mins = mins;
-	clip.maxs = maxs;
-	clip.passEntityNum = passEntityNum;
-	clip.capsule = capsule;
+	CM_BoxTrace( &clip->trace, start, end, mins, maxs, 0, contentmask, capsule );
+	clip->trace.entityNum = clip->trace.fraction != 1.0 ? ENTITYNUM_WORLD : ENTITYNUM_NONE;
+	if ( clip->trace.fraction == 0 ) {
+		return qfalse;		// blocked immediately by the world
+	}
+
+	clip->contentmask = contentmask;
+	clip->start = start;
+//	VectorCopy( clip->trace.endpos, clip->end );
+	VectorCopy( end, clip->end );
+	clip->mins = mins;
+	clip->maxs = maxs;
+	clip->passEntityNum = passEntityNum;
+	clip->capsule = capsule;
 
 	// create the bounding box of the entire move
 	// we can limit it to the part of the move not
@@ -629,21 +1209,280 @@ void SV_Trace( trace_t *results, const vec3_t start, vec3_t mins, vec3_t maxs, c
 	// a significant savings for line of sight and shot traces
 	for ( i=0 ; i<3 ; i++ ) {
 		if ( end[i] > start[i] ) {
-			clip.boxmins[i] = clip.start[i] + clip.mins[i] - 1;
-			clip.boxmaxs[i] = clip.end[i] + clip.maxs[i] + 1;
+			clip->boxmins[i] = clip->start[i] + clip->mins[i] - 1;
+			clip->boxmaxs[i] = clip->end[i] + clip->maxs[i] + 1;
 		} else {
-			clip.boxmins[i] = clip.end[i] + clip.mins[i] - 1;
-			clip.boxmaxs[i] = clip.start[i] + clip.maxs[i] + 1;
+			clip->boxmins[i] = clip->end[i] + clip->mins[i] - 1;
+			clip->boxmaxs[i] = clip->start[i] + clip->maxs[i] + 1;
 		}
 	}
 
-	// clip to other solid entities
-	SV_ClipMoveToEntities ( &clip );
+	return qtrue;
+}
+
+
+/*
+==================
+SV_TraceMove
+
+==================
+*/
+static void SV_TraceMove( trace_t *results, const vec3_t start, vec3_t mins, vec3_t maxs, const vec3_t end, int passEntityNum, int contentmask, int capsule ) {
+	moveclip_t	clip;
+
+	if ( SV_ClipMoveToWorld( &clip, start, mins, maxs, end, passEntityNum, contentmask, capsule ) ) {
+		// clip to other solid entities
+		SV_ClipMoveToEntities ( &clip );
+	}
 
 	*results = clip.trace;
 }
 
 
+/*
+============================================================================
+
+TRACE CACHE
+
+The game repeats many traces before anything has moved, so with
+sv_traceCache set their results are kept until the next entity is
+linked or unlinked, or the next server frame.
+
+The game also changes r.contents and r.ownerNum without relinking, when
+an item is picked up or a body is gibbed.  So an entry remembers those of
+every entity its move box touched and of the pass entity, and is only
+used while they are unchanged.  Moving an entity or changing its bounds
+still has to relink it, as the entity index needs that anyway; engine
+code that changes anything else a trace looks at must call
+SV_FlushTraceCache.
+============================================================================
+*/
+
+#define	TRACE_CACHE_SIZE	1024		// must be a power of two
+#define	TRACE_CACHE_ENTITIES	16		// traces touching more aren't kept
+
+typedef struct {
+	vec3_t		start, end;
+	vec3_t		mins, maxs;
+	int			passEntityNum;
+	int			contentmask;
+	int			capsule;
+} traceKey_t;
+
+typedef struct {
+	int			number;
+	int			contents;
+	int			ownerNum;
+} traceCacheEntity_t;
+
+typedef struct {
+	traceKey_t	key;
+	trace_t		trace;
+	int			generation;		// valid while it matches traceCacheGeneration
+
+	int			passOwnerNum;
+	int			numEntities;
+	traceCacheEntity_t	entities[TRACE_CACHE_ENTITIES];
+} traceCacheEntry_t;
+
+static traceCacheEntry_t	traceCache[TRACE_CACHE_SIZE];
+static int		traceCacheGeneration = 1;
+static int		c_traceCacheHits, c_traceCacheMisses, c_traceCacheFlushes;
+
+/*
+==================
+SV_FlushTraceCache
+==================
+*/
+void SV_FlushTraceCache( void ) {
+	traceCacheGeneration++;
+	c_traceCacheFlushes++;
+}
+
+/*
+==================
+SV_HashTraceKey
+==================
+*/
+static unsigned SV_HashTraceKey( const traceKey_t *key ) {
+	const unsigned	*words;
+	unsigned		hash;
+	int				i;
+
+	words = (const unsigned *)key;
+	hash = 2166136261u;
+	for ( i = 0 ; i < sizeof( *key ) / 4 ; i++ ) {
+		hash = ( hash ^ words[i] ) * 16777619u;
+	}
+
+	return hash ^ ( hash >> 16 );
+}
+
+/*
+==================
+SV_TraceCache_f
+==================
+*/
+void SV_TraceCache_f( void ) {
+	int		total;
+
+	total = c_traceCacheHits + c_traceCacheMisses;
+	Com_Printf( "trace cache %s: %i hits, %i misses (%.1f%% hit), %i flushes\n",
+		sv_traceCache->integer ? "on" : "off", c_traceCacheHits, c_traceCacheMisses,
+		total ? c_traceCacheHits * 100.0f / total : 0.0f, c_traceCacheFlushes );
+
+	if ( Cmd_Argc() > 1 && !Q_stricmp( Cmd_Argv( 1 ), "reset" ) ) {
+		c_traceCacheHits = 0;
+		c_traceCacheMisses = 0;
+		c_traceCacheFlushes = 0;
+	}
+}
+
+/*
+==================
+SV_Trace
+
+Moves the given mins/maxs volume through the world from start to end.
+passEntityNum and entities owned by passEntityNum are explicitly not checked.
+==================
+*/
+void SV_Trace( trace_t *results, const vec3_t start, vec3_t mins, vec3_t maxs, const vec3_t end, int passEntityNum, int contentmask, int capsule ) {
+	traceKey_t			key;
+	traceCacheEntry_t	*entry;
+	traceCacheEntity_t	*cached;
+	sharedEntity_t		*touch;
+	moveclip_t			clip;
+	int					touchlist[MAX_GENTITIES];
+	int					i, num, passOwnerNum;
+
+	// the cache is not shared with traces from parallel game jobs
+	if ( !sv_traceCache->integer || Com_ThreadIndex() ) {
+		SV_TraceMove( results, start, mins, maxs, end, passEntityNum, contentmask, capsule );
+		return;
+	}
+
+	VectorCopy( start, key.start );
+	VectorCopy( end, key.end );
+	VectorCopy( mins ? mins : vec3_origin, key.mins );
+	VectorCopy( maxs ? maxs : vec3_origin, key.maxs );
+	key.passEntityNum = passEntityNum;
+	key.contentmask = contentmask;
+	key.capsule = capsule;
+
+	passOwnerNum = ENTITYNUM_NONE;
+	if ( passEntityNum >= 0 && passEntityNum < ENTITYNUM_NONE ) {
+		passOwnerNum = SV_GentityNum( passEntityNum )->r.ownerNum;
+	}
+
+	entry = &traceCache[ SV_HashTraceKey( &key ) & ( TRACE_CACHE_SIZE - 1 ) ];
+	if ( entry->generation == traceCacheGeneration && !memcmp( &entry->key, &key, sizeof( key ) )
+		&& entry->passOwnerNum == passOwnerNum ) {
+		for ( i = 0, cached = entry->entities ; i < entry->numEntities ; i++, cached++ ) {
+			touch = SV_GentityNum( cached->number );
+			if ( touch->r.contents != cached->contents || touch->r.ownerNum != cached->ownerNum ) {
+				break;
+			}
+		}
+		if ( i == entry->numEntities ) {
+			c_traceCacheHits++;
+			*results = entry->trace;
+			return;
+		}
+	}
+	c_traceCacheMisses++;
+
+	// SV_TraceMove, keeping the entities that were looked at
+	num = 0;
+	if ( SV_ClipMoveToWorld( &clip, start, mins, maxs, end, passEntityNum, contentmask, capsule ) ) {
+		num = SV_QueryEntities( clip.boxmins, clip.boxmaxs, touchlist, MAX_GENTITIES );
+		SV_ClipMoveToList( &clip, touchlist, num );
+	}
+	*results = clip.trace;
+
+	if ( num > TRACE_CACHE_ENTITIES ) {
+		return;
+	}
+
+	entry->key = key;
+	entry->trace = *results;
+	entry->generation = traceCacheGeneration;
+	entry->passOwnerNum = passOwnerNum;
+	entry->numEntities = num;
+	for ( i = 0, cached = entry->entities ; i < num ; i++, cached++ ) {
+		touch = SV_GentityNum( touchlist[i] );
+		cached->number = touchlist[i];
+		cached->contents = touch->r.contents;
+		cached->ownerNum = touch->r.ownerNum;
+	}
+}
+
+
+/*
+==================
+SV_TraceBatch
+
+The entities near a whole batch are gathered with one area query.  Each
+trace then clips against the ones its own move box touches, which are
+the entities its own query would have listed, in the same order.
+==================
+*/
+#define	MAX_TRACE_BATCH		32
+void SV_TraceBatch( trace_t *results, const traceRequest_t *requests, int numRequests ) {
+	moveclip_t		clips[MAX_TRACE_BATCH];
+	qboolean		moving[MAX_TRACE_BATCH];
+	int				touchlist[MAX_GENTITIES];
+	int				list[MAX_GENTITIES];
+	vec3_t			mins, maxs;
+	const traceRequest_t	*req;
+	sharedEntity_t	*check;
+	moveclip_t		*clip;
+	int				first, count, num, numMoving;
+	int				i, j, n;
+
+	for ( first = 0 ; first < numRequests ; first += count ) {
+		count = numRequests - first;
+		if ( count > MAX_TRACE_BATCH ) {
+			count = MAX_TRACE_BATCH;
+		}
+
+		ClearBounds( mins, maxs );
+		numMoving = 0;
+		for ( i = 0 ; i < count ; i++ ) {
+			req = &requests[first + i];
+			moving[i] = SV_ClipMoveToWorld( &clips[i], req->start, (float *)req->mins, (float *)req->maxs,
+				req->end, req->passEntityNum, req->contentmask, req->capsule );
+			if ( moving[i] ) {
+				AddPointToBounds( clips[i].boxmins, mins, maxs );
+				AddPointToBounds( clips[i].boxmaxs, mins, maxs );
+				numMoving++;
+			}
+		}
+
+		num = numMoving ? SV_QueryEntities( mins, maxs, touchlist, MAX_GENTITIES ) : 0;
+
+		for ( i = 0 ; i < count ; i++ ) {
+			clip = &clips[i];
+			if ( moving[i] ) {
+				for ( j = 0, n = 0 ; j < num ; j++ ) {
+					check = SV_GentityNum( touchlist[j] );
+					if ( check->r.absmin[0] > clip->boxmaxs[0]
+					|| check->r.absmin[1] > clip->boxmaxs[1]
+					|| check->r.absmin[2] > clip->boxmaxs[2]
+					|| check->r.absmax[0] < clip->boxmins[0]
+					|| check->r.absmax[1] < clip->boxmins[1]
+					|| check->r.absmax[2] < clip->boxmins[2]) {
+						continue;
+					}
+					list[n++] = touchlist[j];
+				}
+				SV_ClipMoveToList( clip, list, n );
+			}
+			results[first + i] = clip->trace;
+		}
+	}
+}
+
+
 
 /*
 =============
@@ -685,3 +1524,146 @@ int SV_PointContents( const vec3_t p, int passEntityNum ) {
 }
 
 
+
+
+/*
+================
+SV_FillWorldIndex
+
+Links every linked entity into an index that is not in use,
+so both indexes can be run over the same entities
+================
+*/
+static void SV_FillWorldIndex( worldIndex_t index ) {
+	sharedEntity_t	*gEnt;
+	int				i;
+
+	for ( i = 0 ; i < sv.num_entities ; i++ ) {
+		gEnt = SV_GentityNum( i );
+		if ( !gEnt->r.linked ) {
+			continue;
+		}
+		if ( index == WORLD_TREE ) {
+			SV_LinkTree( i, gEnt );
+		} else {
+			SV_LinkSector( &sv.svEntities[i], gEnt );
+		}
+	}
+}
+
+/*
+================
+SV_WorldBench_f
+
+worldbench record [count]
+worldbench [passes]
+
+Replays the recorded queries against the sector tree and the entity
+tree with the entities where they are now, and compares the results
+================
+*/
+void SV_WorldBench_f( void ) {
+	worldQuery_t	*q;
+	unsigned		*digests, digest;
+	int				touch[MAX_GENTITIES];
+	trace_t			trace;
+	worldIndex_t	active, index;
+	int				i, j, num, pass, passes;
+	int				msec[2], areaQueries, mismatches;
+
+	if ( Cmd_Argc() > 1 && !Q_stricmp( Cmd_Argv( 1 ), "record" ) ) {
+		worldRecording = qfalse;
+		free( worldQueries );
+		numWorldQueries = 0;
+		maxWorldQueries = Cmd_Argc() > 2 ? atoi( Cmd_Argv( 2 ) ) : DEFAULT_WORLD_QUERIES;
+		if ( maxWorldQueries < 1 ) {
+			maxWorldQueries = DEFAULT_WORLD_QUERIES;
+		}
+		maxWorldQueries = MIN( maxWorldQueries, MAX_WORLD_QUERIES );
+		// outside the zone, a long recording would use up most of it
+		worldQueries = malloc( maxWorldQueries * sizeof( *worldQueries ) );
+		if ( !worldQueries ) {
+			Com_Printf( "worldbench: couldn't allocate %i queries\n", maxWorldQueries );
+			return;
+		}
+		worldRecording = qtrue;
+		Com_Printf( "worldbench: recording %i queries\n", maxWorldQueries );
+		return;
+	}
+
+	if ( sv.state != SS_GAME ) {
+		Com_Printf( "Server is not running.\n" );
+		return;
+	}
+	if ( !numWorldQueries ) {
+		Com_Printf( "worldbench: nothing recorded, use \"worldbench record [count]\" first\n" );
+		return;
+	}
+	worldRecording = qfalse;
+
+	passes = Cmd_Argc() > 1 ? atoi( Cmd_Argv( 1 ) ) : WORLDBENCH_PASSES;
+	if ( passes < 1 ) {
+		passes = 1;
+	}
+
+	active = sv_worldIndex;
+	SV_FillWorldIndex( active == WORLD_TREE ? WORLD_SECTORS : WORLD_TREE );
+
+	digests = malloc( numWorldQueries * sizeof( *digests ) );
+	if ( !digests ) {
+		Com_Printf( "worldbench: out of memory\n" );
+		return;
+	}
+	areaQueries = 0;
+	mismatches = 0;
+
+	for ( index = WORLD_SECTORS ; index <= WORLD_TREE ; index++ ) {
+		sv_worldIndex = index;
+
+		msec[index] = Sys_Milliseconds();
+		for ( pass = 0 ; pass < passes ; pass++ ) {
+			for ( i = 0, q = worldQueries ; i < numWorldQueries ; i++, q++ ) {
+				if ( q->capsule == -1 ) {
+					num = SV_QueryEntities( q->mins, q->maxs, touch, MAX_GENTITIES );
+
+					// the indexes list entities in different orders
+					digest = num;
+					for ( j = 0 ; j < num ; j++ ) {
+						digest += touch[j] * 2654435761u;
+					}
+				} else {
+					SV_TraceMove( &trace, q->start, q->mins, q->maxs, q->end,
+						q->passEntityNum, q->contentmask, q->capsule );
+					digest = trace.entityNum ^ (unsigned)( trace.fraction * 65536 );
+				}
+
+				if ( pass ) {
+					continue;
+				}
+				if ( index == WORLD_SECTORS ) {
+					digests[i] = digest;
+					areaQueries += q->capsule == -1;
+				} else if ( digests[i] != digest ) {
+					mismatches++;
+				}
+			}
+		}
+		msec[index] = Sys_Milliseconds() - msec[index];
+	}
+
+	free( digests );
+
+	sv_worldIndex = active;
+	if ( active == WORLD_TREE ) {
+		SV_ClearSectors();
+	} else {
+		SV_ClearEntityTree();
+	}
+
+	Com_Printf( "%i area queries, %i traces, %i passes\n", areaQueries,
+		numWorldQueries - areaQueries, passes );
+	Com_Printf( "sector tree: %5i msec\n", msec[WORLD_SECTORS] );
+	Com_Printf( "entity tree: %5i msec\n", msec[WORLD_TREE] );
+	// traces may legally pick a different entity on an exact tie
+	Com_Printf( "%i results differ\n", mismatches );
+}
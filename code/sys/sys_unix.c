@@ -20,6 +20,11 @@ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
 ===========================================================================
 */
 
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+	// dladdr(), pthread_getattr_np() and the ucontext register names
+#	define _GNU_SOURCE
+#endif
+
 #include "../qcommon/q_shared.h"
 #include "../qcommon/qcommon.h"
 #include "sys_local.h"
@@ -38,6 +43,11 @@ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
 #include <fcntl.h>
 #include <fenv.h>
 #include <sys/wait.h>
+#include <dlfcn.h>
+#include <pthread.h>
+#ifdef __FreeBSD__
+#include <pthread_np.h>
+#endif
 
 qboolean stdinIsATTY;
 
@@ -138,6 +148,26 @@ int Sys_Milliseconds (void)
 	return curtime;
 }
 
+/*
+================
+Sys_Microseconds
+================
+*/
+int64_t Sys_Microseconds (void)
+{
+#ifdef CLOCK_MONOTONIC
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+#else
+	struct timeval tp;
+
+	gettimeofday(&tp, NULL);
+	return (int64_t)tp.tv_sec * 1000000 + tp.tv_usec;
+#endif
+}
+
 /*
 ==================
 Sys_RandomBytes
@@ -272,6 +302,63 @@ FILE *Sys_Mkfifo( const char *ospath )
 	return fifo;
 }
 
+/*
+==================
+Sys_FileStat
+==================
+*/
+qboolean Sys_FileStat( const char *ospath, int64_t *size, int64_t *mtime )
+{
+	struct stat	buf;
+
+	if( stat( ospath, &buf ) || !S_ISREG( buf.st_mode ) )
+		return qfalse;
+
+	*size = buf.st_size;
+	*mtime = buf.st_mtime;
+	return qtrue;
+}
+
+/*
+==================
+Sys_MapFile
+==================
+*/
+void *Sys_MapFile( const char *ospath, int *length )
+{
+	struct stat	buf;
+	void		*base;
+	int			fd;
+
+	fd = open( ospath, O_RDONLY );
+	if( fd < 0 )
+		return NULL;
+
+	if( fstat( fd, &buf ) || buf.st_size <= 0 || buf.st_size > INT_MAX )
+	{
+		close( fd );
+		return NULL;
+	}
+
+	base = mmap( NULL, buf.st_size, PROT_READ, MAP_SHARED, fd, 0 );
+	close( fd );
+	if( base == MAP_FAILED )
+		return NULL;
+
+	*length = buf.st_size;
+	return base;
+}
+
+/*
+==================
+Sys_UnmapFile
+==================
+*/
+void Sys_UnmapFile( void *base, int length )
+{
+	munmap( base, length );
+}
+
 /*
 ==================
 Sys_Cwd
@@ -847,6 +934,7 @@ void Sys_PlatformInit( void )
 	signal( SIGBUS, Sys_SigHandler );
 
 	Sys_SetFloatEnv();
+	Sys_ThreadStackStarted();
 
 	stdinIsATTY = isatty( STDIN_FILENO ) &&
 		!( term && ( !strcmp( term, "raw" ) || !strcmp( term, "dumb" ) ) );
@@ -863,6 +951,179 @@ void Sys_PlatformExit( void )
 {
 }
 
+#if defined(__linux__) && defined(__x86_64__)
+#	define PROFILE_REGS( uc ) (void *)(uc)->uc_mcontext.gregs[REG_RIP], \
+		(void **)(uc)->uc_mcontext.gregs[REG_RSP], (void **)(uc)->uc_mcontext.gregs[REG_RBP]
+#elif defined(__linux__) && defined(__i386__)
+#	define PROFILE_REGS( uc ) (void *)(uc)->uc_mcontext.gregs[REG_EIP], \
+		(void **)(uc)->uc_mcontext.gregs[REG_ESP], (void **)(uc)->uc_mcontext.gregs[REG_EBP]
+#elif defined(__APPLE__) && defined(__x86_64__)
+#	define PROFILE_REGS( uc ) (void *)(uc)->uc_mcontext->__ss.__rip, \
+		(void **)(uc)->uc_mcontext->__ss.__rsp, (void **)(uc)->uc_mcontext->__ss.__rbp
+#elif defined(__FreeBSD__) && defined(__x86_64__)
+#	define PROFILE_REGS( uc ) (void *)(uc)->uc_mcontext.mc_rip, \
+		(void **)(uc)->uc_mcontext.mc_rsp, (void **)(uc)->uc_mcontext.mc_rbp
+#endif
+
+static Q_THREADLOCAL void **threadStackBase;		// lowest address of this thread's stack
+static Q_THREADLOCAL void **threadStackEnd;	// one past the top of this thread's stack
+
+/*
+==============
+Sys_ThreadStackStarted
+
+Records the stack extent of the calling thread so the profiler
+never follows a frame pointer off the stack
+==============
+*/
+void Sys_ThreadStackStarted( void )
+{
+#if defined(__linux__) || defined(__FreeBSD__)
+	pthread_attr_t	attr;
+	void			*base;
+	size_t			size;
+
+#ifdef __linux__
+	if( pthread_getattr_np( pthread_self( ), &attr ) )
+		return;
+#else
+	pthread_attr_init( &attr );
+	if( pthread_attr_get_np( pthread_self( ), &attr ) )
+	{
+		pthread_attr_destroy( &attr );
+		return;
+	}
+#endif
+
+	if( !pthread_attr_getstack( &attr, &base, &size ) )
+	{
+		threadStackBase = base;
+		threadStackEnd = (void **)( (byte *)base + size );
+	}
+	pthread_attr_destroy( &attr );
+#elif defined(__APPLE__)
+	threadStackEnd = pthread_get_stackaddr_np( pthread_self( ) );
+	threadStackBase = (void **)( (byte *)threadStackEnd - pthread_get_stacksize_np( pthread_self( ) ) );
+#endif
+}
+
+#ifdef PROFILE_REGS
+static void (*profileSample)( void *pc, void **sp, void **fp, void **stackEnd );
+
+static void Sys_ProfileRegs( void *pc, void **sp, void **fp )
+{
+	void **stackEnd = threadStackEnd;
+
+	// not on the stack the thread started with, only the pc is safe
+	if( sp < threadStackBase || sp >= stackEnd )
+		stackEnd = NULL;
+
+	profileSample( pc, sp, fp, stackEnd );
+}
+
+static void Sys_ProfileSignal( int sig, siginfo_t *info, void *context )
+{
+	int savedErrno = errno;
+
+	Sys_ProfileRegs( PROFILE_REGS( (ucontext_t *)context ) );
+
+	errno = savedErrno;
+}
+#endif
+
+/*
+==============
+Sys_StartProfiler
+
+SIGPROF on a timer that counts the cpu time of all threads. SA_RESTART
+doesn't restart select or epoll_wait, NET_Wait takes EINTR as a timeout.
+==============
+*/
+qboolean Sys_StartProfiler( int hz, void (*sample)( void *pc, void **sp, void **fp, void **stackEnd ) )
+{
+#ifdef PROFILE_REGS
+	struct sigaction	action;
+	struct itimerval	timer;
+
+	profileSample = sample;
+
+	memset( &action, 0, sizeof( action ) );
+	action.sa_sigaction = Sys_ProfileSignal;
+	action.sa_flags = SA_SIGINFO | SA_RESTART;
+	sigemptyset( &action.sa_mask );
+	if( sigaction( SIGPROF, &action, NULL ) )
+		return qfalse;
+
+	timer.it_interval.tv_sec = 0;
+	timer.it_interval.tv_usec = 1000000 / hz;
+	timer.it_value = timer.it_interval;
+	if( setitimer( ITIMER_PROF, &timer, NULL ) )
+	{
+		signal( SIGPROF, SIG_IGN );
+		return qfalse;
+	}
+
+	return qtrue;
+#else
+	return qfalse;
+#endif
+}
+
+/*
+==============
+Sys_StopProfiler
+==============
+*/
+void Sys_StopProfiler( void )
+{
+	struct itimerval	timer;
+
+	memset( &timer, 0, sizeof( timer ) );
+	setitimer( ITIMER_PROF, &timer, NULL );
+
+	// a signal may still be on its way
+	signal( SIGPROF, SIG_IGN );
+}
+
+/*
+==============
+Sys_SymbolForAddress
+
+The exported symbol at or before address, else module+offset
+for addr2line.  The executable exports nothing and its name is
+not reliable as argv[0] gets cut down to the install path.
+==============
+*/
+void Sys_SymbolForAddress( void *address, char *name, int size )
+{
+	Dl_info info, self;
+
+	if( dladdr( address, &info ) )
+	{
+		if( info.dli_sname )
+		{
+			Q_strncpyz( name, info.dli_sname, size );
+			return;
+		}
+
+		if( dladdr( (void *)Sys_SymbolForAddress, &self ) && self.dli_fbase == info.dli_fbase )
+		{
+			Com_sprintf( name, size, "engine+0x%lx",
+				(unsigned long)( (char *)address - (char *)info.dli_fbase ) );
+			return;
+		}
+
+		if( info.dli_fname )
+		{
+			Com_sprintf( name, size, "%s+0x%lx", COM_SkipPath( (char *)info.dli_fname ),
+				(unsigned long)( (char *)address - (char *)info.dli_fbase ) );
+			return;
+		}
+	}
+
+	Com_sprintf( name, size, "%p", address );
+}
+
 /*
 ==============
 Sys_SetEnv
@@ -180,6 +180,25 @@ int Sys_Milliseconds (void)
 	return sys_curtime;
 }
 
+/*
+================
+Sys_Microseconds
+================
+*/
+int64_t Sys_Microseconds (void)
+{
+	static LARGE_INTEGER frequency;
+	LARGE_INTEGER counter;
+
+	if (!frequency.QuadPart) {
+		QueryPerformanceFrequency(&frequency);
+	}
+	QueryPerformanceCounter(&counter);
+
+	return (counter.QuadPart / frequency.QuadPart) * 1000000 +
+		(counter.QuadPart % frequency.QuadPart) * 1000000 / frequency.QuadPart;
+}
+
 /*
 ================
 Sys_RandomBytes
@@ -325,6 +344,71 @@ FILE *Sys_Mkfifo( const char *ospath )
 	return NULL;
 }
 
+/*
+==============
+Sys_FileStat
+==============
+*/
+qboolean Sys_FileStat( const char *ospath, int64_t *size, int64_t *mtime )
+{
+	WIN32_FILE_ATTRIBUTE_DATA	data;
+
+	if( !GetFileAttributesEx( ospath, GetFileExInfoStandard, &data )
+		|| ( data.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY ) )
+		return qfalse;
+
+	*size = ( (int64_t)data.nFileSizeHigh << 32 ) | data.nFileSizeLow;
+	*mtime = ( (int64_t)data.ftLastWriteTime.dwHighDateTime << 32 ) | data.ftLastWriteTime.dwLowDateTime;
+	return qtrue;
+}
+
+/*
+==============
+Sys_MapFile
+==============
+*/
+void *Sys_MapFile( const char *ospath, int *length )
+{
+	HANDLE			file, mapping;
+	LARGE_INTEGER	size;
+	void			*base;
+
+	file = CreateFile( ospath, GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_DELETE, NULL,
+		OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL );
+	if( file == INVALID_HANDLE_VALUE )
+		return NULL;
+
+	if( !GetFileSizeEx( file, &size ) || size.QuadPart <= 0 || size.QuadPart > INT_MAX )
+	{
+		CloseHandle( file );
+		return NULL;
+	}
+
+	mapping = CreateFileMapping( file, NULL, PAGE_READONLY, 0, 0, NULL );
+	CloseHandle( file );
+	if( !mapping )
+		return NULL;
+
+	// the view keeps the mapping alive
+	base = MapViewOfFile( mapping, FILE_MAP_READ, 0, 0, 0 );
+	CloseHandle( mapping );
+	if( !base )
+		return NULL;
+
+	*length = (int)size.QuadPart;
+	return base;
+}
+
+/*
+==============
+Sys_UnmapFile
+==============
+*/
+void Sys_UnmapFile( void *base, int length )
+{
+	UnmapViewOfFile( base );
+}
+
 /*
 ==============
 Sys_Cwd
@@ -730,6 +814,48 @@ void Sys_PlatformExit( void )
 #endif
 }
 
+/*
+==============
+Sys_ThreadStackStarted
+
+Only the profiler needs it
+==============
+*/
+void Sys_ThreadStackStarted( void )
+{
+}
+
+/*
+==============
+Sys_StartProfiler
+
+Not supported, there is no SIGPROF
+==============
+*/
+qboolean Sys_StartProfiler( int hz, void (*sample)( void *pc, void **sp, void **fp, void **stackEnd ) )
+{
+	return qfalse;
+}
+
+/*
+==============
+Sys_StopProfiler
+==============
+*/
+void Sys_StopProfiler( void )
+{
+}
+
+/*
+==============
+Sys_SymbolForAddress
+==============
+*/
+void Sys_SymbolForAddress( void *address, char *name, int size )
+{
+	Com_sprintf( name, size, "%p", address );
+}
+
 /*
 ==============
 Sys_SetEnv